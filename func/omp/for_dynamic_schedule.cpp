@@ -0,0 +1,91 @@
+#include <omp.h>
+#include <cstdio>
+#include <cstdint>
+
+#include <faasm/faasm.h>
+
+#define ITERATIONS 1000
+
+bool checkCounts(const char *label, const int *counts) {
+    for (int i = 0; i < ITERATIONS; i++) {
+        if (counts[i] != 1) {
+            printf("%s failed: iteration %i run %i times\n", label, i, counts[i]);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * Checks loops with dynamic, guided and runtime schedules run every iteration exactly once
+ */
+FAASM_MAIN_FUNC() {
+    int countsA[ITERATIONS] = {0};
+    #pragma omp parallel for schedule(dynamic, 7) num_threads(4) default(none) shared(countsA)
+    for (int i = 0; i < ITERATIONS; i++) {
+        #pragma omp atomic
+        countsA[i]++;
+    }
+
+    if (!checkCounts("Dynamic", countsA)) {
+        return 1;
+    }
+
+    int countsB[ITERATIONS] = {0};
+    #pragma omp parallel for schedule(guided) num_threads(3) default(none) shared(countsB)
+    for (unsigned int i = 0; i < ITERATIONS; i++) {
+        #pragma omp atomic
+        countsB[i]++;
+    }
+
+    if (!checkCounts("Guided", countsB)) {
+        return 1;
+    }
+
+    // Dynamic loop over a 64-bit counter, running backwards
+    int countsC[ITERATIONS] = {0};
+    #pragma omp parallel for schedule(dynamic) num_threads(4) default(none) shared(countsC)
+    for (int64_t i = ITERATIONS - 1; i >= 0; i--) {
+        #pragma omp atomic
+        countsC[i]++;
+    }
+
+    if (!checkCounts("Dynamic 64-bit", countsC)) {
+        return 1;
+    }
+
+    omp_set_schedule(omp_sched_dynamic, 5);
+    omp_sched_t kind;
+    int chunk;
+    omp_get_schedule(&kind, &chunk);
+    if (kind != omp_sched_dynamic || chunk != 5) {
+        printf("Runtime schedule not set: got %i %i\n", kind, chunk);
+        return 1;
+    }
+
+    // Several loops in one region without barriers between them
+    int countsD[ITERATIONS] = {0};
+    int countsE[ITERATIONS] = {0};
+    #pragma omp parallel num_threads(4) default(none) shared(countsD, countsE)
+    {
+        for (int repeat = 0; repeat < 10; repeat++) {
+            int *counts = repeat % 2 == 0 ? countsD : countsE;
+
+            #pragma omp for schedule(runtime) nowait
+            for (int i = 0; i < ITERATIONS; i++) {
+                #pragma omp atomic
+                counts[i]++;
+            }
+        }
+    }
+
+    for (int i = 0; i < ITERATIONS; i++) {
+        if (countsD[i] != 5 || countsE[i] != 5) {
+            printf("Runtime nowait failed: iteration %i run %i and %i times\n", i, countsD[i], countsE[i]);
+            return 1;
+        }
+    }
+
+    return 0;
+}
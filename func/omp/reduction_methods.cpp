@@ -0,0 +1,58 @@
+#include <omp.h>
+#include <cstdio>
+#include <faasm/faasm.h>
+
+bool checkSum(const char *label, long actual, long expected) {
+    if (actual != expected) {
+        printf("%s failed: expected %li, got %li\n", label, expected, actual);
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * Reductions on teams large and small enough to use the tree and atomic methods, both at the
+ * end of a parallel region and on worksharing loops (which end with a blocking reduce).
+ */
+FAASM_MAIN_FUNC() {
+    int teamSizes[3] = {2, 3, 8};
+    for (int nThreads : teamSizes) {
+        long regionSum = 0;
+        #pragma omp parallel num_threads(nThreads) default(none) reduction(+:regionSum)
+        {
+            regionSum += omp_get_thread_num() + 1;
+        }
+
+        if (!checkSum("Region", regionSum, (long) nThreads * (nThreads + 1) / 2)) {
+            return EXIT_FAILURE;
+        }
+
+        long loopSum = 0;
+        double loopProduct = 1;
+        long loopMax = 0;
+        #pragma omp parallel num_threads(nThreads) default(none) shared(loopSum, loopProduct, loopMax)
+        {
+            for (int repeat = 0; repeat < 5; repeat++) {
+                #pragma omp for reduction(+:loopSum) reduction(*:loopProduct) reduction(max:loopMax)
+                for (int i = 1; i <= 20; i++) {
+                    loopSum += i;
+                    loopProduct *= i % 2 == 0 ? 2 : 1;
+                    loopMax = i > loopMax ? i : loopMax;
+                }
+            }
+        }
+
+        if (!checkSum("Loop sum", loopSum, 5 * 210) || !checkSum("Loop max", loopMax, 20)) {
+            return EXIT_FAILURE;
+        }
+
+        // 2^50, held exactly in a double
+        if (loopProduct != (double) (1LL << 50)) {
+            printf("Loop product failed: got %f\n", loopProduct);
+            return EXIT_FAILURE;
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,46 @@
+#include <omp.h>
+#include <cstdio>
+#include <faasm/faasm.h>
+
+#define N_REGIONS 200
+#define TOTAL 64
+
+/**
+ * Runs many short parallel regions with different team sizes, checking each one sees the
+ * right threads and results (regions are served by a persistent team where possible).
+ */
+FAASM_MAIN_FUNC() {
+    int results[TOTAL];
+
+    for (int region = 0; region < N_REGIONS; region++) {
+        int nThreads = 1 + (region % 4);
+
+        #pragma omp parallel for num_threads(nThreads) schedule(static) default(none) shared(results, region)
+        for (int i = 0; i < TOTAL; i++) {
+            results[i] = i + region;
+        }
+
+        for (int i = 0; i < TOTAL; i++) {
+            if (results[i] != i + region) {
+                printf("Region %i: element %i set to %d, expected %d\n", region, i, results[i], i + region);
+                return EXIT_FAILURE;
+            }
+        }
+
+        int teamSizes[4] = {0, 0, 0, 0};
+        #pragma omp parallel num_threads(nThreads) default(none) shared(teamSizes)
+        {
+            teamSizes[omp_get_thread_num()] = omp_get_num_threads();
+        }
+
+        for (int t = 0; t < 4; t++) {
+            int expected = t < nThreads ? nThreads : 0;
+            if (teamSizes[t] != expected) {
+                printf("Region %i: thread %i saw team of %i, expected %i\n", region, t, teamSizes[t], expected);
+                return EXIT_FAILURE;
+            }
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -169,6 +169,13 @@ extern struct faasmpi_op_t faasmpi_op_minloc;
 #define MPI_STATUS_IGNORE ((MPI_Status *) (0))
 #define MPI_STATUSES_IGNORE ((MPI_Status *) (0))
 
+// Returned as the index when there are no requests to complete
+#define MPI_UNDEFINED (-32766)
+
+// Completed requests are set to null, and null requests are skipped when waiting or testing
+#define FAASMPI_REQUEST_NULL 0
+#define MPI_REQUEST_NULL ((MPI_Request) FAASMPI_REQUEST_NULL)
+
 // Window attributes
 #define MPI_WIN_BASE 1
 #define MPI_WIN_SIZE 2
@@ -277,6 +284,14 @@ double MPI_Wtime(void);
 
 int MPI_Wait(MPI_Request *request, MPI_Status *status);
 
+int MPI_Waitall(int count, MPI_Request array_of_requests[], MPI_Status array_of_statuses[]);
+
+int MPI_Waitany(int count, MPI_Request array_of_requests[], int *index, MPI_Status *status);
+
+int MPI_Test(MPI_Request *request, int *flag, MPI_Status *status);
+
+int MPI_Testany(int count, MPI_Request array_of_requests[], int *index, int *flag, MPI_Status *status);
+
 int MPI_Comm_create(MPI_Comm comm, MPI_Group group, MPI_Comm *newcomm);
 
 int MPI_Comm_group(MPI_Comm comm, MPI_Group *group);
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+// Must be bumped whenever the way we set up modules for compilation changes, so that object code
+// from older builds is no longer picked up. The WAVM and LLVM versions are part of the key already.
+#define CODE_CACHE_VERSION "1"
+
+namespace wasm {
+    /**
+     * Key for the object code compiled from the given wasm. As well as the wasm itself this
+     * covers everything else that goes into the machine code: the features and limits we
+     * impose on modules, the compiler version and the host CPU.
+     */
+    std::string getCodeCacheKey(const std::vector<uint8_t> &wasmBytes);
+
+    /**
+     * Content-addressed store of compiled object code on local disk, so that modules compiled
+     * by one worker process don't have to be compiled again after it restarts.
+     *
+     * Entries are written to a temporary file and renamed into place, so readers (including
+     * other processes on the host) only ever see complete object files.
+     */
+    class CodeCache {
+    public:
+        ~CodeCache();
+
+        bool isEnabled();
+
+        std::string getObjectPath(const std::string &key);
+
+        /**
+         * Loads the object code for the key from its mapped file, or returns empty if it's not
+         * cached.
+         */
+        std::vector<uint8_t> load(const std::string &key);
+
+        void store(const std::string &key, const std::vector<uint8_t> &objectCode);
+
+        /**
+         * Gets the object code and stores it on a background thread, so that serialising and
+         * writing it doesn't hold up the caller.
+         */
+        void storeAsync(const std::string &key, const std::function<std::vector<uint8_t>()> &getObjectCode);
+
+        void remove(const std::string &key);
+
+        void waitForPending();
+
+    private:
+        std::mutex mx;
+        std::condition_variable cv;
+        std::unordered_set<std::string> pendingKeys;
+    };
+
+    CodeCache &getCodeCache();
+}
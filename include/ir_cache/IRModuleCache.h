@@ -36,6 +36,7 @@ namespace wasm {
         std::unordered_map<std::string, IR::Module> moduleMap;
         std::unordered_map<std::string, Runtime::ModuleRef> compiledModuleMap;
         std::unordered_map<std::string, int> originalTableSizes;
+        std::unordered_map<std::string, std::string> codeCacheKeys;
 
         util::SystemConfig &conf;
 
@@ -49,6 +50,8 @@ namespace wasm {
 
         Runtime::ModuleRef getCompiledMainModule(const std::string &user, const std::string &func);
 
+        Runtime::ModuleRef compileMainModule(const std::string &key, IR::Module &module);
+
         Runtime::ModuleRef getCompiledSharedModule(const std::string &user, const std::string &func,
                 const std::string &path);
     };
@@ -2,23 +2,65 @@
 
 #include <wavm/WAVMWasmModule.h>
 
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+
 namespace module_cache {
+    /**
+     * Holds zygotes, both the base module for each function and "special" ones restored from
+     * snapshots. Callers share ownership of the zygotes they get, so those in use are never freed.
+     *
+     * Each zygote is charged for its memory and the copy in its memfd. Once the total goes over
+     * the limit, the least recently used zygotes not in use are evicted.
+     */
     class WasmModuleCache {
     public:
-        wasm::WAVMWasmModule &getCachedModule(const message::Message &msg);
+        std::shared_ptr<wasm::WAVMWasmModule> getCachedModule(const message::Message &msg);
 
         void clear();
 
         size_t getTotalCachedModuleCount();
+
+        size_t getTotalCachedBytes();
+
+        long getHitCount();
+
+        long getMissCount();
+
+        long getEvictionCount();
+
     private:
+        struct CacheEntry {
+            std::mutex mx;
+            std::shared_ptr<wasm::WAVMWasmModule> module;
+            std::atomic<uint64_t> lastUsed{0};
+            size_t bytes = 0;
+        };
+
         std::shared_mutex mx;
-        std::unordered_map<std::string, wasm::WAVMWasmModule> cachedModuleMap;
+        std::unordered_map<std::string, std::shared_ptr<CacheEntry>> cachedModuleMap;
+        size_t totalBytes = 0;
+
+        std::atomic<uint64_t> useCounter{0};
+        std::atomic<long> hits{0};
+        std::atomic<long> misses{0};
+        std::atomic<long> evictions{0};
 
         std::string getCachedModuleKey(const message::Message &msg);
 
         std::string getBaseCachedModuleKey(const message::Message &msg);
 
-        int getCachedModuleCount(const std::string &key);
+        std::shared_ptr<wasm::WAVMWasmModule> getOrCreate(
+                const std::string &key,
+                const std::function<std::shared_ptr<wasm::WAVMWasmModule>()> &create
+        );
+
+        void evict();
     };
 
     WasmModuleCache &getWasmModuleCache();
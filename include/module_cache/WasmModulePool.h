@@ -0,0 +1,98 @@
+#pragma once
+
+#include <wavm/WAVMWasmModule.h>
+#include <util/clock.h>
+
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// Period over which claim rates are measured
+#define MODULE_POOL_RATE_WINDOW_MS 1000
+
+// How long the manager waits between refills if not woken by a claim
+#define MODULE_POOL_REFILL_INTERVAL_MS 100
+
+// Functions not seen for this long have their instances dropped
+#define MODULE_POOL_IDLE_MS 60000
+
+namespace module_cache {
+    /**
+     * Number of ready instances to keep for a function, enough to cover the claims expected
+     * while replacing one, with at least one for any function in use.
+     */
+    int getModulePoolTarget(double claimsPerSec, double cloneMillis, int maxSize);
+
+    /**
+     * Keeps instances of recently used functions cloned from their zygotes and ready to execute,
+     * so that binding to a function doesn't have to wait for a clone.
+     *
+     * Instances are created by a background manager thread. It refills each function's pool
+     * after claims, sized on the function's recent claim rate and how long cloning it takes.
+     */
+    class WasmModulePool {
+    public:
+        /**
+         * Takes a ready instance of the function, or returns null if there isn't one (or the
+         * call needs a special zygote).
+         */
+        std::unique_ptr<wasm::WAVMWasmModule> claim(const message::Message &msg);
+
+        /**
+         * Notes a call to the function has arrived, so its zygote and instances can be
+         * prepared before it's bound.
+         */
+        void notifyCall(const message::Message &msg);
+
+        /**
+         * Updates pool sizes and clones instances until every pool is full.
+         */
+        void refill();
+
+        void start();
+
+        void shutdown();
+
+        size_t getReadyCount(const message::Message &msg);
+
+        int getTargetSize(const message::Message &msg);
+
+        void clear();
+
+    private:
+        struct FunctionPool {
+            message::Message msg;
+            std::deque<std::unique_ptr<wasm::WAVMWasmModule>> ready;
+
+            long windowClaims = 0;
+            double claimsPerSec = 0;
+            double cloneMillis = 0;
+            int target = 1;
+
+            util::TimePoint windowStart;
+            util::TimePoint lastSeen;
+        };
+
+        std::mutex mx;
+        std::condition_variable cv;
+        std::unordered_map<std::string, FunctionPool> pools;
+
+        bool _shutdown = false;
+        std::thread managerThread;
+
+        std::string getPoolKey(const message::Message &msg);
+
+        FunctionPool &getPool(const std::string &key, const message::Message &msg);
+
+        bool refillOne();
+
+        void takeInstances(FunctionPool &pool, std::vector<std::unique_ptr<wasm::WAVMWasmModule>> &out);
+    };
+
+    WasmModulePool &getWasmModulePool();
+}
@@ -2,6 +2,9 @@
 
 #include <faasmpi/mpi.h>
 
+#include <cstddef>
+#include <cstdint>
+
 namespace mpi {
     enum MpiMessageType {
         NORMAL,
@@ -16,6 +19,18 @@ namespace mpi {
         RMA_WRITE
     };
 
+    /**
+     * Where the data for a message lives. Messages sent via Redis have their data in state,
+     * those sent directly carry it with them or leave it with the sender until it's pulled.
+     * Local messages carry their data, or have already written it to the receiver's buffer.
+     */
+    enum MpiPayload {
+        PAYLOAD_STATE,
+        PAYLOAD_INLINE,
+        PAYLOAD_AT_SENDER,
+        PAYLOAD_DELIVERED
+    };
+
     struct MpiMessage {
         int id;
         int worldId;
@@ -25,5 +40,11 @@ namespace mpi {
         int count;
 
         MpiMessageType messageType;
+
+        MpiPayload payload = PAYLOAD_STATE;
+
+        // Inline data and the size of its allocation, only meaningful on the node holding the message
+        uint8_t *buffer = nullptr;
+        size_t bufferSize = 0;
     };
 }
\ No newline at end of file
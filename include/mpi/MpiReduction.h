@@ -0,0 +1,20 @@
+#pragma once
+
+#include <faasmpi/mpi.h>
+
+#include <cstdint>
+
+namespace mpi {
+    /**
+     * Combines count elements of the input into the output, i.e. out[i] = op(out[i], in[i]).
+     *
+     * For MPI_MAXLOC and MPI_MINLOC the elements are (value, location) pairs, both of the
+     * given type (as with MPI_2INT), so count covers both halves of each pair.
+     */
+    typedef void (*MpiReduceKernel)(const uint8_t *in, uint8_t *out, int count);
+
+    MpiReduceKernel getReduceKernel(faasmpi_op_t *operation, faasmpi_datatype_t *datatype);
+
+    void applyReduceOp(faasmpi_op_t *operation, faasmpi_datatype_t *datatype, int count,
+                       const uint8_t *inBuffer, uint8_t *outBuffer);
+}
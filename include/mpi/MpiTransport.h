@@ -0,0 +1,97 @@
+#pragma once
+
+#include "mpi/MpiMessage.h"
+
+#include <tcp/TCPClient.h>
+#include <tcp/TCPServer.h>
+#include <util/clock.h>
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#define MPI_PORT 8004
+#define MPI_ENDPOINT_PREFIX "mpi_endpoint_"
+
+namespace mpi {
+    /**
+     * Receives MPI messages sent directly from other nodes, and serves the data for large
+     * messages sent from this node when the receiver pulls it.
+     */
+    class MpiServer final : public tcp::TCPServer {
+    public:
+        MpiServer();
+
+        explicit MpiServer(int port);
+
+        tcp::TCPMessage *handleMessage(tcp::TCPMessage *request) override;
+    };
+
+    struct MpiPendingPayload {
+        std::unique_ptr<uint8_t[]> data;
+        size_t len = 0;
+        int worldId = 0;
+        util::TimePoint expiry;
+    };
+
+    /**
+     * Sends MPI messages straight to other nodes over a persistent connection per node, with
+     * header and data in a single message. Data up to MPI_EAGER_LIMIT is sent with the
+     * header. Anything larger is kept on this node until the receiver has posted its receive
+     * and pulls the data directly into its buffer. Data that's never pulled is dropped once
+     * MPI_PAYLOAD_TIMEOUT has passed, or when its world is destroyed.
+     *
+     * Nodes advertise their endpoint in Redis. Nodes without one are sent to via the global
+     * MPI bus as before.
+     */
+    class MpiTransport {
+    public:
+        MpiTransport();
+
+        void registerEndpoint(const std::string &nodeId, const std::string &host, int port = MPI_PORT);
+
+        void removeEndpoint(const std::string &nodeId);
+
+        bool hasDirectEndpoint(const std::string &nodeId);
+
+        void sendMessage(const std::string &nodeId, MpiMessage *msg, const uint8_t *data, size_t dataLen);
+
+        void pullPayload(const std::string &nodeId, const MpiMessage *msg, uint8_t *buffer, size_t bufferLen);
+
+        MpiPendingPayload takePendingPayload(int messageId);
+
+        void dropPendingPayloads(int worldId);
+
+        long getPendingCount();
+
+        void clear();
+
+    private:
+        struct PeerConnection {
+            std::mutex mx;
+            std::unique_ptr<tcp::TCPClient> client;
+        };
+
+        std::mutex endpointsMx;
+        std::unordered_map<std::string, std::string> endpoints;
+
+        std::mutex peersMx;
+        std::unordered_map<std::string, std::shared_ptr<PeerConnection>> peers;
+
+        std::mutex pendingMx;
+        std::unordered_map<int, MpiPendingPayload> pending;
+
+        void dropExpiredPayloads();
+
+        std::string getEndpoint(const std::string &nodeId);
+
+        std::shared_ptr<PeerConnection> getPeer(const std::string &endpoint);
+
+        void resetPeer(PeerConnection &peer);
+    };
+
+    MpiTransport &getMpiTransport();
+
+    std::string getMpiEndpointKey(const std::string &nodeId);
+}
@@ -2,7 +2,11 @@
 
 #include "mpi/MpiMessage.h"
 
+#include <atomic>
+#include <deque>
+#include <mutex>
 #include <thread>
+#include <vector>
 #include <proto/faasm.pb.h>
 #include <state/StateKeyValue.h>
 #include <scheduler/InMemoryMessageQueue.h>
@@ -11,6 +15,44 @@ namespace mpi {
     typedef util::Queue<MpiMessage *> InMemoryMpiQueue;
     typedef util::Queue<int> InMemoryIntQueue;
 
+#define MPI_MESSAGE_POOL_SIZE 256
+#define MPI_ASYNC_SPIN_COUNT 128
+
+    /**
+     * A receive waiting on a pair of local ranks. Local senders write straight into the
+     * posted buffer rather than buffering the message.
+     */
+    struct MpiPostedRecv {
+        // Held for the whole of a receive, so only one receive on the pair is posted at once
+        std::mutex recvMx;
+
+        std::mutex mx;
+        uint8_t *buffer = nullptr;
+        size_t bufferLen = 0;
+        MpiMessageType messageType = MpiMessageType::NORMAL;
+
+        // Messages taken off the queue while receiving a different type, in arrival order.
+        // Only touched holding recvMx.
+        std::deque<MpiMessage *> unmatched;
+    };
+
+    /**
+     * A non-blocking send or receive. Sends never block, so are complete as soon as they're
+     * posted. Receives are queued against their pair of ranks and completed in the order they
+     * were posted, when waited on or tested, or when a later blocking point-to-point receive
+     * on the same pair needs them out of the way.
+     */
+    struct MpiAsyncRequest {
+        int sendRank = 0;
+        int recvRank = 0;
+        uint8_t *buffer = nullptr;
+        faasmpi_datatype_t *dataType = nullptr;
+        int count = 0;
+
+        bool isComplete = false;
+        MPI_Status status{};
+    };
+
     struct MpiWorldState {
         int worldSize;
     };
@@ -25,6 +67,8 @@ namespace mpi {
     public:
         MpiWorld();
 
+        ~MpiWorld();
+
         void create(const message::Message &call, int newId, int newSize);
 
         void initialiseFromState(const message::Message &msg, int worldId);
@@ -56,6 +100,10 @@ namespace mpi {
                        const uint8_t *buffer, faasmpi_datatype_t *dataType, int count,
                        MpiMessageType messageType = MpiMessageType::NORMAL);
 
+        void bcast(int rootRank, int thisRank,
+                   uint8_t *buffer, faasmpi_datatype_t *dataType, int count,
+                   MpiMessageType messageType = MpiMessageType::NORMAL);
+
         void recv(int sendRank, int recvRank,
                   uint8_t *buffer, faasmpi_datatype_t *dataType, int count,
                   MPI_Status *status, MpiMessageType messageType = MpiMessageType::NORMAL);
@@ -63,7 +111,20 @@ namespace mpi {
         int irecv(int sendRank, int recvRank,
                    uint8_t *buffer, faasmpi_datatype_t *dataType, int count);
 
-        void awaitAsyncRequest(int requestId);
+        void awaitAsyncRequest(int requestId, MPI_Status *status = nullptr);
+
+        bool testAsyncRequest(int requestId, MPI_Status *status = nullptr);
+
+        // Completed requests in the list are set to FAASMPI_REQUEST_NULL and null ones are
+        // skipped, so the same list can be waited on repeatedly. With nothing left to complete
+        // the "any" variants return MPI_UNDEFINED.
+        void awaitAllAsyncRequests(std::vector<int> &requestIds, MPI_Status *statuses = nullptr);
+
+        int awaitAnyAsyncRequest(std::vector<int> &requestIds, MPI_Status *status = nullptr);
+
+        int testAnyAsyncRequest(std::vector<int> &requestIds, MPI_Status *status = nullptr);
+
+        long getAsyncRequestCount();
 
         void scatter(int sendRank, int recvRank,
                      const uint8_t *sendBuffer, faasmpi_datatype_t *sendType, int sendCount,
@@ -99,6 +160,12 @@ namespace mpi {
 
         long getLocalQueueSize(int sendRank, int recvRank);
 
+        MpiMessage *acquireMessage(size_t dataLen);
+
+        void releaseMessage(MpiMessage *msg);
+
+        long getPooledMessageCount();
+
         void overrideNodeId(const std::string &newNodeId);
 
         void createWindow(const faasmpi_win_t *window, uint8_t *windowPtr);
@@ -124,7 +191,15 @@ namespace mpi {
         std::unordered_map<std::string, uint8_t *> windowPointerMap;
 
         std::unordered_map<std::string, std::shared_ptr<InMemoryMpiQueue>> localQueueMap;
-        std::unordered_map<int, std::thread> asyncThreadMap;
+        std::unordered_map<std::string, std::shared_ptr<MpiPostedRecv>> postedRecvMap;
+
+        std::mutex asyncMx;
+        std::unordered_map<int, MpiAsyncRequest> asyncRequestMap;
+        std::unordered_map<std::string, std::deque<int>> pendingRecvMap;
+        std::atomic<int> pendingRecvCount{0};
+
+        std::mutex messagePoolMx;
+        std::vector<MpiMessage *> messagePool;
 
         void setUpStateKV();
 
@@ -134,8 +209,44 @@ namespace mpi {
 
         void checkRankOnThisNode(int rank);
 
-        int doISendRecv(int sendRank, int recvRank, const uint8_t *sendBuffer, uint8_t *recvBuffer,
-                         faasmpi_datatype_t *dataType, int count);
+        bool useLinearCollectives();
+
+        std::vector<std::vector<int>> getRanksByNode(int rootRank);
+
+        void treeBroadcast(const std::vector<int> &group, int thisRank, uint8_t *buffer,
+                           faasmpi_datatype_t *dataType, int count, MpiMessageType messageType);
+
+        void treeReduce(const std::vector<int> &group, int thisRank, uint8_t *buffer,
+                        faasmpi_datatype_t *dataType, int count, faasmpi_op_t *operation,
+                        MpiMessageType messageType);
+
+        void recursiveDoublingAllReduce(const std::vector<int> &group, int thisRank, uint8_t *buffer,
+                                        faasmpi_datatype_t *dataType, int count, faasmpi_op_t *operation);
+
+        void ringAllReduce(const std::vector<int> &group, int thisRank, uint8_t *buffer,
+                           faasmpi_datatype_t *dataType, int count, faasmpi_op_t *operation);
+
+        void disseminationBarrier(const std::vector<int> &group, int thisRank);
+
+        void gatherByNode(int sendRank, int recvRank,
+                          const uint8_t *sendBuffer, faasmpi_datatype_t *sendType, int sendCount,
+                          uint8_t *recvBuffer, faasmpi_datatype_t *recvType, int recvCount);
+
+        std::shared_ptr<MpiPostedRecv> getPostedRecv(int sendRank, int recvRank);
+
+        void sendLocal(MpiMessage *msg, const uint8_t *buffer, size_t dataLen);
+
+        void doRecv(int sendRank, int recvRank,
+                    uint8_t *buffer, faasmpi_datatype_t *dataType, int count,
+                    MPI_Status *status, MpiMessageType messageType);
+
+        void progressRecvs(int sendRank, int recvRank, bool blocking, int untilRequestId);
+
+        bool takeCompletedRequest(int requestId, MPI_Status *status);
+
+        bool hasNormalMessage(int sendRank, int recvRank);
+
+        int generateRequestId();
 
         void pushToState();
     };
@@ -85,6 +85,14 @@ namespace redis {
 
         void setRangePipeline(const std::string &key, long offset, const uint8_t *value, size_t size);
 
+        void setPipeline(const std::string &key, const uint8_t *value, size_t size);
+
+        void incrPipeline(const std::string &key);
+
+        void delPipeline(const std::string &key);
+
+        void incrBitfieldPipeline(const std::string &key, long idx);
+
         void flushPipeline(long pipelineLength);
 
         void getRange(const std::string &key, uint8_t *buffer, size_t bufferLen, long start, long end);
@@ -140,6 +148,12 @@ namespace redis {
 
         void enqueueBytes(const std::string &queueName, const uint8_t* buffer, size_t bufferLen);
 
+        void enqueueBytesPipeline(const std::string &queueName, const std::vector<uint8_t> &value);
+
+        void enqueueBytesBatch(const std::string &queueName, const std::vector<std::vector<uint8_t>> &values);
+
+        void requeueBytesBatch(const std::string &queueName, const std::vector<std::vector<uint8_t>> &values);
+
         std::string dequeue(const std::string &queueName, int timeout = DEFAULT_TIMEOUT);
 
         std::vector<uint8_t> dequeueBytes(const std::string &queueName, int timeout = DEFAULT_TIMEOUT);
@@ -148,9 +162,15 @@ namespace redis {
 
         void dequeueMultiple(const std::string &queueName, uint8_t *buff, long buffLen, long nElems);
 
+        std::vector<std::vector<uint8_t>> dequeueBytesBatch(const std::string &queueName, long maxElems,
+                                                            int timeout = DEFAULT_TIMEOUT);
+
     private:
         explicit Redis(const RedisInstance &instance);
 
+        template<typename It>
+        void pushBytesBatch(const char *cmd, const std::string &queueName, It begin, It end);
+
         redisContext *context;
 
         const RedisInstance &instance;
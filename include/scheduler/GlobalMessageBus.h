@@ -14,6 +14,8 @@ namespace scheduler {
 
         virtual message::Message nextMessage(int timeout) = 0;
 
+        virtual std::vector<message::Message> nextMessageBatch(int maxMessages, int timeout) = 0;
+
         virtual std::string getMessageStatus(unsigned int messageId) = 0;
 
         virtual void setFunctionResult(message::Message &msg) = 0;
@@ -4,6 +4,16 @@
 #include <util/queue.h>
 
 namespace scheduler {
-    typedef util::Queue<message::Message> InMemoryMessageQueue;
+    /**
+     * Calls are enqueued while holding scheduler locks (and by workers chaining calls), so
+     * these queues overflow rather than make the caller wait for space.
+     */
+    class InMemoryMessageQueue : public util::LockFreeQueue<message::Message> {
+    public:
+        InMemoryMessageQueue() : LockFreeQueue(DEFAULT_LOCK_FREE_QUEUE_CAPACITY, true) {
+
+        }
+    };
+
     typedef std::pair<std::string, InMemoryMessageQueue *> InMemoryMessageQueuePair;
-}
\ No newline at end of file
+}
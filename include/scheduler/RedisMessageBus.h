@@ -15,6 +15,8 @@ namespace scheduler {
 
         message::Message nextMessage(int timeout) override;
 
+        std::vector<message::Message> nextMessageBatch(int maxMessages, int timeout) override;
+
         std::string getMessageStatus(unsigned int messageId) override;
 
         void setFunctionResult(message::Message &msg) override;
@@ -4,13 +4,22 @@
 #include "GlobalMessageBus.h"
 #include "SharingMessageBus.h"
 
+#include <util/clock.h>
 #include <util/func.h>
 #include <util/queue.h>
 
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <list>
+#include <mutex>
 #include <shared_mutex>
+#include <thread>
 #include <redis/Redis.h>
 
 #define GLOBAL_NODE_SET "available_workers"
+#define SCHEDULER_SHARDS 32
+#define NODE_LOAD_PREFIX "load_"
 
 
 namespace scheduler {
@@ -21,10 +30,67 @@ namespace scheduler {
         NO
     };
 
+    /**
+     * Scheduling state for a single function. Counters can be read without locking, but
+     * changes that may alter the opinion are made holding the record's mutex.
+     */
+    struct FunctionRecord {
+        explicit FunctionRecord(std::string funcStrIn) : funcStr(std::move(funcStrIn)),
+                                                         queue(std::make_shared<InMemoryMessageQueue>()) {
+        }
+
+        const std::string funcStr;
+        std::shared_ptr<InMemoryMessageQueue> queue;
+
+        std::mutex mx;
+        std::atomic<long> threadCount{0};
+        std::atomic<long> inFlightCount{0};
+        std::atomic<SchedulerOpinion> opinion{MAYBE};
+    };
+
+    struct SchedulerShard {
+        std::shared_mutex mx;
+        std::unordered_map<std::string, std::shared_ptr<FunctionRecord>> records;
+    };
+
+    enum WarmSetUpdateType {
+        ADD_WARM,
+        REMOVE_WARM,
+        ADD_GLOBAL,
+        REMOVE_GLOBAL,
+        STOP_UPDATES
+    };
+
+    struct WarmSetUpdate {
+        WarmSetUpdateType type;
+        std::string funcStr;
+    };
+
+    struct CachedNodeSet {
+        std::unordered_set<std::string> nodes;
+        util::TimePoint fetched;
+    };
+
+    struct CachedNodeLoad {
+        long load;
+        util::TimePoint fetched;
+    };
+
+    /**
+     * A worker thread waiting for a bind message. The thread may still hold the module for
+     * the last function it ran, so binds for that function are sent to it first.
+     */
+    struct IdleWorker {
+        std::string lastFuncStr;
+        std::shared_ptr<InMemoryMessageQueue> inbox;
+    };
+
     class Scheduler {
     public:
         Scheduler();
 
+        ~Scheduler();
+
         void callFunction(message::Message &msg, bool forceLocal=false);
 
         SchedulerOpinion getOpinion(const message::Message &msg);
@@ -45,6 +111,12 @@ namespace scheduler {
 
         std::shared_ptr<InMemoryMessageQueue> getBindQueue();
 
+        void parkIdleWorker(const std::string &lastFuncStr, const std::shared_ptr<InMemoryMessageQueue> &inbox);
+
+        bool unparkIdleWorker(const std::shared_ptr<InMemoryMessageQueue> &inbox);
+
+        long getIdleWorkerCount();
+
         std::string getFunctionWarmSetName(const message::Message &msg);
 
         std::string getFunctionWarmSetNameFromStr(const std::string &funcStr);
@@ -73,29 +145,91 @@ namespace scheduler {
 
         std::vector<unsigned int> getScheduledMessageIds();
 
+        void flushWarmSetUpdates();
+
+        std::string getNodeLoadKey(const std::string &node);
+
+        long getNodeLoad();
+
+        void publishNodeLoad();
+
+        void clearNodeSetCache();
+
     private:
         std::string nodeId;
 
-        void updateOpinion(const message::Message &msg);
+        std::shared_ptr<FunctionRecord> getFunctionRecord(const message::Message &msg);
 
-        void addWarmThreads(const message::Message &msg);
+        void updateOpinion(FunctionRecord &record, const message::Message &msg);
 
-        util::SystemConfig &conf;
+        void addWarmThreads(FunctionRecord &record, const message::Message &msg);
 
-        std::shared_ptr<InMemoryMessageQueue> bindQueue;
+        void dispatchBind(const std::string &funcStr, const message::Message &bindMsg);
 
-        std::shared_mutex mx;
-        std::unordered_map<std::string, std::shared_ptr<InMemoryMessageQueue>> queueMap;
-        std::unordered_map<std::string, long> threadCountMap;
-        std::unordered_map<std::string, long> inFlightCountMap;
-        std::unordered_map<std::string, SchedulerOpinion> opinionMap;
+        void queueWarmSetUpdate(WarmSetUpdateType type, const std::string &funcStr);
 
-        SharingMessageBus &sharingBus;
+        void applyWarmSetUpdates();
+
+        std::unordered_set<std::string> getCachedNodeSet(const std::string &setName);
+
+        long getCachedNodeLoad(const std::string &node);
+
+        std::string pickLeastLoadedNode(const std::unordered_set<std::string> &options);
+
+        util::SystemConfig &conf;
 
+        std::shared_ptr<InMemoryMessageQueue> bindQueue;
+
+        // Idle worker threads in the order they went idle. Bind messages go to one of these
+        // if possible, otherwise on to the shared bind queue
+        std::mutex idleMx;
+        std::list<IdleWorker> idleWorkers;
+
+        // Function records are sharded by hash of the function string
+        std::array<SchedulerShard, SCHEDULER_SHARDS> shards;
+
+        // Warm/ global set membership is updated in Redis by a background thread, in the
+        // order the changes are made
+        util::Queue<WarmSetUpdate> warmSetQueue;
+        std::thread warmSetThread;
+        std::mutex warmSetMx;
+        std::condition_variable warmSetCv;
+        long warmSetQueued = 0;
+        long warmSetApplied = 0;
+
+        // Other nodes' warm/ global set membership and load hints are cached for
+        // SCHEDULER_CACHE_TTL ms so that scheduling decisions don't always go to Redis
+        std::mutex cacheMx;
+        std::unordered_map<std::string, CachedNodeSet> nodeSetCache;
+        std::unordered_map<std::string, CachedNodeLoad> nodeLoadCache;
+
+        // Calls in flight across all functions on this node, published as a load hint
+        std::atomic<long> nodeInFlightCount{0};
+
+        std::mutex logMx;
         bool logMessageIds = false;
         std::vector<unsigned int> loggedMessageIds;
     };
 
+    /**
+     * Marks the call as awaiting for the life of the guard, so the thread is counted again
+     * however the wait ends.
+     */
+    class AwaitingGuard {
+    public:
+        AwaitingGuard(Scheduler &schIn, const message::Message &msgIn);
+
+        ~AwaitingGuard();
+
+        AwaitingGuard(const AwaitingGuard &) = delete;
+
+        AwaitingGuard &operator=(const AwaitingGuard &) = delete;
+
+    private:
+        Scheduler &sch;
+        const message::Message &msg;
+    };
+
     Scheduler &getScheduler();
 
     GlobalMessageBus &getGlobalMessageBus();
@@ -1,14 +1,56 @@
 #pragma once
 
+#include <util/clock.h>
 #include <util/func.h>
 #include <util/queue.h>
 #include <redis/Redis.h>
 
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
 #define SHARING_QUEUE_PREFIX "sharing_"
 
 namespace scheduler {
     std::string getSharingQueueNameForNode(const std::string &nodeId);
 
+    /**
+     * Coalesces messages shared with the same node into a single push. A node's batch is
+     * pushed when it reaches SHARING_BATCH_SIZE messages, or SHARING_BATCH_WINDOW ms after
+     * its first message, whichever comes first.
+     */
+    class SharingMessageBatcher {
+    public:
+        SharingMessageBatcher();
+
+        ~SharingMessageBatcher();
+
+        void add(const std::string &nodeId, std::vector<uint8_t> msgBytes);
+
+        void flush();
+
+    private:
+        struct PendingBatch {
+            std::vector<std::vector<uint8_t>> messages;
+            util::TimePoint started;
+        };
+
+        util::SystemConfig &conf;
+
+        std::mutex mx;
+        std::condition_variable cv;
+        std::unordered_map<std::string, PendingBatch> pending;
+
+        bool stopped = false;
+        std::thread flushThread;
+
+        void pushBatch(const std::string &nodeId, const std::vector<std::vector<uint8_t>> &messages);
+    };
+
+    SharingMessageBatcher &getSharingMessageBatcher();
+
     class SharingMessageBus {
     public:
         SharingMessageBus();
@@ -19,6 +61,12 @@ namespace scheduler {
 
         message::Message nextMessageForThisNode();
 
+        /**
+         * Pushes any messages popped in a batch but not yet returned back onto their queues,
+         * e.g. when the thread consuming them shuts down.
+         */
+        void requeueReceived();
+
         void shareMessageWithNode(const std::string &nodeId, const message::Message &msg);
 
         void broadcastMessage(const message::Message &msg);
@@ -26,5 +74,8 @@ namespace scheduler {
         util::SystemConfig &conf;
         std::string thisNodeId;
         redis::Redis &redis;
+
+        // Messages already popped in a batch but not yet returned
+        std::unordered_map<std::string, std::deque<message::Message>> received;
     };
-}
\ No newline at end of file
+}
@@ -1,10 +1,17 @@
 #pragma once
 
 #include "StateKeyValue.h"
+#include "StateMessage.h"
 
 #include <util/clock.h>
 
 #include <redis/Redis.h>
+#include <tcp/TCPClient.h>
+
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
 
 
 namespace state {
@@ -16,15 +23,65 @@ namespace state {
 
     class InMemoryStateKeyValue final : public StateKeyValue {
     public:
-        InMemoryStateKeyValue(const std::string &keyIn, size_t sizeIn);
+        InMemoryStateKeyValue(const std::string &userIn, const std::string &keyIn, size_t sizeIn);
+
+        InMemoryStateKeyValue(const std::string &userIn, const std::string &keyIn, size_t sizeIn,
+                              const std::string &thisIPIn);
+
+        ~InMemoryStateKeyValue();
+
+        bool isMaster();
+
+        void lockGlobal() override;
+
+        void unlockGlobal() override;
+
+        /**
+         * Takes the global lock held on the master, returning its id, or zero if someone else
+         * holds it. Like Redis locks, it expires after REMOTE_LOCK_TIMEOUT_SECS, so a holder that
+         * dies can't keep the value locked.
+         */
+        long tryLockGlobalLocal();
+
+        /**
+         * Releases the global lock if it's still held with the given id
+         */
+        void unlockGlobalLocal(long lockId);
+
+        static size_t getStateSizeFromRemote(const std::string &userIn, const std::string &keyIn,
+                                             const std::string &thisIPIn);
+
     private:
+        const std::string user;
+        const std::string unmaskedKey;
+
         std::string thisIP;
         std::string masterIP;
         InMemoryStateKeyStatus status;
 
-        void lockGlobal() override;
+        std::mutex globalLockMutex;
+        std::condition_variable globalLockCv;
+        long globalLockId = 0;
+        long nextGlobalLockId = 1;
+        util::TimePoint globalLockExpiry;
+        long lastGlobalLockId = 0;
 
-        void unlockGlobal() override;
+        bool isGlobalLockHeld();
+
+        long takeGlobalLock();
+
+        std::mutex clientMutex;
+        std::unique_ptr<tcp::TCPClient> masterClient;
+
+        void exchangeWithMaster(tcp::TCPMessageType type, const StateRequest &request,
+                                const std::function<void(tcp::TCPClient &)> &receive);
+
+        tcp::TCPMessage *sendToMaster(tcp::TCPMessageType type, const StateRequest &request);
+
+        size_t sendToMasterInto(tcp::TCPMessageType type, const StateRequest &request, uint8_t *buffer,
+                                size_t bufferLen);
+
+        StateRequest buildRequest(size_t offset, size_t length, const uint8_t *data = nullptr);
 
         void pullFromRemote() override;
 
@@ -32,7 +89,7 @@ namespace state {
 
         void pushToRemote() override;
 
-        void pushPartialToRemote(const uint8_t *dirtyMaskBytes) override;
+        void pushPartialToRemote(util::Bitmap &mask) override;
 
         void deleteFromRemote() override;
     };
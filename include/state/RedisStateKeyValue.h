@@ -1,19 +1,55 @@
 #pragma once
 
 #include "StateKeyValue.h"
+#include "StatePullPool.h"
 
 #include <util/clock.h>
 
 #include <redis/Redis.h>
 
+// Granularity at which changes by other writers are tracked in versioned refresh mode
+#define STATE_VERSION_CHUNK_SIZE 16384
+
 
 namespace state {
     class RedisStateKeyValue final : public StateKeyValue {
     public:
         RedisStateKeyValue(const std::string &keyIn, size_t sizeIn);
+
+        ~RedisStateKeyValue();
+
+        /**
+         * Sets a whole value in Redis without a local copy. Like a full push, this moves on the
+         * epoch so that clients refreshing by version pull the whole value again.
+         */
+        static void setRemote(const std::string &key, const std::vector<uint8_t> &value);
     private:
         int lastRemoteLockId = 0;
 
+        // Values bigger than a chunk are pulled in parallel chunks on the pull pool
+        const size_t pullChunkSize;
+        std::shared_ptr<StatePullTracker> pullTracker;
+
+        void pullRange(long offset, size_t length);
+
+        // Versioned refresh. Every push increments a version counter for the value, every full
+        // push increments an epoch, and partial pushes increment per-chunk versions. After a
+        // partial push we can then pull only the chunks others have changed since our last sync.
+        const bool versionedRefresh;
+        const std::string versionKey;
+        const std::string epochKey;
+        const std::string chunkVersionsKey;
+        const size_t nChunks;
+
+        bool versionsKnown = false;
+        long lastVersion = 0;
+        long lastEpoch = 0;
+        std::vector<uint32_t> chunkVersions;
+
+        std::vector<uint32_t> getRemoteChunkVersions();
+
+        void refreshChangedChunks(long newVersion, const std::vector<bool> &pushedChunks);
+
         void lockGlobal() override;
 
         void unlockGlobal() override;
@@ -24,7 +60,7 @@ namespace state {
 
         void pushToRemote() override;
 
-        void pushPartialToRemote(const uint8_t *dirtyMaskBytes) override;
+        void pushPartialToRemote(util::Bitmap &mask) override;
 
         void deleteFromRemote() override;
     };
@@ -1,10 +1,12 @@
 #pragma once
 
+#include <util/bitmap.h>
 #include <util/clock.h>
 #include <util/exception.h>
 #include <redis/Redis.h>
 
 #include <atomic>
+#include <functional>
 #include <shared_mutex>
 #include <string>
 #include <unordered_map>
@@ -32,6 +34,11 @@ namespace state {
 
         void set(const uint8_t *buffer);
 
+        /**
+         * Sets the whole value by writing it in place, without pulling it first.
+         */
+        void setInPlace(const std::function<void(uint8_t *)> &writeValue);
+
         void setSegment(long offset, const uint8_t *buffer, size_t length);
 
         void mapSharedMemory(void *destination, long pagesOffset, long nPages);
@@ -75,7 +82,7 @@ namespace state {
         virtual void unlockGlobal() = 0;
 
     protected:
-        bool isDirty;
+        std::atomic<bool> isDirty;
 
         redis::Redis &redis;
 
@@ -87,14 +94,18 @@ namespace state {
         size_t valueSize;
         size_t sharedMemSize;
         void *sharedMemory;
-        void *dirtyMask;
-        void *allocatedMask;
+
+        // One bit per byte of the value
+        util::Bitmap dirtyMask;
+
+        // One bit per host page of shared memory
+        util::Bitmap allocatedMask;
 
         void pullImpl(bool onlyIfEmpty);
 
         void pullSegmentImpl(bool onlyIfEmpty, long offset, size_t length);
 
-        void doPushPartial(const uint8_t *dirtyMaskBytes);
+        bool doPushPartial(util::Bitmap &mask);
 
         bool isSegmentAllocated(long offset, size_t length);
 
@@ -114,7 +125,7 @@ namespace state {
 
         virtual void pushToRemote() = 0;
 
-        virtual void pushPartialToRemote(const uint8_t *dirtyMaskBytes) = 0;
+        virtual void pushPartialToRemote(util::Bitmap &mask) = 0;
 
         virtual void deleteFromRemote() = 0;
     };
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <tcp/TCPMessage.h>
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+
+namespace state {
+    /**
+     * Request sent between nodes in in-memory state mode. User and key are those originally
+     * passed to the state API (i.e. not masked with the user).
+     */
+    struct StateRequest {
+        std::string user;
+        std::string key;
+        size_t valueSize = 0;
+        size_t offset = 0;
+        size_t length = 0;
+
+        // Points to the data in the request message (if any)
+        const uint8_t *data = nullptr;
+    };
+
+    tcp::TCPMessage *buildStateRequest(tcp::TCPMessageType type, const StateRequest &request);
+
+    StateRequest parseStateRequest(const tcp::TCPMessage *msg);
+
+    tcp::TCPMessage *buildStateResponse(tcp::TCPMessageType type, size_t dataLen);
+
+    /**
+     * Partial pushes are sent as a list of segments, each made up of an offset,
+     * a length and the data itself.
+     */
+    void appendStateSegment(std::vector<uint8_t> &segments, size_t offset, const uint8_t *data, size_t length);
+
+    /**
+     * Segments come off the wire, so they're checked against the buffer before being passed on
+     */
+    template<typename F>
+    void forEachStateSegment(const uint8_t *segments, size_t segmentsLen, F f) {
+        size_t cursor = 0;
+        while (cursor < segmentsLen) {
+            if (segmentsLen - cursor < 2 * sizeof(size_t)) {
+                throw std::runtime_error("State segment header truncated");
+            }
+
+            size_t offset;
+            size_t length;
+            std::copy(segments + cursor, segments + cursor + sizeof(size_t), reinterpret_cast<uint8_t *>(&offset));
+            cursor += sizeof(size_t);
+            std::copy(segments + cursor, segments + cursor + sizeof(size_t), reinterpret_cast<uint8_t *>(&length));
+            cursor += sizeof(size_t);
+
+            if (segmentsLen - cursor < length) {
+                throw std::runtime_error("State segment data truncated");
+            }
+
+            f(offset, segments + cursor, length);
+            cursor += length;
+        }
+    }
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <util/bitmap.h>
+#include <util/queue.h>
+
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+namespace state {
+    /**
+     * Tracks which chunks of a value are still being pulled in the background
+     */
+    class StatePullTracker {
+    public:
+        explicit StatePullTracker(size_t nChunksIn);
+
+        void setPending(size_t firstChunk, size_t nChunks);
+
+        void chunkDone(size_t chunkIdx, bool success);
+
+        void await(size_t firstChunk, size_t nChunks);
+
+        /**
+         * Waits for all pulls in flight to finish, without checking whether they failed
+         */
+        void awaitIdle();
+
+    private:
+        std::mutex mx;
+        std::condition_variable cv;
+        util::Bitmap pending;
+        util::Bitmap failed;
+    };
+
+    /**
+     * Fixed set of threads, each with its own Redis connection, that pull chunks of
+     * state values directly into their shared memory.
+     */
+    class StatePullPool {
+    public:
+        explicit StatePullPool(int nThreads);
+
+        ~StatePullPool();
+
+        void pullChunks(const std::string &key, uint8_t *buffer, long offset, size_t length, size_t chunkSize,
+                        const std::shared_ptr<StatePullTracker> &tracker);
+
+    private:
+        std::vector<std::thread> threads;
+        util::Queue<std::function<void()>> taskQueue;
+    };
+
+    StatePullPool &getStatePullPool();
+}
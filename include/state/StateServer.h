@@ -1,5 +1,7 @@
 #pragma once
 
+#include "State.h"
+
 #include <tcp/TCPServer.h>
 
 #define STATE_PORT 8003
@@ -10,6 +12,11 @@ namespace state {
     public:
         StateServer();
 
+        explicit StateServer(State &stateIn);
+
         tcp::TCPMessage * handleMessage(tcp::TCPMessage *) override;
+
+    private:
+        State &state;
     };
-}
\ No newline at end of file
+}
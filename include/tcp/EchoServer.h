@@ -6,7 +6,7 @@
 namespace tcp {
     class EchoServer final : public tcp::TCPServer {
     public:
-        explicit EchoServer(int portIn);
+        explicit EchoServer(int portIn, int nThreads = 1);
 
         tcp::TCPMessage *handleMessage(tcp::TCPMessage *) override;
     };
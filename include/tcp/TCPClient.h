@@ -11,8 +11,7 @@
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <netdb.h>
-
-#define RECEIVE_SIZE 256
+#include <sys/uio.h>
 
 namespace tcp {
 
@@ -22,16 +21,22 @@ namespace tcp {
 
         void sendMessage(TCPMessage *msg) const;
 
+        void sendMessage(TCPMessageType type, const iovec *parts, int nParts) const;
+
         TCPMessage *recvMessage() const;
 
         TCPMessage *recvMessage(size_t dataSize) const;
 
+        TCPMessage recvMessageInto(uint8_t *buffer, size_t bufferLen) const;
+
         void exit();
     private:
         std::string host;
         int port;
 
         int clientSocket;
+
+        void recvAll(uint8_t *buffer, size_t len) const;
     };
 }
 
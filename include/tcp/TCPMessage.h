@@ -10,10 +10,23 @@ namespace tcp {
         STATE_SIZE,
         STATE_GET,
         STATE_SET,
+        STATE_PUSH_PARTIAL,
+        STATE_LOCK,
+        STATE_UNLOCK,
+        STATE_DELETE,
+        MPI_MESSAGE,
+        MPI_PULL,
+    };
+
+    // Sent in the header of responses, so that failures don't depend on the data
+    enum class TCPMessageStatus : uint8_t {
+        OK,
+        FAILED,
     };
 
     struct TCPMessage {
         TCPMessageType type;
+        TCPMessageStatus status;
         size_t len;
         uint8_t *buffer;
     };
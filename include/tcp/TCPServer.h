@@ -4,38 +4,74 @@
 
 #include <vector>
 #include <atomic>
+#include <mutex>
 #include <thread>
+#include <unordered_set>
 
 #include <arpa/inet.h>
 #include <netinet/in.h>
-#include <poll.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 
 #include <util/exception.h>
 
-#define POLL_COUNT 50
+#define TCP_SERVER_MAX_EVENTS 64
 
 namespace tcp {
+    /**
+     * Server handling length-prefixed messages (a TCPMessage header followed by its data).
+     * Connections are watched with epoll and each is only ever handled by one thread at a
+     * time, so poll can be called from several threads, or start can be used to run a
+     * number of threads in the background.
+     */
     class TCPServer {
     public:
-        TCPServer(int portIn, long timeoutMillisIn);
+        TCPServer(int portIn, long timeoutMillisIn, int nThreadsIn = 1);
+
+        virtual ~TCPServer();
 
         int poll();
 
-        void close() const;
+        void start();
+
+        void stop();
+
+        void close();
 
         virtual TCPMessage *handleMessage(TCPMessage *request) = 0;
 
     private:
         int port;
         int serverSocket;
+        int epollFd;
+        int stopFd;
         struct sockaddr_in serverAddress{};
-        struct pollfd pollFds[POLL_COUNT];
-        int nFds = 1;
 
         long timeoutMillis;
+        int nThreads;
+
+        std::atomic<bool> stopped;
+        std::vector<std::thread> serverThreads;
+
+        std::mutex clientsMx;
+        std::unordered_set<int> clientFds;
+
+        int pollEvents(int maxEvents, long timeout);
+
+        void acceptClients();
+
+        void closeClient(int fd);
+
+        bool recvAll(int fd, uint8_t *buffer, size_t len);
+
+        bool handleClientEvent(int fd);
     };
 
+    bool sendTcpMessage(int fd, const TCPMessage *msg);
+
+    bool sendTcpMessage(int fd, TCPMessageType type, const iovec *parts, int nParts,
+                        TCPMessageStatus status = TCPMessageStatus::OK);
+
     class TCPFailedException : public util::FaasmException {
     public:
         explicit TCPFailedException(std::string message) : FaasmException(std::move(message)) {
@@ -49,4 +85,4 @@ namespace tcp {
 
         }
     };
-}
\ No newline at end of file
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace util {
+    /**
+     * Fixed-size bitmap, scanned a 64-bit word at a time.
+     *
+     * Words are updated atomically, so different threads can set and clear bits concurrently,
+     * even within the same word.
+     */
+    class Bitmap {
+    public:
+        explicit Bitmap(size_t nBitsIn);
+
+        size_t size() const;
+
+        void set(size_t start, size_t len);
+
+        void clear(size_t start, size_t len);
+
+        void clearAll();
+
+        /**
+         * Clears the bitmap, returning the bits that were set. Bits set concurrently end up in
+         * exactly one of the two.
+         */
+        Bitmap takeAll();
+
+        bool isSet(size_t idx) const;
+
+        bool allSet(size_t start, size_t len) const;
+
+        bool anySet() const;
+
+        size_t nextSet(size_t start) const;
+
+        size_t nextClear(size_t start) const;
+
+        void setFromByteMask(const uint8_t *mask, size_t maskLen);
+
+        /**
+         * Calls the given function with the start and length of each run of set bits
+         */
+        template<typename F>
+        void forEachRun(F f) const {
+            size_t pos = 0;
+            while (pos < nBits) {
+                size_t runStart = nextSet(pos);
+                if (runStart >= nBits) {
+                    break;
+                }
+
+                size_t runEnd = nextClear(runStart);
+                f(runStart, runEnd - runStart);
+                pos = runEnd;
+            }
+        }
+
+    private:
+        size_t nBits;
+        std::vector<std::atomic<uint64_t>> words;
+
+        void updateWord(size_t wordIdx, uint64_t mask, bool value);
+
+        void setRange(size_t start, size_t len, bool value);
+    };
+}
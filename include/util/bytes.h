@@ -1,5 +1,6 @@
 #pragma once
 
+#include <streambuf>
 #include <string>
 #include <vector>
 
@@ -13,4 +14,28 @@ namespace util {
     int safeCopyToBuffer(const std::vector<uint8_t> &dataIn, uint8_t *buffer, int bufferLen);
 
     int safeCopyToBuffer(const uint8_t *dataIn, int dataLen, uint8_t *buffer, int bufferLen);
+
+    /**
+     * Stream buffer appending everything written to a byte vector
+     */
+    class BytesOutputStreamBuf : public std::streambuf {
+    public:
+        explicit BytesOutputStreamBuf(std::vector<uint8_t> &bytesIn);
+
+    protected:
+        std::streamsize xsputn(const char *s, std::streamsize n) override;
+
+        int_type overflow(int_type c) override;
+
+    private:
+        std::vector<uint8_t> &bytes;
+    };
+
+    /**
+     * Stream buffer reading from bytes in place. The bytes must outlive it.
+     */
+    class BytesInputStreamBuf : public std::streambuf {
+    public:
+        BytesInputStreamBuf(const uint8_t *data, size_t dataLen);
+    };
 }
\ No newline at end of file
@@ -17,6 +17,8 @@ namespace util {
 
         void setFakeNow(const TimePoint &t);
 
+        void stopFakeNow();
+
     private:
         bool isFake = false;
         TimePoint fakeNow;
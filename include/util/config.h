@@ -29,6 +29,10 @@ namespace util {
         std::string pythonPreload;
         std::string captureStdout;
         std::string stateMode;
+        std::string stateRefreshMode;
+        int statePullThreads;
+        int statePullChunkSize;
+        int stateServerThreads;
         std::string wasmVm;
 
         // Redis
@@ -38,6 +42,14 @@ namespace util {
 
         // Caching
         std::string irCacheMode;
+        std::string moduleResetMode;
+        int modulePoolSize;
+        int moduleCacheMaxMb;
+        std::string codeCacheMode;
+
+        // Snapshots
+        std::string snapshotMode;
+        std::string snapshotCompression;
 
         // Scheduling
         int maxNodes;
@@ -45,10 +57,15 @@ namespace util {
         int noScheduler;
         int maxInFlightRatio;
         int maxWorkersPerFunction;
+        int schedulerCacheTtl;
+        int sharingBatchSize;
+        int sharingBatchWindow;
         std::string threadMode;
 
         // Worker-related timeouts
         int globalMessageTimeout;
+        int globalQueueThreads;
+        int globalQueueBatchSize;
         int unboundTimeout;
         int boundTimeout;
         int chainedCallTimeout;
@@ -56,6 +73,7 @@ namespace util {
         // Filesystem storage
         std::string functionDir;
         std::string objectFileDir;
+        std::string codeCacheDir;
         std::string runtimeFilesDir;
         std::string sharedFilesDir;
         std::string sharedFilesStorageDir;
@@ -65,6 +83,11 @@ namespace util {
 
         // MPI
         int defaultMpiWorldSize;
+        int mpiEagerLimit;
+        int mpiServerThreads;
+        int mpiPayloadTimeout;
+        int mpiLinearCollectiveSize;
+        int mpiRingAllReduceBytes;
 
         // Endpoint
         std::string endpointInterface;
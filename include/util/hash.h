@@ -1,7 +1,13 @@
 #pragma once
 
+#include <cstdint>
 #include <string>
+#include <vector>
 
 namespace util {
     std::string stringToSHA1(const std::string &strIn);
-}
\ No newline at end of file
+
+    std::string bytesToSHA1(const std::vector<uint8_t> &bytesIn);
+
+    std::string hashToHex(const std::string &hash);
+}
@@ -1,6 +1,9 @@
 #pragma once
 
+#include <cstdint>
 #include <unistd.h>
+#include <utility>
+#include <vector>
 
 namespace util {
     static const long HOST_PAGE_SIZE = sysconf(_SC_PAGESIZE);
@@ -12,4 +15,16 @@ namespace util {
     size_t getRequiredHostPagesRoundDown(size_t nBytes);
 
     size_t alignOffsetDown(size_t offset);
+
+    /**
+     * Returns the pages of a private file mapping which have been written to since they were
+     * mapped, as (offset, length) byte ranges from the start of the region. These are the pages
+     * no longer backed by the file.
+     */
+    std::vector<std::pair<size_t, size_t>> getDirtyPrivatePages(const uint8_t *start, size_t nBytes);
+
+    /**
+     * Drops the given pages of a private file mapping, so that they're read from the file again.
+     */
+    void resetDirtyPrivatePages(uint8_t *start, const std::vector<std::pair<size_t, size_t>> &ranges);
 }
\ No newline at end of file
@@ -3,7 +3,19 @@
 #include "locks.h"
 #include "exception.h"
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
 #include <queue>
+#include <thread>
+#include <type_traits>
+
+#define DEFAULT_LOCK_FREE_QUEUE_CAPACITY 4096
+#define LOCK_FREE_QUEUE_SPIN_COUNT 128
 
 namespace util {
     class QueueTimeoutException : public util::FaasmException {
@@ -75,6 +87,248 @@ namespace util {
     };
 
 
+    /**
+     * Waits on a futex while the given word still holds the expected value. Returns false if
+     * the timeout expired (a zero timeout waits indefinitely).
+     */
+    bool futexWait(std::atomic<uint32_t> &word, uint32_t expected, long timeoutMs);
+
+    void futexWake(std::atomic<uint32_t> &word, int nWaiters);
+
+    /**
+     * Bounded lock-free multi-producer/ multi-consumer queue (a ring of sequenced cells as
+     * described by Dmitry Vyukov). Producers and consumers only block on a futex when the
+     * queue is full or empty, so the uncontended paths never take a lock.
+     *
+     * Drop-in for Queue where peeking isn't required. Enqueueing on a full queue blocks,
+     * unless the queue is created to overflow, in which case values that don't fit go on a
+     * locked overflow list. Producers then never wait on consumers, at the cost of a lock
+     * while the ring is full.
+     */
+    template<typename T>
+    class LockFreeQueue {
+    public:
+        explicit LockFreeQueue(size_t capacityIn = DEFAULT_LOCK_FREE_QUEUE_CAPACITY,
+                               bool overflowIn = false) : overflowWhenFull(overflowIn) {
+            capacity = 2;
+            while (capacity < capacityIn) {
+                capacity <<= 1;
+            }
+            mask = capacity - 1;
+
+            cells = std::unique_ptr<Cell[]>(new Cell[capacity]);
+            for (size_t i = 0; i < capacity; i++) {
+                cells[i].sequence.store(i, std::memory_order_relaxed);
+            }
+
+            enqueuePos.store(0, std::memory_order_relaxed);
+            dequeuePos.store(0, std::memory_order_relaxed);
+        }
+
+        ~LockFreeQueue() {
+            reset();
+        }
+
+        LockFreeQueue(const LockFreeQueue &) = delete;
+
+        LockFreeQueue &operator=(const LockFreeQueue &) = delete;
+
+        bool tryEnqueue(T &value) {
+            Cell *cell;
+            size_t pos = enqueuePos.load(std::memory_order_relaxed);
+            while (true) {
+                cell = &cells[pos & mask];
+                size_t seq = cell->sequence.load(std::memory_order_acquire);
+                intptr_t diff = (intptr_t) seq - (intptr_t) pos;
+
+                if (diff == 0) {
+                    if (enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                        break;
+                    }
+                } else if (diff < 0) {
+                    return false;
+                } else {
+                    pos = enqueuePos.load(std::memory_order_relaxed);
+                }
+            }
+
+            new(&cell->storage) T(std::move(value));
+            cell->sequence.store(pos + 1, std::memory_order_release);
+
+            notify(pushEpoch, pushWaiters);
+            return true;
+        }
+
+        bool tryDequeue(T &value) {
+            Cell *cell;
+            size_t pos = dequeuePos.load(std::memory_order_relaxed);
+            while (true) {
+                cell = &cells[pos & mask];
+                size_t seq = cell->sequence.load(std::memory_order_acquire);
+                intptr_t diff = (intptr_t) seq - (intptr_t) (pos + 1);
+
+                if (diff == 0) {
+                    if (dequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                        break;
+                    }
+                } else if (diff < 0) {
+                    return tryDequeueOverflow(value);
+                } else {
+                    pos = dequeuePos.load(std::memory_order_relaxed);
+                }
+            }
+
+            T *item = reinterpret_cast<T *>(&cell->storage);
+            value = std::move(*item);
+            item->~T();
+            cell->sequence.store(pos + mask + 1, std::memory_order_release);
+
+            notify(popEpoch, popWaiters);
+            return true;
+        }
+
+        void enqueue(T value) {
+            if (overflowWhenFull) {
+                enqueueOrOverflow(value);
+                return;
+            }
+
+            for (int i = 0; i < LOCK_FREE_QUEUE_SPIN_COUNT; i++) {
+                if (tryEnqueue(value)) {
+                    return;
+                }
+                std::this_thread::yield();
+            }
+
+            while (true) {
+                // Register as waiting before the final check so a pop can't be missed
+                popWaiters.fetch_add(1);
+                uint32_t seen = popEpoch.load();
+                if (tryEnqueue(value)) {
+                    popWaiters.fetch_sub(1);
+                    return;
+                }
+
+                futexWait(popEpoch, seen, 0);
+                popWaiters.fetch_sub(1);
+            }
+        }
+
+        T dequeue(long timeoutMs = 0) {
+            T value;
+            for (int i = 0; i < LOCK_FREE_QUEUE_SPIN_COUNT; i++) {
+                if (tryDequeue(value)) {
+                    return value;
+                }
+                std::this_thread::yield();
+            }
+
+            auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+            while (true) {
+                pushWaiters.fetch_add(1);
+                uint32_t seen = pushEpoch.load();
+                if (tryDequeue(value)) {
+                    pushWaiters.fetch_sub(1);
+                    return value;
+                }
+
+                long remainingMs = 0;
+                if (timeoutMs > 0) {
+                    remainingMs = std::chrono::duration_cast<std::chrono::milliseconds>(
+                            deadline - std::chrono::steady_clock::now()).count();
+
+                    if (remainingMs <= 0) {
+                        pushWaiters.fetch_sub(1);
+                        throw QueueTimeoutException("Queue timeout");
+                    }
+                }
+
+                futexWait(pushEpoch, seen, remainingMs);
+                pushWaiters.fetch_sub(1);
+            }
+        }
+
+        long size() {
+            long enqueued = enqueuePos.load();
+            long dequeued = dequeuePos.load();
+            return std::max(enqueued - dequeued, 0L) + (long) overflowCount.load();
+        }
+
+        void reset() {
+            T value;
+            while (tryDequeue(value)) {
+            }
+        }
+
+    private:
+        struct Cell {
+            std::atomic<size_t> sequence;
+            typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+        };
+
+        size_t capacity;
+        size_t mask;
+        std::unique_ptr<Cell[]> cells;
+
+        // Keep the two ends on separate cache lines to avoid false sharing
+        alignas(64) std::atomic<size_t> enqueuePos;
+        alignas(64) std::atomic<size_t> dequeuePos;
+
+        // Bumped on push/ pop only when there are blocked threads to wake
+        alignas(64) std::atomic<uint32_t> pushEpoch{0};
+        std::atomic<uint32_t> pushWaiters{0};
+        alignas(64) std::atomic<uint32_t> popEpoch{0};
+        std::atomic<uint32_t> popWaiters{0};
+
+        // Values that didn't fit in the ring, oldest first
+        const bool overflowWhenFull;
+        std::mutex overflowMx;
+        std::deque<T> overflow;
+        std::atomic<size_t> overflowCount{0};
+
+        void enqueueOrOverflow(T &value) {
+            // Once anything has overflowed, later values follow it until it's drained, so
+            // they don't overtake it
+            if (overflowCount.load() == 0 && tryEnqueue(value)) {
+                return;
+            }
+
+            {
+                UniqueLock lock(overflowMx);
+                overflow.push_back(std::move(value));
+                overflowCount.fetch_add(1);
+            }
+
+            notify(pushEpoch, pushWaiters);
+        }
+
+        bool tryDequeueOverflow(T &value) {
+            if (overflowCount.load() == 0) {
+                return false;
+            }
+
+            UniqueLock lock(overflowMx);
+            if (overflow.empty()) {
+                return false;
+            }
+
+            value = std::move(overflow.front());
+            overflow.pop_front();
+            overflowCount.fetch_sub(1);
+
+            return true;
+        }
+
+        void notify(std::atomic<uint32_t> &epoch, std::atomic<uint32_t> &waiters) {
+            // Pairs with waiters registering before their last check of the queue
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (waiters.load(std::memory_order_relaxed) > 0) {
+                epoch.fetch_add(1);
+                futexWake(epoch, 1);
+            }
+        }
+    };
+
     class TokenPool {
     public:
         explicit TokenPool(int nTokens);
@@ -93,6 +347,6 @@ namespace util {
 
     private:
         int _size;
-        Queue<int> queue;
+        LockFreeQueue<int> queue;
     };
 }
\ No newline at end of file
@@ -1,9 +1,13 @@
 #pragma once
 
+#include <string>
 #include <unordered_set>
+#include <vector>
 
 namespace util {
     std::string randomString(int len);
 
     std::string randomStringFromSet(const std::unordered_set<std::string> &s);
+
+    std::vector<std::string> randomStringsFromSet(const std::unordered_set<std::string> &s, int n);
 }
\ No newline at end of file
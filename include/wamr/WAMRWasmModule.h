@@ -33,7 +33,7 @@ namespace wasm {
         void writeArgvToMemory(uint32_t wasmArgvPointers, uint32_t wasmArgvBuffer) override;
 
     protected:
-        void doSnapshot(std::ostream &outStream) override;
+        MemorySnapshotWriter prepareSnapshot() override;
 
         void doRestore(std::istream &inStream) override;
 
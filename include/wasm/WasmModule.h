@@ -1,6 +1,7 @@
 #pragma once
 
 #include <wasm/openmp/Level.h>
+#include <wasm/serialisation.h>
 #include "WasmEnvironment.h"
 
 #include <util/logging.h>
@@ -110,7 +111,7 @@ namespace wasm {
 
         int getStdoutFd();
 
-        virtual void doSnapshot(std::ostream &outStream) = 0;
+        virtual MemorySnapshotWriter prepareSnapshot() = 0;
 
         virtual void doRestore(std::istream &inStream) = 0;
 
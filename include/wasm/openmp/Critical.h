@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <unordered_map>
+
+namespace wasm {
+    namespace openmp {
+        /**
+         * Locks for named critical sections (and critical reductions), keyed on the address of
+         * the kmp_critical_name the compiler emits for each name. Unrelated critical sections
+         * then don't exclude one another.
+         */
+        class OMPCriticalSections {
+        public:
+            std::mutex &getMutex(uint32_t lockPtr);
+
+            int getCount();
+
+            void clear();
+
+        private:
+            std::shared_mutex mx;
+            std::unordered_map<uint32_t, std::unique_ptr<std::mutex>> sections;
+        };
+    }
+}
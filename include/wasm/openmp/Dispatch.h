@@ -0,0 +1,91 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+
+#define OMP_DISPATCH_BUFFERS 8
+
+namespace wasm {
+    namespace openmp {
+        class OMPLevel;
+
+        // Types in accordance with Clang's OpenMP implementation (see kmp.h)
+        namespace kmp {
+            enum sched_type : int32_t {
+                sch_lower = 32, /**< lower bound for unordered values */
+                sch_static_chunked = 33,
+                sch_static = 34, /**< static unspecialized */
+                sch_dynamic_chunked = 35,
+                sch_guided_chunked = 36,
+                sch_runtime = 37,
+                sch_auto = 38,
+                sch_static_greedy = 40,
+                sch_static_balanced = 41,
+                sch_guided_iterative_chunked = 42,
+                sch_guided_analytical_chunked = 43,
+                sch_upper,
+
+                sch_modifier_monotonic = (1 << 29),
+                sch_modifier_nonmonotonic = (1 << 30),
+            };
+        }
+
+        // Values of omp_sched_t
+        enum omp_sched : int32_t {
+            omp_sched_static = 1,
+            omp_sched_dynamic = 2,
+            omp_sched_guided = 3,
+            omp_sched_auto = 4,
+        };
+
+        /**
+         * State shared by the team for one dynamically scheduled loop. Iterations are handed
+         * out by bumping the shared counter, so only setting up and retiring the loop takes
+         * the lock.
+         *
+         * Threads can run ahead into later loops (e.g. with nowait), so each level has a ring
+         * of these, and a thread only reuses one once the whole team has finished with it.
+         */
+        struct OMPDispatchBuffer {
+            std::mutex mx;
+            std::condition_variable cv;
+            uint64_t seq = UINT64_MAX;
+            int finished = 0;
+
+            int32_t schedule = 0;
+            uint64_t tripCount = 0;
+            uint64_t chunk = 1;
+
+            alignas(64) std::atomic<uint64_t> next{0};
+        };
+
+        /**
+         * A chunk of iterations handed to a thread, in terms of the original loop bounds.
+         * Bounds are held as raw bits, so the same arithmetic works for signed, unsigned,
+         * 32- and 64-bit loops once truncated to the loop's type.
+         */
+        struct OMPChunk {
+            uint64_t lower = 0;
+            uint64_t upper = 0;
+            int64_t stride = 1;
+            bool isLast = false;
+        };
+
+        int32_t normaliseSchedule(const OMPLevel &level, int32_t schedule, int64_t &chunk);
+
+        uint64_t getTripCount(uint64_t lower, uint64_t upper, int64_t incr, bool isSigned);
+
+        /**
+         * Called by every thread in the team on entering a loop scheduled with __kmpc_dispatch_init_*.
+         */
+        void dispatchInit(OMPLevel &level, int threadNum, int32_t schedule, uint64_t lower, uint64_t upper,
+                          int64_t incr, int64_t chunk, bool isSigned);
+
+        /**
+         * Gets this thread's next chunk of the current loop, returning false once the loop is done.
+         */
+        bool dispatchNext(OMPLevel &level, int threadNum, OMPChunk &chunk);
+    }
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Space given to each reduction variable when shipped between hosts. Bigger types can't be
+// reduced in distributed mode.
+#define OMP_REDUCE_VAR_BYTES 32
+
+namespace wasm {
+    namespace openmp {
+        /**
+         * Reduction variables from one or more threads of a distributed fork, already combined
+         * with the fork's reduce function. Each variable takes OMP_REDUCE_VAR_BYTES of data.
+         */
+        struct OMPReduceContribution {
+            int32_t nThreads = 0;
+            std::vector<uint8_t> data;
+
+            std::vector<uint8_t> toBytes() const;
+
+            static OMPReduceContribution fromBytes(const std::vector<uint8_t> &bytes);
+        };
+
+        std::string getForkReduceKey(const std::string &forkKey, int reductionIdx);
+
+        /**
+         * Collects the contributions of the threads from each distributed fork running on this
+         * host, so that they make one contribution between them.
+         *
+         * Threads join the fork as they start and leave as they finish. Each one folds in what
+         * local threads have contributed before it, and the last to leave sends the result on
+         * to the fork's master. Threads that don't overlap send their own contributions.
+         */
+        class OMPNodeReductions {
+        public:
+            void joinFork(const std::string &forkKey);
+
+            /**
+             * Adds this thread's contribution to the given reduction. The combine function is
+             * passed the contribution pending from other threads on this host, if any, to fold
+             * into this thread's variables, and returns the data for the result.
+             */
+            void contribute(const std::string &forkKey, int reductionIdx,
+                            const std::function<std::vector<uint8_t>(const OMPReduceContribution *)> &combine);
+
+            void leaveFork(const std::string &forkKey);
+
+            int getActiveThreadCount(const std::string &forkKey);
+
+            void clear();
+
+        private:
+            struct ForkReductions {
+                int activeThreads = 0;
+                std::unordered_map<int, OMPReduceContribution> pending;
+            };
+
+            std::mutex mx;
+            std::unordered_map<std::string, ForkReductions> forks;
+
+            void flush(const std::string &forkKey, ForkReductions &fork);
+        };
+
+        OMPNodeReductions &getNodeReductions();
+
+        /**
+         * Joins the fork on this host for the life of the guard, so threads leave it however
+         * they finish.
+         */
+        class OMPForkGuard {
+        public:
+            explicit OMPForkGuard(const std::string &forkKeyIn);
+
+            ~OMPForkGuard();
+
+            OMPForkGuard(const OMPForkGuard &) = delete;
+
+            OMPForkGuard &operator=(const OMPForkGuard &) = delete;
+
+        private:
+            const std::string forkKey;
+        };
+    }
+}
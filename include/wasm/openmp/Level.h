@@ -1,6 +1,12 @@
 #pragma once
 
+#include <wasm/openmp/Dispatch.h>
+#include <wasm/openmp/Reduction.h>
+
+#include <array>
+#include <string>
 #include <mutex>
+#include <vector>
 #include <proto/faasm.pb.h>
 #include <util/barrier.h>
 #include <util/environment.h>
@@ -17,11 +23,15 @@ namespace wasm {
             const int num_threads = 1; // Number of threads of this level
             int wanted_num_threads = -1; // Desired number of thread set by omp_set_num_threads for all future levels
             int pushed_num_threads = -1; // Num threads pushed by compiler, valid for one parallel section, overrides wanted
+            const bool is_distributed = false; // Whether this thread's team is spread across chained calls
+            std::string fork_key; // Identifies the distributed fork this level was created by
+            int distributed_reductions = 0; // Reductions this thread has made in the distributed fork
             std::unique_ptr<util::Barrier> barrier = {}; // Only needed if num_threads > 1
-            std::mutex reduceMutex; // Mutex used for reduction data. Although technically wrong behaviour, make sense for us
-            // TODO - This implementation limits to one lock for all critical sections at a level.
-            // Mention in report (maybe fix looking at the lck address and doing a lookup on it though?)
-            std::mutex criticalSection; // Mutex used in critical sections.
+            int32_t runtime_schedule = omp_sched_static; // Schedule for schedule(runtime), set by omp_set_schedule
+            int64_t runtime_chunk = 0; // Chunk size for schedule(runtime), zero for the default
+            std::array<OMPDispatchBuffer, OMP_DISPATCH_BUFFERS> dispatch_buffers; // Shared state for dynamic loops
+            std::vector<uint64_t> dispatch_seqs = std::vector<uint64_t>(1, 0); // Dynamic loops entered by each thread
+            std::vector<OMPReduceSlot> reduce_slots = std::vector<OMPReduceSlot>(1); // Per-thread tree reduction state
 
             // Defaults set to mimic Clang 9.0.1 behaviour
             OMPLevel() = default;
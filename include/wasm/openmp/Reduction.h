@@ -0,0 +1,56 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+
+#define OMP_REDUCE_SPIN_COUNT 1024
+
+// Teams up to this size reduce atomically when the compiler allows it, as in Clang's runtime
+#define OMP_ATOMIC_REDUCE_MAX_THREADS 4
+
+namespace wasm {
+    namespace openmp {
+        class OMPLevel;
+
+        // Types in accordance with Clang's OpenMP implementation (see kmp.h)
+        namespace kmp {
+            enum _reduction_method {
+                reduction_method_not_defined = 0,
+                critical_reduce_block = (1 << 8),
+                atomic_reduce_block = (2 << 8),
+                tree_reduce_block = (3 << 8),
+                empty_reduce_block = (4 << 8)
+            };
+
+            // Flags of ident_t
+            enum ident_flags : int32_t {
+                KMP_IDENT_ATOMIC_REDUCE = 0x10, /**< compiler generated the atomic reduction path */
+            };
+        }
+
+        /**
+         * A thread's slot in a tree reduction. The thread publishes its partial result here
+         * by bumping the round, and its parent in the tree waits for that round.
+         */
+        struct OMPReduceSlot {
+            alignas(64) std::atomic<uint32_t> round{0};
+            std::atomic<int> waiters{0};
+            uint32_t reduceData = 0;
+        };
+
+        kmp::_reduction_method determineReductionMethod(const OMPLevel &level, bool atomicAvailable,
+                                                        bool treeAvailable);
+
+        /**
+         * Combines every thread's reduction data into thread zero's in log2(n) rounds, with
+         * reduceFunc(lhs, rhs) folding rhs into lhs. Returns true on thread zero, which then
+         * holds the result.
+         *
+         * A thread's data may be read by its parent up until thread zero returns, so the team
+         * must pass a barrier before any thread reuses it or starts another reduction.
+         */
+        bool treeReduce(OMPLevel &level, int threadNum, uint32_t reduceData,
+                        const std::function<void(uint32_t, uint32_t)> &reduceFunc);
+    }
+}
@@ -1,19 +1,87 @@
 #ifndef FAASM_SERIALISATION_H
 #define FAASM_SERIALISATION_H
 
-#include <cereal/types/vector.hpp>
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <utility>
+#include <vector>
+
+#define SNAPSHOT_MAGIC 0x50414e53
+
+// Memory is stored in chunks of at most this size, which bounds the buffers used to compress it
+#define SNAPSHOT_CHUNK_BYTES (1024 * 1024)
+
+// Snapshot flags
+#define SNAPSHOT_FLAG_DIFF 1
+#define SNAPSHOT_FLAG_LZ4 2
 
 namespace wasm {
-    class MemorySerialised {
+    /**
+     * Start of a serialised memory snapshot. Diff snapshots only hold the pages that differ from
+     * the function's zygote, which is identified by its memory size and hash. Any other pages are
+     * the zygote's up to baseBytes, and zero beyond.
+     */
+    struct MemorySnapshotHeader {
+        uint32_t magic = SNAPSHOT_MAGIC;
+        uint32_t flags = 0;
+        uint64_t numPages = 0;
+        uint64_t baseBytes = 0;
+        uint64_t baseHash = 0;
+        uint64_t nChunks = 0;
+    };
+
+    /**
+     * A range of memory in a snapshot. Chunks stored with fewer bytes than their length are
+     * compressed.
+     */
+    struct MemorySnapshotChunk {
+        uint64_t offset = 0;
+        uint32_t length = 0;
+        uint32_t storedLength = 0;
+    };
+
+    /**
+     * Snapshot of the given (offset, length) ranges of memory, compressed up front so that its
+     * size is known before it's written, e.g. straight into a state value. Chunks that aren't
+     * compressed are written straight from memory, which mustn't change in the meantime.
+     */
+    class MemorySnapshotWriter {
     public:
-        size_t numPages;
-        std::vector<uint8_t> data;
+        MemorySnapshotWriter(MemorySnapshotHeader headerIn, const uint8_t *memBase,
+                             const std::vector<std::pair<size_t, size_t>> &ranges);
 
-        template<class Archive>
-        void serialize(Archive &ar)  {
-            ar(numPages, data);
-        }
+        size_t size() const;
+
+        void write(std::ostream &outStream) const;
+
+        /**
+         * Writes the snapshot to the buffer, which must hold size() bytes.
+         */
+        void write(uint8_t *buffer) const;
+
+    private:
+        MemorySnapshotHeader header;
+        std::vector<MemorySnapshotChunk> chunks;
+        std::vector<const uint8_t *> chunkData;
+        std::vector<std::vector<uint8_t>> compressedChunks;
     };
+
+    void writeMemorySnapshot(std::ostream &outStream, MemorySnapshotHeader header, const uint8_t *memBase,
+                             const std::vector<std::pair<size_t, size_t>> &ranges);
+
+    MemorySnapshotHeader readMemorySnapshotHeader(std::istream &inStream);
+
+    /**
+     * Reads the chunks following the header into memory, which must already be big enough.
+     */
+    void readMemorySnapshotChunks(std::istream &inStream, const MemorySnapshotHeader &header, uint8_t *memBase,
+                                  size_t memSize);
+
+    /**
+     * Splits ranges of memory into the chunks they'll be stored in.
+     */
+    std::vector<std::pair<size_t, size_t>> getSnapshotChunks(const std::vector<std::pair<size_t, size_t>> &ranges);
 }
 
 #endif
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <wasm/WasmModule.h>
+#include <wasm/openmp/Level.h>
+
+#include <WAVM/Platform/Thread.h>
+#include <WAVM/Runtime/Runtime.h>
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#define OMP_POOL_SPIN_COUNT 4096
+
+constexpr int OMP_STACK_SIZE = 2 * (ONE_MB_BYTES);
+
+using namespace WAVM;
+
+namespace wasm {
+    class WAVMWasmModule;
+
+    class OMPThreadPool;
+
+    struct OMPPoolThread {
+        OMPThreadPool *pool = nullptr;
+        int threadNum = 0;
+        uint32_t startEpoch = 0;
+        Platform::Thread *thread = nullptr;
+
+        U32 stackTop = 0;
+        Runtime::GCPointer<Runtime::Context> context;
+    };
+
+    /**
+     * Team of threads kept parked between local OpenMP parallel regions, so that short
+     * regions don't pay for creating and joining threads on every fork. Each thread keeps
+     * its own wasm stack and context for the life of the pool.
+     *
+     * Threads spin for a while waiting for the next region before blocking, as regions often
+     * come in quick succession. The forking thread waits for the team in the same way.
+     */
+    class OMPThreadPool {
+    public:
+        OMPThreadPool(WAVMWasmModule *module, Runtime::Compartment *compartment);
+
+        ~OMPThreadPool();
+
+        /**
+         * Runs the microtask on the first threads in the pool (one per set of arguments),
+         * returning the number of threads that failed. Must be called holding the region
+         * mutex.
+         */
+        int64_t runRegion(message::Message *parentCall, Runtime::Function *func,
+                          std::vector<std::vector<IR::UntaggedValue>> &funcArgs,
+                          const std::shared_ptr<openmp::OMPLevel> &level);
+
+        /**
+         * Held by the thread running a region. Forks that can't take it (e.g. from within
+         * a region) must start their own threads.
+         */
+        std::mutex &getRegionMutex();
+
+        int getThreadCount();
+
+        void shutdown();
+
+    private:
+        WAVMWasmModule *module;
+        Runtime::Compartment *compartment;
+
+        std::mutex regionMx;
+        std::vector<std::unique_ptr<OMPPoolThread>> threads;
+
+        // Set up by the forking thread before bumping the epoch, and left alone until every
+        // thread in the pool has acknowledged that epoch
+        message::Message *regionCall = nullptr;
+        Runtime::Function *regionFunc = nullptr;
+        std::vector<std::vector<IR::UntaggedValue>> *regionArgs = nullptr;
+        std::shared_ptr<openmp::OMPLevel> regionLevel;
+        int regionSize = 0;
+        bool isShutdown = false;
+
+        // Threads only sleep on the futexes after spinning, so wakes are skipped when nobody
+        // is asleep
+        std::atomic<uint32_t> regionEpoch{0};
+        std::atomic<int> regionWaiters{0};
+        std::atomic<int> remaining{0};
+        std::atomic<uint32_t> doneEpoch{0};
+        std::atomic<int> doneWaiters{0};
+        std::atomic<int64_t> regionErrors{0};
+
+        static int64_t threadEntry(void *threadPtr);
+
+        void addThread();
+
+        void runThread(OMPPoolThread &thread);
+
+        void finishThread();
+    };
+}
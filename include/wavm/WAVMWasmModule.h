@@ -1,6 +1,7 @@
 #pragma once
 
 #include <wasm/WasmModule.h>
+#include <wasm/openmp/Critical.h>
 
 #include <WAVM/Runtime/Intrinsics.h>
 #include <WAVM/Runtime/Linker.h>
@@ -17,6 +18,8 @@ namespace wasm {
 
     struct WasmThreadSpec;
 
+    class OMPThreadPool;
+
     class WAVMWasmModule : public WasmModule, Runtime::Resolver {
     public:
         WAVMWasmModule();
@@ -38,6 +41,13 @@ namespace wasm {
 
         bool tearDown();
 
+        /**
+         * Puts the module back to the state of its zygote after a call. With the dirty reset mode,
+         * a module whose memory is mapped from the zygote's keeps its compartment and only has the
+         * pages dirtied by the call restored. Otherwise it's cloned from the zygote again.
+         */
+        void resetFromZygote(const WAVMWasmModule &zygote);
+
         // ----- Memory management -----
         uint32_t mmapMemory(uint32_t length);
 
@@ -47,6 +57,8 @@ namespace wasm {
 
         uint32_t mmapKey(const std::shared_ptr<state::StateKeyValue> &kv, long offset, uint32_t length);
 
+        size_t getMemorySizeBytes();
+
         // ----- Environment variables
         void writeWasmEnvToMemory(uint32_t envPointers, uint32_t envBuffer) override;
 
@@ -90,6 +102,10 @@ namespace wasm {
         // ----- Threading -----
         int64_t executeThread(WasmThreadSpec &spec);
 
+        OMPThreadPool &getOMPThreadPool();
+
+        openmp::OMPCriticalSections &getOMPCriticalSections();
+
         // ----- Disassembly -----
         std::map<std::string, std::string> buildDisassemblyMap();
 
@@ -113,7 +129,7 @@ namespace wasm {
         int getDataOffsetFromGOT(const std::string &name);
 
     protected:
-        void doSnapshot(std::ostream &outStream) override;
+        MemorySnapshotWriter prepareSnapshot() override;
 
         void doRestore(std::istream &inStream) override;
 
@@ -130,10 +146,24 @@ namespace wasm {
 
         int memoryFd = -1;
         size_t memoryFdSize = 0;
+        bool ownsMemoryFd = false;
+
+        // Identifies the contents written to the memory fd, as fd numbers are reused
+        uint64_t memoryFdId = 0;
+
+        // Hash of the memory fd's contents, to check snapshot diffs are applied to the same zygote
+        uint64_t memoryFdHash = 0;
 
         bool _isBound = false;
         bool boundIsTypescript = false;
 
+        // Persistent team for OpenMP regions, created on the first fork
+        std::mutex ompThreadPoolMx;
+        std::unique_ptr<OMPThreadPool> ompThreadPool;
+
+        // Shared by all teams, as critical sections exclude every thread in the program
+        openmp::OMPCriticalSections ompCriticalSections;
+
         // Shared memory regions
         std::unordered_map<std::string, I32> sharedMemWasmPtrs;
 
@@ -152,6 +182,10 @@ namespace wasm {
 
         void clone(const WAVMWasmModule &other);
 
+        bool canResetDirtyPages(const WAVMWasmModule &zygote);
+
+        size_t resetDirtyPages(const WAVMWasmModule &zygote);
+
         void addModuleToGOT(IR::Module &mod, bool isMainModule);
 
         void executeZygoteFunction();
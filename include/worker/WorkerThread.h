@@ -6,6 +6,7 @@
 #include <wavm/WAVMWasmModule.h>
 #include <scheduler/Scheduler.h>
 
+#include <functional>
 #include <string>
 
 namespace worker {
@@ -15,10 +16,12 @@ namespace worker {
 
         void bindToFunction(const message::Message &msg, bool force = false);
 
-        void run();
+        void run(const std::function<bool()> &isShutdown = [] { return false; });
 
         const bool isBound();
 
+        void unbind();
+
         std::string processNextMessage();
 
         void finish();
@@ -35,6 +38,16 @@ namespace worker {
 
         message::Message boundMessage;
 
+        // Function whose module is still loaded after unbinding
+        std::string lastFuncStr;
+
+        // Whether the module is in the state of its function's base zygote, rather than
+        // holding a call's memory or a snapshot's
+        bool moduleIsBase = false;
+
+        // Bind messages sent directly to this thread while it's idle
+        std::shared_ptr<scheduler::InMemoryMessageQueue> inbox;
+
         int executionCount;
 
         scheduler::Scheduler &scheduler;
@@ -43,6 +56,8 @@ namespace worker {
 
         scheduler::GlobalMessageBus &globalBus;
 
+        message::Message nextBindMessage(int timeoutMs);
+
         std::string executeCall(message::Message &msg);
 
         void finishCall(message::Message &msg, bool success, const std::string &errorMsg);
@@ -2,6 +2,7 @@
 
 #include <scheduler/Scheduler.h>
 #include <util/queue.h>
+#include <util/timing.h>
 
 namespace worker {
     class WorkerThreadPool {
@@ -24,6 +25,10 @@ namespace worker {
 
         int getThreadCount();
 
+        long getIngressCount();
+
+        double getIngressRate();
+
         bool isShutdown();
 
         void shutdown();
@@ -35,7 +40,9 @@ namespace worker {
         util::TokenPool threadTokenPool;
 
         std::thread stateThread;
-        std::thread globalQueueThread;
+        std::vector<std::thread> globalQueueThreads;
+        std::atomic<long> ingressCount;
+        util::TimePoint ingressStart;
         std::thread sharingQueueThread;
         std::thread mpiThread;
         std::thread poolThread;
@@ -40,6 +40,8 @@ faasmpi_datatype_t *getFaasmDatatypeFromId(int datatypeId) {
             return MPI_DOUBLE;
         case FAASMPI_CHAR:
             return MPI_CHAR;
+        case FAASMPI_UINT64_T:
+            return MPI_UINT64_T;
         default:
             throw std::runtime_error("Unrecognised datatype ID\n");
     }
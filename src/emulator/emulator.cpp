@@ -9,6 +9,7 @@ extern "C" {
 #include <util/locks.h>
 #include <util/logging.h>
 #include <redis/Redis.h>
+#include <state/RedisStateKeyValue.h>
 #include <state/State.h>
 #include <thread>
 #include <util/state.h>
@@ -208,8 +209,7 @@ unsigned int __faasm_write_state_from_file(const char *key, const char *filePath
 
     // Write to state
     const std::string actualKey = util::keyForUser(getEmulatorUser(), key);
-    redis::Redis &redis = redis::Redis::getState();
-    redis.set(actualKey, bytes);
+    state::RedisStateKeyValue::setRemote(actualKey, bytes);
 
     return bytes.size();
 }
@@ -0,0 +1,184 @@
+#include "CodeCache.h"
+#include "IRModuleCache.h"
+
+#include <util/config.h>
+#include <util/hash.h>
+#include <util/locks.h>
+#include <util/logging.h>
+
+#include <boost/filesystem.hpp>
+
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+
+// Set by the build
+#ifndef FAASM_LLVM_VERSION
+#define FAASM_LLVM_VERSION ""
+#endif
+
+#ifndef FAASM_WAVM_REVISION
+#define FAASM_WAVM_REVISION ""
+#endif
+
+namespace wasm {
+    CodeCache &getCodeCache() {
+        static CodeCache c;
+        return c;
+    }
+
+    static std::string getHostCpuDescription() {
+        // Compiled code is specific to the CPU model and the extensions it supports
+        std::ifstream cpuInfo("/proc/cpuinfo");
+        std::string modelName;
+        std::string flags;
+
+        std::string line;
+        while (std::getline(cpuInfo, line)) {
+            if (modelName.empty() && line.rfind("model name", 0) == 0) {
+                modelName = line;
+            } else if (flags.empty() && line.rfind("flags", 0) == 0) {
+                flags = line;
+            }
+
+            if (!modelName.empty() && !flags.empty()) {
+                break;
+            }
+        }
+
+        return modelName + "\n" + flags;
+    }
+
+    std::string getCodeCacheKey(const std::vector<uint8_t> &wasmBytes) {
+        static const std::string compileParams = std::string("version=") + CODE_CACHE_VERSION +
+                                                 ";llvm=" + FAASM_LLVM_VERSION +
+                                                 ";wavm=" + FAASM_WAVM_REVISION +
+                                                 ";simd=1;atomics=1" +
+                                                 ";memory=" + std::to_string((U64) MAX_MEMORY_PAGES) +
+                                                 ";table=" + std::to_string((U64) MAX_TABLE_SIZE) +
+                                                 ";" + getHostCpuDescription();
+
+        std::string wasmHash = util::bytesToSHA1(wasmBytes);
+        return util::hashToHex(util::stringToSHA1(wasmHash + compileParams));
+    }
+
+    CodeCache::~CodeCache() {
+        waitForPending();
+    }
+
+    bool CodeCache::isEnabled() {
+        return util::getSystemConfig().codeCacheMode == "on";
+    }
+
+    std::string CodeCache::getObjectPath(const std::string &key) {
+        return util::getSystemConfig().codeCacheDir + "/" + key + ".o";
+    }
+
+    std::vector<uint8_t> CodeCache::load(const std::string &key) {
+        const std::shared_ptr<spdlog::logger> &logger = util::getLogger();
+        const std::string path = getObjectPath(key);
+
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return {};
+        }
+
+        struct stat st{};
+        if (fstat(fd, &st) != 0 || st.st_size == 0) {
+            close(fd);
+            return {};
+        }
+
+        size_t nBytes = st.st_size;
+        void *mapped = mmap(nullptr, nBytes, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+
+        if (mapped == MAP_FAILED) {
+            logger->warn("Failed to map cached object code at {} ({})", path, strerror(errno));
+            return {};
+        }
+
+        // WAVM takes the object code as a vector, so this is the one copy we make of it
+        madvise(mapped, nBytes, MADV_SEQUENTIAL);
+        auto bytePtr = static_cast<uint8_t *>(mapped);
+        std::vector<uint8_t> objectCode(bytePtr, bytePtr + nBytes);
+        munmap(mapped, nBytes);
+
+        return objectCode;
+    }
+
+    void CodeCache::store(const std::string &key, const std::vector<uint8_t> &objectCode) {
+        static std::atomic<int> tmpCounter(0);
+
+        const std::string path = getObjectPath(key);
+        boost::filesystem::create_directories(util::getSystemConfig().codeCacheDir);
+
+        const std::string tmpPath = path + ".tmp" + std::to_string(getpid()) + "_" + std::to_string(tmpCounter++);
+        int fd = open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) {
+            throw std::runtime_error("Could not open " + tmpPath + " to cache object code");
+        }
+
+        size_t written = 0;
+        while (written < objectCode.size()) {
+            ssize_t res = write(fd, objectCode.data() + written, objectCode.size() - written);
+            if (res < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                break;
+            }
+            written += res;
+        }
+
+        // Make sure it's all on disk before it becomes visible
+        bool success = written == objectCode.size() && fsync(fd) == 0;
+        close(fd);
+
+        if (!success || rename(tmpPath.c_str(), path.c_str()) != 0) {
+            unlink(tmpPath.c_str());
+            throw std::runtime_error("Failed to write cached object code to " + path);
+        }
+    }
+
+    void CodeCache::storeAsync(const std::string &key, const std::function<std::vector<uint8_t>()> &getObjectCode) {
+        {
+            util::UniqueLock lock(mx);
+            if (pendingKeys.count(key) > 0) {
+                return;
+            }
+            pendingKeys.insert(key);
+        }
+
+        std::thread([this, key, getObjectCode] {
+            const std::shared_ptr<spdlog::logger> &logger = util::getLogger();
+
+            try {
+                store(key, getObjectCode());
+                logger->debug("Cached object code {}", key);
+            } catch (std::exception &e) {
+                logger->warn("Failed to cache object code {}: {}", key, e.what());
+            }
+
+            // Notify under the lock, as waiters may destroy the cache as soon as they wake
+            util::UniqueLock lock(mx);
+            pendingKeys.erase(key);
+            cv.notify_all();
+        }).detach();
+    }
+
+    void CodeCache::remove(const std::string &key) {
+        unlink(getObjectPath(key).c_str());
+    }
+
+    void CodeCache::waitForPending() {
+        util::UniqueLock lock(mx);
+        cv.wait(lock, [this] { return pendingKeys.empty(); });
+    }
+}
@@ -1,4 +1,5 @@
 #include "IRModuleCache.h"
+#include "CodeCache.h"
 
 #include <util/locks.h>
 #include <util/logging.h>
@@ -89,7 +90,7 @@ namespace wasm {
                 if (!objectFileBytes.empty()) {
                     compiledModuleMap[key] = Runtime::loadPrecompiledModule(module, objectFileBytes);
                 } else {
-                    compiledModuleMap[key] = Runtime::compileModule(module);
+                    compiledModuleMap[key] = compileMainModule(key, module);
                 }
             }
         } else {
@@ -99,6 +100,32 @@ namespace wasm {
         return compiledModuleMap[key];
     }
 
+    Runtime::ModuleRef IRModuleCache::compileMainModule(const std::string &key, IR::Module &module) {
+        const std::shared_ptr<spdlog::logger> &logger = util::getLogger();
+        CodeCache &codeCache = getCodeCache();
+
+        auto codeKeyIt = codeCacheKeys.find(key);
+        if (!codeCache.isEnabled() || codeKeyIt == codeCacheKeys.end()) {
+            return Runtime::compileModule(module);
+        }
+
+        const std::string codeKey = codeKeyIt->second;
+        std::vector<uint8_t> cachedObjectCode = codeCache.load(codeKey);
+        if (!cachedObjectCode.empty()) {
+            logger->debug("Loading main module {} from code cache ({})", key, codeKey);
+            return Runtime::loadPrecompiledModule(module, cachedObjectCode);
+        }
+
+        // Nothing else can run the module, so compile it here and write it out in the background
+        logger->debug("Compiling main module {} (not in code cache)", key);
+        Runtime::ModuleRef compiledModule = Runtime::compileModule(module);
+        codeCache.storeAsync(codeKey, [compiledModule] {
+            return Runtime::getObjectCode(compiledModule);
+        });
+
+        return compiledModule;
+    }
+
     Runtime::ModuleRef IRModuleCache::getCompiledSharedModule(const std::string &user, const std::string &func,
                                                                  const std::string &path) {
         std::string key = getModuleKey(user, func, path);
@@ -152,6 +179,10 @@ namespace wasm {
                     WAST::reportParseErrors("wast_file", (const char *) wasmBytes.data(), parseErrors);
                 }
 
+                if (getCodeCache().isEnabled()) {
+                    codeCacheKeys[key] = getCodeCacheKey(wasmBytes);
+                }
+
                 // Force maximum size
                 module.memories.defs[0].type.size.max = (U64) MAX_MEMORY_PAGES;
 
@@ -3,6 +3,7 @@
 #include <util/locks.h>
 #include <util/func.h>
 #include <util/config.h>
+#include <util/logging.h>
 #include <sys/mman.h>
 
 namespace module_cache {
@@ -12,13 +13,25 @@ namespace module_cache {
     }
 
     size_t WasmModuleCache::getTotalCachedModuleCount() {
+        util::SharedLock lock(mx);
         return cachedModuleMap.size();
     }
 
-    int WasmModuleCache::getCachedModuleCount(const std::string &key) {
+    size_t WasmModuleCache::getTotalCachedBytes() {
         util::SharedLock lock(mx);
-        int count = cachedModuleMap.count(key);
-        return count;
+        return totalBytes;
+    }
+
+    long WasmModuleCache::getHitCount() {
+        return hits;
+    }
+
+    long WasmModuleCache::getMissCount() {
+        return misses;
+    }
+
+    long WasmModuleCache::getEvictionCount() {
+        return evictions;
     }
 
     std::string WasmModuleCache::getBaseCachedModuleKey(const message::Message &msg) {
@@ -35,64 +48,148 @@ namespace module_cache {
         }
     }
 
+    std::shared_ptr<wasm::WAVMWasmModule> WasmModuleCache::getOrCreate(
+            const std::string &key,
+            const std::function<std::shared_ptr<wasm::WAVMWasmModule>()> &create
+    ) {
+        std::shared_ptr<CacheEntry> entry;
+        {
+            util::SharedLock lock(mx);
+            auto it = cachedModuleMap.find(key);
+            if (it != cachedModuleMap.end() && it->second->module != nullptr) {
+                it->second->lastUsed = ++useCounter;
+                hits++;
+                return it->second->module;
+            }
+        }
+
+        {
+            util::FullLock lock(mx);
+            std::shared_ptr<CacheEntry> &existing = cachedModuleMap[key];
+            if (existing == nullptr) {
+                existing = std::make_shared<CacheEntry>();
+            }
+            entry = existing;
+        }
+
+        // Build outside the cache lock so other zygotes can be used in the meantime. Only
+        // one thread builds each
+        util::UniqueLock entryLock(entry->mx);
+        if (entry->module != nullptr) {
+            entry->lastUsed = ++useCounter;
+            hits++;
+            return entry->module;
+        }
+
+        misses++;
+        std::shared_ptr<wasm::WAVMWasmModule> module;
+        try {
+            module = create();
+        } catch (std::exception &e) {
+            util::FullLock lock(mx);
+            auto it = cachedModuleMap.find(key);
+            if (it != cachedModuleMap.end() && it->second == entry) {
+                cachedModuleMap.erase(it);
+            }
+            throw;
+        }
+
+        // Charge for the zygote's memory and the copy in its memfd. Not cached if cleared since
+        util::FullLock lock(mx);
+        auto it = cachedModuleMap.find(key);
+        if (it != cachedModuleMap.end() && it->second == entry) {
+            entry->module = module;
+            entry->lastUsed = ++useCounter;
+            entry->bytes = 2 * module->getMemorySizeBytes();
+            totalBytes += entry->bytes;
+            evict();
+        }
+
+        return module;
+    }
+
+    void WasmModuleCache::evict() {
+        const std::shared_ptr<spdlog::logger> &logger = util::getLogger();
+        util::SystemConfig &conf = util::getSystemConfig();
+        size_t maxBytes = (size_t) conf.moduleCacheMaxMb * ONE_MB_BYTES;
+
+        while (totalBytes > maxBytes) {
+            // Find the least recently used zygote that no one else holds
+            auto lru = cachedModuleMap.end();
+            for (auto it = cachedModuleMap.begin(); it != cachedModuleMap.end(); it++) {
+                const std::shared_ptr<CacheEntry> &entry = it->second;
+                bool inUse = entry->module == nullptr || entry->module.use_count() > 1;
+                if (inUse) {
+                    continue;
+                }
+
+                if (lru == cachedModuleMap.end() || entry->lastUsed < lru->second->lastUsed) {
+                    lru = it;
+                }
+            }
+
+            if (lru == cachedModuleMap.end()) {
+                logger->warn("Module cache over limit ({} bytes) but all zygotes in use", totalBytes);
+                return;
+            }
+
+            logger->debug("Evicting zygote {} ({} bytes)", lru->first, lru->second->bytes);
+            totalBytes -= lru->second->bytes;
+            cachedModuleMap.erase(lru);
+            evictions++;
+        }
+    }
+
     /**
      * There are two kinds of cached module here, the "base" cached module, i.e. the
      * default module with its zygote function executed, (same for all instances),
      * or one of many "special" cached modules, those restored from snapshots captured at
      * arbitrary points (e.g. when spawning a thread).
      */
-    wasm::WAVMWasmModule &WasmModuleCache::getCachedModule(const message::Message &msg) {
+    std::shared_ptr<wasm::WAVMWasmModule> WasmModuleCache::getCachedModule(const message::Message &msg) {
         const std::shared_ptr<spdlog::logger> &logger = util::getLogger();
 
         // Get the keys for both types of cached module
         const std::string baseKey = getBaseCachedModuleKey(msg);
         const std::string specialKey = getCachedModuleKey(msg);
 
-        // Check for the base cached module
-        if (getCachedModuleCount(baseKey) == 0) {
-            util::FullLock lock(mx);
-            if (cachedModuleMap.count(baseKey) == 0) {
-                // Instantiate the base module
-                logger->debug("Creating new base zygote: {}", baseKey);
-                wasm::WAVMWasmModule &module = cachedModuleMap[baseKey];
-                module.bindToFunction(msg);
-
-                // Write memory to fd (to allow copy-on-write cloning)
-                int fd = memfd_create(baseKey.c_str(), 0);
-                module.writeMemoryToFd(fd);
-            }
-        }
+        std::shared_ptr<wasm::WAVMWasmModule> baseModule = getOrCreate(baseKey, [&msg, &baseKey, &logger] {
+            // Instantiate the base module
+            logger->debug("Creating new base zygote: {}", baseKey);
+            auto module = std::make_shared<wasm::WAVMWasmModule>();
+            module->bindToFunction(msg);
+
+            // Write memory to fd (to allow copy-on-write cloning)
+            int fd = memfd_create(baseKey.c_str(), 0);
+            module->writeMemoryToFd(fd);
+
+            return module;
+        });
 
         // Stop now if we're just looking for the base cached module
-        if(specialKey == baseKey) {
-            return cachedModuleMap[baseKey];
+        if (specialKey == baseKey) {
+            return baseModule;
         }
 
-        // See if we already have the special cached module
-        if (getCachedModuleCount(specialKey) == 0) {
-            util::FullLock lock(mx);
-            if (cachedModuleMap.count(specialKey) == 0) {
-                // Get the base module and the special module
-                logger->debug("Creating new special zygote: {}", specialKey);
-                wasm::WAVMWasmModule &baseModule = cachedModuleMap[baseKey];
-                wasm::WAVMWasmModule &specialModule = cachedModuleMap[specialKey];
-
-                // Clone the special module from the base one
-                specialModule = baseModule;
+        return getOrCreate(specialKey, [&msg, &specialKey, &baseModule, &logger] {
+            // Clone the special module from the base one
+            logger->debug("Creating new special zygote: {}", specialKey);
+            auto module = std::make_shared<wasm::WAVMWasmModule>(*baseModule);
 
-                // Restore the special module
-                specialModule.restoreFromState(specialKey, msg.snapshotsize());
+            // Restore the special module
+            module->restoreFromState(specialKey, msg.snapshotsize());
 
-                // Write memory to fd
-                int fd = memfd_create(specialKey.c_str(), 0);
-                specialModule.writeMemoryToFd(fd);
-            }
-        }
+            // Write memory to fd
+            int fd = memfd_create(specialKey.c_str(), 0);
+            module->writeMemoryToFd(fd);
 
-        return cachedModuleMap[specialKey];
+            return module;
+        });
     }
 
     void WasmModuleCache::clear() {
+        util::FullLock lock(mx);
         cachedModuleMap.clear();
+        totalBytes = 0;
     }
-}
\ No newline at end of file
+}
@@ -0,0 +1,281 @@
+#include "WasmModulePool.h"
+#include "WasmModuleCache.h"
+
+#include <util/config.h>
+#include <util/locks.h>
+#include <util/logging.h>
+#include <util/timing.h>
+
+#include <algorithm>
+#include <cmath>
+
+namespace module_cache {
+    WasmModulePool &getWasmModulePool() {
+        static WasmModulePool p;
+        return p;
+    }
+
+    int getModulePoolTarget(double claimsPerSec, double cloneMillis, int maxSize) {
+        // Cover claims arriving while an instance is cloned and before the manager next runs
+        double refillSecs = (cloneMillis + MODULE_POOL_REFILL_INTERVAL_MS) / 1000.0;
+        int target = (int) std::ceil(claimsPerSec * refillSecs);
+
+        return std::min(std::max(target, 1), maxSize);
+    }
+
+    std::string WasmModulePool::getPoolKey(const message::Message &msg) {
+        return msg.user() + "/" + msg.function();
+    }
+
+    WasmModulePool::FunctionPool &WasmModulePool::getPool(const std::string &key, const message::Message &msg) {
+        auto it = pools.find(key);
+        if (it != pools.end()) {
+            return it->second;
+        }
+
+        util::Clock &clock = util::getGlobalClock();
+        util::TimePoint now = clock.now();
+
+        FunctionPool &pool = pools[key];
+        pool.msg = msg;
+        pool.windowStart = now;
+        pool.lastSeen = now;
+
+        return pool;
+    }
+
+    std::unique_ptr<wasm::WAVMWasmModule> WasmModulePool::claim(const message::Message &msg) {
+        // Only base zygotes are pooled, special ones are for one-off restores
+        util::SystemConfig &conf = util::getSystemConfig();
+        if (conf.modulePoolSize <= 0 || !msg.snapshotkey().empty()) {
+            return nullptr;
+        }
+
+        std::unique_ptr<wasm::WAVMWasmModule> module;
+        {
+            util::UniqueLock lock(mx);
+            FunctionPool &pool = getPool(getPoolKey(msg), msg);
+            pool.windowClaims++;
+            pool.lastSeen = util::getGlobalClock().now();
+
+            if (!pool.ready.empty()) {
+                module = std::move(pool.ready.front());
+                pool.ready.pop_front();
+            }
+        }
+
+        // Wake the manager to replace it
+        cv.notify_one();
+
+        return module;
+    }
+
+    void WasmModulePool::notifyCall(const message::Message &msg) {
+        util::SystemConfig &conf = util::getSystemConfig();
+        if (conf.modulePoolSize <= 0 || !msg.snapshotkey().empty()) {
+            return;
+        }
+
+        bool isNew;
+        {
+            util::UniqueLock lock(mx);
+            const std::string key = getPoolKey(msg);
+            isNew = pools.count(key) == 0;
+
+            FunctionPool &pool = getPool(key, msg);
+            pool.lastSeen = util::getGlobalClock().now();
+        }
+
+        if (isNew) {
+            cv.notify_one();
+        }
+    }
+
+    void WasmModulePool::refill() {
+        const std::shared_ptr<spdlog::logger> &logger = util::getLogger();
+        util::SystemConfig &conf = util::getSystemConfig();
+        util::Clock &clock = util::getGlobalClock();
+
+        // Tearing down instances is slow, so evicted ones are destroyed after releasing the lock
+        std::vector<std::unique_ptr<wasm::WAVMWasmModule>> evicted;
+        {
+            util::UniqueLock lock(mx);
+            util::TimePoint now = clock.now();
+            for (auto it = pools.begin(); it != pools.end();) {
+                FunctionPool &pool = it->second;
+
+                if (clock.timeDiff(now, pool.lastSeen) > MODULE_POOL_IDLE_MS) {
+                    logger->debug("Dropping {} idle instances of {}", pool.ready.size(), it->first);
+                    takeInstances(pool, evicted);
+                    it = pools.erase(it);
+                    continue;
+                }
+
+                // Smooth the claim rate over windows
+                long windowMillis = clock.timeDiff(now, pool.windowStart);
+                if (windowMillis >= MODULE_POOL_RATE_WINDOW_MS) {
+                    double windowRate = (double) pool.windowClaims * 1000.0 / (double) windowMillis;
+                    pool.claimsPerSec = (pool.claimsPerSec + windowRate) / 2;
+                    pool.windowClaims = 0;
+                    pool.windowStart = now;
+                }
+
+                pool.target = getModulePoolTarget(pool.claimsPerSec, pool.cloneMillis, conf.modulePoolSize);
+                while ((int) pool.ready.size() > pool.target) {
+                    evicted.push_back(std::move(pool.ready.back()));
+                    pool.ready.pop_back();
+                }
+
+                it++;
+            }
+        }
+
+        evicted.clear();
+
+        while (refillOne()) {
+        }
+    }
+
+    bool WasmModulePool::refillOne() {
+        const std::shared_ptr<spdlog::logger> &logger = util::getLogger();
+
+        // Fill the emptiest pool first
+        std::string key;
+        message::Message msg;
+        {
+            util::UniqueLock lock(mx);
+            if (_shutdown) {
+                return false;
+            }
+
+            int maxDeficit = 0;
+            for (auto &p : pools) {
+                int deficit = p.second.target - (int) p.second.ready.size();
+                if (deficit > maxDeficit) {
+                    maxDeficit = deficit;
+                    key = p.first;
+                }
+            }
+
+            if (key.empty()) {
+                return false;
+            }
+
+            msg = pools[key].msg;
+        }
+
+        // Clone without holding the lock, building the zygote if need be
+        std::unique_ptr<wasm::WAVMWasmModule> module;
+        util::TimePoint cloneStart = util::startTimer();
+        try {
+            std::shared_ptr<wasm::WAVMWasmModule> zygote = getWasmModuleCache().getCachedModule(msg);
+            module = std::make_unique<wasm::WAVMWasmModule>(*zygote);
+        } catch (std::exception &e) {
+            logger->error("Failed to create pooled instance of {}: {}", key, e.what());
+
+            // Declared before the lock, so they're destroyed after it's released
+            std::vector<std::unique_ptr<wasm::WAVMWasmModule>> evicted;
+            util::UniqueLock lock(mx);
+            auto it = pools.find(key);
+            if (it != pools.end()) {
+                takeInstances(it->second, evicted);
+                pools.erase(it);
+            }
+
+            return true;
+        }
+        double cloneMillis = util::getTimeDiffMillis(cloneStart);
+
+        // The lock is declared after the instance, so an instance that isn't kept is destroyed
+        // after releasing it
+        util::UniqueLock lock(mx);
+        auto it = pools.find(key);
+        if (it == pools.end()) {
+            return true;
+        }
+
+        FunctionPool &pool = it->second;
+        pool.cloneMillis = pool.cloneMillis == 0 ? cloneMillis : (pool.cloneMillis + cloneMillis) / 2;
+        if ((int) pool.ready.size() < pool.target) {
+            pool.ready.push_back(std::move(module));
+        }
+
+        return true;
+    }
+
+    void WasmModulePool::start() {
+        const std::shared_ptr<spdlog::logger> &logger = util::getLogger();
+        util::SystemConfig &conf = util::getSystemConfig();
+        if (conf.modulePoolSize <= 0) {
+            logger->info("Not pooling module instances");
+            return;
+        }
+
+        logger->info("Starting module pool manager (up to {} instances per function)", conf.modulePoolSize);
+
+        {
+            util::UniqueLock lock(mx);
+            _shutdown = false;
+        }
+
+        managerThread = std::thread([this] {
+            while (true) {
+                {
+                    util::UniqueLock lock(mx);
+                    if (_shutdown) {
+                        break;
+                    }
+
+                    cv.wait_for(lock, std::chrono::milliseconds(MODULE_POOL_REFILL_INTERVAL_MS));
+                    if (_shutdown) {
+                        break;
+                    }
+                }
+
+                refill();
+            }
+        });
+    }
+
+    void WasmModulePool::shutdown() {
+        {
+            util::UniqueLock lock(mx);
+            _shutdown = true;
+        }
+        cv.notify_all();
+
+        if (managerThread.joinable()) {
+            managerThread.join();
+        }
+    }
+
+    size_t WasmModulePool::getReadyCount(const message::Message &msg) {
+        util::UniqueLock lock(mx);
+        auto it = pools.find(getPoolKey(msg));
+        return it == pools.end() ? 0 : it->second.ready.size();
+    }
+
+    int WasmModulePool::getTargetSize(const message::Message &msg) {
+        util::UniqueLock lock(mx);
+        auto it = pools.find(getPoolKey(msg));
+        return it == pools.end() ? 0 : it->second.target;
+    }
+
+    void WasmModulePool::takeInstances(FunctionPool &pool, std::vector<std::unique_ptr<wasm::WAVMWasmModule>> &out) {
+        for (auto &m : pool.ready) {
+            out.push_back(std::move(m));
+        }
+        pool.ready.clear();
+    }
+
+    void WasmModulePool::clear() {
+        std::vector<std::unique_ptr<wasm::WAVMWasmModule>> evicted;
+        {
+            util::UniqueLock lock(mx);
+            for (auto &p : pools) {
+                takeInstances(p.second, evicted);
+            }
+            pools.clear();
+        }
+    }
+}
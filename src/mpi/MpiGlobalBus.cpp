@@ -30,7 +30,12 @@ namespace mpi {
         std::string queueName = getMpiQueueNameForNode(otherNodeId);
         auto m = new MpiMessage;
         redis.dequeueBytes(queueName, BYTES(m), sizeof(MpiMessage), MPI_MESSAGE_TIMEOUT_MS);
-        
+
+        // Data for messages on the bus is always in state
+        m->payload = PAYLOAD_STATE;
+        m->buffer = nullptr;
+        m->bufferSize = 0;
+
         return m;
     }
     
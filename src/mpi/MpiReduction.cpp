@@ -0,0 +1,218 @@
+#include "mpi/MpiReduction.h"
+
+#include <util/logging.h>
+
+#include <algorithm>
+#include <stdexcept>
+#include <type_traits>
+
+#if defined(__SSE2__)
+
+#include <immintrin.h>
+
+#endif
+
+#define MAX_OP_ID FAASMPI_OP_MINLOC
+#define MAX_DATATYPE_ID FAASMPI_UINT64_T
+
+namespace mpi {
+    template<typename T>
+    struct SumOp {
+        static T apply(T a, T b) { return a + b; }
+    };
+
+    template<typename T>
+    struct ProdOp {
+        static T apply(T a, T b) { return a * b; }
+    };
+
+    template<typename T>
+    struct MaxOp {
+        static T apply(T a, T b) { return std::max(a, b); }
+    };
+
+    template<typename T>
+    struct MinOp {
+        static T apply(T a, T b) { return std::min(a, b); }
+    };
+
+    template<typename T>
+    struct LandOp {
+        static T apply(T a, T b) { return a && b; }
+    };
+
+    template<typename T>
+    struct LorOp {
+        static T apply(T a, T b) { return a || b; }
+    };
+
+    template<typename T>
+    struct BandOp {
+        static T apply(T a, T b) { return a & b; }
+    };
+
+    template<typename T>
+    struct BorOp {
+        static T apply(T a, T b) { return a | b; }
+    };
+
+    /**
+     * Vector version of an op, where the instruction set has one. Kernels fall back to the
+     * scalar op for anything without a specialisation here, and for the tail of the buffer.
+     */
+    template<typename T, typename Op>
+    struct SimdOp {
+        static constexpr int width = 0;
+    };
+
+#define SIMD_OP(T, OP, VEC, WIDTH, LOAD, STORE, APPLY)              \
+    template<>                                                      \
+    struct SimdOp<T, OP<T>> {                                       \
+        static constexpr int width = WIDTH;                         \
+        static VEC load(const T *p) { return LOAD; }                \
+        static void store(T *p, VEC v) { STORE; }                   \
+        static VEC apply(VEC a, VEC b) { return APPLY; }            \
+    };
+
+#if defined(__AVX__)
+    SIMD_OP(float, SumOp, __m256, 8, _mm256_loadu_ps(p), _mm256_storeu_ps(p, v), _mm256_add_ps(a, b))
+    SIMD_OP(float, ProdOp, __m256, 8, _mm256_loadu_ps(p), _mm256_storeu_ps(p, v), _mm256_mul_ps(a, b))
+    SIMD_OP(float, MaxOp, __m256, 8, _mm256_loadu_ps(p), _mm256_storeu_ps(p, v), _mm256_max_ps(a, b))
+    SIMD_OP(float, MinOp, __m256, 8, _mm256_loadu_ps(p), _mm256_storeu_ps(p, v), _mm256_min_ps(a, b))
+
+    SIMD_OP(double, SumOp, __m256d, 4, _mm256_loadu_pd(p), _mm256_storeu_pd(p, v), _mm256_add_pd(a, b))
+    SIMD_OP(double, ProdOp, __m256d, 4, _mm256_loadu_pd(p), _mm256_storeu_pd(p, v), _mm256_mul_pd(a, b))
+    SIMD_OP(double, MaxOp, __m256d, 4, _mm256_loadu_pd(p), _mm256_storeu_pd(p, v), _mm256_max_pd(a, b))
+    SIMD_OP(double, MinOp, __m256d, 4, _mm256_loadu_pd(p), _mm256_storeu_pd(p, v), _mm256_min_pd(a, b))
+#elif defined(__SSE2__)
+    SIMD_OP(float, SumOp, __m128, 4, _mm_loadu_ps(p), _mm_storeu_ps(p, v), _mm_add_ps(a, b))
+    SIMD_OP(float, ProdOp, __m128, 4, _mm_loadu_ps(p), _mm_storeu_ps(p, v), _mm_mul_ps(a, b))
+    SIMD_OP(float, MaxOp, __m128, 4, _mm_loadu_ps(p), _mm_storeu_ps(p, v), _mm_max_ps(a, b))
+    SIMD_OP(float, MinOp, __m128, 4, _mm_loadu_ps(p), _mm_storeu_ps(p, v), _mm_min_ps(a, b))
+
+    SIMD_OP(double, SumOp, __m128d, 2, _mm_loadu_pd(p), _mm_storeu_pd(p, v), _mm_add_pd(a, b))
+    SIMD_OP(double, ProdOp, __m128d, 2, _mm_loadu_pd(p), _mm_storeu_pd(p, v), _mm_mul_pd(a, b))
+    SIMD_OP(double, MaxOp, __m128d, 2, _mm_loadu_pd(p), _mm_storeu_pd(p, v), _mm_max_pd(a, b))
+    SIMD_OP(double, MinOp, __m128d, 2, _mm_loadu_pd(p), _mm_storeu_pd(p, v), _mm_min_pd(a, b))
+#endif
+
+#if defined(__AVX2__)
+#define LOAD_INT_256 _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p))
+#define STORE_INT_256 _mm256_storeu_si256(reinterpret_cast<__m256i *>(p), v)
+    SIMD_OP(int, SumOp, __m256i, 8, LOAD_INT_256, STORE_INT_256, _mm256_add_epi32(a, b))
+    SIMD_OP(int, MaxOp, __m256i, 8, LOAD_INT_256, STORE_INT_256, _mm256_max_epi32(a, b))
+    SIMD_OP(int, MinOp, __m256i, 8, LOAD_INT_256, STORE_INT_256, _mm256_min_epi32(a, b))
+    SIMD_OP(int, BandOp, __m256i, 8, LOAD_INT_256, STORE_INT_256, _mm256_and_si256(a, b))
+    SIMD_OP(int, BorOp, __m256i, 8, LOAD_INT_256, STORE_INT_256, _mm256_or_si256(a, b))
+#elif defined(__SSE2__)
+#define LOAD_INT_128 _mm_loadu_si128(reinterpret_cast<const __m128i *>(p))
+#define STORE_INT_128 _mm_storeu_si128(reinterpret_cast<__m128i *>(p), v)
+    SIMD_OP(int, SumOp, __m128i, 4, LOAD_INT_128, STORE_INT_128, _mm_add_epi32(a, b))
+    SIMD_OP(int, BandOp, __m128i, 4, LOAD_INT_128, STORE_INT_128, _mm_and_si128(a, b))
+    SIMD_OP(int, BorOp, __m128i, 4, LOAD_INT_128, STORE_INT_128, _mm_or_si128(a, b))
+#if defined(__SSE4_1__)
+    SIMD_OP(int, MaxOp, __m128i, 4, LOAD_INT_128, STORE_INT_128, _mm_max_epi32(a, b))
+    SIMD_OP(int, MinOp, __m128i, 4, LOAD_INT_128, STORE_INT_128, _mm_min_epi32(a, b))
+#endif
+#endif
+
+    template<typename T, typename Op>
+    static void reduceKernel(const uint8_t *in, uint8_t *out, int count) {
+        auto inCast = reinterpret_cast<const T *>(in);
+        auto outCast = reinterpret_cast<T *>(out);
+
+        int i = 0;
+        if constexpr (SimdOp<T, Op>::width > 0) {
+            typedef SimdOp<T, Op> Simd;
+            for (; i + Simd::width <= count; i += Simd::width) {
+                Simd::store(outCast + i, Simd::apply(Simd::load(outCast + i), Simd::load(inCast + i)));
+            }
+        }
+
+        for (; i < count; i++) {
+            outCast[i] = Op::apply(outCast[i], inCast[i]);
+        }
+    }
+
+    template<typename T, bool isMax>
+    static void locKernel(const uint8_t *in, uint8_t *out, int count) {
+        auto inCast = reinterpret_cast<const T *>(in);
+        auto outCast = reinterpret_cast<T *>(out);
+
+        // Ties go to the lower location
+        for (int i = 0; i + 1 < count; i += 2) {
+            T inValue = inCast[i];
+            T outValue = outCast[i];
+            bool isBetter = isMax ? inValue > outValue : inValue < outValue;
+            if (isBetter || (inValue == outValue && inCast[i + 1] < outCast[i + 1])) {
+                outCast[i] = inValue;
+                outCast[i + 1] = inCast[i + 1];
+            }
+        }
+    }
+
+    struct KernelTable {
+        MpiReduceKernel kernels[MAX_OP_ID + 1][MAX_DATATYPE_ID + 1] = {};
+        size_t elemSizes[MAX_DATATYPE_ID + 1] = {};
+
+        template<typename T>
+        void addType(int datatypeId) {
+            elemSizes[datatypeId] = sizeof(T);
+
+            kernels[FAASMPI_OP_SUM][datatypeId] = reduceKernel<T, SumOp<T>>;
+            kernels[FAASMPI_OP_PROD][datatypeId] = reduceKernel<T, ProdOp<T>>;
+            kernels[FAASMPI_OP_MAX][datatypeId] = reduceKernel<T, MaxOp<T>>;
+            kernels[FAASMPI_OP_MIN][datatypeId] = reduceKernel<T, MinOp<T>>;
+            kernels[FAASMPI_OP_MAXLOC][datatypeId] = locKernel<T, true>;
+            kernels[FAASMPI_OP_MINLOC][datatypeId] = locKernel<T, false>;
+
+            // Logical and bitwise ops are only defined for integers
+            if constexpr (std::is_integral_v<T>) {
+                kernels[FAASMPI_OP_LAND][datatypeId] = reduceKernel<T, LandOp<T>>;
+                kernels[FAASMPI_OP_LOR][datatypeId] = reduceKernel<T, LorOp<T>>;
+                kernels[FAASMPI_OP_BAND][datatypeId] = reduceKernel<T, BandOp<T>>;
+                kernels[FAASMPI_OP_BOR][datatypeId] = reduceKernel<T, BorOp<T>>;
+            }
+        }
+
+        KernelTable() {
+            addType<int>(FAASMPI_INT);
+            addType<int64_t>(FAASMPI_LONG);
+            addType<long long int>(FAASMPI_LONG_LONG_INT);
+            addType<float>(FAASMPI_FLOAT);
+            addType<double>(FAASMPI_DOUBLE);
+            addType<char>(FAASMPI_CHAR);
+            addType<uint64_t>(FAASMPI_UINT64_T);
+        }
+    };
+
+    MpiReduceKernel getReduceKernel(faasmpi_op_t *operation, faasmpi_datatype_t *datatype) {
+        static const KernelTable table;
+
+        // A long is 4 bytes in wasm but 8 on the host, so it's reduced as whichever integer
+        // matches the size the datatype carries
+        int datatypeId = datatype->id;
+        if (datatypeId == FAASMPI_LONG && datatype->size == sizeof(int32_t)) {
+            datatypeId = FAASMPI_INT;
+        }
+
+        MpiReduceKernel kernel = nullptr;
+        if (operation->id > 0 && operation->id <= MAX_OP_ID && datatypeId > 0 && datatypeId <= MAX_DATATYPE_ID &&
+            table.elemSizes[datatypeId] == (size_t) datatype->size) {
+            kernel = table.kernels[operation->id][datatypeId];
+        }
+
+        if (kernel == nullptr) {
+            util::getLogger()->error("Unsupported reduction (op={}, datatype={}, size={})", operation->id,
+                                     datatype->id, datatype->size);
+            throw std::runtime_error("Unsupported reduction");
+        }
+
+        return kernel;
+    }
+
+    void applyReduceOp(faasmpi_op_t *operation, faasmpi_datatype_t *datatype, int count,
+                       const uint8_t *inBuffer, uint8_t *outBuffer) {
+        getReduceKernel(operation, datatype)(inBuffer, outBuffer, count);
+    }
+}
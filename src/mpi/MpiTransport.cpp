@@ -0,0 +1,292 @@
+#include "mpi/MpiTransport.h"
+#include "mpi/MpiWorldRegistry.h"
+
+#include <redis/Redis.h>
+#include <util/bytes.h>
+#include <util/config.h>
+#include <util/locks.h>
+#include <util/logging.h>
+#include <util/macros.h>
+
+namespace mpi {
+    std::string getMpiEndpointKey(const std::string &nodeId) {
+        return MPI_ENDPOINT_PREFIX + nodeId;
+    }
+
+    MpiTransport &getMpiTransport() {
+        // Must be shared across threads, so that connections and pending data are shared
+        static MpiTransport transport;
+        return transport;
+    }
+
+    MpiServer::MpiServer() : MpiServer(MPI_PORT) {
+
+    }
+
+    MpiServer::MpiServer(int port) : tcp::TCPServer(port, util::getSystemConfig().globalMessageTimeout,
+                                                    util::getSystemConfig().mpiServerThreads) {
+
+    }
+
+    tcp::TCPMessage *MpiServer::handleMessage(tcp::TCPMessage *request) {
+        const std::shared_ptr<spdlog::logger> &logger = util::getLogger();
+
+        if (request->type == tcp::TCPMessageType::MPI_PULL) {
+            // Respond with the data for the given message (empty if not found)
+            MpiPendingPayload payload;
+            if (request->len == sizeof(int)) {
+                int messageId = *reinterpret_cast<int *>(request->buffer);
+                payload = getMpiTransport().takePendingPayload(messageId);
+            }
+
+            // Response takes ownership of the data
+            auto response = new tcp::TCPMessage();
+            response->type = tcp::TCPMessageType::MPI_PULL;
+            response->len = payload.len;
+            response->buffer = payload.data.release();
+
+            return response;
+        }
+
+        if (request->type != tcp::TCPMessageType::MPI_MESSAGE || request->len < sizeof(MpiMessage)) {
+            logger->error("Unexpected MPI request type {} ({} bytes)", request->type, request->len);
+            return nullptr;
+        }
+
+        // Message header is followed by any inline data, which must be copied out of the
+        // receive buffer as it's consumed later
+        auto m = new MpiMessage;
+        std::copy(request->buffer, request->buffer + sizeof(MpiMessage), BYTES(m));
+        m->buffer = nullptr;
+        m->bufferSize = 0;
+
+        size_t dataLen = request->len - sizeof(MpiMessage);
+        if (dataLen > 0) {
+            m->buffer = new uint8_t[dataLen];
+            m->bufferSize = dataLen;
+            std::copy(request->buffer + sizeof(MpiMessage), request->buffer + request->len, m->buffer);
+        }
+
+        MpiWorldRegistry &registry = getMpiWorldRegistry();
+        MpiWorld &world = registry.getWorld(m->worldId);
+        world.enqueueMessage(m);
+
+        // Messages aren't acknowledged, ordering is guaranteed by the connection
+        return nullptr;
+    }
+
+    MpiTransport::MpiTransport() = default;
+
+    void MpiTransport::registerEndpoint(const std::string &nodeId, const std::string &host, int port) {
+        std::string endpoint = host + ":" + std::to_string(port);
+
+        redis::Redis &redis = redis::Redis::getQueue();
+        redis.set(getMpiEndpointKey(nodeId), util::stringToBytes(endpoint));
+
+        util::UniqueLock lock(endpointsMx);
+        endpoints[nodeId] = endpoint;
+    }
+
+    void MpiTransport::removeEndpoint(const std::string &nodeId) {
+        redis::Redis &redis = redis::Redis::getQueue();
+        redis.del(getMpiEndpointKey(nodeId));
+
+        util::UniqueLock lock(endpointsMx);
+        endpoints.erase(nodeId);
+    }
+
+    std::string MpiTransport::getEndpoint(const std::string &nodeId) {
+        {
+            util::UniqueLock lock(endpointsMx);
+            auto it = endpoints.find(nodeId);
+            if (it != endpoints.end()) {
+                return it->second;
+            }
+        }
+
+        // Only endpoints that exist are cached, as nodes may register after we first look
+        redis::Redis &redis = redis::Redis::getQueue();
+        std::string endpoint = util::bytesToString(redis.get(getMpiEndpointKey(nodeId)));
+        if (!endpoint.empty()) {
+            util::UniqueLock lock(endpointsMx);
+            endpoints[nodeId] = endpoint;
+        }
+
+        return endpoint;
+    }
+
+    bool MpiTransport::hasDirectEndpoint(const std::string &nodeId) {
+        return !getEndpoint(nodeId).empty();
+    }
+
+    std::shared_ptr<MpiTransport::PeerConnection> MpiTransport::getPeer(const std::string &endpoint) {
+        util::UniqueLock lock(peersMx);
+        std::shared_ptr<PeerConnection> &peer = peers[endpoint];
+        if (!peer) {
+            peer = std::make_shared<PeerConnection>();
+        }
+
+        return peer;
+    }
+
+    void MpiTransport::resetPeer(PeerConnection &peer) {
+        // Should be called holding the peer's lock
+        if (peer.client) {
+            peer.client->exit();
+            peer.client.reset();
+        }
+    }
+
+    static std::unique_ptr<tcp::TCPClient> connectToEndpoint(const std::string &endpoint) {
+        size_t colon = endpoint.rfind(':');
+        std::string host = endpoint.substr(0, colon);
+        int port = std::stoi(endpoint.substr(colon + 1));
+
+        return std::make_unique<tcp::TCPClient>(host, port);
+    }
+
+    void MpiTransport::sendMessage(const std::string &nodeId, MpiMessage *msg, const uint8_t *data,
+                                   size_t dataLen) {
+        const std::string endpoint = getEndpoint(nodeId);
+        if (endpoint.empty()) {
+            throw std::runtime_error("No MPI endpoint for node " + nodeId);
+        }
+
+        // Small messages go with the header. Larger ones are held here for the receiver
+        util::SystemConfig &conf = util::getSystemConfig();
+        bool isEager = data == nullptr || dataLen <= (size_t) conf.mpiEagerLimit;
+        if (isEager) {
+            msg->payload = PAYLOAD_INLINE;
+        } else {
+            msg->payload = PAYLOAD_AT_SENDER;
+
+            MpiPendingPayload payload;
+            payload.data = std::make_unique<uint8_t[]>(dataLen);
+            payload.len = dataLen;
+            payload.worldId = msg->worldId;
+            payload.expiry = util::getGlobalClock().now() + std::chrono::milliseconds(conf.mpiPayloadTimeout);
+            std::copy(data, data + dataLen, payload.data.get());
+
+            util::UniqueLock lock(pendingMx);
+            dropExpiredPayloads();
+            pending[msg->id] = std::move(payload);
+        }
+
+        iovec parts[2];
+        parts[0].iov_base = (void *) msg;
+        parts[0].iov_len = sizeof(MpiMessage);
+        parts[1].iov_base = (void *) data;
+        parts[1].iov_len = isEager && data != nullptr ? dataLen : 0;
+
+        std::shared_ptr<PeerConnection> peer = getPeer(endpoint);
+        util::UniqueLock lock(peer->mx);
+        try {
+            if (!peer->client) {
+                peer->client = connectToEndpoint(endpoint);
+            }
+
+            peer->client->sendMessage(tcp::TCPMessageType::MPI_MESSAGE, parts, 2);
+        } catch (tcp::TCPFailedException &ex) {
+            util::getLogger()->error("Failed sending MPI message to {} ({})", nodeId, endpoint);
+            resetPeer(*peer);
+            throw;
+        }
+    }
+
+    void MpiTransport::pullPayload(const std::string &nodeId, const MpiMessage *msg, uint8_t *buffer,
+                                   size_t bufferLen) {
+        const std::string endpoint = getEndpoint(nodeId);
+        if (endpoint.empty()) {
+            throw std::runtime_error("No MPI endpoint for node " + nodeId);
+        }
+
+        iovec part{};
+        part.iov_base = (void *) &msg->id;
+        part.iov_len = sizeof(int);
+
+        std::shared_ptr<PeerConnection> peer = getPeer(endpoint);
+        util::UniqueLock lock(peer->mx);
+        tcp::TCPMessage response{};
+        try {
+            if (!peer->client) {
+                peer->client = connectToEndpoint(endpoint);
+            }
+
+            // Data is received directly into the receive buffer
+            peer->client->sendMessage(tcp::TCPMessageType::MPI_PULL, &part, 1);
+            response = peer->client->recvMessageInto(buffer, bufferLen);
+        } catch (tcp::TCPFailedException &ex) {
+            util::getLogger()->error("Failed pulling MPI message {} from {} ({})", msg->id, nodeId, endpoint);
+            resetPeer(*peer);
+            throw;
+        }
+
+        if (response.len != bufferLen) {
+            util::getLogger()->error("Unexpected MPI data length for {} ({} != {})", msg->id, response.len,
+                                     bufferLen);
+            throw std::runtime_error("Failed pulling MPI message data");
+        }
+    }
+
+    MpiPendingPayload MpiTransport::takePendingPayload(int messageId) {
+        util::UniqueLock lock(pendingMx);
+
+        MpiPendingPayload payload;
+        auto it = pending.find(messageId);
+        if (it != pending.end()) {
+            payload = std::move(it->second);
+            pending.erase(it);
+        }
+
+        return payload;
+    }
+
+    void MpiTransport::dropExpiredPayloads() {
+        // Should be called holding the pending lock. Receivers that never pull their data,
+        // e.g. because a rank has failed, would otherwise leave it here for good
+        util::TimePoint now = util::getGlobalClock().now();
+        for (auto it = pending.begin(); it != pending.end();) {
+            if (it->second.expiry <= now) {
+                util::getLogger()->warn("Dropping MPI message {} never pulled by its receiver", it->first);
+                it = pending.erase(it);
+            } else {
+                it++;
+            }
+        }
+    }
+
+    void MpiTransport::dropPendingPayloads(int worldId) {
+        util::UniqueLock lock(pendingMx);
+        for (auto it = pending.begin(); it != pending.end();) {
+            if (it->second.worldId == worldId) {
+                it = pending.erase(it);
+            } else {
+                it++;
+            }
+        }
+    }
+
+    long MpiTransport::getPendingCount() {
+        util::UniqueLock lock(pendingMx);
+        return (long) pending.size();
+    }
+
+    void MpiTransport::clear() {
+        {
+            util::UniqueLock lock(peersMx);
+            for (auto &p : peers) {
+                util::UniqueLock peerLock(p.second->mx);
+                resetPeer(*p.second);
+            }
+            peers.clear();
+        }
+
+        {
+            util::UniqueLock lock(endpointsMx);
+            endpoints.clear();
+        }
+
+        util::UniqueLock lock(pendingMx);
+        pending.clear();
+    }
+}
@@ -3,18 +3,31 @@
 
 #include <scheduler/Scheduler.h>
 #include <state/State.h>
+#include <util/config.h>
 #include <util/gids.h>
 #include <mpi/MpiGlobalBus.h>
+#include <mpi/MpiReduction.h>
+#include <mpi/MpiTransport.h>
 #include <util/logging.h>
 #include <util/macros.h>
 #include <util/timing.h>
 
+#include <algorithm>
+#include <chrono>
+
 
 namespace mpi {
     MpiWorld::MpiWorld() : id(-1), size(-1), thisNodeId(util::getNodeId()), creationTime(util::startTimer()) {
 
     }
 
+    MpiWorld::~MpiWorld() {
+        for (auto m : messagePool) {
+            delete[] m->buffer;
+            delete m;
+        }
+    }
+
     std::string getWorldStateKey(int worldId) {
         if (worldId <= 0) {
             throw std::runtime_error(fmt::format("World ID must be bigger than zero ({})", worldId));
@@ -101,6 +114,14 @@ namespace mpi {
         }
 
         localQueueMap.clear();
+
+        // Data held for receivers that never pulled it
+        getMpiTransport().dropPendingPayloads(id);
+
+        util::UniqueLock lock(asyncMx);
+        asyncRequestMap.clear();
+        pendingRecvMap.clear();
+        pendingRecvCount = 0;
     }
 
     void MpiWorld::initialiseFromState(const message::Message &msg, int worldId) {
@@ -140,10 +161,17 @@ namespace mpi {
     }
 
     std::string MpiWorld::getNodeForRank(int rank) {
+        {
+            util::SharedLock lock(worldMutex);
+            auto it = rankNodeMap.find(rank);
+            if (it != rankNodeMap.end()) {
+                return it->second;
+            }
+        }
+
         // Pull from state if not present
-        if (rankNodeMap.count(rank) == 0) {
+        {
             util::FullLock lock(worldMutex);
-
             if (rankNodeMap.count(rank) == 0) {
                 auto buffer = new uint8_t[NODE_ID_LEN];
                 const std::shared_ptr<state::StateKeyValue> &kv = getRankNodeState(rank);
@@ -158,32 +186,24 @@ namespace mpi {
                 std::string otherNodeId(bufferChar, bufferChar + NODE_ID_LEN);
                 rankNodeMap[rank] = otherNodeId;
             }
-        }
 
-        return rankNodeMap[rank];
+            return rankNodeMap[rank];
+        }
     }
 
     int MpiWorld::isend(int sendRank, int recvRank, const uint8_t *buffer, faasmpi_datatype_t *dataType, int count) {
-        return doISendRecv(sendRank, recvRank, buffer, nullptr, dataType, count);
-    }
+        // Sending never blocks, so the send is done straight away
+        send(sendRank, recvRank, buffer, dataType, count);
 
-    int MpiWorld::doISendRecv(int sendRank, int recvRank, const uint8_t *sendBuffer, uint8_t *recvBuffer,
-                              faasmpi_datatype_t *dataType, int count) {
+        int requestId = generateRequestId();
 
-        int requestId = (int) util::generateGid();
-
-        // Spawn a thread to do the work
-        asyncThreadMap.insert(
-                std::pair<int, std::thread>(
-                        requestId,
-                        [this, sendRank, recvRank, sendBuffer, recvBuffer, dataType, count] {
-                            // Do the operation (i.e. the underlying synchronous send/ receive)
-                            if (recvBuffer == nullptr) {
-                                this->send(sendRank, recvRank, sendBuffer, dataType, count);
-                            } else {
-                                this->recv(sendRank, recvRank, recvBuffer, dataType, count, nullptr);
-                            }
-                        }));
+        util::UniqueLock lock(asyncMx);
+        MpiAsyncRequest &request = asyncRequestMap[requestId];
+        request.sendRank = sendRank;
+        request.recvRank = recvRank;
+        request.isComplete = true;
+        request.status.MPI_SOURCE = sendRank;
+        request.status.MPI_ERROR = MPI_SUCCESS;
 
         return requestId;
     }
@@ -199,8 +219,17 @@ namespace mpi {
         // Generate a message ID
         int msgId = (int) util::generateGid();
 
-        // Create the message
-        auto m = new MpiMessage;
+        // Work out whether the message is sent locally, directly to another node or via the global bus
+        const std::string otherNodeId = getNodeForRank(recvRank);
+        bool isLocal = otherNodeId == thisNodeId;
+
+        MpiTransport &transport = getMpiTransport();
+        bool isDirect = !isLocal && transport.hasDirectEndpoint(otherNodeId);
+
+        size_t dataLen = buffer == nullptr ? 0 : count * dataType->size;
+
+        // Create the message, local messages carry their data with them
+        MpiMessage *m = acquireMessage(isLocal ? dataLen : 0);
         m->id = msgId;
         m->worldId = id;
         m->sender = sendRank;
@@ -209,19 +238,11 @@ namespace mpi {
         m->count = count;
         m->messageType = messageType;
 
-        // Work out whether the message is sent locally or to another node
-        const std::string otherNodeId = getNodeForRank(recvRank);
-        bool isLocal = otherNodeId == thisNodeId;
-
-        // Set up message data in state (must obviously be done before dispatching)
-        if (count > 0 && buffer != nullptr) {
+        // Set up message data in global state if it's going via the bus (must obviously be done before dispatching)
+        if (dataLen > 0 && !isLocal && !isDirect) {
             const std::shared_ptr<state::StateKeyValue> &kv = getMessageState(msgId, dataType, count);
             kv->set(buffer);
-
-            // Push to global state if not local
-            if (!isLocal) {
-                kv->pushFull();
-            }
+            kv->pushFull();
         }
 
         // Dispatch the message locally or globally
@@ -229,15 +250,125 @@ namespace mpi {
             if (messageType == MpiMessageType::RMA_WRITE) {
                 logger->trace("MPI - local RMA write {} -> {}", sendRank, recvRank);
                 synchronizeRmaWrite(m, false);
+                releaseMessage(m);
             } else {
                 logger->trace("MPI - send {} -> {}", sendRank, recvRank);
-                getLocalQueue(sendRank, recvRank)->enqueue(m);
+                sendLocal(m, buffer, dataLen);
             }
+        } else if (isDirect) {
+            logger->trace("MPI - send direct {} -> {}", sendRank, recvRank);
+            transport.sendMessage(otherNodeId, m, buffer, dataLen);
+            releaseMessage(m);
         } else {
             logger->trace("MPI - send remote {} -> {}", sendRank, recvRank);
             MpiGlobalBus &bus = mpi::getMpiGlobalBus();
             bus.sendMessageToNode(otherNodeId, m);
+            releaseMessage(m);
+        }
+    }
+
+    void MpiWorld::sendLocal(MpiMessage *msg, const uint8_t *buffer, size_t dataLen) {
+        const std::shared_ptr<MpiPostedRecv> &posted = getPostedRecv(msg->sender, msg->destination);
+        const std::shared_ptr<InMemoryMpiQueue> &queue = getLocalQueue(msg->sender, msg->destination);
+
+        // Local messages are queued holding this lock so that they stay in order with
+        // messages written directly to a posted receive
+        util::UniqueLock lock(posted->mx);
+
+        if (dataLen == 0) {
+            // Nothing to copy
+            msg->payload = PAYLOAD_DELIVERED;
+        } else if (posted->buffer != nullptr && posted->messageType == msg->messageType &&
+                   dataLen <= posted->bufferLen) {
+            // The receiver is already waiting, so the data can go straight into its buffer
+            std::copy(buffer, buffer + dataLen, posted->buffer);
+            posted->buffer = nullptr;
+            msg->payload = PAYLOAD_DELIVERED;
+        } else {
+            std::copy(buffer, buffer + dataLen, msg->buffer);
+            msg->payload = PAYLOAD_INLINE;
+        }
+
+        queue->enqueue(msg);
+    }
+
+    MpiMessage *MpiWorld::acquireMessage(size_t dataLen) {
+        MpiMessage *msg = nullptr;
+        {
+            util::UniqueLock lock(messagePoolMx);
+            if (!messagePool.empty()) {
+                msg = messagePool.back();
+                messagePool.pop_back();
+            }
+        }
+
+        if (msg == nullptr) {
+            msg = new MpiMessage;
+        }
+
+        // Pooled buffers are reused if they're big enough
+        if (dataLen > msg->bufferSize) {
+            delete[] msg->buffer;
+            msg->buffer = new uint8_t[dataLen];
+            msg->bufferSize = dataLen;
+        }
+
+        msg->payload = PAYLOAD_STATE;
+        return msg;
+    }
+
+    void MpiWorld::releaseMessage(MpiMessage *msg) {
+        // Large buffers aren't worth keeping hold of, as those messages are usually written directly
+        util::SystemConfig &conf = util::getSystemConfig();
+        if (msg->bufferSize > (size_t) conf.mpiEagerLimit) {
+            delete[] msg->buffer;
+            msg->buffer = nullptr;
+            msg->bufferSize = 0;
         }
+
+        {
+            util::UniqueLock lock(messagePoolMx);
+            if (messagePool.size() < MPI_MESSAGE_POOL_SIZE) {
+                messagePool.push_back(msg);
+                return;
+            }
+        }
+
+        delete[] msg->buffer;
+        delete msg;
+    }
+
+    long MpiWorld::getPooledMessageCount() {
+        util::UniqueLock lock(messagePoolMx);
+        return (long) messagePool.size();
+    }
+
+    static const std::vector<int> &getNodeGroup(const std::vector<std::vector<int>> &nodes, int rank) {
+        for (const auto &n : nodes) {
+            if (std::find(n.begin(), n.end(), rank) != n.end()) {
+                return n;
+            }
+        }
+
+        throw std::runtime_error(fmt::format("Rank {} not found on any node", rank));
+    }
+
+    static std::vector<int> getNodeLeaders(const std::vector<std::vector<int>> &nodes) {
+        std::vector<int> leaders;
+        for (const auto &n : nodes) {
+            leaders.push_back(n.front());
+        }
+
+        return leaders;
+    }
+
+    static int getGroupIndex(const std::vector<int> &group, int rank) {
+        auto it = std::find(group.begin(), group.end(), rank);
+        if (it == group.end()) {
+            throw std::runtime_error(fmt::format("Rank {} not in collective group", rank));
+        }
+
+        return (int) (it - group.begin());
     }
 
     void MpiWorld::broadcast(int sendRank, const uint8_t *buffer, faasmpi_datatype_t *dataType, int count,
@@ -256,6 +387,30 @@ namespace mpi {
         }
     }
 
+    void MpiWorld::bcast(int rootRank, int thisRank, uint8_t *buffer, faasmpi_datatype_t *dataType, int count,
+                         MpiMessageType messageType) {
+        if (useLinearCollectives()) {
+            if (thisRank == rootRank) {
+                broadcast(rootRank, buffer, dataType, count, messageType);
+            } else {
+                recv(rootRank, thisRank, buffer, dataType, count, nullptr, messageType);
+            }
+
+            return;
+        }
+
+        util::getLogger()->trace("MPI - tree bcast {} -> {}", rootRank, thisRank);
+
+        // Send to one rank on each node, which then passes it on to the others on its node
+        const std::vector<std::vector<int>> nodes = getRanksByNode(rootRank);
+        const std::vector<int> &localRanks = getNodeGroup(nodes, thisRank);
+        if (localRanks.front() == thisRank) {
+            treeBroadcast(getNodeLeaders(nodes), thisRank, buffer, dataType, count, messageType);
+        }
+
+        treeBroadcast(localRanks, thisRank, buffer, dataType, count, messageType);
+    }
+
     void checkSendRecvMatch(faasmpi_datatype_t *sendType, int sendCount, faasmpi_datatype_t *recvType, int recvCount) {
         if (sendType->id != recvType->id && sendCount == recvCount) {
             const std::shared_ptr<spdlog::logger> &logger = util::getLogger();
@@ -306,6 +461,11 @@ namespace mpi {
 
         bool isInPlace = sendBuffer == recvBuffer;
 
+        if (!useLinearCollectives()) {
+            gatherByNode(sendRank, recvRank, sendBuffer, sendType, sendCount, recvBuffer, recvType, recvCount);
+            return;
+        }
+
         // If we're the root, do the gathering
         if (sendRank == recvRank) {
             logger->trace("MPI - gather all -> {}", recvRank);
@@ -354,33 +514,92 @@ namespace mpi {
 
         // Note that sendCount and recvCount here are per-rank, so we need to work out the full buffer size
         int fullCount = recvCount * size;
-        if (rank == root) {
-            // Broadcast the result
-            broadcast(root, recvBuffer, recvType, fullCount, MpiMessageType::ALLGATHER);
-        } else {
-            // Await the broadcast from the master
-            recv(root, rank, recvBuffer, recvType, fullCount, nullptr, MpiMessageType::ALLGATHER);
-        }
+        bcast(root, rank, recvBuffer, recvType, fullCount, MpiMessageType::ALLGATHER);
     }
 
     int MpiWorld::irecv(int sendRank, int recvRank, uint8_t *buffer, faasmpi_datatype_t *dataType, int count) {
-        return doISendRecv(sendRank, recvRank, nullptr, buffer, dataType, count);
+        int requestId = generateRequestId();
+
+        {
+            util::UniqueLock lock(asyncMx);
+            MpiAsyncRequest &request = asyncRequestMap[requestId];
+            request.sendRank = sendRank;
+            request.recvRank = recvRank;
+            request.buffer = buffer;
+            request.dataType = dataType;
+            request.count = count;
+
+            pendingRecvMap[std::to_string(sendRank) + "_" + std::to_string(recvRank)].push_back(requestId);
+            pendingRecvCount++;
+        }
+
+        // Complete it straight away if the message is already here
+        progressRecvs(sendRank, recvRank, false, requestId);
+
+        return requestId;
     }
 
     void MpiWorld::recv(int sendRank, int recvRank,
                         uint8_t *buffer, faasmpi_datatype_t *dataType, int count,
                         MPI_Status *status, MpiMessageType messageType) {
+        // Non-blocking receives posted earlier on this pair take the earlier point-to-point
+        // messages. Collectives have their own message types so don't need them out of the way.
+        if (messageType == MpiMessageType::NORMAL && pendingRecvCount > 0) {
+            progressRecvs(sendRank, recvRank, true, -1);
+        }
+
+        doRecv(sendRank, recvRank, buffer, dataType, count, status, messageType);
+    }
+
+    void MpiWorld::doRecv(int sendRank, int recvRank,
+                          uint8_t *buffer, faasmpi_datatype_t *dataType, int count,
+                          MPI_Status *status, MpiMessageType messageType) {
         const std::shared_ptr<spdlog::logger> &logger = util::getLogger();
 
-        // Listen to the in-memory queue for this rank and message type
-        const MpiMessage *m;
-        logger->trace("MPI - recv {} -> {}", sendRank, recvRank);
-        m = getLocalQueue(sendRank, recvRank)->dequeue();
+        // Post the receive buffer if nothing is waiting, so a local sender can write to it directly
+        const std::shared_ptr<MpiPostedRecv> &posted = getPostedRecv(sendRank, recvRank);
+        const std::shared_ptr<InMemoryMpiQueue> &queue = getLocalQueue(sendRank, recvRank);
+        util::UniqueLock recvLock(posted->recvMx);
+
+        // A message of this type may have been set aside by an earlier receive on the pair
+        MpiMessage *m = nullptr;
+        for (auto it = posted->unmatched.begin(); it != posted->unmatched.end(); it++) {
+            if ((*it)->messageType == messageType) {
+                m = *it;
+                posted->unmatched.erase(it);
+                break;
+            }
+        }
+
+        if (m == nullptr) {
+            size_t bufferLen = buffer == nullptr ? 0 : count * dataType->size;
+            if (bufferLen > 0) {
+                util::UniqueLock lock(posted->mx);
+                if (queue->size() == 0) {
+                    posted->buffer = buffer;
+                    posted->bufferLen = bufferLen;
+                    posted->messageType = messageType;
+                }
+            }
 
-        if (messageType != m->messageType) {
-            logger->error("Message types mismatched on {}->{} (expected={}, got={})", sendRank, recvRank, messageType,
-                          m->messageType);
-            throw std::runtime_error("Mismatched message types");
+            // Listen to the in-memory queue for this rank and message type. Messages for other
+            // operations on the pair (e.g. a collective overtaking a pending point-to-point
+            // receive) are set aside for the receive they belong to.
+            logger->trace("MPI - recv {} -> {}", sendRank, recvRank);
+            while (true) {
+                MpiMessage *next = queue->dequeue();
+                if (next->messageType == messageType) {
+                    m = next;
+                    break;
+                }
+
+                posted->unmatched.push_back(next);
+            }
+
+            if (bufferLen > 0) {
+                util::UniqueLock lock(posted->mx);
+                posted->buffer = nullptr;
+            }
         }
 
         if (m->count > count) {
@@ -389,8 +608,15 @@ namespace mpi {
         }
 
         if (m->count > 0) {
-            const std::shared_ptr<state::StateKeyValue> &kv = getMessageState(m->id, dataType, m->count);
-            kv->get(buffer);
+            size_t dataLen = m->count * dataType->size;
+            if (m->payload == PAYLOAD_INLINE && m->buffer != nullptr) {
+                std::copy(m->buffer, m->buffer + dataLen, buffer);
+            } else if (m->payload == PAYLOAD_AT_SENDER) {
+                getMpiTransport().pullPayload(getNodeForRank(m->sender), m, buffer, dataLen);
+            } else if (m->payload == PAYLOAD_STATE) {
+                const std::shared_ptr<state::StateKeyValue> &kv = getMessageState(m->id, dataType, m->count);
+                kv->get(buffer);
+            }
         }
 
         // Set status values if required
@@ -404,98 +630,255 @@ namespace mpi {
             // TODO - thread through tag
             status->MPI_TAG = -1;
         }
+
+        releaseMessage(m);
     }
 
-    void MpiWorld::awaitAsyncRequest(int requestId) {
-        util::getLogger()->trace("MPI - await {}", requestId);
+    void MpiWorld::progressRecvs(int sendRank, int recvRank, bool blocking, int untilRequestId) {
+        // Only the receiving rank progresses its receives, so the front of the pending list
+        // can't change under us while it's being received
+        const std::string key = std::to_string(sendRank) + "_" + std::to_string(recvRank);
+
+        while (true) {
+            int requestId;
+            MpiAsyncRequest request;
+            {
+                util::UniqueLock lock(asyncMx);
+                auto it = pendingRecvMap.find(key);
+                if (it == pendingRecvMap.end() || it->second.empty()) {
+                    return;
+                }
+
+                requestId = it->second.front();
+                request = asyncRequestMap[requestId];
+            }
+
+            if (!blocking && !hasNormalMessage(sendRank, recvRank)) {
+                return;
+            }
+
+            MPI_Status status{};
+            doRecv(sendRank, recvRank, request.buffer, request.dataType, request.count, &status,
+                   MpiMessageType::NORMAL);
 
-        if (asyncThreadMap.count(requestId) == 0) {
+            {
+                util::UniqueLock lock(asyncMx);
+                pendingRecvMap[key].pop_front();
+                pendingRecvCount--;
+
+                MpiAsyncRequest &completed = asyncRequestMap[requestId];
+                completed.isComplete = true;
+                completed.status = status;
+            }
+
+            if (requestId == untilRequestId) {
+                return;
+            }
+        }
+    }
+
+    bool MpiWorld::hasNormalMessage(int sendRank, int recvRank) {
+        const std::shared_ptr<MpiPostedRecv> &posted = getPostedRecv(sendRank, recvRank);
+        const std::shared_ptr<InMemoryMpiQueue> &queue = getLocalQueue(sendRank, recvRank);
+        util::UniqueLock recvLock(posted->recvMx);
+
+        // Set aside anything else that's arrived, without waiting
+        while (queue->size() > 0) {
+            MpiMessage *next = queue->peek();
+            if (next->messageType == MpiMessageType::NORMAL) {
+                return true;
+            }
+
+            posted->unmatched.push_back(queue->dequeue());
+        }
+
+        for (MpiMessage *m : posted->unmatched) {
+            if (m->messageType == MpiMessageType::NORMAL) {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    bool MpiWorld::takeCompletedRequest(int requestId, MPI_Status *status) {
+        util::UniqueLock lock(asyncMx);
+
+        auto it = asyncRequestMap.find(requestId);
+        if (it == asyncRequestMap.end()) {
             throw std::runtime_error("Attempting to await unrecognised async request: " + std::to_string(requestId));
         }
 
-        // Rejoin the thread doing the async work
-        std::thread &t = asyncThreadMap[requestId];
-        if (t.joinable()) {
-            t.join();
+        if (!it->second.isComplete) {
+            return false;
+        }
+
+        if (status != nullptr) {
+            *status = it->second.status;
+        }
+
+        asyncRequestMap.erase(it);
+        return true;
+    }
+
+    void MpiWorld::awaitAsyncRequest(int requestId, MPI_Status *status) {
+        util::getLogger()->trace("MPI - await {}", requestId);
+
+        MpiAsyncRequest request;
+        {
+            util::UniqueLock lock(asyncMx);
+            auto it = asyncRequestMap.find(requestId);
+            if (it == asyncRequestMap.end()) {
+                throw std::runtime_error(
+                        "Attempting to await unrecognised async request: " + std::to_string(requestId));
+            }
+
+            request = it->second;
+        }
+
+        if (!request.isComplete) {
+            progressRecvs(request.sendRank, request.recvRank, true, requestId);
+        }
+
+        takeCompletedRequest(requestId, status);
+    }
+
+    bool MpiWorld::testAsyncRequest(int requestId, MPI_Status *status) {
+        MpiAsyncRequest request;
+        {
+            util::UniqueLock lock(asyncMx);
+            auto it = asyncRequestMap.find(requestId);
+            if (it == asyncRequestMap.end()) {
+                throw std::runtime_error(
+                        "Attempting to test unrecognised async request: " + std::to_string(requestId));
+            }
+
+            request = it->second;
+        }
+
+        if (!request.isComplete) {
+            progressRecvs(request.sendRank, request.recvRank, false, requestId);
+        }
+
+        return takeCompletedRequest(requestId, status);
+    }
+
+    void MpiWorld::awaitAllAsyncRequests(std::vector<int> &requestIds, MPI_Status *statuses) {
+        // Receives on each pair complete in the order they were posted whichever we wait on
+        // first, and sends are already done, so waiting in turn can't hold anything up
+        for (size_t i = 0; i < requestIds.size(); i++) {
+            if (requestIds[i] == FAASMPI_REQUEST_NULL) {
+                continue;
+            }
+
+            awaitAsyncRequest(requestIds[i], statuses == nullptr ? nullptr : &statuses[i]);
+            requestIds[i] = FAASMPI_REQUEST_NULL;
         }
     }
 
+    int MpiWorld::testAnyAsyncRequest(std::vector<int> &requestIds, MPI_Status *status) {
+        bool allNull = true;
+        for (size_t i = 0; i < requestIds.size(); i++) {
+            if (requestIds[i] == FAASMPI_REQUEST_NULL) {
+                continue;
+            }
+
+            allNull = false;
+            if (testAsyncRequest(requestIds[i], status)) {
+                requestIds[i] = FAASMPI_REQUEST_NULL;
+                return (int) i;
+            }
+        }
+
+        return allNull ? MPI_UNDEFINED : -1;
+    }
+
+    int MpiWorld::awaitAnyAsyncRequest(std::vector<int> &requestIds, MPI_Status *status) {
+        // The requests may be waiting on any number of different pairs, so we poll them,
+        // backing off once it's clear nothing is about to arrive
+        for (int attempt = 0;; attempt++) {
+            int idx = testAnyAsyncRequest(requestIds, status);
+            if (idx >= 0 || idx == MPI_UNDEFINED) {
+                return idx;
+            }
+
+            if (attempt < MPI_ASYNC_SPIN_COUNT) {
+                std::this_thread::yield();
+            } else {
+                std::this_thread::sleep_for(std::chrono::microseconds(50));
+            }
+        }
+    }
+
+    int MpiWorld::generateRequestId() {
+        // Zero is kept for null requests
+        int requestId;
+        do {
+            requestId = (int) util::generateGid();
+        } while (requestId == FAASMPI_REQUEST_NULL);
+
+        return requestId;
+    }
+
+    long MpiWorld::getAsyncRequestCount() {
+        util::UniqueLock lock(asyncMx);
+        return (long) asyncRequestMap.size();
+    }
+
     void MpiWorld::reduce(int sendRank, int recvRank, uint8_t *sendBuffer, uint8_t *recvBuffer,
                           faasmpi_datatype_t *datatype, int count, faasmpi_op_t *operation) {
         const std::shared_ptr<spdlog::logger> &logger = util::getLogger();
 
+        size_t bufferSize = datatype->size * count;
+        bool isInPlace = sendBuffer == recvBuffer;
+
+        // Fails for unsupported reductions before anything is sent
+        MpiReduceKernel kernel = getReduceKernel(operation, datatype);
+
+        if (!useLinearCollectives()) {
+            logger->trace("MPI - tree reduce ({}) {} -> {}", operation->id, sendRank, recvRank);
+
+            // Results build up in the receive buffer on the root, and a scratch buffer elsewhere
+            std::vector<uint8_t> scratch;
+            uint8_t *results = recvBuffer;
+            if (sendRank != recvRank) {
+                scratch.assign(sendBuffer, sendBuffer + bufferSize);
+                results = scratch.data();
+            } else if (!isInPlace) {
+                std::copy(sendBuffer, sendBuffer + bufferSize, recvBuffer);
+            }
+
+            // Reduce on each node first, then between the nodes
+            const std::vector<std::vector<int>> nodes = getRanksByNode(recvRank);
+            const std::vector<int> &localRanks = getNodeGroup(nodes, sendRank);
+            treeReduce(localRanks, sendRank, results, datatype, count, operation, MpiMessageType::REDUCE);
+
+            if (localRanks.front() == sendRank) {
+                treeReduce(getNodeLeaders(nodes), sendRank, results, datatype, count, operation,
+                           MpiMessageType::REDUCE);
+            }
+
+            return;
+        }
+
         // If we're the receiver, await inputs
         if (sendRank == recvRank) {
             logger->trace("MPI - reduce ({}) all -> {}", operation->id, recvRank);
 
-            size_t bufferSize = datatype->size * count;
-
-            // Zero the receive buffer if we're not operating in-place
-            bool isInPlace = sendBuffer == recvBuffer;
+            // Start from this rank's data if we're not operating in-place
             if (!isInPlace) {
-                memset(recvBuffer, 0, bufferSize);
+                std::copy(sendBuffer, sendBuffer + bufferSize, recvBuffer);
             }
 
+            std::vector<uint8_t> rankData(bufferSize);
             for (int r = 0; r < size; r++) {
-                // Work out the data for this rank
-                uint8_t *rankData;
-                if (r == recvRank && isInPlace) {
-                    // If we're receiving from ourselves and in-place, our work is already done
-                    // and the results are written in the recv buffer
+                // Data for this rank is already in the receive buffer
+                if (r == recvRank) {
                     continue;
-                } else if (r == recvRank) {
-                    // If we're receiving from ourselves not in-place, the data for this rank
-                    // is just the send buffer
-                    rankData = sendBuffer;
-                } else {
-                    // If we're receiving from another rank, call recv
-                    rankData = new uint8_t[bufferSize];
-                    recv(r, recvRank, rankData, datatype, count, nullptr, MpiMessageType::REDUCE);
-                }
-
-                if (operation->id == faasmpi_op_sum.id) {
-                    if (datatype->id == FAASMPI_INT) {
-                        auto recvBufferCast = reinterpret_cast<int *>(recvBuffer);
-                        auto rankDataCast = reinterpret_cast<int *>(rankData);
-
-                        for (int slot = 0; slot < count; slot++) {
-                            recvBufferCast[slot] += rankDataCast[slot];
-                        }
-                    } else if (datatype->id == FAASMPI_DOUBLE) {
-                        auto recvBufferCast = reinterpret_cast<double *>(recvBuffer);
-                        auto rankDataCast = reinterpret_cast<double *>(rankData);
-
-                        for (int slot = 0; slot < count; slot++) {
-                            recvBufferCast[slot] += rankDataCast[slot];
-                        }
-                    } else {
-                        throw std::runtime_error("Unsupported type for sum reduction");
-                    }
-                } else if (operation->id == faasmpi_op_max.id) {
-                    if (datatype->id == FAASMPI_INT) {
-                        auto recvBufferCast = reinterpret_cast<int *>(recvBuffer);
-                        auto rankDataCast = reinterpret_cast<int *>(rankData);
-
-                        for (int slot = 0; slot < count; slot++) {
-                            recvBufferCast[slot] = std::max(recvBufferCast[slot], rankDataCast[slot]);
-                        }
-                    } else if (datatype->id == FAASMPI_DOUBLE) {
-                        auto recvBufferCast = reinterpret_cast<double *>(recvBuffer);
-                        auto rankDataCast = reinterpret_cast<double *>(rankData);
-
-                        for (int slot = 0; slot < count; slot++) {
-                            recvBufferCast[slot] = std::max(recvBufferCast[slot], rankDataCast[slot]);
-                        }
-                    } else {
-                        throw std::runtime_error("Unsupported type for max reduction");
-                    }
-                } else {
-                    throw std::runtime_error("Not yet implemented reduce operation");
                 }
 
-                if (r != recvRank) {
-                    delete[] rankData;
-                }
+                recv(r, recvRank, rankData.data(), datatype, count, nullptr, MpiMessageType::REDUCE);
+                kernel(rankData.data(), recvBuffer, count);
             }
 
         } else {
@@ -506,6 +889,37 @@ namespace mpi {
 
     void MpiWorld::allReduce(int rank, uint8_t *sendBuffer, uint8_t *recvBuffer, faasmpi_datatype_t *datatype,
                              int count, faasmpi_op_t *operation) {
+        if (!useLinearCollectives()) {
+            util::getLogger()->trace("MPI - tree allreduce ({}) {}", operation->id, rank);
+
+            size_t bufferSize = datatype->size * count;
+            if (sendBuffer != recvBuffer) {
+                std::copy(sendBuffer, sendBuffer + bufferSize, recvBuffer);
+            }
+
+            // Reduce on each node, combine the results between nodes, then share them on each node
+            const std::vector<std::vector<int>> nodes = getRanksByNode(0);
+            const std::vector<int> &localRanks = getNodeGroup(nodes, rank);
+            treeReduce(localRanks, rank, recvBuffer, datatype, count, operation, MpiMessageType::ALLREDUCE);
+
+            if (localRanks.front() == rank && nodes.size() > 1) {
+                // Ring is bandwidth-optimal for large messages, recursive doubling takes fewer steps for small ones.
+                // The ring splits the buffer without regard to the (value, location) pairs of loc ops, so
+                // those always use recursive doubling.
+                const std::vector<int> leaders = getNodeLeaders(nodes);
+                util::SystemConfig &conf = util::getSystemConfig();
+                bool isLocOp = operation->id == FAASMPI_OP_MAXLOC || operation->id == FAASMPI_OP_MINLOC;
+                if (!isLocOp && bufferSize >= (size_t) conf.mpiRingAllReduceBytes && count >= (int) leaders.size()) {
+                    ringAllReduce(leaders, rank, recvBuffer, datatype, count, operation);
+                } else {
+                    recursiveDoublingAllReduce(leaders, rank, recvBuffer, datatype, count, operation);
+                }
+            }
+
+            treeBroadcast(localRanks, rank, recvBuffer, datatype, count, MpiMessageType::ALLREDUCE);
+            return;
+        }
+
         // Rank 0 coordinates the allreduce operation
         if (rank == 0) {
             // Run the standard reduce
@@ -528,26 +942,23 @@ namespace mpi {
 
         size_t sendOffset = sendCount * sendType->size;
 
-        // Send out messages for this rank
-        for (int r = 0; r < size; r++) {
-            // Work out what data to send to this rank
-            size_t rankOffset = r * sendOffset;
-            uint8_t *sendChunk = sendBuffer + rankOffset;
+        // Copy this rank's data directly
+        uint8_t *ownChunk = sendBuffer + (rank * sendOffset);
+        std::copy(ownChunk, ownChunk + sendOffset, recvBuffer + (rank * sendOffset));
 
-            if (r == rank) {
-                // Copy directly
-                std::copy(sendChunk, sendChunk + sendOffset, recvBuffer + rankOffset);
-            } else {
-                // Send message to other rank
-                send(rank, r, sendChunk, sendType, sendCount, MpiMessageType::ALLTOALL);
-            }
+        // Send out messages for this rank, starting from the next rank along so that every
+        // rank isn't sending to the same rank at once
+        for (int i = 1; i < size; i++) {
+            int r = (rank + i) % size;
+
+            // Work out what data to send to this rank
+            uint8_t *sendChunk = sendBuffer + (r * sendOffset);
+            send(rank, r, sendChunk, sendType, sendCount, MpiMessageType::ALLTOALL);
         }
 
         // Await incoming messages from others
-        for (int r = 0; r < size; r++) {
-            if (r == rank) {
-                continue;
-            }
+        for (int i = 1; i < size; i++) {
+            int r = (rank - i + size) % size;
 
             // Work out where to place the result from this rank
             uint8_t *recvChunk = recvBuffer + (r * sendOffset);
@@ -558,8 +969,32 @@ namespace mpi {
     }
 
     void MpiWorld::probe(int sendRank, int recvRank, MPI_Status *status) {
+        // Earlier non-blocking receives get the messages ahead of whatever is probed for
+        if (pendingRecvCount > 0) {
+            progressRecvs(sendRank, recvRank, true, -1);
+        }
+
+        const std::shared_ptr<MpiPostedRecv> &posted = getPostedRecv(sendRank, recvRank);
         const std::shared_ptr<InMemoryMpiQueue> &queue = getLocalQueue(sendRank, recvRank);
-        const MpiMessage *m = queue->peek();
+        util::UniqueLock recvLock(posted->recvMx);
+
+        // Probes only match point-to-point messages, so anything else is set aside
+        const MpiMessage *m = nullptr;
+        for (MpiMessage *u : posted->unmatched) {
+            if (u->messageType == MpiMessageType::NORMAL) {
+                m = u;
+                break;
+            }
+        }
+
+        while (m == nullptr) {
+            MpiMessage *next = queue->peek();
+            if (next->messageType == MpiMessageType::NORMAL) {
+                m = next;
+            } else {
+                posted->unmatched.push_back(queue->dequeue());
+            }
+        }
 
         faasmpi_datatype_t *datatype = getFaasmDatatypeFromId(m->type);
         status->bytesSize = m->count * datatype->size;
@@ -570,6 +1005,34 @@ namespace mpi {
     void MpiWorld::barrier(int thisRank) {
         const std::shared_ptr<spdlog::logger> &logger = util::getLogger();
 
+        if (!useLinearCollectives()) {
+            // Ranks join on their node, the first rank on each node joins with the other nodes,
+            // then lets the ranks on its node go
+            const std::vector<std::vector<int>> nodes = getRanksByNode(0);
+            const std::vector<int> &localRanks = getNodeGroup(nodes, thisRank);
+            int leader = localRanks.front();
+
+            if (thisRank != leader) {
+                logger->trace("MPI - barrier join {} -> {}", thisRank, leader);
+                send(thisRank, leader, nullptr, MPI_INT, 0, MpiMessageType::BARRIER_JOIN);
+                recv(leader, thisRank, nullptr, MPI_INT, 0, nullptr, MpiMessageType::BARRIER_DONE);
+                return;
+            }
+
+            for (size_t i = 1; i < localRanks.size(); i++) {
+                recv(localRanks[i], thisRank, nullptr, MPI_INT, 0, nullptr, MpiMessageType::BARRIER_JOIN);
+            }
+
+            disseminationBarrier(getNodeLeaders(nodes), thisRank);
+
+            for (size_t i = 1; i < localRanks.size(); i++) {
+                send(thisRank, localRanks[i], nullptr, MPI_INT, 0, MpiMessageType::BARRIER_DONE);
+            }
+
+            logger->trace("MPI - barrier done {}", thisRank);
+            return;
+        }
+
         if (thisRank == 0) {
             // This is the root, hence just does the waiting
 
@@ -604,6 +1067,7 @@ namespace mpi {
         if (msg->messageType == MpiMessageType::RMA_WRITE) {
             // NOTE - RMA notifications must be processed synchronously to ensure ordering
             synchronizeRmaWrite(msg, true);
+            releaseMessage(msg);
         } else {
             logger->trace("Queueing message locally {} -> {}", msg->sender, msg->destination);
             getLocalQueue(msg->sender, msg->destination)->enqueue(msg);
@@ -626,6 +1090,273 @@ namespace mpi {
         return localQueueMap[key];
     }
 
+    std::shared_ptr<MpiPostedRecv> MpiWorld::getPostedRecv(int sendRank, int recvRank) {
+        std::string key = std::to_string(sendRank) + "_" + std::to_string(recvRank);
+
+        {
+            util::SharedLock lock(worldMutex);
+            auto it = postedRecvMap.find(key);
+            if (it != postedRecvMap.end()) {
+                return it->second;
+            }
+        }
+
+        util::FullLock lock(worldMutex);
+        std::shared_ptr<MpiPostedRecv> &posted = postedRecvMap[key];
+        if (!posted) {
+            posted = std::make_shared<MpiPostedRecv>();
+        }
+
+        return posted;
+    }
+
+    bool MpiWorld::useLinearCollectives() {
+        // Small worlds are quicker going through a single rank
+        util::SystemConfig &conf = util::getSystemConfig();
+        return size <= conf.mpiLinearCollectiveSize;
+    }
+
+    std::vector<std::vector<int>> MpiWorld::getRanksByNode(int rootRank) {
+        // Every rank must come up with the same grouping. Ranks are in order on each node, and
+        // nodes are in order of their lowest rank, apart from the root going first on the first node
+        std::vector<std::vector<int>> nodes;
+        std::unordered_map<std::string, size_t> nodeIdxs;
+        for (int r = 0; r < size; r++) {
+            const std::string node = getNodeForRank(r);
+            auto it = nodeIdxs.find(node);
+            if (it == nodeIdxs.end()) {
+                nodeIdxs[node] = nodes.size();
+                nodes.push_back({r});
+            } else {
+                nodes[it->second].push_back(r);
+            }
+        }
+
+        size_t rootNodeIdx = nodeIdxs[getNodeForRank(rootRank)];
+        std::vector<int> &rootNode = nodes[rootNodeIdx];
+        auto rootIt = std::find(rootNode.begin(), rootNode.end(), rootRank);
+        std::rotate(rootNode.begin(), rootIt, rootIt + 1);
+        std::rotate(nodes.begin(), nodes.begin() + rootNodeIdx, nodes.begin() + rootNodeIdx + 1);
+
+        return nodes;
+    }
+
+    void MpiWorld::treeBroadcast(const std::vector<int> &group, int thisRank, uint8_t *buffer,
+                                 faasmpi_datatype_t *dataType, int count, MpiMessageType messageType) {
+        // Binomial tree rooted at the first rank in the group
+        int n = (int) group.size();
+        int idx = getGroupIndex(group, thisRank);
+
+        int mask = 1;
+        while (mask < n) {
+            if (idx & mask) {
+                recv(group[idx - mask], thisRank, buffer, dataType, count, nullptr, messageType);
+                break;
+            }
+            mask <<= 1;
+        }
+
+        mask >>= 1;
+        while (mask > 0) {
+            if (idx + mask < n) {
+                send(thisRank, group[idx + mask], buffer, dataType, count, messageType);
+            }
+            mask >>= 1;
+        }
+    }
+
+    void MpiWorld::treeReduce(const std::vector<int> &group, int thisRank, uint8_t *buffer,
+                              faasmpi_datatype_t *dataType, int count, faasmpi_op_t *operation,
+                              MpiMessageType messageType) {
+        // Binomial tree rooted at the first rank in the group. The buffer holds this rank's
+        // data, and ends up holding the result on the first rank
+        int n = (int) group.size();
+        int idx = getGroupIndex(group, thisRank);
+        MpiReduceKernel kernel = getReduceKernel(operation, dataType);
+        std::vector<uint8_t> childData(count * dataType->size);
+
+        for (int mask = 1; mask < n; mask <<= 1) {
+            if (idx & mask) {
+                send(thisRank, group[idx - mask], buffer, dataType, count, messageType);
+                break;
+            }
+
+            int child = idx | mask;
+            if (child < n) {
+                recv(group[child], thisRank, childData.data(), dataType, count, nullptr, messageType);
+                kernel(childData.data(), buffer, count);
+            }
+        }
+    }
+
+    void MpiWorld::recursiveDoublingAllReduce(const std::vector<int> &group, int thisRank, uint8_t *buffer,
+                                              faasmpi_datatype_t *dataType, int count,
+                                              faasmpi_op_t *operation) {
+        int n = (int) group.size();
+        int idx = getGroupIndex(group, thisRank);
+        MpiReduceKernel kernel = getReduceKernel(operation, dataType);
+        std::vector<uint8_t> otherData(count * dataType->size);
+
+        // With a group size that isn't a power of two, the first few even ranks hand their
+        // data to the next rank along and sit out the exchanges
+        int pof2 = 1;
+        while (pof2 * 2 <= n) {
+            pof2 *= 2;
+        }
+        int rem = n - pof2;
+
+        int exchangeIdx;
+        if (idx < 2 * rem) {
+            if (idx % 2 == 0) {
+                send(thisRank, group[idx + 1], buffer, dataType, count, MpiMessageType::ALLREDUCE);
+                exchangeIdx = -1;
+            } else {
+                recv(group[idx - 1], thisRank, otherData.data(), dataType, count, nullptr,
+                     MpiMessageType::ALLREDUCE);
+                kernel(otherData.data(), buffer, count);
+                exchangeIdx = idx / 2;
+            }
+        } else {
+            exchangeIdx = idx - rem;
+        }
+
+        // Swap partial results with a partner twice as far away each time
+        if (exchangeIdx >= 0) {
+            for (int mask = 1; mask < pof2; mask <<= 1) {
+                int partnerExchangeIdx = exchangeIdx ^ mask;
+                int partnerIdx = partnerExchangeIdx < rem ? partnerExchangeIdx * 2 + 1 : partnerExchangeIdx + rem;
+                int partner = group[partnerIdx];
+
+                send(thisRank, partner, buffer, dataType, count, MpiMessageType::ALLREDUCE);
+                recv(partner, thisRank, otherData.data(), dataType, count, nullptr, MpiMessageType::ALLREDUCE);
+                kernel(otherData.data(), buffer, count);
+            }
+        }
+
+        // Hand the result back to those that sat out
+        if (idx < 2 * rem) {
+            if (idx % 2 == 0) {
+                recv(group[idx + 1], thisRank, buffer, dataType, count, nullptr, MpiMessageType::ALLREDUCE);
+            } else {
+                send(thisRank, group[idx - 1], buffer, dataType, count, MpiMessageType::ALLREDUCE);
+            }
+        }
+    }
+
+    void MpiWorld::ringAllReduce(const std::vector<int> &group, int thisRank, uint8_t *buffer,
+                                 faasmpi_datatype_t *dataType, int count, faasmpi_op_t *operation) {
+        // Buffer is split into one chunk per rank, each of which is reduced as it's passed
+        // round the ring, then the reduced chunks are passed round again. Requires at least
+        // as many elements as ranks
+        int n = (int) group.size();
+        int idx = getGroupIndex(group, thisRank);
+        int right = group[(idx + 1) % n];
+        int left = group[(idx - 1 + n) % n];
+        MpiReduceKernel kernel = getReduceKernel(operation, dataType);
+
+        int baseCount = count / n;
+        int extra = count % n;
+        auto chunkStart = [baseCount, extra, dataType](int chunk) {
+            return (size_t) (chunk * baseCount + std::min(chunk, extra)) * dataType->size;
+        };
+        auto chunkCount = [baseCount, extra](int chunk) {
+            return baseCount + (chunk < extra ? 1 : 0);
+        };
+
+        std::vector<uint8_t> chunkData((baseCount + 1) * dataType->size);
+        for (int step = 0; step < n - 1; step++) {
+            int sendChunk = (idx - step + n) % n;
+            int recvChunk = (idx - step - 1 + n) % n;
+
+            send(thisRank, right, buffer + chunkStart(sendChunk), dataType, chunkCount(sendChunk),
+                 MpiMessageType::ALLREDUCE);
+            recv(left, thisRank, chunkData.data(), dataType, chunkCount(recvChunk), nullptr,
+                 MpiMessageType::ALLREDUCE);
+            kernel(chunkData.data(), buffer + chunkStart(recvChunk), chunkCount(recvChunk));
+        }
+
+        // Each rank now has the result for the chunk after its own
+        for (int step = 0; step < n - 1; step++) {
+            int sendChunk = (idx + 1 - step + n) % n;
+            int recvChunk = (idx - step + n) % n;
+
+            send(thisRank, right, buffer + chunkStart(sendChunk), dataType, chunkCount(sendChunk),
+                 MpiMessageType::ALLREDUCE);
+            recv(left, thisRank, buffer + chunkStart(recvChunk), dataType, chunkCount(recvChunk), nullptr,
+                 MpiMessageType::ALLREDUCE);
+        }
+    }
+
+    void MpiWorld::disseminationBarrier(const std::vector<int> &group, int thisRank) {
+        // Each round signals the rank twice as far along as the last, so every rank has heard
+        // from every other (indirectly) after log2(n) rounds
+        int n = (int) group.size();
+        int idx = getGroupIndex(group, thisRank);
+
+        for (int distance = 1; distance < n; distance <<= 1) {
+            send(thisRank, group[(idx + distance) % n], nullptr, MPI_INT, 0, MpiMessageType::BARRIER_JOIN);
+            recv(group[(idx - distance + n) % n], thisRank, nullptr, MPI_INT, 0, nullptr,
+                 MpiMessageType::BARRIER_JOIN);
+        }
+    }
+
+    void MpiWorld::gatherByNode(int sendRank, int recvRank, const uint8_t *sendBuffer, faasmpi_datatype_t *sendType,
+                                int sendCount, uint8_t *recvBuffer, faasmpi_datatype_t *recvType, int recvCount) {
+        size_t sendOffset = sendCount * sendType->size;
+        size_t recvOffset = recvCount * recvType->size;
+        bool isInPlace = sendBuffer == recvBuffer;
+
+        // Non-root ranks in-place are part of an allgather (see gather)
+        const uint8_t *ownChunk = isInPlace ? sendBuffer + (sendRank * sendOffset) : sendBuffer;
+
+        const std::vector<std::vector<int>> nodes = getRanksByNode(recvRank);
+        const std::vector<int> &localRanks = getNodeGroup(nodes, sendRank);
+        int leader = localRanks.front();
+
+        if (sendRank != leader) {
+            send(sendRank, leader, ownChunk, sendType, sendCount, MpiMessageType::GATHER);
+            return;
+        }
+
+        if (sendRank != recvRank) {
+            // Collect the data for this node and send it to the root in one go
+            std::vector<uint8_t> nodeData(localRanks.size() * sendOffset);
+            std::copy(ownChunk, ownChunk + sendOffset, nodeData.begin());
+            for (size_t i = 1; i < localRanks.size(); i++) {
+                recv(localRanks[i], sendRank, nodeData.data() + (i * sendOffset), sendType, sendCount, nullptr,
+                     MpiMessageType::GATHER);
+            }
+
+            send(sendRank, recvRank, nodeData.data(), sendType, sendCount * (int) localRanks.size(),
+                 MpiMessageType::GATHER);
+            return;
+        }
+
+        // On the root, data for this node goes straight into place
+        if (!isInPlace) {
+            std::copy(sendBuffer, sendBuffer + sendOffset, recvBuffer + (recvRank * recvOffset));
+        }
+
+        for (size_t i = 1; i < localRanks.size(); i++) {
+            recv(localRanks[i], recvRank, recvBuffer + (localRanks[i] * recvOffset), recvType, recvCount, nullptr,
+                 MpiMessageType::GATHER);
+        }
+
+        // Data from other nodes comes in the order of the ranks on that node
+        std::vector<uint8_t> nodeData;
+        for (size_t n = 1; n < nodes.size(); n++) {
+            const std::vector<int> &nodeRanks = nodes[n];
+            nodeData.resize(nodeRanks.size() * recvOffset);
+            recv(nodeRanks.front(), recvRank, nodeData.data(), recvType, recvCount * (int) nodeRanks.size(),
+                 nullptr, MpiMessageType::GATHER);
+
+            for (size_t i = 0; i < nodeRanks.size(); i++) {
+                const uint8_t *chunk = nodeData.data() + (i * recvOffset);
+                std::copy(chunk, chunk + recvOffset, recvBuffer + (nodeRanks[i] * recvOffset));
+            }
+        }
+    }
+
     void MpiWorld::rmaGet(int sendRank, faasmpi_datatype_t *sendType, int sendCount,
                           uint8_t *recvBuffer, faasmpi_datatype_t *recvType, int recvCount) {
         checkSendRecvMatch(sendType, sendCount, recvType, recvCount);
@@ -688,8 +1419,11 @@ namespace mpi {
     }
 
     long MpiWorld::getLocalQueueSize(int sendRank, int recvRank) {
+        const std::shared_ptr<MpiPostedRecv> &posted = getPostedRecv(sendRank, recvRank);
         const std::shared_ptr<InMemoryMpiQueue> &queue = getLocalQueue(sendRank, recvRank);
-        return queue->size();
+
+        util::UniqueLock recvLock(posted->recvMx);
+        return queue->size() + (long) posted->unmatched.size();
     }
 
     void MpiWorld::checkRankOnThisNode(int rank) {
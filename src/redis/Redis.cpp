@@ -271,6 +271,23 @@ namespace redis {
         redisAppendCommand(context, "SETRANGE %s %li %b", key.c_str(), offset, value, size);
     }
 
+    void Redis::setPipeline(const std::string &key, const uint8_t *value, size_t size) {
+        redisAppendCommand(context, "SET %s %b", key.c_str(), value, size);
+    }
+
+    void Redis::incrPipeline(const std::string &key) {
+        redisAppendCommand(context, "INCR %s", key.c_str());
+    }
+
+    void Redis::delPipeline(const std::string &key) {
+        redisAppendCommand(context, "DEL %s", key.c_str());
+    }
+
+    void Redis::incrBitfieldPipeline(const std::string &key, long idx) {
+        // Increments the idx-th unsigned 32-bit integer in the string (stored big-endian)
+        redisAppendCommand(context, "BITFIELD %s INCRBY u32 #%li 1", key.c_str(), idx);
+    }
+
     void Redis::flushPipeline(long pipelineLength) {
         void *reply;
         for (long p = 0; p < pipelineLength; p++) {
@@ -512,6 +529,44 @@ namespace redis {
         freeReplyObject(reply);
     }
 
+    void Redis::enqueueBytesPipeline(const std::string &queueName, const std::vector<uint8_t> &value) {
+        redisAppendCommand(context, "RPUSH %s %b", queueName.c_str(), value.data(), value.size());
+    }
+
+    void Redis::enqueueBytesBatch(const std::string &queueName, const std::vector<std::vector<uint8_t>> &values) {
+        pushBytesBatch("RPUSH", queueName, values.begin(), values.end());
+    }
+
+    void Redis::requeueBytesBatch(const std::string &queueName, const std::vector<std::vector<uint8_t>> &values) {
+        // LPUSH inserts each value at the head in turn, so push in reverse to keep the order
+        pushBytesBatch("LPUSH", queueName, values.rbegin(), values.rend());
+    }
+
+    template<typename It>
+    void Redis::pushBytesBatch(const char *cmd, const std::string &queueName, It begin, It end) {
+        if (begin == end) {
+            return;
+        }
+
+        // Push all values with a single command
+        std::vector<const char *> argv = {cmd, queueName.c_str()};
+        std::vector<size_t> argvLen = {strlen(cmd), queueName.size()};
+        for (It it = begin; it != end; ++it) {
+            argv.push_back(reinterpret_cast<const char *>(it->data()));
+            argvLen.push_back(it->size());
+        }
+
+        auto reply = (redisReply *) redisCommandArgv(context, (int) argv.size(), argv.data(), argvLen.data());
+
+        if (reply == nullptr || reply->type != REDIS_REPLY_INTEGER) {
+            int replyType = reply == nullptr ? -1 : reply->type;
+            freeReplyObject(reply);
+            throw std::runtime_error("Failed to push batch. Reply type = " + std::to_string(replyType));
+        }
+
+        freeReplyObject(reply);
+    }
+
 
     redisReply *Redis::dequeueBase(const std::string &queueName, int timeoutMs) {
         // NOTE - we contradict the default redis behaviour here by doing a non-blocking pop when
@@ -589,6 +644,34 @@ namespace redis {
         freeReplyObject(reply);
     }
 
+    std::vector<std::vector<uint8_t>> Redis::dequeueBytesBatch(const std::string &queueName, long maxElems,
+                                                               int timeoutMs) {
+        // Wait for the first value as normal
+        std::vector<std::vector<uint8_t>> result;
+        result.push_back(dequeueBytes(queueName, timeoutMs));
+
+        // Pipeline non-blocking pops for anything else that's already there. Other consumers
+        // may still get there first, in which case the pops just come back empty.
+        long nExtra = std::min(listLength(queueName), maxElems - 1);
+        for (long i = 0; i < nExtra; i++) {
+            redisAppendCommand(context, "LPOP %s", queueName.c_str());
+        }
+
+        for (long i = 0; i < nExtra; i++) {
+            void *reply;
+            redisGetReply(context, &reply);
+
+            auto r = (redisReply *) reply;
+            if (r != nullptr && r->type == REDIS_REPLY_STRING) {
+                result.push_back(getBytesFromReply(r));
+            }
+
+            freeReplyObject(reply);
+        }
+
+        return result;
+    }
+
     std::vector<uint8_t> Redis::dequeueBytes(const std::string &queueName, int timeoutMs) {
         bool isBlocking = timeoutMs > 0;
         redisReply *reply = this->dequeueBase(queueName, timeoutMs);
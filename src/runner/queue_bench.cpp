@@ -0,0 +1,65 @@
+#include <util/logging.h>
+#include <util/queue.h>
+
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#define OPS_PER_THREAD 200000
+
+/**
+ * Compares throughput of the mutex-based queue and the lock-free queue with equal numbers
+ * of producer and consumer threads.
+ */
+template<typename Q>
+double runBenchmark(Q &queue, int nThreads) {
+    std::vector<std::thread> threads;
+
+    auto start = std::chrono::steady_clock::now();
+    for (int t = 0; t < nThreads; t++) {
+        threads.emplace_back([&queue] {
+            for (long i = 0; i < OPS_PER_THREAD; i++) {
+                queue.enqueue(i);
+            }
+        });
+
+        threads.emplace_back([&queue] {
+            for (long i = 0; i < OPS_PER_THREAD; i++) {
+                queue.dequeue();
+            }
+        });
+    }
+
+    for (auto &t : threads) {
+        t.join();
+    }
+
+    double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return ((double) nThreads * OPS_PER_THREAD) / secs;
+}
+
+int main(int argc, char *argv[]) {
+    util::initLogging();
+    const std::shared_ptr<spdlog::logger> logger = util::getLogger();
+
+    int maxThreads = 64;
+    if (argc == 2) {
+        maxThreads = std::stoi(argv[1]);
+    } else if (argc > 2) {
+        logger->error("Usage: queue_bench [max_threads]");
+        return 1;
+    }
+
+    logger->info("{:>8} {:>16} {:>16}", "threads", "mutex (ops/s)", "lock-free (ops/s)");
+    for (int nThreads = 1; nThreads <= maxThreads; nThreads *= 2) {
+        util::Queue<long> mutexQueue;
+        double mutexRate = runBenchmark(mutexQueue, nThreads);
+
+        util::LockFreeQueue<long> lockFreeQueue;
+        double lockFreeRate = runBenchmark(lockFreeQueue, nThreads);
+
+        logger->info("{:>8} {:>16.0f} {:>16.0f}", nThreads, mutexRate, lockFreeRate);
+    }
+
+    return 0;
+}
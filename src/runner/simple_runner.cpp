@@ -82,10 +82,10 @@ bool runFunction(std::string &user, std::string &function, int runCount) {
 
     // Create the module
     module_cache::WasmModuleCache &registry = module_cache::getWasmModuleCache();
-    wasm::WAVMWasmModule &cachedModule = registry.getCachedModule(m);
+    std::shared_ptr<wasm::WAVMWasmModule> cachedModule = registry.getCachedModule(m);
 
     // Create new module from cache
-    wasm::WAVMWasmModule module(cachedModule);
+    wasm::WAVMWasmModule module(*cachedModule);
 
     // Run repeated executions
     bool success = true;
@@ -102,7 +102,7 @@ bool runFunction(std::string &user, std::string &function, int runCount) {
         }
 
         // Reset using cached module
-        module = cachedModule;
+        module = *cachedModule;
         logger->info("DONE Run {} - {}/{} ", i, user, function);
     }
 
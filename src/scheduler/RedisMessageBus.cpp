@@ -47,6 +47,36 @@ namespace scheduler {
         }
     }
 
+    std::vector<message::Message> RedisMessageBus::nextMessageBatch(int maxMessages, int timeoutMs) {
+        const std::shared_ptr<spdlog::logger> &logger = util::getLogger();
+
+        std::vector<std::vector<uint8_t>> dequeueResults;
+        try {
+            logger->debug("Waiting for up to {} messages on {}", maxMessages, conf.queueName);
+
+            // Blocks for the first message then drains whatever else is waiting
+            dequeueResults = redis.dequeueBytesBatch(conf.queueName, maxMessages, timeoutMs);
+        }
+        catch (redis::RedisNoResponseException &ex) {
+            throw GlobalMessageBusNoMessageException("No message from global bus");
+        }
+
+        std::vector<message::Message> msgs;
+        msgs.reserve(dequeueResults.size());
+        for (const auto &bytes : dequeueResults) {
+            if (conf.serialisation == "json") {
+                std::string json(bytes.begin(), bytes.end());
+                msgs.emplace_back(util::jsonToMessage(json));
+            } else {
+                message::Message msg;
+                msg.ParseFromArray(bytes.data(), (int) bytes.size());
+                msgs.emplace_back(std::move(msg));
+            }
+        }
+
+        return msgs;
+    }
+
     void RedisMessageBus::setFunctionResult(message::Message &msg) {
         // Record which node did the execution
         msg.set_executednode(util::getNodeId());
@@ -14,10 +14,93 @@ namespace scheduler {
     Scheduler::Scheduler() :
             nodeId(util::getNodeId()),
             conf(util::getSystemConfig()),
-            sharingBus(SharingMessageBus::getInstance()),
             logMessageIds(false) {
 
         bindQueue = std::make_shared<InMemoryMessageQueue>();
+
+        warmSetThread = std::thread([this] {
+            applyWarmSetUpdates();
+        });
+    }
+
+    Scheduler::~Scheduler() {
+        queueWarmSetUpdate(STOP_UPDATES, "");
+        if (warmSetThread.joinable()) {
+            warmSetThread.join();
+        }
+    }
+
+    void Scheduler::queueWarmSetUpdate(WarmSetUpdateType type, const std::string &funcStr) {
+        {
+            util::UniqueLock lock(warmSetMx);
+            warmSetQueued++;
+        }
+
+        warmSetQueue.enqueue({type, funcStr});
+    }
+
+    void Scheduler::applyWarmSetUpdates() {
+        util::Clock &clock = util::getGlobalClock();
+        util::TimePoint lastLoadPublish;
+
+        while (true) {
+            // Load hints are published from here, at most once per cache TTL
+            long publishInterval = std::max(conf.schedulerCacheTtl, 1);
+            if (clock.timeDiff(clock.now(), lastLoadPublish) >= publishInterval) {
+                lastLoadPublish = clock.now();
+                try {
+                    publishNodeLoad();
+                } catch (std::exception &e) {
+                    util::getLogger()->error("Failed publishing load for {}: {}", nodeId, e.what());
+                }
+            }
+
+            WarmSetUpdate update;
+            try {
+                update = warmSetQueue.dequeue(publishInterval);
+            } catch (util::QueueTimeoutException &e) {
+                continue;
+            }
+
+            if (update.type == STOP_UPDATES) {
+                break;
+            }
+
+            try {
+                switch (update.type) {
+                    case (ADD_WARM):
+                        addNodeToWarmSet(update.funcStr);
+                        break;
+                    case (REMOVE_WARM):
+                        removeNodeFromWarmSet(update.funcStr);
+                        break;
+                    case (ADD_GLOBAL):
+                        addNodeToGlobalSet();
+                        break;
+                    case (REMOVE_GLOBAL):
+                        removeNodeFromGlobalSet();
+                        break;
+                    default:
+                        break;
+                }
+            } catch (std::exception &e) {
+                util::getLogger()->error("Failed updating warm set for {}: {}", update.funcStr, e.what());
+            }
+
+            {
+                util::UniqueLock lock(warmSetMx);
+                warmSetApplied++;
+            }
+            warmSetCv.notify_all();
+        }
+    }
+
+    void Scheduler::flushWarmSetUpdates() {
+        util::UniqueLock lock(warmSetMx);
+        long target = warmSetQueued;
+        warmSetCv.wait(lock, [this, target] {
+            return warmSetApplied >= target;
+        });
     }
 
     void Scheduler::addNodeToGlobalSet(const std::string &node) {
@@ -48,18 +131,31 @@ namespace scheduler {
     }
 
     void Scheduler::clear() {
-        // Remove this node from all the global warm sets
-        for (const auto &iter: queueMap) {
-            this->removeNodeFromWarmSet(iter.first);
+        // Let outstanding updates land before undoing them
+        flushWarmSetUpdates();
+        clearNodeSetCache();
+        nodeInFlightCount = 0;
+
+        // Remove this node from all the global warm sets and clear all queues and data
+        for (auto &shard : shards) {
+            util::FullLock lock(shard.mx);
+            for (const auto &iter: shard.records) {
+                this->removeNodeFromWarmSet(iter.first);
+            }
+            shard.records.clear();
         }
 
-        // Clear all queues and data
         bindQueue->reset();
-        queueMap.clear();
-        threadCountMap.clear();
-        inFlightCountMap.clear();
-        opinionMap.clear();
-        loggedMessageIds.clear();
+
+        {
+            util::UniqueLock lock(idleMx);
+            idleWorkers.clear();
+        }
+
+        {
+            util::UniqueLock lock(logMx);
+            loggedMessageIds.clear();
+        }
 
         setMessageIdLogging(false);
 
@@ -68,23 +164,45 @@ namespace scheduler {
 
     void Scheduler::enqueueMessage(const message::Message &msg) {
         if (msg.type() == message::Message_MessageType_BIND) {
-            bindQueue->enqueue(msg);
+            dispatchBind(util::funcToString(msg, false), msg);
         } else {
             auto q = this->getFunctionQueue(msg);
             q->enqueue(msg);
         }
     }
 
-    long Scheduler::getFunctionThreadCount(const message::Message &msg) {
+    std::shared_ptr<FunctionRecord> Scheduler::getFunctionRecord(const message::Message &msg) {
         std::string funcStr = util::funcToString(msg, false);
-        return threadCountMap[funcStr];
+        SchedulerShard &shard = shards[std::hash<std::string>{}(funcStr) % SCHEDULER_SHARDS];
+
+        {
+            util::SharedLock lock(shard.mx);
+            auto it = shard.records.find(funcStr);
+            if (it != shard.records.end()) {
+                return it->second;
+            }
+        }
+
+        util::FullLock lock(shard.mx);
+        auto it = shard.records.find(funcStr);
+        if (it != shard.records.end()) {
+            return it->second;
+        }
+
+        auto record = std::make_shared<FunctionRecord>(funcStr);
+        shard.records.emplace(funcStr, record);
+        return record;
+    }
+
+    long Scheduler::getFunctionThreadCount(const message::Message &msg) {
+        return getFunctionRecord(msg)->threadCount;
     }
 
     double Scheduler::getFunctionInFlightRatio(const message::Message &msg) {
-        std::string funcStr = util::funcToString(msg, false);
+        auto record = getFunctionRecord(msg);
 
-        long threadCount = threadCountMap[funcStr];
-        long inFlightCount = getFunctionInFlightCount(msg);
+        long threadCount = record->threadCount;
+        long inFlightCount = record->inFlightCount;
 
         if (threadCount == 0) {
             return 0;
@@ -103,69 +221,64 @@ namespace scheduler {
     }
 
     long Scheduler::getFunctionInFlightCount(const message::Message &msg) {
-        return inFlightCountMap[util::funcToString(msg, false)];
+        return getFunctionRecord(msg)->inFlightCount;
     }
 
     std::shared_ptr<InMemoryMessageQueue> Scheduler::getFunctionQueue(const message::Message &msg) {
-        std::string funcStr = util::funcToString(msg, false);
-
-        // This will be called from within something holding the lock
-        if (queueMap.count(funcStr) == 0) {
-            if (queueMap.count(funcStr) == 0) {
-                auto mq = new InMemoryMessageQueue();
-                queueMap.emplace(InMemoryMessageQueuePair(funcStr, mq));
-            }
-        }
-
-        return queueMap[funcStr];
+        return getFunctionRecord(msg)->queue;
     }
 
     void Scheduler::notifyCallFinished(const message::Message &msg) {
-        util::FullLock lock(mx);
+        auto record = getFunctionRecord(msg);
+        util::UniqueLock lock(record->mx);
 
         // Decrement the in-flight count
-        const std::string funcStr = util::funcToString(msg, false);
-        inFlightCountMap[funcStr] = std::max(inFlightCountMap[funcStr] - 1, 0L);
+        if (record->inFlightCount > 0) {
+            record->inFlightCount--;
+            nodeInFlightCount--;
+        }
 
-        updateOpinion(msg);
+        updateOpinion(*record, msg);
     }
 
     void Scheduler::notifyThreadFinished(const message::Message &msg) {
-        std::string funcStr = util::funcToString(msg, false);
+        auto record = getFunctionRecord(msg);
+        util::UniqueLock lock(record->mx);
 
-        {
-            util::FullLock lock(mx);
-            threadCountMap[funcStr] = std::max(threadCountMap[funcStr] - 1, 0L);
+        record->threadCount = std::max(record->threadCount - 1, 0L);
 
-            updateOpinion(msg);
-        }
+        updateOpinion(*record, msg);
     }
 
     void Scheduler::notifyAwaiting(const message::Message &msg) {
-        std::string funcStr = util::funcToString(msg, false);
+        auto record = getFunctionRecord(msg);
 
         // When a thread is awaiting a call, we can reduce the thread count
         // as it's doing a non-blocking wait, then we can potentially add more
-        {
-            util::FullLock lock(mx);
-            threadCountMap[funcStr] = std::max(threadCountMap[funcStr] - 1, 0L);
+        util::UniqueLock lock(record->mx);
+        record->threadCount = std::max(record->threadCount - 1, 0L);
 
-            addWarmThreads(msg);
+        addWarmThreads(*record, msg);
 
-            updateOpinion(msg);
-        }
+        updateOpinion(*record, msg);
     }
 
     void Scheduler::notifyFinishedAwaiting(const message::Message &msg) {
-        std::string funcStr = util::funcToString(msg, false);
+        auto record = getFunctionRecord(msg);
 
         // When a thread returns from awaiting, we can increase the thread count again
-        {
-            util::FullLock lock(mx);
-            threadCountMap[funcStr]++;
+        util::UniqueLock lock(record->mx);
+        record->threadCount++;
 
-            updateOpinion(msg);
-        }
+        updateOpinion(*record, msg);
+    }
+
+    AwaitingGuard::AwaitingGuard(Scheduler &schIn, const message::Message &msgIn) : sch(schIn), msg(msgIn) {
+        sch.notifyAwaiting(msg);
+    }
+
+    AwaitingGuard::~AwaitingGuard() {
+        sch.notifyFinishedAwaiting(msg);
     }
 
     std::string Scheduler::getFunctionWarmSetName(const message::Message &msg) {
@@ -188,7 +301,6 @@ namespace scheduler {
     }
 
     void Scheduler::callFunction(message::Message &msg, bool forceLocal) {
-        util::FullLock lock(mx);
         PROF_START(scheduleCall)
 
         const std::shared_ptr<spdlog::logger> &logger = util::getLogger();
@@ -208,25 +320,29 @@ namespace scheduler {
 
         // Log this call if needed
         if(logMessageIds) {
+            util::UniqueLock lock(logMx);
             loggedMessageIds.push_back(msg.id());
         }
 
         const std::string funcStrWithId = util::funcToString(msg, true);
-        const std::string funcStrNoId = util::funcToString(msg, false);
 
         if (bestNode == nodeId) {
             // Run locally if we're the best choice
             logger->debug("Executing {} locally", funcStrWithId);
-            this->enqueueMessage(msg);
+            auto record = getFunctionRecord(msg);
+            util::UniqueLock lock(record->mx);
+
+            record->queue->enqueue(msg);
 
             // Increment the in-flight count
-            inFlightCountMap[funcStrNoId]++;
+            record->inFlightCount++;
+            nodeInFlightCount++;
 
             // Add more threads if necessary
-            this->addWarmThreads(msg);
+            this->addWarmThreads(*record, msg);
 
             // Update our opinion
-            updateOpinion(msg);
+            updateOpinion(*record, msg);
         } else {
             // Increment the number of hops
             msg.set_hops(msg.hops() + 1);
@@ -236,20 +352,23 @@ namespace scheduler {
                           nodeId, funcStrWithId,
                           bestNode, msg.hops());
 
+            // The bus is per thread, as it holds the thread's Redis connection
+            SharingMessageBus &sharingBus = SharingMessageBus::getInstance();
             sharingBus.shareMessageWithNode(bestNode, msg);
         }
 
         PROF_END(scheduleCall)
     }
 
-    void Scheduler::addWarmThreads(const message::Message &msg) {
+    void Scheduler::addWarmThreads(FunctionRecord &record, const message::Message &msg) {
+        // Should be called holding the record's lock
         const std::shared_ptr<spdlog::logger> logger = util::getLogger();
 
         int maxInFlightRatio = getFunctionMaxInFlightRatio(msg);
-        double inFlightRatio = getFunctionInFlightRatio(msg);
-        long nThreads = getFunctionThreadCount(msg);
+        long nThreads = record.threadCount;
+        double inFlightRatio = nThreads == 0 ? 0 : ((double) record.inFlightCount) / nThreads;
 
-        const std::string funcStr = util::funcToString(msg, false);
+        const std::string &funcStr = record.funcStr;
         logger->debug("{} IF ratio = {} (max {}) threads = {}", funcStr, inFlightRatio, maxInFlightRatio, nThreads);
 
         // If we have no threads OR if we've got threads and are at or over the in-flight ratio
@@ -262,7 +381,7 @@ namespace scheduler {
             logger->debug("Scaling up {} to {} threads", funcStr, nThreads + 1);
 
             // Increment thread count here
-            threadCountMap[funcStr]++;
+            record.threadCount++;
 
             // Send bind message (i.e. request a thread)
             message::Message bindMsg = util::messageFactory(msg.user(), msg.function());
@@ -272,8 +391,75 @@ namespace scheduler {
             bindMsg.set_pythonuser(msg.pythonuser());
             bindMsg.set_pythonfunction(msg.pythonfunction());
 
-            this->enqueueMessage(bindMsg);
+            dispatchBind(funcStr, bindMsg);
+        }
+    }
+
+    void Scheduler::dispatchBind(const std::string &funcStr, const message::Message &bindMsg) {
+        util::UniqueLock lock(idleMx);
+
+        if (idleWorkers.empty()) {
+            bindQueue->enqueue(bindMsg);
+            return;
+        }
+
+        // Prefer the most recent worker to have run this function, as its module is still warm.
+        // Failing that, prefer one with nothing loaded, then the one that's been idle longest
+        auto match = idleWorkers.end();
+        for (auto it = idleWorkers.rbegin(); it != idleWorkers.rend(); ++it) {
+            if (it->lastFuncStr == funcStr) {
+                match = std::prev(it.base());
+                break;
+            }
+        }
+
+        if (match == idleWorkers.end()) {
+            match = std::find_if(idleWorkers.begin(), idleWorkers.end(), [](const IdleWorker &w) {
+                return w.lastFuncStr.empty();
+            });
+        }
+
+        if (match == idleWorkers.end()) {
+            match = idleWorkers.begin();
         }
+
+        match->inbox->enqueue(bindMsg);
+        idleWorkers.erase(match);
+    }
+
+    void Scheduler::parkIdleWorker(const std::string &lastFuncStr,
+                                   const std::shared_ptr<InMemoryMessageQueue> &inbox) {
+        util::UniqueLock lock(idleMx);
+
+        // Anything already waiting on the shared bind queue goes straight to this worker
+        message::Message bindMsg;
+        if (bindQueue->tryDequeue(bindMsg)) {
+            inbox->enqueue(bindMsg);
+            return;
+        }
+
+        idleWorkers.push_back({lastFuncStr, inbox});
+    }
+
+    bool Scheduler::unparkIdleWorker(const std::shared_ptr<InMemoryMessageQueue> &inbox) {
+        util::UniqueLock lock(idleMx);
+
+        auto it = std::find_if(idleWorkers.begin(), idleWorkers.end(), [&inbox](const IdleWorker &w) {
+            return w.inbox == inbox;
+        });
+
+        // If the worker is no longer parked a bind message has already been sent to its inbox
+        if (it == idleWorkers.end()) {
+            return false;
+        }
+
+        idleWorkers.erase(it);
+        return true;
+    }
+
+    long Scheduler::getIdleWorkerCount() {
+        util::UniqueLock lock(idleMx);
+        return (long) idleWorkers.size();
     }
 
     std::string opinionStr(const SchedulerOpinion &o) {
@@ -292,17 +478,17 @@ namespace scheduler {
         }
     }
 
-    void Scheduler::updateOpinion(const message::Message &msg) {
-        // Lock-free, should be called when lock held
-        const std::string funcStr = util::funcToString(msg, false);
+    void Scheduler::updateOpinion(FunctionRecord &record, const message::Message &msg) {
+        // Should be called holding the record's lock
+        const std::string &funcStr = record.funcStr;
 
         // Check the thread capacity
-        long threadCount = this->getFunctionThreadCount(msg);
+        long threadCount = record.threadCount;
         bool hasWarmThreads = threadCount > 0;
         bool atMaxThreads = threadCount >= conf.maxWorkersPerFunction;
 
         // Check the in-flight ratio
-        double inFlightRatio = this->getFunctionInFlightRatio(msg);
+        double inFlightRatio = threadCount == 0 ? 0 : ((double) record.inFlightCount) / threadCount;
         int maxInFlightRatio = this->getFunctionMaxInFlightRatio(msg);
         bool isInFlightRatioBreached = inFlightRatio >= maxInFlightRatio;
 
@@ -325,7 +511,7 @@ namespace scheduler {
         }
 
         const std::shared_ptr<spdlog::logger> &logger = util::getLogger();
-        SchedulerOpinion currentOpinion = opinionMap[funcStr];
+        SchedulerOpinion currentOpinion = record.opinion;
         if (newOpinion != currentOpinion) {
             std::string newOpinionStr = opinionStr(newOpinion);
             std::string currentOpinionStr = opinionStr(currentOpinion);
@@ -342,35 +528,35 @@ namespace scheduler {
                     maxInFlightRatio
             );
 
+            // Redis is updated in the background so as not to hold up scheduling
             if (newOpinion == NO) {
                 // Moving to no means we want to switch off from all decisions
-                removeNodeFromWarmSet(funcStr);
-                removeNodeFromGlobalSet();
+                queueWarmSetUpdate(REMOVE_WARM, funcStr);
+                queueWarmSetUpdate(REMOVE_GLOBAL, funcStr);
             } else if (newOpinion == MAYBE && currentOpinion == NO) {
                 // Rejoin the global set if we're now a maybe when previously a no
-                addNodeToGlobalSet();
+                queueWarmSetUpdate(ADD_GLOBAL, funcStr);
             } else if (newOpinion == MAYBE && currentOpinion == YES) {
                 // Stay in the global set, but not in the warm if we've gone back to maybe from yes
-                removeNodeFromWarmSet(funcStr);
+                queueWarmSetUpdate(REMOVE_WARM, funcStr);
             } else if (newOpinion == YES && currentOpinion == NO) {
                 // Rejoin everything if we're into a yes state from a no
-                addNodeToWarmSet(funcStr);
-                addNodeToGlobalSet();
+                queueWarmSetUpdate(ADD_WARM, funcStr);
+                queueWarmSetUpdate(ADD_GLOBAL, funcStr);
             } else if (newOpinion == YES && currentOpinion == MAYBE) {
                 // Join the warm set if we've become yes from maybe
-                addNodeToWarmSet(funcStr);
+                queueWarmSetUpdate(ADD_WARM, funcStr);
             } else {
                 throw std::logic_error("Should not be able to reach this point");
             }
 
-            // Finally update the map
-            opinionMap[funcStr] = newOpinion;
+            // Finally update the record
+            record.opinion = newOpinion;
         }
     }
 
     SchedulerOpinion Scheduler::getOpinion(const message::Message &msg) {
-        const std::string funcStr = funcToString(msg, false);
-        return opinionMap[funcStr];
+        return getFunctionRecord(msg)->opinion;
     }
 
     std::string Scheduler::getBestNodeForFunction(const message::Message &msg) {
@@ -384,22 +570,21 @@ namespace scheduler {
 
         // Accept if we have capacity
         const std::string funcStrNoId = util::funcToString(msg, false);
-        SchedulerOpinion thisOpinion = opinionMap[funcStrNoId];
+        SchedulerOpinion thisOpinion = getFunctionRecord(msg)->opinion;
         if (thisOpinion == YES) {
             return nodeId;
         }
 
         // Get options from the warm set
         std::string warmSet = this->getFunctionWarmSetName(msg);
-        redis::Redis &redis = redis::Redis::getQueue();
-        std::unordered_set<std::string> warmOptions = redis.smembers(warmSet);
+        std::unordered_set<std::string> warmOptions = getCachedNodeSet(warmSet);
 
         // Remove this node from the warm options
         warmOptions.erase(nodeId);
 
-        // If we have warm options, pick a random one
+        // If we have warm options, pick the least loaded
         if (!warmOptions.empty()) {
-            return util::randomStringFromSet(warmOptions);
+            return pickLeastLoadedNode(warmOptions);
         }
 
         // If there are no other warm options and we're a maybe, accept on this node
@@ -408,12 +593,12 @@ namespace scheduler {
         }
 
         // Now there's no warm options we're rejecting, so check all options
-        std::unordered_set<std::string> allOptions = redis.smembers(GLOBAL_NODE_SET);
+        std::unordered_set<std::string> allOptions = getCachedNodeSet(GLOBAL_NODE_SET);
         allOptions.erase(nodeId);
 
         if (!allOptions.empty()) {
-            // Pick a random option from all nodes
-            return util::randomStringFromSet(allOptions);
+            // Pick from all nodes
+            return pickLeastLoadedNode(allOptions);
         } else {
             // Give up and try to execute locally
             double inFlightRatio = getFunctionInFlightRatio(msg);
@@ -429,6 +614,80 @@ namespace scheduler {
     }
 
     std::vector<unsigned int> Scheduler::getScheduledMessageIds() {
+        util::UniqueLock lock(logMx);
         return loggedMessageIds;
     }
-}
\ No newline at end of file
+
+    std::unordered_set<std::string> Scheduler::getCachedNodeSet(const std::string &setName) {
+        util::Clock &clock = util::getGlobalClock();
+
+        {
+            util::UniqueLock lock(cacheMx);
+            auto it = nodeSetCache.find(setName);
+            if (it != nodeSetCache.end() && clock.timeDiff(clock.now(), it->second.fetched) < conf.schedulerCacheTtl) {
+                return it->second.nodes;
+            }
+        }
+
+        // Fetch outside the lock so other decisions aren't held up by Redis
+        redis::Redis &redis = redis::Redis::getQueue();
+        std::unordered_set<std::string> nodes = redis.smembers(setName);
+
+        util::UniqueLock lock(cacheMx);
+        nodeSetCache[setName] = {nodes, clock.now()};
+        return nodes;
+    }
+
+    long Scheduler::getCachedNodeLoad(const std::string &node) {
+        util::Clock &clock = util::getGlobalClock();
+
+        {
+            util::UniqueLock lock(cacheMx);
+            auto it = nodeLoadCache.find(node);
+            if (it != nodeLoadCache.end() && clock.timeDiff(clock.now(), it->second.fetched) < conf.schedulerCacheTtl) {
+                return it->second.load;
+            }
+        }
+
+        // Nodes that haven't published a hint count as idle
+        redis::Redis &redis = redis::Redis::getQueue();
+        long load = redis.getLong(getNodeLoadKey(node));
+
+        util::UniqueLock lock(cacheMx);
+        nodeLoadCache[node] = {load, clock.now()};
+        return load;
+    }
+
+    std::string Scheduler::pickLeastLoadedNode(const std::unordered_set<std::string> &options) {
+        // Power of two choices, i.e. pick the less loaded of two random options
+        std::vector<std::string> choices = util::randomStringsFromSet(options, 2);
+        if (choices.size() < 2) {
+            return choices.empty() ? "" : choices.at(0);
+        }
+
+        if (getCachedNodeLoad(choices.at(1)) < getCachedNodeLoad(choices.at(0))) {
+            return choices.at(1);
+        }
+
+        return choices.at(0);
+    }
+
+    std::string Scheduler::getNodeLoadKey(const std::string &node) {
+        return NODE_LOAD_PREFIX + node;
+    }
+
+    long Scheduler::getNodeLoad() {
+        return nodeInFlightCount;
+    }
+
+    void Scheduler::publishNodeLoad() {
+        redis::Redis &redis = redis::Redis::getQueue();
+        redis.setLong(getNodeLoadKey(nodeId), nodeInFlightCount);
+    }
+
+    void Scheduler::clearNodeSetCache() {
+        util::UniqueLock lock(cacheMx);
+        nodeSetCache.clear();
+        nodeLoadCache.clear();
+    }
+}
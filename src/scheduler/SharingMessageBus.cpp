@@ -1,5 +1,6 @@
 #include "SharingMessageBus.h"
 
+#include <util/locks.h>
 #include <util/logging.h>
 #include <scheduler/Scheduler.h>
 
@@ -21,12 +22,35 @@ namespace scheduler {
     }
 
     message::Message SharingMessageBus::nextMessageForNode(const std::string &nodeId) {
+        std::deque<message::Message> &buffered = received[nodeId];
+        if (!buffered.empty()) {
+            message::Message msg = buffered.front();
+            buffered.pop_front();
+            return msg;
+        }
+
         std::string queueName = getSharingQueueNameForNode(nodeId);
-        std::vector<uint8_t> dequeueResult = redis.dequeueBytes(queueName, conf.globalMessageTimeout);
 
-        message::Message msg;
-        msg.ParseFromArray(dequeueResult.data(), (int) dequeueResult.size());
+        if (conf.sharingBatchSize <= 1) {
+            std::vector<uint8_t> dequeueResult = redis.dequeueBytes(queueName, conf.globalMessageTimeout);
+
+            message::Message msg;
+            msg.ParseFromArray(dequeueResult.data(), (int) dequeueResult.size());
+
+            return msg;
+        }
+
+        // Drain as many as we can in one go and hold on to the rest
+        std::vector<std::vector<uint8_t>> results = redis.dequeueBytesBatch(queueName, conf.sharingBatchSize,
+                                                                            conf.globalMessageTimeout);
+        for (const auto &r : results) {
+            message::Message msg;
+            msg.ParseFromArray(r.data(), (int) r.size());
+            buffered.push_back(msg);
+        }
 
+        message::Message msg = buffered.front();
+        buffered.pop_front();
         return msg;
     }
 
@@ -34,17 +58,147 @@ namespace scheduler {
         return this->nextMessageForNode(thisNodeId);
     }
 
+    void SharingMessageBus::requeueReceived() {
+        for (auto &p : received) {
+            if (p.second.empty()) {
+                continue;
+            }
+
+            std::vector<std::vector<uint8_t>> msgBytes;
+            for (const auto &msg : p.second) {
+                msgBytes.emplace_back(util::messageToBytes(msg));
+            }
+
+            // Put them back at the head of the queue so they're next in line for another worker
+            redis.requeueBytesBatch(getSharingQueueNameForNode(p.first), msgBytes);
+            p.second.clear();
+        }
+    }
+
     void SharingMessageBus::shareMessageWithNode(const std::string &nodeId, const message::Message &msg) {
-        std::string queueName = getSharingQueueNameForNode(nodeId);
         std::vector<uint8_t> msgBytes = util::messageToBytes(msg);
+
+        if (conf.sharingBatchSize > 1) {
+            getSharingMessageBatcher().add(nodeId, std::move(msgBytes));
+            return;
+        }
+
+        std::string queueName = getSharingQueueNameForNode(nodeId);
         redis.enqueueBytes(queueName, msgBytes);
     }
 
     void SharingMessageBus::broadcastMessage(const message::Message &msg) {
         std::unordered_set<std::string> allOptions = redis.smembers(GLOBAL_NODE_SET);
 
+        // Broadcasts aren't batched, but are pipelined to all nodes at once
+        std::vector<uint8_t> msgBytes = util::messageToBytes(msg);
         for(auto &nodeId : allOptions) {
-            shareMessageWithNode(nodeId, msg);
+            redis.enqueueBytesPipeline(getSharingQueueNameForNode(nodeId), msgBytes);
         }
+
+        redis.flushPipeline((long) allOptions.size());
+    }
+
+    SharingMessageBatcher &getSharingMessageBatcher() {
+        static SharingMessageBatcher batcher;
+        return batcher;
+    }
+
+    SharingMessageBatcher::SharingMessageBatcher() : conf(util::getSystemConfig()) {
+        flushThread = std::thread([this] {
+            util::Clock &clock = util::getGlobalClock();
+
+            while (true) {
+                std::unordered_map<std::string, std::vector<std::vector<uint8_t>>> expired;
+                {
+                    util::UniqueLock lock(mx);
+                    cv.wait_for(lock, std::chrono::milliseconds(std::max(conf.sharingBatchWindow, 1)));
+
+                    if (stopped) {
+                        break;
+                    }
+
+                    for (auto it = pending.begin(); it != pending.end();) {
+                        if (clock.timeDiff(clock.now(), it->second.started) >= conf.sharingBatchWindow) {
+                            expired[it->first] = std::move(it->second.messages);
+                            it = pending.erase(it);
+                        } else {
+                            it++;
+                        }
+                    }
+                }
+
+                for (auto &p : expired) {
+                    try {
+                        pushBatch(p.first, p.second);
+                    } catch (std::exception &e) {
+                        util::getLogger()->error("Failed sharing {} messages with {}: {}", p.second.size(), p.first,
+                                                 e.what());
+                    }
+                }
+            }
+
+            // Send whatever is still pending on shutdown so accepted calls aren't dropped. This
+            // runs on the flush thread after its loop has finished, as the Redis connection is
+            // thread-local and the destructor's thread may already have torn its own down.
+            try {
+                flush();
+            } catch (std::exception &e) {
+                util::getLogger()->error("Failed sharing pending messages on shutdown: {}", e.what());
+            }
+        });
+    }
+
+    SharingMessageBatcher::~SharingMessageBatcher() {
+        {
+            util::UniqueLock lock(mx);
+            stopped = true;
+        }
+        cv.notify_all();
+
+        if (flushThread.joinable()) {
+            flushThread.join();
+        }
+    }
+
+    void SharingMessageBatcher::add(const std::string &nodeId, std::vector<uint8_t> msgBytes) {
+        std::vector<std::vector<uint8_t>> full;
+        {
+            util::UniqueLock lock(mx);
+            PendingBatch &batch = pending[nodeId];
+            if (batch.messages.empty()) {
+                batch.started = util::getGlobalClock().now();
+            }
+
+            batch.messages.emplace_back(std::move(msgBytes));
+
+            if ((int) batch.messages.size() < conf.sharingBatchSize) {
+                return;
+            }
+
+            full = std::move(batch.messages);
+            pending.erase(nodeId);
+        }
+
+        // Push full batches straight away from the calling thread
+        pushBatch(nodeId, full);
+    }
+
+    void SharingMessageBatcher::flush() {
+        std::unordered_map<std::string, PendingBatch> toPush;
+        {
+            util::UniqueLock lock(mx);
+            std::swap(toPush, pending);
+        }
+
+        for (auto &p : toPush) {
+            pushBatch(p.first, p.second.messages);
+        }
+    }
+
+    void SharingMessageBatcher::pushBatch(const std::string &nodeId,
+                                          const std::vector<std::vector<uint8_t>> &messages) {
+        redis::Redis &redis = redis::Redis::getQueue();
+        redis.enqueueBytesBatch(getSharingQueueNameForNode(nodeId), messages);
     }
-}
\ No newline at end of file
+}
@@ -1,17 +1,37 @@
 #include "InMemoryStateKeyValue.h"
+#include "StateServer.h"
 
 #include <util/bytes.h>
+#include <util/config.h>
+#include <util/locks.h>
 #include <util/logging.h>
+#include <util/macros.h>
+#include <util/state.h>
+#include <util/timing.h>
+
+#include <unistd.h>
 
 #define MASTER_KEY_PREFIX "master_"
-#define STATE_PORT 8005
 
 namespace state {
+    static std::string getMasterKey(const std::string &actualKey) {
+        return MASTER_KEY_PREFIX + actualKey;
+    }
+
+    InMemoryStateKeyValue::InMemoryStateKeyValue(
+            const std::string &userIn, const std::string &keyIn, size_t sizeIn) :
+            InMemoryStateKeyValue(userIn, keyIn, sizeIn, util::getSystemConfig().endpointHost) {
+
+    }
+
     InMemoryStateKeyValue::InMemoryStateKeyValue(
-            const std::string &keyIn, size_t sizeIn) : StateKeyValue(keyIn, sizeIn),
-                                                       thisIP(util::getSystemConfig().endpointHost) {
+            const std::string &userIn, const std::string &keyIn, size_t sizeIn,
+            const std::string &thisIPIn) : StateKeyValue(util::keyForUser(userIn, keyIn), sizeIn),
+                                           user(userIn),
+                                           unmaskedKey(keyIn),
+                                           thisIP(thisIPIn) {
         // Establish master
-        const std::string masterKey = MASTER_KEY_PREFIX + key;
+        const std::string masterKey = getMasterKey(key);
         std::vector<uint8_t> masterIPBytes = redis.get(masterKey);
 
         if (masterIPBytes.empty()) {
@@ -28,33 +48,229 @@ namespace state {
                 // Claim the master if we've got the lock and nobody else is master
                 redis.set(masterKey, util::stringToBytes(thisIP));
                 masterIP = thisIP;
-                status = InMemoryStateKeyStatus::MASTER;
             } else {
                 // Set master if it's now not empty
                 masterIP = util::bytesToString(masterIPBytes);
-                status = InMemoryStateKeyStatus::NOT_MASTER;
             }
 
             redis.releaseLock(masterKey, masterLockId);
         } else {
             masterIP = util::bytesToString(masterIPBytes);
+        }
+
+        // Note that we may already be the master if the value has been recreated locally
+        if (masterIP == thisIP) {
+            status = InMemoryStateKeyStatus::MASTER;
+        } else {
             status = InMemoryStateKeyStatus::NOT_MASTER;
         }
     }
 
+    InMemoryStateKeyValue::~InMemoryStateKeyValue() {
+        if (masterClient) {
+            masterClient->exit();
+        }
+    }
+
+    bool InMemoryStateKeyValue::isMaster() {
+        return status == InMemoryStateKeyStatus::MASTER;
+    }
+
+    size_t InMemoryStateKeyValue::getStateSizeFromRemote(const std::string &userIn, const std::string &keyIn,
+                                                         const std::string &thisIPIn) {
+        redis::Redis &redis = redis::Redis::getState();
+        std::string actualKey = util::keyForUser(userIn, keyIn);
+
+        // If there's no master, or we're the master and don't have it, it doesn't exist yet
+        std::string masterIP = util::bytesToString(redis.get(getMasterKey(actualKey)));
+        if (masterIP.empty() || masterIP == thisIPIn) {
+            return 0;
+        }
+
+        StateRequest request;
+        request.user = userIn;
+        request.key = keyIn;
+
+        tcp::TCPClient client(masterIP, STATE_PORT);
+        tcp::TCPMessage *requestMsg = buildStateRequest(tcp::TCPMessageType::STATE_SIZE, request);
+        client.sendMessage(requestMsg);
+        tcp::freeTcpMessage(requestMsg);
+
+        tcp::TCPMessage *response = client.recvMessage();
+        client.exit();
+
+        if (response->status != tcp::TCPMessageStatus::OK) {
+            tcp::freeTcpMessage(response);
+            throw StateKeyValueException("Master failed size request for " + keyIn);
+        }
+
+        size_t stateSize = 0;
+        if (response->len == sizeof(size_t)) {
+            stateSize = *reinterpret_cast<size_t *>(response->buffer);
+        }
+        tcp::freeTcpMessage(response);
+
+        return stateSize;
+    }
+
+    StateRequest InMemoryStateKeyValue::buildRequest(size_t offset, size_t length, const uint8_t *data) {
+        StateRequest request;
+        request.user = user;
+        request.key = unmaskedKey;
+        request.valueSize = valueSize;
+        request.offset = offset;
+        request.length = length;
+        request.data = data;
+
+        return request;
+    }
+
+    void InMemoryStateKeyValue::exchangeWithMaster(tcp::TCPMessageType type, const StateRequest &request,
+                                                   const std::function<void(tcp::TCPClient &)> &receive) {
+        tcp::TCPMessage *requestMsg = buildStateRequest(type, request);
+
+        // Connection to the master is reused across requests on this value
+        util::UniqueLock lock(clientMutex);
+        try {
+            if (!masterClient) {
+                masterClient = std::make_unique<tcp::TCPClient>(masterIP, STATE_PORT);
+            }
+
+            masterClient->sendMessage(requestMsg);
+            tcp::freeTcpMessage(requestMsg);
+
+            receive(*masterClient);
+        } catch (tcp::TCPFailedException &ex) {
+            logger->error("Failed request to master {} for {}", masterIP, key);
+
+            if (masterClient) {
+                masterClient->exit();
+                masterClient.reset();
+            }
+
+            throw StateKeyValueException("Failed request to master for " + key);
+        }
+    }
+
+    tcp::TCPMessage *InMemoryStateKeyValue::sendToMaster(tcp::TCPMessageType type, const StateRequest &request) {
+        tcp::TCPMessage *response = nullptr;
+        exchangeWithMaster(type, request, [&response](tcp::TCPClient &client) {
+            response = client.recvMessage();
+        });
+
+        if (response->status != tcp::TCPMessageStatus::OK) {
+            tcp::freeTcpMessage(response);
+            throw StateKeyValueException("Master failed request for " + key);
+        }
+
+        return response;
+    }
+
+    size_t InMemoryStateKeyValue::sendToMasterInto(tcp::TCPMessageType type, const StateRequest &request,
+                                                   uint8_t *buffer, size_t bufferLen) {
+        // Response data is received directly into the given buffer
+        size_t responseLen = 0;
+        bool failed = false;
+        exchangeWithMaster(type, request, [&responseLen, &failed, buffer, bufferLen](tcp::TCPClient &client) {
+            tcp::TCPMessage response = client.recvMessageInto(buffer, bufferLen);
+            responseLen = response.len;
+            failed = response.status != tcp::TCPMessageStatus::OK;
+        });
+
+        if (failed) {
+            throw StateKeyValueException("Master failed request for " + key);
+        }
+
+        return responseLen;
+    }
+
+    bool InMemoryStateKeyValue::isGlobalLockHeld() {
+        return globalLockId != 0 && util::getGlobalClock().now() < globalLockExpiry;
+    }
+
+    long InMemoryStateKeyValue::takeGlobalLock() {
+        globalLockId = nextGlobalLockId++;
+        globalLockExpiry = util::getGlobalClock().now() + std::chrono::seconds(REMOTE_LOCK_TIMEOUT_SECS);
+        return globalLockId;
+    }
+
+    long InMemoryStateKeyValue::tryLockGlobalLocal() {
+        util::UniqueLock lock(globalLockMutex);
+        if (isGlobalLockHeld()) {
+            return 0;
+        }
+
+        return takeGlobalLock();
+    }
+
+    void InMemoryStateKeyValue::unlockGlobalLocal(long lockId) {
+        {
+            util::UniqueLock lock(globalLockMutex);
+
+            // The lock may have expired and been taken by someone else since
+            if (lockId != globalLockId) {
+                logger->warn("Ignoring unlock of {} with stale lock id {}", key, lockId);
+                return;
+            }
+
+            globalLockId = 0;
+        }
+
+        globalLockCv.notify_one();
+    }
+
     void InMemoryStateKeyValue::lockGlobal() {
         if (status == InMemoryStateKeyStatus::MASTER) {
-            // TODO - acquire global lock locally
-        } else {
-            // TODO - acquire global lock remotely
+            util::UniqueLock lock(globalLockMutex);
+            while (isGlobalLockHeld()) {
+                globalLockCv.wait_for(lock, std::chrono::seconds(REMOTE_LOCK_TIMEOUT_SECS));
+            }
+
+            lastGlobalLockId = takeGlobalLock();
+            return;
         }
+
+        // Remote locking mirrors the retries on a Redis lock
+        PROF_START(remoteLock)
+
+        unsigned int retryCount = 0;
+        while (true) {
+            tcp::TCPMessage *response = sendToMaster(tcp::TCPMessageType::STATE_LOCK, buildRequest(0, 0));
+            long lockId = 0;
+            if (response->len == sizeof(long)) {
+                std::copy(response->buffer, response->buffer + sizeof(long), BYTES(&lockId));
+            }
+            tcp::freeTcpMessage(response);
+
+            if (lockId > 0) {
+                lastGlobalLockId = lockId;
+                break;
+            }
+
+            logger->debug("Waiting on remote lock for {} (loop {})", key, retryCount);
+
+            if (retryCount >= REMOTE_LOCK_MAX_RETRIES) {
+                logger->error("Timed out waiting for lock on {}", key);
+                throw StateKeyValueException("Timed out waiting for lock on " + key);
+            }
+
+            // Sleep for 1ms
+            usleep(1000);
+            retryCount++;
+        }
+
+        PROF_END(remoteLock)
     }
 
     void InMemoryStateKeyValue::unlockGlobal() {
+        long lockId = lastGlobalLockId;
+
         if (status == InMemoryStateKeyStatus::MASTER) {
-            // TODO - global unlock locally
+            unlockGlobalLocal(lockId);
         } else {
-            // TODO - global unlock on remote
+            tcp::TCPMessage *response = sendToMaster(tcp::TCPMessageType::STATE_UNLOCK,
+                                                     buildRequest(0, sizeof(long), BYTES(&lockId)));
+            tcp::freeTcpMessage(response);
         }
     }
 
@@ -63,7 +279,7 @@ namespace state {
             return;
         }
 
-        // TODO - do pull from master
+        pullRangeFromRemote(0, valueSize);
     }
 
     void InMemoryStateKeyValue::pullRangeFromRemote(long offset, size_t length) {
@@ -71,30 +287,88 @@ namespace state {
             return;
         }
 
-        // TODO - do range pull from master
+        PROF_START(stateSegmentPull)
+
+        logger->debug("Pulling segment ({}-{}) for {} from {}", offset, offset + length, key, masterIP);
+        auto memoryBytes = static_cast<uint8_t *>(sharedMemory);
+        size_t responseLen = sendToMasterInto(tcp::TCPMessageType::STATE_GET, buildRequest(offset, length),
+                                              memoryBytes + offset, length);
+
+        if (responseLen != length) {
+            logger->error("Unexpected response length from master for {} ({} != {})", key, responseLen, length);
+            throw StateKeyValueException("Failed pulling from master for " + key);
+        }
+
+        PROF_END(stateSegmentPull)
     }
 
     void InMemoryStateKeyValue::pushToRemote() {
-        if (status == InMemoryStateKeyStatus::MASTER) {
-            return;
-        }
+        // Clear the dirty flags before reading the value, so writes flagged during the push
+        // stay dirty
+        isDirty = false;
+        zeroDirtyMask();
 
-        // TODO - do push to master
+        if (status != InMemoryStateKeyStatus::MASTER) {
+            PROF_START(pushFull)
+
+            logger->debug("Pushing whole value for {} to {}", key, masterIP);
+            auto memoryBytes = static_cast<uint8_t *>(sharedMemory);
+            tcp::TCPMessage *response = sendToMaster(tcp::TCPMessageType::STATE_SET,
+                                                     buildRequest(0, valueSize, memoryBytes));
+            tcp::freeTcpMessage(response);
+
+            PROF_END(pushFull)
+        }
     }
 
-    void InMemoryStateKeyValue::pushPartialToRemote(const uint8_t *dirtyMaskBytes) {
+    void InMemoryStateKeyValue::pushPartialToRemote(util::Bitmap &mask) {
         if (status == InMemoryStateKeyStatus::MASTER) {
+            mask.clearAll();
+            isDirty = false;
             return;
         }
 
-        // TODO - do partial push to master
+        PROF_START(pushPartial)
+
+        // Take the mask before reading the value, so segments flagged during the push stay dirty
+        util::Bitmap toPush = mask.takeAll();
+
+        // Build up the dirty segments to send in a single request
+        auto sharedMemoryBytes = BYTES(sharedMemory);
+        std::vector<uint8_t> segments;
+        long updateCount = 0;
+
+        toPush.forEachRun([&segments, &sharedMemoryBytes, &updateCount](size_t startIdx, size_t length) {
+            appendStateSegment(segments, startIdx, sharedMemoryBytes + startIdx, length);
+            updateCount++;
+        });
+
+        if (updateCount > 0) {
+            logger->debug("Pushing {} updates on {} to {}", updateCount, key, masterIP);
+            tcp::TCPMessage *response = sendToMaster(tcp::TCPMessageType::STATE_PUSH_PARTIAL,
+                                                     buildRequest(0, segments.size(), segments.data()));
+            tcp::freeTcpMessage(response);
+        }
+
+        // Read the latest value
+        if (_fullyAllocated) {
+            logger->debug("Pulling from master on partial push for {}", key);
+            pullFromRemote();
+        }
+
+        // Mark as no longer dirty
+        isDirty = false;
+
+        PROF_END(pushPartial)
     }
 
     void InMemoryStateKeyValue::deleteFromRemote() {
+        // The master's copy is the global copy, so clearing locally is enough
         if (status == InMemoryStateKeyStatus::MASTER) {
-            // TODO - delete locally
-        } else {
-            // TODO - request delete from master
+            return;
         }
+
+        tcp::TCPMessage *response = sendToMaster(tcp::TCPMessageType::STATE_DELETE, buildRequest(0, 0));
+        tcp::freeTcpMessage(response);
     }
-}
\ No newline at end of file
+}
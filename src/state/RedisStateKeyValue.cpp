@@ -1,13 +1,40 @@
 #include "RedisStateKeyValue.h"
 
+#include <util/config.h>
 #include <util/logging.h>
 #include <util/timing.h>
 #include <util/macros.h>
 
 namespace state {
-    RedisStateKeyValue::RedisStateKeyValue(const std::string &keyIn, size_t sizeIn) : StateKeyValue(keyIn, sizeIn) {
+    RedisStateKeyValue::RedisStateKeyValue(const std::string &keyIn, size_t sizeIn) :
+            StateKeyValue(keyIn, sizeIn),
+            pullChunkSize(util::getSystemConfig().statePullChunkSize),
+            pullTracker(std::make_shared<StatePullTracker>((sizeIn + pullChunkSize - 1) / pullChunkSize)),
+            versionedRefresh(util::getSystemConfig().stateRefreshMode == "versioned"),
+            versionKey(keyIn + "_version"),
+            epochKey(keyIn + "_epoch"),
+            chunkVersionsKey(keyIn + "_chunks"),
+            nChunks((sizeIn + STATE_VERSION_CHUNK_SIZE - 1) / STATE_VERSION_CHUNK_SIZE) {
     };
 
+    RedisStateKeyValue::~RedisStateKeyValue() {
+        // Chunks still being pulled are written straight into the shared memory
+        pullTracker->awaitIdle();
+    }
+
+    void RedisStateKeyValue::setRemote(const std::string &key, const std::vector<uint8_t> &value) {
+        redis::Redis &redis = redis::Redis::getState();
+
+        if (util::getSystemConfig().stateRefreshMode == "versioned") {
+            redis.setPipeline(key, value.data(), value.size());
+            redis.incrPipeline(key + "_epoch");
+            redis.incrPipeline(key + "_version");
+            redis.flushPipeline(3);
+        } else {
+            redis.set(key, value);
+        }
+    }
+
     void RedisStateKeyValue::lockGlobal() {
         lastRemoteLockId = waitOnRedisRemoteLock(key);
     }
@@ -21,22 +48,38 @@ namespace state {
 
         // Read from the remote
         logger->debug("Pulling remote value for {}", key);
-        auto memoryBytes = static_cast<uint8_t *>(sharedMemory);
-        redis.get(key, memoryBytes, valueSize);
+        pullRange(0, valueSize);
 
         PROF_END(statePull)
     }
 
+    void RedisStateKeyValue::pullRange(long offset, size_t length) {
+        if (length <= pullChunkSize) {
+            // Note - redis ranges are inclusive, so we need to knock one off
+            auto memoryBytes = static_cast<uint8_t *>(sharedMemory);
+            if (offset == 0 && length == valueSize) {
+                redis.get(key, memoryBytes, valueSize);
+            } else {
+                redis.getRange(key, memoryBytes + offset, length, offset, offset + length - 1);
+            }
+            return;
+        }
+
+        // Chunks are pulled in parallel straight into the value, which stays locked until all
+        // have landed
+        size_t firstChunk = offset / pullChunkSize;
+        size_t lastChunk = (offset + length - 1) / pullChunkSize;
+        auto memoryBytes = static_cast<uint8_t *>(sharedMemory);
+        getStatePullPool().pullChunks(key, memoryBytes, offset, length, pullChunkSize, pullTracker);
+        pullTracker->await(firstChunk, lastChunk - firstChunk + 1);
+    }
+
     void RedisStateKeyValue::pullRangeFromRemote(long offset, size_t length) {
         PROF_START(stateSegmentPull)
 
-        // Note - redis ranges are inclusive, so we need to knock one off
-        size_t rangeEnd = offset + length - 1;
-
         // Read from the remote
         logger->debug("Pulling remote segment ({}-{}) for {}", offset, offset + length, key);
-        auto memoryBytes = static_cast<uint8_t *>(sharedMemory);
-        redis.getRange(key, memoryBytes + offset, length, offset, rangeEnd);
+        pullRange(offset, length);
 
         PROF_END(stateSegmentPull)
     }
@@ -46,61 +89,72 @@ namespace state {
 
         logger->debug("Pushing whole value for {}", key);
 
-        redis.set(key, static_cast<uint8_t *>(sharedMemory), valueSize);
-
-        // Remove any dirty flags
+        // Clear the dirty flags before reading the value, so writes flagged during the push
+        // stay dirty
         isDirty = false;
         zeroDirtyMask();
 
+        // A full push invalidates everyone's chunk versions, including ours
+        if (versionedRefresh) {
+            redis.setPipeline(key, static_cast<uint8_t *>(sharedMemory), valueSize);
+            redis.incrPipeline(epochKey);
+            redis.incrPipeline(versionKey);
+            redis.flushPipeline(3);
+            versionsKnown = false;
+        } else {
+            redis.set(key, static_cast<uint8_t *>(sharedMemory), valueSize);
+        }
+
         PROF_END(pushFull)
     }
 
-    void RedisStateKeyValue::pushPartialToRemote(const uint8_t *dirtyMaskBytes) {
+    void RedisStateKeyValue::pushPartialToRemote(util::Bitmap &mask) {
         PROF_START(pushPartial)
 
+        // Take the mask before reading the value, so segments flagged during the push stay dirty
+        util::Bitmap toPush = mask.takeAll();
+
         // Iterate through and pipeline the dirty segments
         auto sharedMemoryBytes = BYTES(sharedMemory);
         long updateCount = 0;
-        long startIdx = 0;
-        bool isOn = false;
-
-        for (size_t i = 0; i < valueSize; i++) {
-            if (dirtyMaskBytes[i] == 0) {
-                // If we encounter an "off" mask and we're "on", switch off and write the segment
-                if (isOn) {
-                    isOn = false;
-
-                    // Pipeline the change
-                    unsigned long length = i - startIdx;
-                    redis.setRangePipeline(key, startIdx, sharedMemoryBytes + startIdx, length);
-                    updateCount++;
-                }
-            } else {
-                if (!isOn) {
-                    isOn = true;
-                    startIdx = i;
-                }
-            }
-        }
+        std::vector<bool> pushedChunks;
 
-        // Write a final chunk
-        if (isOn) {
-            unsigned long length = valueSize - startIdx;
+        toPush.forEachRun([this, &sharedMemoryBytes, &updateCount](size_t startIdx, size_t length) {
             redis.setRangePipeline(key, startIdx, sharedMemoryBytes + startIdx, length);
             updateCount++;
+        });
+
+        // Bump the version of each chunk we've written to after writing the data
+        if (versionedRefresh) {
+            pushedChunks.resize(nChunks, false);
+            toPush.forEachRun([this, &pushedChunks, &updateCount](size_t startIdx, size_t length) {
+                size_t firstChunk = startIdx / STATE_VERSION_CHUNK_SIZE;
+                size_t lastChunk = (startIdx + length - 1) / STATE_VERSION_CHUNK_SIZE;
+                for (size_t c = firstChunk; c <= lastChunk; c++) {
+                    if (!pushedChunks[c]) {
+                        pushedChunks[c] = true;
+                        redis.incrBitfieldPipeline(chunkVersionsKey, c);
+                        updateCount++;
+                    }
+                }
+            });
         }
 
-        // Zero the mask now that we're finished with it
-        memset((void *) dirtyMaskBytes, 0, valueSize);
-
         // Flush the pipeline
         logger->debug("Pipelined {} updates on {}", updateCount, key);
         redis.flushPipeline(updateCount);
 
         // Read the latest value
         if (_fullyAllocated) {
-            logger->debug("Pulling from remote on partial push for {}", key);
-            redis.get(key, sharedMemoryBytes, valueSize);
+            if (versionedRefresh) {
+                long newVersion = redis.incr(versionKey);
+                refreshChangedChunks(newVersion, pushedChunks);
+            } else {
+                logger->debug("Pulling from remote on partial push for {}", key);
+                pullRange(0, valueSize);
+            }
+        } else if (versionedRefresh) {
+            redis.incr(versionKey);
         }
 
         // Mark as no longer dirty
@@ -109,7 +163,89 @@ namespace state {
         PROF_END(pushPartial)
     }
 
+    std::vector<uint32_t> RedisStateKeyValue::getRemoteChunkVersions() {
+        // Chunks that have never been written won't be in the string, so are zero
+        std::vector<uint8_t> versionBytes = redis.get(chunkVersionsKey);
+        std::vector<uint32_t> versions(nChunks, 0);
+
+        size_t nRemote = std::min(nChunks, versionBytes.size() / sizeof(uint32_t));
+        for (size_t c = 0; c < nRemote; c++) {
+            const uint8_t *b = versionBytes.data() + c * sizeof(uint32_t);
+            versions[c] = ((uint32_t) b[0] << 24) | ((uint32_t) b[1] << 16) | ((uint32_t) b[2] << 8) | b[3];
+        }
+
+        return versions;
+    }
+
+    void RedisStateKeyValue::refreshChangedChunks(long newVersion, const std::vector<bool> &pushedChunks) {
+        PROF_START(refreshChunks)
+
+        // If nobody else has pushed since our last sync there's nothing to pull
+        if (versionsKnown && newVersion == lastVersion + 1) {
+            for (size_t c = 0; c < nChunks; c++) {
+                if (pushedChunks[c]) {
+                    chunkVersions[c]++;
+                }
+            }
+
+            lastVersion = newVersion;
+            logger->debug("No remote changes to {} since last sync", key);
+            return;
+        }
+
+        // Note - versions are read before data, so at worst we'll pull a chunk again unnecessarily
+        auto sharedMemoryBytes = BYTES(sharedMemory);
+        long remoteEpoch = redis.getCounter(epochKey);
+        std::vector<uint32_t> remoteVersions = getRemoteChunkVersions();
+
+        if (!versionsKnown || remoteEpoch != lastEpoch) {
+            logger->debug("Pulling whole value on partial push for {}", key);
+            pullRange(0, valueSize);
+        } else {
+            // Pull runs of chunks whose versions differ from what we expect
+            long pullCount = 0;
+            size_t c = 0;
+            while (c < nChunks) {
+                uint32_t expected = chunkVersions[c] + (pushedChunks[c] ? 1 : 0);
+                if (remoteVersions[c] == expected) {
+                    c++;
+                    continue;
+                }
+
+                size_t runStart = c;
+                while (c < nChunks && remoteVersions[c] != chunkVersions[c] + (pushedChunks[c] ? 1 : 0)) {
+                    c++;
+                }
+
+                long start = runStart * STATE_VERSION_CHUNK_SIZE;
+                size_t length = std::min(c * STATE_VERSION_CHUNK_SIZE, valueSize) - start;
+                redis.getRange(key, sharedMemoryBytes + start, length, start, start + length - 1);
+                pullCount++;
+            }
+
+            logger->debug("Pulled {} changed ranges on partial push for {}", pullCount, key);
+        }
+
+        chunkVersions = remoteVersions;
+        lastEpoch = remoteEpoch;
+        lastVersion = newVersion;
+        versionsKnown = true;
+
+        PROF_END(refreshChunks)
+    }
+
     void RedisStateKeyValue::deleteFromRemote() {
-        redis.del(key);
+        // Chunk versions go with the value, but the epoch moves on rather than restarting, so that
+        // clients that synced before the delete can't mistake a later value for the one they have
+        if (versionedRefresh) {
+            redis.delPipeline(key);
+            redis.delPipeline(chunkVersionsKey);
+            redis.incrPipeline(epochKey);
+            redis.incrPipeline(versionKey);
+            redis.flushPipeline(4);
+            versionsKnown = false;
+        } else {
+            redis.del(key);
+        }
     }
 }
\ No newline at end of file
@@ -15,7 +15,10 @@ namespace state {
     StateKeyValue::StateKeyValue(const std::string &keyIn, size_t sizeIn) : key(keyIn),
                                                                             redis(redis::Redis::getState()),
                                                                             logger(util::getLogger()),
-                                                                            valueSize(sizeIn) {
+                                                                            valueSize(sizeIn),
+                                                                            dirtyMask(sizeIn),
+                                                                            allocatedMask(
+                                                                                    getRequiredHostPages(sizeIn)) {
 
         // Work out size of required shared memory
         size_t nHostPages = getRequiredHostPages(valueSize);
@@ -24,15 +27,6 @@ namespace state {
 
         isDirty = false;
         _fullyAllocated = false;
-
-        // Set up flags
-        dirtyMask = new uint8_t[sharedMemSize];
-
-        zeroDirtyMask();
-
-        allocatedMask = new uint8_t[sharedMemSize];
-
-        zeroAllocatedMask();
     }
 
     void StateKeyValue::pull() {
@@ -41,14 +35,14 @@ namespace state {
     }
 
     bool StateKeyValue::isSegmentAllocated(long offset, size_t length) {
-        // TODO - more efficient way of checking this
-        auto allocatedMaskBytes = BYTES(allocatedMask);
-        for (size_t i = 0; i < length; i++) {
-            if (allocatedMaskBytes[offset + i] == 0) {
-                return false;
-            }
+        if (length == 0) {
+            return true;
         }
-        return true;
+
+        // Allocation is page-granular, so check all pages the segment touches
+        size_t firstPage = offset / HOST_PAGE_SIZE;
+        size_t lastPage = (offset + length - 1) / HOST_PAGE_SIZE;
+        return allocatedMask.allSet(firstPage, lastPage - firstPage + 1);
     }
 
     void StateKeyValue::get(uint8_t *buffer) {
@@ -105,6 +99,17 @@ namespace state {
         isDirty = true;
     }
 
+    void StateKeyValue::setInPlace(const std::function<void(uint8_t *)> &writeValue) {
+        FullLock lock(valueMutex);
+
+        if (sharedMemory == nullptr) {
+            initialiseStorage(true);
+        }
+
+        writeValue(static_cast<uint8_t *>(sharedMemory));
+        isDirty = true;
+    }
+
     void StateKeyValue::setSegment(long offset, const uint8_t *buffer, size_t length) {
         // Check we're in bounds
         size_t end = offset + length;
@@ -138,11 +143,11 @@ namespace state {
     }
 
     void StateKeyValue::zeroDirtyMask() {
-        memset(dirtyMask, 0, valueSize);
+        dirtyMask.clearAll();
     }
 
     void StateKeyValue::zeroAllocatedMask() {
-        memset(allocatedMask, 0, valueSize);
+        allocatedMask.clearAll();
     }
 
     void StateKeyValue::zeroValue() {
@@ -152,12 +157,19 @@ namespace state {
     }
 
     void StateKeyValue::flagSegmentDirty(long offset, long len) {
-        isDirty |= true;
-        memset(((uint8_t *) dirtyMask) + offset, 0b11111111, len);
+        // Flagging doesn't lock the value, so the mask has to be set before the flag
+        dirtyMask.set(offset, len);
+        isDirty = true;
     }
 
     void StateKeyValue::flagSegmentAllocated(long offset, long len) {
-        memset(((uint8_t *) allocatedMask) + offset, 0b11111111, len);
+        if (len <= 0) {
+            return;
+        }
+
+        size_t firstPage = offset / HOST_PAGE_SIZE;
+        size_t lastPage = (offset + len - 1) / HOST_PAGE_SIZE;
+        allocatedMask.set(firstPage, lastPage - firstPage + 1);
     }
 
     std::string StateKeyValue::getSegmentKey(long offset, long length) {
@@ -262,8 +274,18 @@ namespace state {
     void StateKeyValue::initialiseStorage(bool allocate) {
         PROF_START(initialiseStorage)
 
-        // Don't need to initialise twice
+        // Don't need to initialise twice, but may need to make a reserved region writable
         if (sharedMemory != nullptr) {
+            if (allocate && !_fullyAllocated) {
+                int res = mprotect(sharedMemory, sharedMemSize, PROT_WRITE);
+                if (res != 0) {
+                    logger->debug("Allocating reserved storage size {} failed. errno: {}", sharedMemSize, errno);
+                    throw std::runtime_error("Failed allocating memory for KV");
+                }
+
+                _fullyAllocated = true;
+            }
+
             return;
         }
 
@@ -310,12 +332,19 @@ namespace state {
         }
 
         uint8_t *maskPtr = maskKv->get();
-        doPushPartial(maskPtr);
+
+        // Convert the byte mask so that the push can scan it a word at a time
+        util::Bitmap mask(valueSize);
+        mask.setFromByteMask(maskPtr, valueSize);
+
+        // Mask is consumed by the push
+        if (doPushPartial(mask)) {
+            memset(maskPtr, 0, valueSize);
+        }
     }
 
     void StateKeyValue::pushPartial() {
-        auto dirtyMaskBytes = BYTES(dirtyMask);
-        doPushPartial(dirtyMaskBytes);
+        doPushPartial(dirtyMask);
     }
 
     void StateKeyValue::pushFull() {
@@ -385,10 +414,10 @@ namespace state {
         pullRangeFromRemote(offset, length);
     }
 
-    void StateKeyValue::doPushPartial(const uint8_t *dirtyMaskBytes) {
+    bool StateKeyValue::doPushPartial(util::Bitmap &mask) {
         // Ignore if not dirty
         if (!isDirty) {
-            return;
+            return false;
         }
 
         // We need a full lock while doing this, mainly to ensure no other threads start
@@ -398,10 +427,15 @@ namespace state {
         // Double check condition
         if (!isDirty) {
             logger->debug("Ignoring partial push on {}", key);
-            return;
+            return false;
         }
 
-        pushPartialToRemote(dirtyMaskBytes);
+        pushPartialToRemote(mask);
+
+        // Writes outside a mask passed in are still to be pushed
+        isDirty = dirtyMask.anySet();
+
+        return true;
     }
 
     long StateKeyValue::waitOnRedisRemoteLock(const std::string &redisKey) {
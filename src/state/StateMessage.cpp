@@ -0,0 +1,112 @@
+#include "StateMessage.h"
+
+#include <util/macros.h>
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace state {
+    static void writeSize(uint8_t *&cursor, size_t value) {
+        std::copy(BYTES(&value), BYTES(&value) + sizeof(size_t), cursor);
+        cursor += sizeof(size_t);
+    }
+
+    static size_t readSize(const uint8_t *&cursor, const uint8_t *end) {
+        if ((size_t) (end - cursor) < sizeof(size_t)) {
+            throw std::runtime_error("State request truncated");
+        }
+
+        size_t value;
+        std::copy(cursor, cursor + sizeof(size_t), BYTES(&value));
+        cursor += sizeof(size_t);
+        return value;
+    }
+
+    static void writeString(uint8_t *&cursor, const std::string &value) {
+        writeSize(cursor, value.size());
+        std::copy(value.begin(), value.end(), cursor);
+        cursor += value.size();
+    }
+
+    static std::string readString(const uint8_t *&cursor, const uint8_t *end) {
+        size_t len = readSize(cursor, end);
+        if ((size_t) (end - cursor) < len) {
+            throw std::runtime_error("State request string truncated");
+        }
+
+        std::string value(reinterpret_cast<const char *>(cursor), len);
+        cursor += len;
+        return value;
+    }
+
+    tcp::TCPMessage *buildStateRequest(tcp::TCPMessageType type, const StateRequest &request) {
+        // Header is user, key, value size, offset and length. Data follows
+        size_t headerLen = request.user.size() + request.key.size() + 5 * sizeof(size_t);
+        size_t dataLen = request.data == nullptr ? 0 : request.length;
+
+        auto msg = new tcp::TCPMessage();
+        msg->type = type;
+        msg->len = headerLen + dataLen;
+        msg->buffer = new uint8_t[msg->len];
+
+        uint8_t *cursor = msg->buffer;
+        writeString(cursor, request.user);
+        writeString(cursor, request.key);
+        writeSize(cursor, request.valueSize);
+        writeSize(cursor, request.offset);
+        writeSize(cursor, request.length);
+
+        if (dataLen > 0) {
+            std::copy(request.data, request.data + dataLen, cursor);
+        }
+
+        return msg;
+    }
+
+    StateRequest parseStateRequest(const tcp::TCPMessage *msg) {
+        if (msg->buffer == nullptr || msg->len < 5 * sizeof(size_t)) {
+            throw std::runtime_error("State request too short");
+        }
+
+        // Everything here comes off the wire, so each length is checked before it's used
+        StateRequest request;
+        const uint8_t *cursor = msg->buffer;
+        const uint8_t *end = msg->buffer + msg->len;
+        request.user = readString(cursor, end);
+        request.key = readString(cursor, end);
+        request.valueSize = readSize(cursor, end);
+        request.offset = readSize(cursor, end);
+        request.length = readSize(cursor, end);
+
+        // Any data must be exactly the length given
+        size_t dataLen = end - cursor;
+        if (dataLen > 0) {
+            if (dataLen != request.length) {
+                throw std::runtime_error("State request data doesn't match its length");
+            }
+
+            request.data = cursor;
+        }
+
+        return request;
+    }
+
+    tcp::TCPMessage *buildStateResponse(tcp::TCPMessageType type, size_t dataLen) {
+        auto msg = new tcp::TCPMessage();
+        msg->type = type;
+        msg->len = dataLen;
+        msg->buffer = dataLen > 0 ? new uint8_t[dataLen] : nullptr;
+
+        return msg;
+    }
+
+    void appendStateSegment(std::vector<uint8_t> &segments, size_t offset, const uint8_t *data, size_t length) {
+        size_t start = segments.size();
+        segments.resize(start + 2 * sizeof(size_t) + length);
+
+        uint8_t *cursor = segments.data() + start;
+        writeSize(cursor, offset);
+        writeSize(cursor, length);
+        std::copy(data, data + length, cursor);
+    }
+}
@@ -0,0 +1,120 @@
+#include "StatePullPool.h"
+#include "StateKeyValue.h"
+
+#include <redis/Redis.h>
+#include <util/config.h>
+#include <util/locks.h>
+#include <util/logging.h>
+
+#include <algorithm>
+
+namespace state {
+    StatePullTracker::StatePullTracker(size_t nChunksIn) : pending(nChunksIn), failed(nChunksIn) {
+
+    }
+
+    void StatePullTracker::setPending(size_t firstChunk, size_t nChunks) {
+        // Failures are only reported to those waiting on the pull that hit them
+        util::UniqueLock lock(mx);
+        failed.clear(firstChunk, nChunks);
+        pending.set(firstChunk, nChunks);
+    }
+
+    void StatePullTracker::chunkDone(size_t chunkIdx, bool success) {
+        {
+            util::UniqueLock lock(mx);
+            pending.clear(chunkIdx, 1);
+            if (!success) {
+                failed.set(chunkIdx, 1);
+            }
+        }
+
+        cv.notify_all();
+    }
+
+    void StatePullTracker::await(size_t firstChunk, size_t nChunks) {
+        size_t end = std::min(firstChunk + nChunks, pending.size());
+
+        util::UniqueLock lock(mx);
+        cv.wait(lock, [this, firstChunk, end] {
+            return pending.nextSet(firstChunk) >= end;
+        });
+
+        if (failed.nextSet(firstChunk) < end) {
+            throw StateKeyValueException("Failed pulling chunk of state value");
+        }
+    }
+
+    void StatePullTracker::awaitIdle() {
+        util::UniqueLock lock(mx);
+        cv.wait(lock, [this] {
+            return !pending.anySet();
+        });
+    }
+
+    StatePullPool &getStatePullPool() {
+        static StatePullPool pool(util::getSystemConfig().statePullThreads);
+        return pool;
+    }
+
+    StatePullPool::StatePullPool(int nThreads) {
+        for (int i = 0; i < nThreads; i++) {
+            threads.emplace_back([this] {
+                while (true) {
+                    std::function<void()> task = taskQueue.dequeue();
+
+                    // Empty task signals shutdown
+                    if (!task) {
+                        break;
+                    }
+
+                    task();
+                }
+            });
+        }
+    }
+
+    StatePullPool::~StatePullPool() {
+        for (size_t i = 0; i < threads.size(); i++) {
+            taskQueue.enqueue(nullptr);
+        }
+
+        for (auto &t : threads) {
+            if (t.joinable()) {
+                t.join();
+            }
+        }
+    }
+
+    void StatePullPool::pullChunks(const std::string &key, uint8_t *buffer, long offset, size_t length,
+                                   size_t chunkSize, const std::shared_ptr<StatePullTracker> &tracker) {
+        if (length == 0) {
+            return;
+        }
+
+        // Chunks are aligned to the start of the value, so the first and last may be partial
+        size_t end = offset + length;
+        size_t firstChunk = offset / chunkSize;
+        size_t lastChunk = (end - 1) / chunkSize;
+        tracker->setPending(firstChunk, lastChunk - firstChunk + 1);
+
+        for (size_t c = firstChunk; c <= lastChunk; c++) {
+            long start = std::max((size_t) offset, c * chunkSize);
+            size_t len = std::min(end, (c + 1) * chunkSize) - start;
+
+            taskQueue.enqueue([key, buffer, start, len, c, tracker] {
+                bool success = true;
+                try {
+                    // Note - redis ranges are inclusive
+                    redis::Redis &redis = redis::Redis::getState();
+                    redis.getRange(key, buffer + start, len, start, start + len - 1);
+                } catch (std::exception &ex) {
+                    util::getLogger()->error("Failed pulling chunk {} of {}: {}", c, key, ex.what());
+                    success = false;
+                }
+
+                tracker->chunkDone(c, success);
+            });
+        }
+    }
+}
@@ -1,35 +1,152 @@
 #include "StateServer.h"
+#include "StateMessage.h"
+#include "InMemoryStateKeyValue.h"
 
 #include <util/logging.h>
 #include <util/config.h>
+#include <util/macros.h>
 
 namespace state {
-    StateServer::StateServer() : tcp::TCPServer(STATE_PORT, util::getSystemConfig().globalMessageTimeout) {
+    static void checkRange(const std::shared_ptr<StateKeyValue> &kv, size_t offset, size_t length) {
+        // Written to avoid overflow, as both come off the wire
+        if (offset > kv->size() || length > kv->size() - offset) {
+            throw StateKeyValueException("State request out of bounds for " + kv->key);
+        }
+    }
+
+    StateServer::StateServer() : StateServer(getGlobalState()) {
+
+    }
+
+    StateServer::StateServer(State &stateIn) : tcp::TCPServer(STATE_PORT,
+                                                              util::getSystemConfig().globalMessageTimeout,
+                                                              util::getSystemConfig().stateServerThreads),
+                                               state(stateIn) {
 
     }
 
     tcp::TCPMessage *StateServer::handleMessage(tcp::TCPMessage *recvMessage) {
         const std::shared_ptr<spdlog::logger> &logger = util::getLogger();
 
-        switch (recvMessage->type) {
-            case (tcp::TCPMessageType::STATE_SIZE): {
-                logger->debug("State size request");
-                // TODO - state size
-            }
-            case (tcp::TCPMessageType::STATE_GET): {
-                logger->debug("State get request");
-                // TODO - state get
-            }
-            case (tcp::TCPMessageType::STATE_SET): {
-                logger->debug("State set request");
-                // TODO - state set
+        tcp::TCPMessageType msgType = recvMessage->type;
+        tcp::TCPMessage *response = nullptr;
+
+        try {
+            StateRequest request = parseStateRequest(recvMessage);
+
+            // All values served from here are in-memory values, of which this node is the master
+            auto getInMemoryKV = [this, &request] {
+                std::shared_ptr<StateKeyValue> kv = state.getKV(request.user, request.key, request.valueSize);
+                return std::static_pointer_cast<InMemoryStateKeyValue>(kv);
+            };
+
+            switch (msgType) {
+                case (tcp::TCPMessageType::STATE_SIZE): {
+                    logger->debug("State size request for {}/{}", request.user, request.key);
+
+                    size_t stateSize = 0;
+                    try {
+                        stateSize = state.getKV(request.user, request.key, 0)->size();
+                    } catch (StateKeyValueException &ex) {
+                        // Value doesn't exist here
+                    }
+
+                    response = buildStateResponse(msgType, sizeof(size_t));
+                    *reinterpret_cast<size_t *>(response->buffer) = stateSize;
+                    break;
+                }
+                case (tcp::TCPMessageType::STATE_GET): {
+                    logger->debug("State get request for {}/{} ({}-{})", request.user, request.key,
+                                  request.offset, request.offset + request.length);
+
+                    auto kv = getInMemoryKV();
+                    checkRange(kv, request.offset, request.length);
+
+                    response = buildStateResponse(msgType, request.length);
+                    if (request.offset == 0 && request.length == kv->size()) {
+                        kv->get(response->buffer);
+                    } else {
+                        kv->getSegment(request.offset, response->buffer, request.length);
+                    }
+                    break;
+                }
+                case (tcp::TCPMessageType::STATE_SET): {
+                    logger->debug("State set request for {}/{}", request.user, request.key);
+
+                    auto kv = getInMemoryKV();
+                    if (request.data == nullptr || request.length != kv->size()) {
+                        throw StateKeyValueException("Invalid state set request for " + kv->key);
+                    }
+
+                    kv->set(request.data);
+                    response = buildStateResponse(msgType, 0);
+                    break;
+                }
+                case (tcp::TCPMessageType::STATE_PUSH_PARTIAL): {
+                    logger->debug("State partial push request for {}/{}", request.user, request.key);
+
+                    auto kv = getInMemoryKV();
+                    if (request.data != nullptr) {
+                        // Check every segment before applying any, so a bad request changes nothing
+                        forEachStateSegment(request.data, request.length,
+                                            [&kv](size_t offset, const uint8_t *data, size_t length) {
+                                                checkRange(kv, offset, length);
+                                            });
+
+                        forEachStateSegment(request.data, request.length,
+                                            [&kv](size_t offset, const uint8_t *data, size_t length) {
+                                                kv->setSegment(offset, data, length);
+                                            });
+                    }
+
+                    response = buildStateResponse(msgType, 0);
+                    break;
+                }
+                case (tcp::TCPMessageType::STATE_LOCK): {
+                    logger->debug("State lock request for {}/{}", request.user, request.key);
+
+                    auto kv = getInMemoryKV();
+                    long lockId = kv->tryLockGlobalLocal();
+                    response = buildStateResponse(msgType, sizeof(long));
+                    std::copy(BYTES(&lockId), BYTES(&lockId) + sizeof(long), response->buffer);
+                    break;
+                }
+                case (tcp::TCPMessageType::STATE_UNLOCK): {
+                    logger->debug("State unlock request for {}/{}", request.user, request.key);
+
+                    // Unlocks carry the id of the lock being released
+                    if (request.data == nullptr || request.length != sizeof(long)) {
+                        throw StateKeyValueException("Invalid state unlock request for " + request.key);
+                    }
+
+                    long lockId;
+                    std::copy(request.data, request.data + sizeof(long), BYTES(&lockId));
+                    getInMemoryKV()->unlockGlobalLocal(lockId);
+                    response = buildStateResponse(msgType, 0);
+                    break;
+                }
+                case (tcp::TCPMessageType::STATE_DELETE): {
+                    logger->debug("State delete request for {}/{}", request.user, request.key);
+
+                    getInMemoryKV()->deleteGlobal();
+                    response = buildStateResponse(msgType, 0);
+                    break;
+                }
+                default: {
+                    logger->error("Unrecognised state request type {}", msgType);
+                    throw StateKeyValueException("Unrecognised state request");
+                }
             }
-            default: {
-                // TODO - fail
+        } catch (std::exception &ex) {
+            logger->error("Failed handling state request: {}", ex.what());
+
+            if (response != nullptr) {
+                tcp::freeTcpMessage(response);
             }
+            response = buildStateResponse(msgType, 0);
+            response->status = tcp::TCPMessageStatus::FAILED;
         }
 
-        // TODO - response
-        return nullptr;
+        return response;
     }
 }
@@ -30,8 +30,14 @@ namespace state {
             }
         }
 
-        // Full lock for doing anything
-        FullLock fullLock(kvMapMutex);
+        // The rest doesn't touch the map, and mustn't hold up other lookups while it goes to
+        // another node
+
+        // In-memory values are held by their master
+        SystemConfig &conf = util::getSystemConfig();
+        if (conf.stateMode == "inmemory") {
+            return InMemoryStateKeyValue::getStateSizeFromRemote(user, key, conf.endpointHost);
+        }
 
         std::string actualKey = util::keyForUser(user, key);
 
@@ -69,7 +75,7 @@ namespace state {
             auto kv = new RedisStateKeyValue(actualKey, size);
             kvMap.emplace(key, kv);
         } else if(stateMode == "inmemory") {
-            auto kv = new InMemoryStateKeyValue(actualKey, size);
+            auto kv = new InMemoryStateKeyValue(user, key, size);
             kvMap.emplace(key, kv);
         }
 
@@ -4,7 +4,9 @@
 #include <util/config.h>
 
 namespace tcp {
-    EchoServer::EchoServer(int portIn) : tcp::TCPServer(portIn, util::getSystemConfig().globalMessageTimeout) {
+    EchoServer::EchoServer(int portIn, int nThreads) : tcp::TCPServer(portIn,
+                                                                      util::getSystemConfig().globalMessageTimeout,
+                                                                      nThreads) {
     }
 
     tcp::TCPMessage *EchoServer::handleMessage(tcp::TCPMessage *recvMessage) {
@@ -1,8 +1,12 @@
 #include "TCPClient.h"
 #include "TCPMessage.h"
+#include "TCPServer.h"
 
+#include <util/logging.h>
 #include <util/macros.h>
 
+#include <cstring>
+
 
 namespace tcp {
     TCPClient::TCPClient(std::string hostIn, int portIn) : host(std::move(hostIn)), port(portIn) {
@@ -13,25 +17,48 @@ namespace tcp {
         server.sin_family = AF_INET;
         server.sin_port = htons(port);
 
-        ::connect(clientSocket, (struct sockaddr *) &server, sizeof(server));
+        int connectRes = ::connect(clientSocket, (struct sockaddr *) &server, sizeof(server));
+        if (connectRes < 0) {
+            util::getLogger()->error("Failed to connect to {}:{}. Errno {} ({})", host, port, errno,
+                                     strerror(errno));
+            ::close(clientSocket);
+            throw TCPFailedException("Failed to connect");
+        }
     }
 
     void TCPClient::sendMessage(TCPMessage *msg) const {
-        size_t msgSize = tcpMessageLen(msg);
-        uint8_t *msgBuffer = tcpMessageToBuffer(msg);
+        if (!sendTcpMessage(clientSocket, msg)) {
+            throw TCPFailedException("Send error");
+        }
+    }
 
-        ::send(clientSocket, msgBuffer, msgSize, 0);
+    void TCPClient::sendMessage(TCPMessageType type, const iovec *parts, int nParts) const {
+        if (!sendTcpMessage(clientSocket, type, parts, nParts)) {
+            throw TCPFailedException("Send error");
+        }
+    }
+
+    void TCPClient::recvAll(uint8_t *buffer, size_t len) const {
+        size_t bytesReceived = 0;
+        while (bytesReceived < len) {
+            ssize_t nRecv = ::recv(clientSocket, buffer + bytesReceived, len - bytesReceived, MSG_WAITALL);
+            if (nRecv <= 0) {
+                throw TCPFailedException("Recv error");
+            }
+
+            bytesReceived += nRecv;
+        }
     }
 
     TCPMessage *TCPClient::recvMessage() const {
         // Receive the message header
         auto m = new TCPMessage();
-        ::recv(clientSocket, BYTES(m), sizeof(TCPMessage), 0);
+        recvAll(BYTES(m), sizeof(TCPMessage));
 
         // Receive the message data
         if (m->len > 0) {
             m->buffer = new uint8_t[m->len];
-            ::recv(clientSocket, m->buffer, m->len, 0);
+            recvAll(m->buffer, m->len);
         } else {
             m->buffer = nullptr;
         }
@@ -42,13 +69,32 @@ namespace tcp {
     TCPMessage *TCPClient::recvMessage(size_t dataSize) const {
         size_t bufferSize = sizeof(TCPMessage) + dataSize;
         auto buffer = new uint8_t[bufferSize];
-        ::recv(clientSocket, buffer, bufferSize, 0);
+        recvAll(buffer, bufferSize);
 
         TCPMessage *m = tcpMessageFromBuffer(buffer);
         return m;
     }
 
+    TCPMessage TCPClient::recvMessageInto(uint8_t *buffer, size_t bufferLen) const {
+        // Receive the message header
+        TCPMessage m{};
+        recvAll(BYTES(&m), sizeof(TCPMessage));
+
+        // Receive the data straight into the caller's buffer if it fits, otherwise drain it
+        // so the connection can still be used
+        if (m.len <= bufferLen) {
+            m.buffer = buffer;
+            recvAll(buffer, m.len);
+        } else {
+            std::vector<uint8_t> discard(m.len);
+            recvAll(discard.data(), m.len);
+            m.buffer = nullptr;
+        }
+
+        return m;
+    }
+
     void TCPClient::exit() {
         ::close(clientSocket);
     }
-}
\ No newline at end of file
+}
@@ -1,15 +1,29 @@
 #include "TCPServer.h"
 
+#include <algorithm>
+#include <chrono>
 #include <cstring>
+#include <util/locks.h>
 #include <util/logging.h>
 #include <util/macros.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
 #include <sys/ioctl.h>
+#include <sys/uio.h>
 
-#define BUF_SIZE 256
-#define BACKLOG 5
+#define BACKLOG SOMAXCONN
+
+// Largest receive buffer a server thread holds on to between messages
+#define MAX_KEPT_RECV_BUFFER (1024 * 1024)
+
+// How long to back off when out of file descriptors or memory to accept connections
+#define ACCEPT_BACKOFF_MS 10
 
 namespace tcp {
-    TCPServer::TCPServer(int portIn, long timeoutMillisIn) : port(portIn), timeoutMillis(timeoutMillisIn) {
+    TCPServer::TCPServer(int portIn, long timeoutMillisIn, int nThreadsIn) : port(portIn),
+                                                                             timeoutMillis(timeoutMillisIn),
+                                                                             nThreads(std::max(nThreadsIn, 1)),
+                                                                             stopped(false) {
         const std::shared_ptr<spdlog::logger> &logger = util::getLogger();
 
         // Set up the socket
@@ -51,172 +65,350 @@ namespace tcp {
             throw std::runtime_error("Failed to listen with TCP server");
         }
 
-        // Zero the poll fds and set up the server socket
-        memset(pollFds, 0, sizeof(pollFds));
-        pollFds[0].fd = serverSocket;
-        pollFds[0].events = POLLIN;
+        // Set up epoll. The server socket and the stop fd are level-triggered so that every
+        // waiting thread sees them, client sockets are one-shot (see handleClientEvent)
+        epollFd = epoll_create1(0);
+        stopFd = eventfd(0, EFD_NONBLOCK);
+        if (epollFd < 0 || stopFd < 0) {
+            logger->error("Failed to set up epoll on {}. Errno {} ({})", port, errno, strerror(errno));
+            throw std::runtime_error("Failed to set up epoll for TCP server");
+        }
+
+        epoll_event serverEvent{};
+        serverEvent.events = EPOLLIN;
+        serverEvent.data.fd = serverSocket;
+        epoll_ctl(epollFd, EPOLL_CTL_ADD, serverSocket, &serverEvent);
+
+        epoll_event stopEvent{};
+        stopEvent.events = EPOLLIN;
+        stopEvent.data.fd = stopFd;
+        epoll_ctl(epollFd, EPOLL_CTL_ADD, stopFd, &stopEvent);
 
         logger->debug("Listening on {}", port);
     }
 
+    TCPServer::~TCPServer() {
+        stop();
+    }
+
     int TCPServer::poll() {
+        return pollEvents(TCP_SERVER_MAX_EVENTS, timeoutMillis);
+    }
+
+    void TCPServer::start() {
+        const std::shared_ptr<spdlog::logger> &logger = util::getLogger();
+        logger->debug("Starting {} server threads on {}", nThreads, port);
+
+        stopped = false;
+        for (int i = 0; i < nThreads; i++) {
+            // Threads take one event at a time so that busy connections are spread between them
+            serverThreads.emplace_back([this] {
+                while (!stopped) {
+                    try {
+                        pollEvents(1, timeoutMillis);
+                    } catch (TCPTimeoutException &ex) {
+                        continue;
+                    } catch (TCPFailedException &ex) {
+                        // Errors are logged where they happen, the server keeps going
+                        continue;
+                    }
+                }
+            });
+        }
+    }
+
+    void TCPServer::stop() {
+        if (serverThreads.empty()) {
+            return;
+        }
+
+        // Wake up all the threads
+        stopped = true;
+        uint64_t wake = 1;
+        ssize_t writeRes = ::write(stopFd, &wake, sizeof(wake));
+        if (writeRes < 0) {
+            util::getLogger()->warn("Failed to wake TCP server threads on {}", port);
+        }
+
+        for (auto &t : serverThreads) {
+            if (t.joinable()) {
+                t.join();
+            }
+        }
+        serverThreads.clear();
+
+        // Reset for restarting
+        uint64_t drain;
+        if (::read(stopFd, &drain, sizeof(drain)) < 0) {
+            util::getLogger()->warn("Failed to reset TCP server stop flag on {}", port);
+        }
+    }
+
+    int TCPServer::pollEvents(int maxEvents, long timeout) {
         const std::shared_ptr<spdlog::logger> &logger = util::getLogger();
 
         int nMessagesProcessed = 0;
 
         // Wait for input
-        int pollCount = ::poll(pollFds, nFds, timeoutMillis);
-        if (pollCount < 0) {
+        std::vector<epoll_event> events(maxEvents);
+        int eventCount = epoll_wait(epollFd, events.data(), maxEvents, (int) timeout);
+        if (eventCount < 0) {
+            if (errno == EINTR) {
+                return 0;
+            }
+
             logger->error("Error with polling: {} ({})", errno, strerror(errno));
             throw TCPFailedException("Error with polling");
-        } else if (pollCount == 0) {
+        } else if (eventCount == 0) {
             throw TCPTimeoutException("Polling timed out");
         }
 
-        logger->debug("Got {} poll events", pollCount);
+        logger->debug("Got {} poll events", eventCount);
+
+        for (int i = 0; i < eventCount; i++) {
+            const epoll_event &e = events[i];
+            int fd = e.data.fd;
+
+            if (fd == stopFd) {
+                continue;
+            }
 
-        // Process poll events by iterating through each socket
-        int currentFds = nFds;
-        for (int i = 0; i < currentFds; i++) {
-            pollfd thisFd = pollFds[i];
+            // Server event
+            if (fd == serverSocket) {
+                if (e.events & (EPOLLERR | EPOLLHUP)) {
+                    logger->error("Unexpected poll event on server socket: {}", e.events);
+                    throw TCPFailedException("Unexpected poll event");
+                }
 
-            // Ignore those with no events
-            if (thisFd.revents == 0) {
+                acceptClients();
                 continue;
             }
 
-            if (thisFd.revents != POLLIN) {
-                // Some unexpected event
-                logger->error("Unexpected poll event: {}", thisFd.revents);
-                throw TCPFailedException("Unexpected poll event");
+            // Client has hung up or errored without sending anything
+            bool closeSocket = !(e.events & EPOLLIN);
+            if (!closeSocket) {
+                closeSocket = !handleClientEvent(fd);
             }
 
-            // Server event
-            if (thisFd.fd == serverSocket) {
-                struct sockaddr_in clientAddress{};
-                socklen_t addrSize = sizeof(clientAddress);
-
-                // Accept the client
-                int socket = ::accept(serverSocket, (struct sockaddr *) &clientAddress, &addrSize);
-                if (socket < 0) {
-                    if (errno != EWOULDBLOCK) {
+            if (closeSocket) {
+                closeClient(fd);
+                continue;
+            }
+
+            // Record that we've now received a message
+            nMessagesProcessed++;
+
+            // Hand the connection back to epoll for the next message
+            epoll_event clientEvent{};
+            clientEvent.events = EPOLLIN | EPOLLRDHUP | EPOLLONESHOT;
+            clientEvent.data.fd = fd;
+            epoll_ctl(epollFd, EPOLL_CTL_MOD, fd, &clientEvent);
+        }
+
+        return nMessagesProcessed;
+    }
+
+    void TCPServer::acceptClients() {
+        const std::shared_ptr<spdlog::logger> &logger = util::getLogger();
+
+        // Several threads may be woken for the same connection, only one will accept it
+        while (true) {
+            struct sockaddr_in clientAddress{};
+            socklen_t addrSize = sizeof(clientAddress);
+
+            int socket = ::accept(serverSocket, (struct sockaddr *) &clientAddress, &addrSize);
+            if (socket < 0) {
+                switch (errno) {
+                    case EWOULDBLOCK:
+#if EAGAIN != EWOULDBLOCK
+                    case EAGAIN:
+#endif
+                        return;
+                    case EINTR:
+                    case ECONNABORTED:
+                    case EPROTO:
+                        // Only affects this connection, try the next one
+                        continue;
+                    case EMFILE:
+                    case ENFILE:
+                    case ENOBUFS:
+                    case ENOMEM:
+                        // Connections stay queued until resources free up, back off rather
+                        // than spinning on the server socket
+                        logger->warn("Unable to accept on {}. Errno {} ({})", port, errno, strerror(errno));
+                        std::this_thread::sleep_for(std::chrono::milliseconds(ACCEPT_BACKOFF_MS));
+                        return;
+                    default:
                         logger->error("Failed to accept {}. Errno {} ({})", port, errno, strerror(errno));
                         throw TCPFailedException("Failed to accept");
-                    }
-                    continue;
                 }
+            }
 
-                // Add the new client fd
-                pollFds[nFds].fd = socket;
-                pollFds[nFds].events = POLLIN;
-                nFds++;
-            } else {
-                bool closeSocket = false;
-
-                // Set up TCP message to hold data
-                TCPMessage *msg = new TCPMessage();
-                int packetCount = 0;
-                size_t bytesReceived = 0;
-
-                while (true) {
-                    // Receive the data
-                    uint8_t buffer[BUF_SIZE];
-                    int nRecv = ::recv(thisFd.fd, buffer, BUF_SIZE, 0);
-
-                    // Connection closed
-                    if (nRecv == 0) {
-                        closeSocket = true;
-                        break;
-                    }
+            {
+                util::UniqueLock lock(clientsMx);
+                clientFds.insert(socket);
+            }
 
-                    // Error
-                    if (nRecv < 0) {
-                        if (errno != EWOULDBLOCK) {
-                            logger->error("Failed to recv on {}. Errno {} ({})", port, errno, strerror(errno));
-                            throw TCPFailedException("Recv error");
-                        }
-                        break;
-                    }
+            // Each connection is only given to one thread at a time
+            epoll_event clientEvent{};
+            clientEvent.events = EPOLLIN | EPOLLRDHUP | EPOLLONESHOT;
+            clientEvent.data.fd = socket;
+            epoll_ctl(epollFd, EPOLL_CTL_ADD, socket, &clientEvent);
+        }
+    }
 
-                    uint8_t *bufferStart;
-                    if (packetCount == 0) {
-                        // First packet contains the main struct
-                        size_t messageHeaderSize = sizeof(TCPMessage);
-                        std::copy(buffer, buffer + messageHeaderSize, BYTES(msg));
-
-                        // Provision the message buffer
-                        if (msg->len > 0) {
-                            msg->buffer = new uint8_t[msg->len];
-                        }
-
-                        // Offset the rest of the buffer
-                        bufferStart = buffer + messageHeaderSize;
-                        nRecv -= messageHeaderSize;
-                    } else {
-                        bufferStart = buffer;
-                    }
+    void TCPServer::closeClient(int fd) {
+        // Must forget the fd before closing it, as it may be reused straight away
+        {
+            util::UniqueLock lock(clientsMx);
+            clientFds.erase(fd);
+        }
 
-                    // Insert the data from this packet
-                    if (nRecv > 0) {
-                        std::copy(bufferStart, bufferStart + nRecv, msg->buffer);
-                    }
+        epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, nullptr);
+        ::close(fd);
+    }
 
-                    bytesReceived += nRecv;
+    bool TCPServer::handleClientEvent(int fd) {
+        const std::shared_ptr<spdlog::logger> &logger = util::getLogger();
 
-                    if (bytesReceived >= msg->len) {
-                        break;
-                    } else {
-                        logger->debug("TCP packet {} = {} bytes", packetCount, nRecv);
-                        packetCount++;
-                    }
-                }
+        // Receive the message header
+        TCPMessage msg{};
+        if (!recvAll(fd, BYTES(&msg), sizeof(TCPMessage))) {
+            return false;
+        }
+
+        // Receive the message data directly into a buffer kept by this thread rather than
+        // allocating one for every message. It's released again after unusually large messages.
+        static thread_local std::vector<uint8_t> recvBuffer;
+        msg.buffer = nullptr;
+        if (msg.len > 0) {
+            if (recvBuffer.size() < msg.len) {
+                recvBuffer.resize(msg.len);
+            }
+
+            msg.buffer = recvBuffer.data();
+            if (!recvAll(fd, msg.buffer, msg.len)) {
+                logger->warn("Did not receive all TCP data (expected {})", msg.len);
+                return false;
+            }
+        }
 
-                if (bytesReceived != msg->len) {
-                    logger->warn("Did not receive exactly the right TCP data (expected {}, got {})", msg->len,
-                                 bytesReceived);
-                } else {
-                    logger->debug("TCP got {} bytes as expected", bytesReceived);
+        logger->debug("TCP got {} bytes as expected", msg.len);
+
+        // Allow subclass to handle the message and respond
+        bool success = true;
+        TCPMessage *response = handleMessage(&msg);
+        if (response) {
+            // Close if response failed
+            success = sendTcpMessage(fd, response);
+            freeTcpMessage(response);
+        }
+
+        if (recvBuffer.size() > MAX_KEPT_RECV_BUFFER) {
+            std::vector<uint8_t>().swap(recvBuffer);
+        }
+
+        return success;
+    }
+
+    bool TCPServer::recvAll(int fd, uint8_t *buffer, size_t len) {
+        size_t bytesReceived = 0;
+        while (bytesReceived < len) {
+            ssize_t nRecv = ::recv(fd, buffer + bytesReceived, len - bytesReceived, MSG_WAITALL);
+
+            // Connection closed
+            if (nRecv == 0) {
+                return false;
+            }
+
+            if (nRecv < 0) {
+                if (errno == EINTR) {
+                    continue;
                 }
 
-                // Record that we've now received a message
-                nMessagesProcessed++;
+                util::getLogger()->error("Failed to recv on {}. Errno {} ({})", port, errno, strerror(errno));
+                return false;
+            }
+
+            bytesReceived += nRecv;
+        }
+
+        return true;
+    }
 
-                // Allow subclass to handle the message and respond
-                TCPMessage *response = handleMessage(msg);
-                if (response) {
-                    size_t bufferLen = tcpMessageLen(response);
-                    uint8_t *buffer = tcpMessageToBuffer(response);
-                    int sendRes = ::send(thisFd.fd, buffer, bufferLen, 0);
+    bool sendTcpMessage(int fd, const TCPMessage *msg) {
+        iovec data{};
+        data.iov_base = msg->buffer;
+        data.iov_len = msg->buffer == nullptr ? 0 : msg->len;
 
-                    // Close if response failed
-                    if (sendRes < 0) {
-                        closeSocket = true;
-                    }
+        return sendTcpMessage(fd, msg->type, &data, 1, msg->status);
+    }
 
-                    // Tidy the response
-                    freeTcpMessage(response);
+    bool sendTcpMessage(int fd, TCPMessageType type, const iovec *parts, int nParts, TCPMessageStatus status) {
+        // Header and data are sent straight from where they are, without copying them together
+        TCPMessage header{};
+        header.type = type;
+        header.status = status;
+        header.buffer = nullptr;
+
+        std::vector<iovec> allParts(nParts + 1);
+        allParts[0].iov_base = &header;
+        allParts[0].iov_len = sizeof(TCPMessage);
+        for (int i = 0; i < nParts; i++) {
+            allParts[i + 1] = parts[i];
+            header.len += parts[i].iov_len;
+        }
+
+        size_t total = sizeof(TCPMessage) + header.len;
+        size_t bytesSent = 0;
+        while (bytesSent < total) {
+            // Skip over whatever has already gone
+            std::vector<iovec> remaining;
+            size_t skip = bytesSent;
+            for (auto &p : allParts) {
+                if (skip >= p.iov_len) {
+                    skip -= p.iov_len;
+                    continue;
                 }
 
-                // Tidy the original message
-                freeTcpMessage(msg);
+                remaining.push_back({BYTES(p.iov_base) + skip, p.iov_len - skip});
+                skip = 0;
+            }
+
+            msghdr hdr{};
+            hdr.msg_iov = remaining.data();
+            hdr.msg_iovlen = remaining.size();
 
-                // Close this connection if necessary
-                if (closeSocket) {
-                    ::close(thisFd.fd);
+            ssize_t sendRes = ::sendmsg(fd, &hdr, MSG_NOSIGNAL);
+            if (sendRes < 0) {
+                if (errno == EINTR) {
+                    continue;
                 }
+
+                return false;
             }
+
+            bytesSent += sendRes;
         }
 
-        return nMessagesProcessed;
+        return true;
     }
 
-    void TCPServer::close() const {
+    void TCPServer::close() {
         util::getLogger()->debug("Shutting down server");
 
-        for (auto &p : pollFds) {
-            if (p.fd > 0) {
-                ::close(p.fd);
+        stop();
+
+        {
+            util::UniqueLock lock(clientsMx);
+            for (int fd : clientFds) {
+                ::close(fd);
             }
+            clientFds.clear();
         }
+
+        ::close(serverSocket);
+        ::close(stopFd);
+        ::close(epollFd);
     }
 }
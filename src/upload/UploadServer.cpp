@@ -8,6 +8,7 @@
 #include <util/state.h>
 #include <util/files.h>
 #include <redis/Redis.h>
+#include <state/RedisStateKeyValue.h>
 
 
 namespace edge {
@@ -195,10 +196,9 @@ namespace edge {
         bodyStream.read_to_end(inputStream).then([&inputStream, &realKey](size_t size) {
             if (size > 0) {
                 // TODO - break hard Redis dependency here
-                redis::Redis &redis = redis::Redis::getState();
                 std::string s = inputStream.collection();
                 const std::vector<uint8_t> bytesData = util::stringToBytes(s);
-                redis.set(realKey, bytesData);
+                state::RedisStateKeyValue::setRemote(realKey, bytesData);
             }
         }).wait();
 
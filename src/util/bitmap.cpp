@@ -0,0 +1,155 @@
+#include "bitmap.h"
+
+#include <algorithm>
+#include <cstring>
+
+#define BITS_PER_WORD 64
+#define ALL_ONES (~((uint64_t) 0))
+
+namespace util {
+    Bitmap::Bitmap(size_t nBitsIn) : nBits(nBitsIn),
+                                     words((nBitsIn + BITS_PER_WORD - 1) / BITS_PER_WORD) {
+
+    }
+
+    size_t Bitmap::size() const {
+        return nBits;
+    }
+
+    void Bitmap::set(size_t start, size_t len) {
+        setRange(start, len, true);
+    }
+
+    void Bitmap::clear(size_t start, size_t len) {
+        setRange(start, len, false);
+    }
+
+    void Bitmap::clearAll() {
+        for (auto &w : words) {
+            w.store(0);
+        }
+    }
+
+    Bitmap Bitmap::takeAll() {
+        Bitmap taken(nBits);
+        for (size_t i = 0; i < words.size(); i++) {
+            if (words[i].load() != 0) {
+                taken.words[i].store(words[i].exchange(0));
+            }
+        }
+
+        return taken;
+    }
+
+    bool Bitmap::isSet(size_t idx) const {
+        return (words[idx / BITS_PER_WORD] >> (idx % BITS_PER_WORD)) & 1;
+    }
+
+    bool Bitmap::allSet(size_t start, size_t len) const {
+        if (len == 0) {
+            return true;
+        }
+
+        return nextClear(start) >= start + len;
+    }
+
+    bool Bitmap::anySet() const {
+        return std::any_of(words.begin(), words.end(), [](const std::atomic<uint64_t> &w) { return w.load() != 0; });
+    }
+
+    size_t Bitmap::nextSet(size_t start) const {
+        if (start >= nBits) {
+            return nBits;
+        }
+
+        size_t wordIdx = start / BITS_PER_WORD;
+        uint64_t word = words[wordIdx] & (ALL_ONES << (start % BITS_PER_WORD));
+
+        while (word == 0) {
+            wordIdx++;
+            if (wordIdx >= words.size()) {
+                return nBits;
+            }
+            word = words[wordIdx];
+        }
+
+        size_t result = wordIdx * BITS_PER_WORD + __builtin_ctzll(word);
+        return std::min(result, nBits);
+    }
+
+    size_t Bitmap::nextClear(size_t start) const {
+        if (start >= nBits) {
+            return nBits;
+        }
+
+        size_t wordIdx = start / BITS_PER_WORD;
+        uint64_t word = ~words[wordIdx] & (ALL_ONES << (start % BITS_PER_WORD));
+
+        while (word == 0) {
+            wordIdx++;
+            if (wordIdx >= words.size()) {
+                return nBits;
+            }
+            word = ~words[wordIdx];
+        }
+
+        // Bits past the end are always clear, so cap the result
+        size_t result = wordIdx * BITS_PER_WORD + __builtin_ctzll(word);
+        return std::min(result, nBits);
+    }
+
+    void Bitmap::setFromByteMask(const uint8_t *mask, size_t maskLen) {
+        size_t len = std::min(maskLen, nBits);
+
+        // Skip zero regions of the mask a word at a time
+        size_t i = 0;
+        while (i < len) {
+            if (i + sizeof(uint64_t) <= len) {
+                uint64_t chunk;
+                std::memcpy(&chunk, mask + i, sizeof(uint64_t));
+                if (chunk == 0) {
+                    i += sizeof(uint64_t);
+                    continue;
+                }
+            }
+
+            if (mask[i] != 0) {
+                words[i / BITS_PER_WORD].fetch_or(((uint64_t) 1) << (i % BITS_PER_WORD));
+            }
+            i++;
+        }
+    }
+
+    void Bitmap::updateWord(size_t wordIdx, uint64_t mask, bool value) {
+        // Other bits in the word may be changed by other threads at the same time
+        if (value) {
+            words[wordIdx].fetch_or(mask);
+        } else {
+            words[wordIdx].fetch_and(~mask);
+        }
+    }
+
+    void Bitmap::setRange(size_t start, size_t len, bool value) {
+        if (len == 0 || start >= nBits) {
+            return;
+        }
+
+        size_t end = std::min(start + len, nBits);
+        size_t firstWord = start / BITS_PER_WORD;
+        size_t lastWord = (end - 1) / BITS_PER_WORD;
+
+        uint64_t firstMask = ALL_ONES << (start % BITS_PER_WORD);
+        uint64_t lastMask = ALL_ONES >> (BITS_PER_WORD - 1 - ((end - 1) % BITS_PER_WORD));
+
+        if (firstWord == lastWord) {
+            updateWord(firstWord, firstMask & lastMask, value);
+            return;
+        }
+
+        updateWord(firstWord, firstMask, value);
+        for (size_t w = firstWord + 1; w < lastWord; w++) {
+            words[w].store(value ? ALL_ONES : 0);
+        }
+        updateWord(lastWord, lastMask, value);
+    }
+}
@@ -63,4 +63,26 @@ namespace util {
 
         return result;
     }
+
+    BytesOutputStreamBuf::BytesOutputStreamBuf(std::vector<uint8_t> &bytesIn) : bytes(bytesIn) {
+
+    }
+
+    std::streamsize BytesOutputStreamBuf::xsputn(const char *s, std::streamsize n) {
+        bytes.insert(bytes.end(), s, s + n);
+        return n;
+    }
+
+    BytesOutputStreamBuf::int_type BytesOutputStreamBuf::overflow(int_type c) {
+        if (!traits_type::eq_int_type(c, traits_type::eof())) {
+            bytes.push_back((uint8_t) c);
+        }
+
+        return traits_type::not_eof(c);
+    }
+
+    BytesInputStreamBuf::BytesInputStreamBuf(const uint8_t *data, size_t dataLen) {
+        char *start = reinterpret_cast<char *>(const_cast<uint8_t *>(data));
+        setg(start, start, start + dataLen);
+    }
 }
@@ -31,4 +31,8 @@ namespace util {
         isFake = true;
         fakeNow = t;
     }
+
+    void Clock::stopFakeNow() {
+        isFake = false;
+    }
 }
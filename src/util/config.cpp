@@ -42,6 +42,10 @@ namespace util {
         pythonPreload = getEnvVar("PYTHON_PRELOAD", "off");
         captureStdout = getEnvVar("CAPTURE_STDOUT", "off");
         stateMode = getEnvVar("STATE_MODE", "redis");
+        stateRefreshMode = getEnvVar("STATE_REFRESH_MODE", "versioned");
+        statePullThreads = this->getSystemConfIntParam("STATE_PULL_THREADS", "4");
+        statePullChunkSize = this->getSystemConfIntParam("STATE_PULL_CHUNK_SIZE", "4194304");
+        stateServerThreads = this->getSystemConfIntParam("STATE_SERVER_THREADS", "4");
         wasmVm = getEnvVar("WASM_VM", "wavm");
 
         // Redis
@@ -51,16 +55,29 @@ namespace util {
 
         // Caching
         irCacheMode = getEnvVar("IR_CACHE_MODE", "on");
+        moduleResetMode = getEnvVar("MODULE_RESET_MODE", "clone");
+        modulePoolSize = this->getSystemConfIntParam("MODULE_POOL_SIZE", "4");
+        moduleCacheMaxMb = this->getSystemConfIntParam("MODULE_CACHE_MAX_MB", "4096");
+        codeCacheMode = getEnvVar("CODE_CACHE_MODE", "on");
+
+        // Snapshots
+        snapshotMode = getEnvVar("SNAPSHOT_MODE", "full");
+        snapshotCompression = getEnvVar("SNAPSHOT_COMPRESSION", "lz4");
 
         // Scheduling
         maxNodes = this->getSystemConfIntParam("MAX_NODES", "4");
         noScheduler = this->getSystemConfIntParam("NO_SCHEDULER", "0");
         maxInFlightRatio = this->getSystemConfIntParam("MAX_IN_FLIGHT_RATIO", "3");
         maxWorkersPerFunction = this->getSystemConfIntParam("MAX_WORKERS_PER_FUNCTION", "10");
+        schedulerCacheTtl = this->getSystemConfIntParam("SCHEDULER_CACHE_TTL", "1000");
+        sharingBatchSize = this->getSystemConfIntParam("SHARING_BATCH_SIZE", "1");
+        sharingBatchWindow = this->getSystemConfIntParam("SHARING_BATCH_WINDOW", "2");
         threadMode = getEnvVar("THREAD_MODE", "local");
 
         // Worker-related timeouts (all in seconds)
         globalMessageTimeout = this->getSystemConfIntParam("GLOBAL_MESSAGE_TIMEOUT", "60000");
+        globalQueueThreads = this->getSystemConfIntParam("GLOBAL_QUEUE_THREADS", "1");
+        globalQueueBatchSize = this->getSystemConfIntParam("GLOBAL_QUEUE_BATCH_SIZE", "10");
         boundTimeout = this->getSystemConfIntParam("BOUND_TIMEOUT", "30000");
         unboundTimeout = this->getSystemConfIntParam("UNBOUND_TIMEOUT", "300000");
         chainedCallTimeout = this->getSystemConfIntParam("CHAINED_CALL_TIMEOUT", "300000");
@@ -68,6 +85,7 @@ namespace util {
         // Filesystem storage
         functionDir = getEnvVar("FUNC_DIR", "/usr/local/code/faasm/wasm");
         objectFileDir = getEnvVar("OBJ_DIR", "/usr/local/faasm/object");
+        codeCacheDir = getEnvVar("CODE_CACHE_DIR", "/usr/local/faasm/code_cache");
         runtimeFilesDir = getEnvVar("RUNTIME_FILES_DIR", "/usr/local/faasm/runtime_root");
         sharedFilesDir = getEnvVar("SHARED_FILES_DIR", "/usr/local/faasm/shared");
         sharedFilesStorageDir = getEnvVar("SHARED_FILES_STORAGE_DIR", "/usr/local/faasm/shared_store");
@@ -77,6 +95,11 @@ namespace util {
 
         // MPI
         defaultMpiWorldSize = this->getSystemConfIntParam("DEFAULT_MPI_WORLD_SIZE", "5");
+        mpiEagerLimit = this->getSystemConfIntParam("MPI_EAGER_LIMIT", "65536");
+        mpiServerThreads = this->getSystemConfIntParam("MPI_SERVER_THREADS", "4");
+        mpiPayloadTimeout = this->getSystemConfIntParam("MPI_PAYLOAD_TIMEOUT", "300000");
+        mpiLinearCollectiveSize = this->getSystemConfIntParam("MPI_LINEAR_COLLECTIVE_SIZE", "8");
+        mpiRingAllReduceBytes = this->getSystemConfIntParam("MPI_RING_ALLREDUCE_BYTES", "65536");
 
         // Endpoint
         endpointInterface = getEnvVar("ENDPOINT_INTERFACE", "");
@@ -117,6 +140,10 @@ namespace util {
         logger->info("PYTHON_PRELOAD             {}", pythonPreload);
         logger->info("CAPTURE_STDOUT             {}", captureStdout);
         logger->info("STATE_MODE                 {}", stateMode);
+        logger->info("STATE_REFRESH_MODE         {}", stateRefreshMode);
+        logger->info("STATE_PULL_THREADS         {}", statePullThreads);
+        logger->info("STATE_PULL_CHUNK_SIZE      {}", statePullChunkSize);
+        logger->info("STATE_SERVER_THREADS       {}", stateServerThreads);
         logger->info("WASM_VM                    {}", wasmVm);
 
         logger->info("--- Redis ---");
@@ -126,6 +153,14 @@ namespace util {
 
         logger->info("--- Caching ---");
         logger->info("IR_CACHE_MODE              {}", irCacheMode);
+        logger->info("MODULE_RESET_MODE          {}", moduleResetMode);
+        logger->info("MODULE_POOL_SIZE           {}", modulePoolSize);
+        logger->info("MODULE_CACHE_MAX_MB        {}", moduleCacheMaxMb);
+        logger->info("CODE_CACHE_MODE            {}", codeCacheMode);
+
+        logger->info("--- Snapshots ---");
+        logger->info("SNAPSHOT_MODE              {}", snapshotMode);
+        logger->info("SNAPSHOT_COMPRESSION       {}", snapshotCompression);
 
         logger->info("--- Scheduling ---");
         logger->info("MAX_NODES                  {}", maxNodes);
@@ -133,10 +168,15 @@ namespace util {
         logger->info("NO_SCHEDULER               {}", noScheduler);
         logger->info("MAX_IN_FLIGHT_RATIO        {}", maxInFlightRatio);
         logger->info("MAX_WORKERS_PER_FUNCTION   {}", maxWorkersPerFunction);
+        logger->info("SCHEDULER_CACHE_TTL        {}", schedulerCacheTtl);
+        logger->info("SHARING_BATCH_SIZE         {}", sharingBatchSize);
+        logger->info("SHARING_BATCH_WINDOW       {}", sharingBatchWindow);
         logger->info("THREAD_MODE                {}", threadMode);
 
         logger->info("--- Timeouts ---");
         logger->info("GLOBAL_MESSAGE_TIMEOUT     {}", globalMessageTimeout);
+        logger->info("GLOBAL_QUEUE_THREADS       {}", globalQueueThreads);
+        logger->info("GLOBAL_QUEUE_BATCH_SIZE    {}", globalQueueBatchSize);
         logger->info("BOUND_TIMEOUT              {}", boundTimeout);
         logger->info("UNBOUND_TIMEOUT            {}", unboundTimeout);
         logger->info("CHAINED_CALL_TIMEOUT       {}", chainedCallTimeout);
@@ -144,6 +184,7 @@ namespace util {
         logger->info("--- Storage ---");
         logger->info("FUNC_DIR                  {}", functionDir);
         logger->info("OBJ_DIR                   {}", objectFileDir);
+        logger->info("CODE_CACHE_DIR            {}", codeCacheDir);
         logger->info("RUNTIME_FILES_DIR         {}", runtimeFilesDir);
         logger->info("SHARED_FILES_DIR          {}", sharedFilesDir);
         logger->info("SHARED_FILES_STORAGE_DIR  {}", sharedFilesStorageDir);
@@ -152,7 +193,12 @@ namespace util {
         logger->info("IBM_API_KEY     {}", ibmApiKey);
 
         logger->info("--- MPI ---");
-        logger->info("DEFAULT_MPI_WORLD_SIZE  {}", defaultMpiWorldSize);
+        logger->info("DEFAULT_MPI_WORLD_SIZE     {}", defaultMpiWorldSize);
+        logger->info("MPI_EAGER_LIMIT            {}", mpiEagerLimit);
+        logger->info("MPI_SERVER_THREADS         {}", mpiServerThreads);
+        logger->info("MPI_PAYLOAD_TIMEOUT        {}", mpiPayloadTimeout);
+        logger->info("MPI_LINEAR_COLLECTIVE_SIZE {}", mpiLinearCollectiveSize);
+        logger->info("MPI_RING_ALLREDUCE_BYTES   {}", mpiRingAllReduceBytes);
 
         logger->info("--- Endpoint ---");
         logger->info("ENDPOINT_INTERFACE         {}", endpointInterface);
@@ -11,4 +11,24 @@ namespace util {
 
         return std::string(shaBuf, shaBuf + SHA_DIGEST_LENGTH);
     }
+
+    std::string bytesToSHA1(const std::vector<uint8_t> &bytesIn) {
+        unsigned char shaBuf[SHA_DIGEST_LENGTH];
+        SHA1(bytesIn.data(), bytesIn.size(), shaBuf);
+
+        return std::string(shaBuf, shaBuf + SHA_DIGEST_LENGTH);
+    }
+
+    std::string hashToHex(const std::string &hash) {
+        static const char hexChars[] = "0123456789abcdef";
+
+        std::string hex;
+        hex.reserve(hash.size() * 2);
+        for (unsigned char c : hash) {
+            hex.push_back(hexChars[c >> 4]);
+            hex.push_back(hexChars[c & 0xf]);
+        }
+
+        return hex;
+    }
 }
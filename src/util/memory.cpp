@@ -1,6 +1,20 @@
 #include "memory.h"
 
+#include <util/logging.h>
+
+#include <algorithm>
+#include <fcntl.h>
+#include <stdexcept>
 #include <stdint.h>
+#include <sys/mman.h>
+
+// Bits of /proc/self/pagemap entries, see the kernel's pagemap docs
+#define PAGEMAP_PRESENT (1ULL << 63)
+#define PAGEMAP_SWAPPED (1ULL << 62)
+#define PAGEMAP_FILE (1ULL << 61)
+
+// Number of pagemap entries read at a time
+#define PAGEMAP_BATCH 512
 
 namespace util {
     bool isPageAligned(void *ptr) {
@@ -23,5 +37,61 @@ namespace util {
         size_t nHostPages = getRequiredHostPagesRoundDown(offset);
         return nHostPages * util::HOST_PAGE_SIZE;
     }
-}
 
+    std::vector<std::pair<size_t, size_t>> getDirtyPrivatePages(const uint8_t *start, size_t nBytes) {
+        if (!isPageAligned((void *) start)) {
+            throw std::runtime_error("Checking dirty pages of unaligned region");
+        }
+
+        int fd = open("/proc/self/pagemap", O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            throw std::runtime_error("Failed to open pagemap");
+        }
+
+        // Writing to a page of a private file mapping replaces it with an anonymous copy, so
+        // dirty pages are those present or swapped out without being file pages
+        std::vector<std::pair<size_t, size_t>> ranges;
+        size_t nPages = getRequiredHostPages(nBytes);
+        size_t firstPage = ((uintptr_t) start) / HOST_PAGE_SIZE;
+        uint64_t entries[PAGEMAP_BATCH];
+        for (size_t batchStart = 0; batchStart < nPages; batchStart += PAGEMAP_BATCH) {
+            size_t batchSize = std::min<size_t>(PAGEMAP_BATCH, nPages - batchStart);
+            off_t offset = (off_t) ((firstPage + batchStart) * sizeof(uint64_t));
+            ssize_t nRead = pread(fd, entries, batchSize * sizeof(uint64_t), offset);
+            if (nRead != (ssize_t) (batchSize * sizeof(uint64_t))) {
+                close(fd);
+                throw std::runtime_error("Failed to read pagemap");
+            }
+
+            for (size_t i = 0; i < batchSize; i++) {
+                uint64_t entry = entries[i];
+                bool isDirty = (entry & PAGEMAP_SWAPPED) || ((entry & PAGEMAP_PRESENT) && !(entry & PAGEMAP_FILE));
+                if (!isDirty) {
+                    continue;
+                }
+
+                // Extend the last range if this page follows on from it
+                size_t pageOffset = (batchStart + i) * HOST_PAGE_SIZE;
+                if (!ranges.empty() && ranges.back().first + ranges.back().second == pageOffset) {
+                    ranges.back().second += HOST_PAGE_SIZE;
+                } else {
+                    ranges.emplace_back(pageOffset, HOST_PAGE_SIZE);
+                }
+            }
+        }
+
+        close(fd);
+
+        return ranges;
+    }
+
+    void resetDirtyPrivatePages(uint8_t *start, const std::vector<std::pair<size_t, size_t>> &ranges) {
+        for (auto &r : ranges) {
+            int res = madvise(start + r.first, r.second, MADV_DONTNEED);
+            if (res != 0) {
+                util::getLogger()->error("Failed to reset {} dirty bytes at offset {}", r.second, r.first);
+                throw std::runtime_error("Failed to reset dirty pages");
+            }
+        }
+    }
+}
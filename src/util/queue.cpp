@@ -1,7 +1,33 @@
 #include <util/queue.h>
 
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <ctime>
+
 namespace util {
-    TokenPool::TokenPool(int nTokens) : _size(nTokens) {
+    bool futexWait(std::atomic<uint32_t> &word, uint32_t expected, long timeoutMs) {
+        struct timespec ts{};
+        struct timespec *tsPtr = nullptr;
+        if (timeoutMs > 0) {
+            ts.tv_sec = timeoutMs / 1000;
+            ts.tv_nsec = (timeoutMs % 1000) * 1000000;
+            tsPtr = &ts;
+        }
+
+        long res = syscall(SYS_futex, reinterpret_cast<uint32_t *>(&word), FUTEX_WAIT_PRIVATE,
+                           expected, tsPtr, nullptr, 0);
+
+        return !(res == -1 && errno == ETIMEDOUT);
+    }
+
+    void futexWake(std::atomic<uint32_t> &word, int nWaiters) {
+        syscall(SYS_futex, reinterpret_cast<uint32_t *>(&word), FUTEX_WAKE_PRIVATE, nWaiters, nullptr, nullptr, 0);
+    }
+
+    TokenPool::TokenPool(int nTokens) : _size(nTokens), queue(nTokens) {
         // Initialise all tokens as available
         for (int i = 0; i < nTokens; i++) {
             this->queue.enqueue(i);
@@ -1,5 +1,7 @@
 #include "util/random.h"
 
+#include <algorithm>
+#include <iterator>
 #include <random>
 
 namespace util {
@@ -41,4 +43,14 @@ namespace util {
 
         return *it;
     }
+
+    std::vector<std::string> randomStringsFromSet(const std::unordered_set<std::string> &s, int n) {
+        static thread_local std::mt19937 rng(std::random_device{}());
+
+        // Picks up to n distinct elements
+        std::vector<std::string> result;
+        std::sample(s.begin(), s.end(), std::back_inserter(result), n, rng);
+
+        return result;
+    }
 }
\ No newline at end of file
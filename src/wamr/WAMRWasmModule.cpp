@@ -111,8 +111,8 @@ namespace wasm {
     };
 
     // ----- Snapshot/ restore -----
-    void WAMRWasmModule::doSnapshot(std::ostream &outStream) {
-
+    MemorySnapshotWriter WAMRWasmModule::prepareSnapshot() {
+        return MemorySnapshotWriter(MemorySnapshotHeader(), nullptr, {});
     }
 
     void WAMRWasmModule::doRestore(std::istream &inStream) {
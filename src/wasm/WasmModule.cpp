@@ -9,7 +9,7 @@
 #include <wasm/openmp/ThreadState.h>
 
 #include <boost/filesystem.hpp>
-#include <sstream>
+#include <fstream>
 #include <sys/mman.h>
 
 
@@ -41,8 +41,8 @@ namespace wasm {
     }
 
     size_t WasmModule::snapshotToState(const std::string &stateKey) {
-        const std::vector<uint8_t> snapData = snapshotToMemory();
-        unsigned long stateSize = snapData.size();
+        const MemorySnapshotWriter snapshot = prepareSnapshot();
+        unsigned long stateSize = snapshot.size();
 
         state::State &state = state::getGlobalState();
         const std::shared_ptr<state::StateKeyValue> &stateKv = state.getKV(
@@ -51,7 +51,10 @@ namespace wasm {
                 stateSize
         );
 
-        stateKv->set(snapData.data());
+        // Written straight into the value rather than built up and copied in
+        stateKv->setInPlace([&snapshot](uint8_t *value) {
+            snapshot.write(value);
+        });
         stateKv->pushFull();
 
         return stateSize;
@@ -72,7 +75,8 @@ namespace wasm {
     }
 
     void WasmModule::restoreFromMemory(const std::vector<uint8_t> &data) {
-        std::istringstream inStream(std::string(reinterpret_cast<const char *>(data.data()), data.size()));
+        util::BytesInputStreamBuf inBuf(data.data(), data.size());
+        std::istream inStream(&inBuf);
         doRestore(inStream);
     }
 
@@ -88,24 +92,24 @@ namespace wasm {
                 stateSize
         );
 
+        // Restore straight from the pulled value
         stateKv->pull();
-        uint8_t *snapPtr = stateKv->get();
-        const std::vector<uint8_t> snapData = std::vector<uint8_t>(snapPtr, snapPtr + stateSize);
-        restoreFromMemory(snapData);
+        util::BytesInputStreamBuf inBuf(stateKv->get(), stateSize);
+        std::istream inStream(&inBuf);
+        doRestore(inStream);
     }
 
     void WasmModule::snapshotToFile(const std::string &filePath) {
         std::ofstream outStream(filePath, std::ios::binary);
-        doSnapshot(outStream);
+        prepareSnapshot().write(outStream);
     }
 
     std::vector<uint8_t> WasmModule::snapshotToMemory() {
-        std::ostringstream outStream;
-        doSnapshot(outStream);
-
-        std::string outStr = outStream.str();
+        const MemorySnapshotWriter snapshot = prepareSnapshot();
+        std::vector<uint8_t> snapData(snapshot.size());
+        snapshot.write(snapData.data());
 
-        return std::vector<uint8_t>(outStr.begin(), outStr.end());
+        return snapData;
     }
 
     int WasmModule::getStdoutFd() {
@@ -203,6 +207,7 @@ namespace wasm {
                                                           msg.ompeffdepth(),
                                                           msg.ompmal(),
                                                           msg.ompnumthreads());
+            ompLevel->fork_key = msg.ompforkkey();
         } else {
             ompLevel = std::make_shared<openmp::OMPLevel>();
         }
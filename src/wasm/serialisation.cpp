@@ -0,0 +1,142 @@
+#include "serialisation.h"
+
+#include <util/logging.h>
+
+#include <algorithm>
+#include <cstring>
+#include <lz4.h>
+#include <stdexcept>
+
+namespace wasm {
+    std::vector<std::pair<size_t, size_t>> getSnapshotChunks(const std::vector<std::pair<size_t, size_t>> &ranges) {
+        std::vector<std::pair<size_t, size_t>> chunks;
+        for (auto &r : ranges) {
+            for (size_t offset = 0; offset < r.second; offset += SNAPSHOT_CHUNK_BYTES) {
+                size_t length = std::min<size_t>(SNAPSHOT_CHUNK_BYTES, r.second - offset);
+                chunks.emplace_back(r.first + offset, length);
+            }
+        }
+
+        return chunks;
+    }
+
+    MemorySnapshotWriter::MemorySnapshotWriter(MemorySnapshotHeader headerIn, const uint8_t *memBase,
+                                               const std::vector<std::pair<size_t, size_t>> &ranges) :
+            header(headerIn) {
+        std::vector<std::pair<size_t, size_t>> chunkRanges = getSnapshotChunks(ranges);
+        header.nChunks = chunkRanges.size();
+
+        bool compress = header.flags & SNAPSHOT_FLAG_LZ4;
+        std::vector<uint8_t> compressed;
+        if (compress) {
+            compressed.resize(LZ4_compressBound(SNAPSHOT_CHUNK_BYTES));
+        }
+
+        chunks.reserve(chunkRanges.size());
+        chunkData.reserve(chunkRanges.size());
+        for (auto &c : chunkRanges) {
+            MemorySnapshotChunk chunk;
+            chunk.offset = c.first;
+            chunk.length = c.second;
+            chunk.storedLength = c.second;
+
+            const uint8_t *data = memBase + c.first;
+
+            // Chunks that don't get smaller are stored as they are
+            if (compress) {
+                int compressedLength = LZ4_compress_default(reinterpret_cast<const char *>(data),
+                                                            reinterpret_cast<char *>(compressed.data()),
+                                                            (int) c.second, (int) compressed.size());
+                if (compressedLength > 0 && (size_t) compressedLength < c.second) {
+                    chunk.storedLength = compressedLength;
+                    compressedChunks.emplace_back(compressed.begin(), compressed.begin() + compressedLength);
+                    data = compressedChunks.back().data();
+                }
+            }
+
+            chunks.push_back(chunk);
+            chunkData.push_back(data);
+        }
+    }
+
+    size_t MemorySnapshotWriter::size() const {
+        size_t total = sizeof(MemorySnapshotHeader);
+        for (auto &c : chunks) {
+            total += sizeof(MemorySnapshotChunk) + c.storedLength;
+        }
+
+        return total;
+    }
+
+    void MemorySnapshotWriter::write(std::ostream &outStream) const {
+        outStream.write(reinterpret_cast<const char *>(&header), sizeof(MemorySnapshotHeader));
+        for (size_t i = 0; i < chunks.size(); i++) {
+            outStream.write(reinterpret_cast<const char *>(&chunks[i]), sizeof(MemorySnapshotChunk));
+            outStream.write(reinterpret_cast<const char *>(chunkData[i]), chunks[i].storedLength);
+        }
+
+        if (!outStream) {
+            throw std::runtime_error("Failed writing snapshot");
+        }
+    }
+
+    void MemorySnapshotWriter::write(uint8_t *buffer) const {
+        std::memcpy(buffer, &header, sizeof(MemorySnapshotHeader));
+        buffer += sizeof(MemorySnapshotHeader);
+
+        for (size_t i = 0; i < chunks.size(); i++) {
+            std::memcpy(buffer, &chunks[i], sizeof(MemorySnapshotChunk));
+            buffer += sizeof(MemorySnapshotChunk);
+
+            std::memcpy(buffer, chunkData[i], chunks[i].storedLength);
+            buffer += chunks[i].storedLength;
+        }
+    }
+
+    void writeMemorySnapshot(std::ostream &outStream, MemorySnapshotHeader header, const uint8_t *memBase,
+                             const std::vector<std::pair<size_t, size_t>> &ranges) {
+        MemorySnapshotWriter(header, memBase, ranges).write(outStream);
+    }
+
+    MemorySnapshotHeader readMemorySnapshotHeader(std::istream &inStream) {
+        MemorySnapshotHeader header;
+        inStream.read(reinterpret_cast<char *>(&header), sizeof(MemorySnapshotHeader));
+        if (!inStream || header.magic != SNAPSHOT_MAGIC) {
+            throw std::runtime_error("Invalid snapshot header");
+        }
+
+        return header;
+    }
+
+    void readMemorySnapshotChunks(std::istream &inStream, const MemorySnapshotHeader &header, uint8_t *memBase,
+                                  size_t memSize) {
+        std::vector<char> compressed;
+        for (uint64_t i = 0; i < header.nChunks; i++) {
+            MemorySnapshotChunk chunk;
+            inStream.read(reinterpret_cast<char *>(&chunk), sizeof(MemorySnapshotChunk));
+            if (!inStream || chunk.offset + chunk.length > memSize || chunk.storedLength > chunk.length) {
+                throw std::runtime_error("Invalid snapshot chunk");
+            }
+
+            char *dest = reinterpret_cast<char *>(memBase + chunk.offset);
+            if (chunk.storedLength == chunk.length) {
+                inStream.read(dest, chunk.length);
+            } else {
+                compressed.resize(chunk.storedLength);
+                inStream.read(compressed.data(), chunk.storedLength);
+
+                int nBytes = LZ4_decompress_safe(compressed.data(), dest, (int) chunk.storedLength,
+                                                 (int) chunk.length);
+                if (nBytes != (int) chunk.length) {
+                    util::getLogger()->error("Decompressed {} bytes of snapshot chunk, expected {}", nBytes,
+                                             chunk.length);
+                    throw std::runtime_error("Failed decompressing snapshot chunk");
+                }
+            }
+
+            if (!inStream) {
+                throw std::runtime_error("Snapshot data truncated");
+            }
+        }
+    }
+}
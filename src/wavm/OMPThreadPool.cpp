@@ -0,0 +1,187 @@
+#include "OMPThreadPool.h"
+#include "WAVMWasmModule.h"
+
+#include <util/locks.h>
+#include <util/logging.h>
+#include <util/queue.h>
+#include <wasm/openmp/ThreadState.h>
+
+#include <Runtime/RuntimePrivate.h>
+
+#include <climits>
+#include <thread>
+
+namespace wasm {
+    OMPThreadPool::OMPThreadPool(WAVMWasmModule *module, Runtime::Compartment *compartment) :
+            module(module), compartment(compartment) {
+
+    }
+
+    OMPThreadPool::~OMPThreadPool() {
+        shutdown();
+    }
+
+    std::mutex &OMPThreadPool::getRegionMutex() {
+        return regionMx;
+    }
+
+    int OMPThreadPool::getThreadCount() {
+        return (int) threads.size();
+    }
+
+    void OMPThreadPool::addThread() {
+        auto thread = std::make_unique<OMPPoolThread>();
+        thread->pool = this;
+        thread->threadNum = (int) threads.size();
+        thread->startEpoch = regionEpoch.load();
+
+        // Stack and context are set up once and reused for every region
+        U32 stackBase = module->mmapMemory(OMP_STACK_SIZE);
+        thread->stackTop = stackBase + OMP_STACK_SIZE - 1;
+        thread->context = Runtime::createContext(compartment);
+
+        thread->thread = Platform::createThread(0, threadEntry, thread.get());
+        threads.push_back(std::move(thread));
+    }
+
+    int64_t OMPThreadPool::runRegion(message::Message *parentCall, Runtime::Function *func,
+                                     std::vector<std::vector<IR::UntaggedValue>> &funcArgs,
+                                     const std::shared_ptr<openmp::OMPLevel> &level) {
+        int nThreads = (int) funcArgs.size();
+        while ((int) threads.size() < nThreads) {
+            addThread();
+        }
+
+        regionCall = parentCall;
+        regionFunc = func;
+        regionArgs = &funcArgs;
+        regionLevel = level;
+        regionSize = nThreads;
+        regionErrors = 0;
+
+        // Every thread acknowledges the region, including those sitting it out, so none can
+        // still be reading the region's parameters (or be an epoch behind) when we return
+        remaining = (int) threads.size();
+
+        // Release the team
+        regionEpoch.fetch_add(1);
+        if (regionWaiters.load() > 0) {
+            util::futexWake(regionEpoch, INT_MAX);
+        }
+
+        // Wait for the team to finish
+        for (int i = 0; i < OMP_POOL_SPIN_COUNT && remaining.load() > 0; i++) {
+            std::this_thread::yield();
+        }
+
+        while (remaining.load() > 0) {
+            doneWaiters.fetch_add(1);
+            uint32_t seen = doneEpoch.load();
+            if (remaining.load() > 0) {
+                util::futexWait(doneEpoch, seen, 0);
+            }
+            doneWaiters.fetch_sub(1);
+        }
+
+        regionArgs = nullptr;
+        return regionErrors.load();
+    }
+
+    int64_t OMPThreadPool::threadEntry(void *threadPtr) {
+        auto thread = reinterpret_cast<OMPPoolThread *>(threadPtr);
+        thread->pool->runThread(*thread);
+        return 0;
+    }
+
+    void OMPThreadPool::runThread(OMPPoolThread &thread) {
+        const std::shared_ptr<spdlog::logger> &logger = util::getLogger();
+
+        setExecutingModule(module);
+        openmp::setThreadNumber(thread.threadNum);
+
+        uint32_t seen = thread.startEpoch;
+        while (true) {
+            // Spin before blocking, as regions often follow one another closely
+            for (int i = 0; i < OMP_POOL_SPIN_COUNT && regionEpoch.load() == seen; i++) {
+                std::this_thread::yield();
+            }
+
+            while (regionEpoch.load() == seen) {
+                regionWaiters.fetch_add(1);
+                if (regionEpoch.load() == seen) {
+                    util::futexWait(regionEpoch, seen, 0);
+                }
+                regionWaiters.fetch_sub(1);
+            }
+
+            seen = regionEpoch.load();
+            if (isShutdown) {
+                return;
+            }
+
+            // Threads beyond the size of this region's team sit it out
+            if (thread.threadNum >= regionSize) {
+                finishThread();
+                continue;
+            }
+
+            setExecutingCall(regionCall);
+            openmp::setThreadLevel(regionLevel);
+            thread.context->runtimeData->mutableGlobals[0] = thread.stackTop;
+
+            Runtime::Function *func = regionFunc;
+            IR::UntaggedValue *args = (*regionArgs)[thread.threadNum].data();
+            bool failed = false;
+            try {
+                Runtime::catchRuntimeExceptions([&thread, func, args, &failed] {
+                    IR::UntaggedValue result;
+                    Runtime::invokeFunction(thread.context, func, Runtime::getFunctionType(func), args, &result);
+                    failed = result.i32 != 0;
+                }, [&logger, &failed](Runtime::Exception *ex) {
+                    logger->error("Runtime exception in OMP thread: {}", Runtime::describeException(ex).c_str());
+                    Runtime::destroyException(ex);
+                    failed = true;
+                });
+            } catch (wasm::WasmExitException &e) {
+                logger->error("OMP thread exited (code {})", e.exitCode);
+                failed = true;
+            }
+
+            if (failed) {
+                regionErrors.fetch_add(1);
+            }
+
+            openmp::setThreadLevel(nullptr);
+            finishThread();
+        }
+    }
+
+    void OMPThreadPool::finishThread() {
+        if (remaining.fetch_sub(1) == 1) {
+            doneEpoch.fetch_add(1);
+            if (doneWaiters.load() > 0) {
+                util::futexWake(doneEpoch, 1);
+            }
+        }
+    }
+
+    void OMPThreadPool::shutdown() {
+        util::UniqueLock lock(regionMx);
+        if (threads.empty()) {
+            return;
+        }
+
+        isShutdown = true;
+        regionEpoch.fetch_add(1);
+        util::futexWake(regionEpoch, INT_MAX);
+
+        for (auto &t : threads) {
+            Platform::joinThread(t->thread);
+        }
+
+        // Releases the threads' contexts
+        threads.clear();
+        regionLevel = nullptr;
+        isShutdown = false;
+    }
+}
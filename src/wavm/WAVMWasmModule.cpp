@@ -1,10 +1,15 @@
 #include "WAVMWasmModule.h"
+#include "OMPThreadPool.h"
 
 #include <boost/filesystem.hpp>
-#include <cereal/archives/binary.hpp>
 #include <sys/mman.h>
 #include <sys/types.h>
 
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <string_view>
+
 #include <ir_cache/IRModuleCache.h>
 #include <storage/SharedFiles.h>
 #include <util/bytes.h>
@@ -23,6 +28,7 @@
 #include <WAVM/Runtime/Runtime.h>
 #include <Runtime/RuntimePrivate.h>
 #include <WASI/WASIPrivate.h>
+#include <wasm/openmp/DistributedReduction.h>
 #include <wasm/openmp/ThreadState.h>
 
 using namespace WAVM;
@@ -75,8 +81,16 @@ namespace wasm {
         nextStackPointer = other.nextStackPointer;
         nextTableBase = other.nextTableBase;
 
+        // Clones share the other module's fd, so it must outlive them
+        if (ownsMemoryFd) {
+            close(memoryFd);
+            ownsMemoryFd = false;
+        }
+
         memoryFd = other.memoryFd;
         memoryFdSize = other.memoryFdSize;
+        memoryFdId = other.memoryFdId;
+        memoryFdHash = other.memoryFdHash;
 
         _isBound = other._isBound;
         boundUser = other.boundUser;
@@ -136,8 +150,91 @@ namespace wasm {
         }
     }
 
+    void WAVMWasmModule::resetFromZygote(const WAVMWasmModule &zygote) {
+        const std::shared_ptr<spdlog::logger> &logger = util::getLogger();
+        util::SystemConfig &conf = util::getSystemConfig();
+
+        util::TimePoint resetStart = util::startTimer();
+        if (conf.moduleResetMode == "dirty" && canResetDirtyPages(zygote)) {
+            size_t nDirtyBytes = resetDirtyPages(zygote);
+            logger->debug("Reset {} dirty pages of {}/{} in {}us", nDirtyBytes / util::HOST_PAGE_SIZE,
+                          boundUser, boundFunction, util::getTimeDiffMicros(resetStart));
+        } else {
+            clone(zygote);
+            logger->debug("Reset {}/{} by cloning in {}us", boundUser, boundFunction,
+                          util::getTimeDiffMicros(resetStart));
+        }
+    }
+
+    bool WAVMWasmModule::canResetDirtyPages(const WAVMWasmModule &zygote) {
+        // Memory must be mapped from the zygote's current memory fd
+        if (!_isBound || !zygote._isBound || memoryFd <= 0 || memoryFdId != zygote.memoryFdId) {
+            return false;
+        }
+
+        // Memory beyond the mapping and extra table entries can't be undone in place
+        Uptr zygotePages = Runtime::getMemoryNumPages(zygote.defaultMemory);
+        if (Runtime::getMemoryNumPages(defaultMemory) != zygotePages ||
+            zygotePages * IR::numBytesPerPage != memoryFdSize) {
+            return false;
+        }
+
+        if (Runtime::getTableNumElements(defaultTable) != Runtime::getTableNumElements(zygote.defaultTable)) {
+            return false;
+        }
+
+        return dynamicModuleCount == zygote.dynamicModuleCount;
+    }
+
+    size_t WAVMWasmModule::resetDirtyPages(const WAVMWasmModule &zygote) {
+        // OMP threads may have been left with state from the call
+        {
+            util::UniqueLock lock(ompThreadPoolMx);
+            ompThreadPool.reset();
+        }
+        ompCriticalSections.clear();
+
+        // Drop dirty pages so they're read from the zygote's memory again
+        U8 *memoryBase = Runtime::getMemoryBaseAddress(defaultMemory);
+        std::vector<std::pair<size_t, size_t>> dirtyPages = util::getDirtyPrivatePages(memoryBase, memoryFdSize);
+        util::resetDirtyPrivatePages(memoryBase, dirtyPages);
+
+        // Globals live in the context, as with cloning it
+        Runtime::ContextRuntimeData *runtimeData = executionContext->runtimeData;
+        const Runtime::ContextRuntimeData *zygoteRuntimeData = zygote.executionContext->runtimeData;
+        std::memcpy(runtimeData->mutableGlobals, zygoteRuntimeData->mutableGlobals,
+                    sizeof(runtimeData->mutableGlobals));
+
+        nextMemoryBase = zygote.nextMemoryBase;
+        nextStackPointer = zygote.nextStackPointer;
+        nextTableBase = zygote.nextTableBase;
+
+        filesystem = zygote.filesystem;
+        wasmEnvironment = zygote.wasmEnvironment;
+
+        stdoutMemFd = 0;
+        stdoutSize = 0;
+
+        sharedMemWasmPtrs = zygote.sharedMemWasmPtrs;
+        globalOffsetTableMap = zygote.globalOffsetTableMap;
+        globalOffsetMemoryMap = zygote.globalOffsetMemoryMap;
+        missingGlobalOffsetEntries = zygote.missingGlobalOffsetEntries;
+
+        size_t nDirtyBytes = 0;
+        for (auto &r : dirtyPages) {
+            nDirtyBytes += r.second;
+        }
+
+        return nDirtyBytes;
+    }
+
     WAVMWasmModule::~WAVMWasmModule() {
         tearDown();
+
+        // Mappings from the fd stay valid after closing it
+        if (ownsMemoryFd) {
+            close(memoryFd);
+        }
     }
 
     bool WAVMWasmModule::tearDown() {
@@ -146,6 +243,13 @@ namespace wasm {
         const std::shared_ptr<spdlog::logger> &logger = util::getLogger();
 
         // --- Faasm stuff ---
+        // OMP threads hold contexts in the compartment, so must go first
+        {
+            util::UniqueLock lock(ompThreadPoolMx);
+            ompThreadPool.reset();
+        }
+        ompCriticalSections.clear();
+
         sharedMemWasmPtrs.clear();
 
         globalOffsetTableMap.clear();
@@ -686,6 +790,12 @@ namespace wasm {
             );
         }
 
+        // Threads from a distributed OpenMP fork pool their reductions with others on this host
+        std::unique_ptr<openmp::OMPForkGuard> forkGuard;
+        if (msg.has_ompforkkey()) {
+            forkGuard = std::make_unique<openmp::OMPForkGuard>(msg.ompforkkey());
+        }
+
         // Call the function
         int returnValue = 0;
         bool success = true;
@@ -819,6 +929,10 @@ namespace wasm {
         return sharedMemWasmPtrs[segmentKey];
     }
 
+    size_t WAVMWasmModule::getMemorySizeBytes() {
+        return Runtime::getMemoryNumPages(defaultMemory) * IR::numBytesPerPage;
+    }
+
     bool WAVMWasmModule::resolve(const std::string &moduleName,
                                  const std::string &name,
                                  IR::ExternType type,
@@ -1036,7 +1150,15 @@ namespace wasm {
     }
 
     void WAVMWasmModule::writeMemoryToFd(int fd) {
+        static std::atomic<uint64_t> lastMemoryFdId(0);
+
+        if (ownsMemoryFd) {
+            close(memoryFd);
+        }
+
         memoryFd = fd;
+        ownsMemoryFd = true;
+        memoryFdId = ++lastMemoryFdId;
 
         const std::shared_ptr<spdlog::logger> &logger = util::getLogger();
         logger->debug("Writing memory for {}/{} to fd {}", this->boundUser, this->boundFunction, memoryFd);
@@ -1057,6 +1179,9 @@ namespace wasm {
         if (werror == -1) {
             logger->error("write call failed");
         }
+
+        memoryFdHash = std::hash<std::string_view>{}(
+                std::string_view(reinterpret_cast<const char *>(memoryBase), memoryFdSize));
     }
 
     void WAVMWasmModule::mapMemoryFromFd() {
@@ -1068,39 +1193,89 @@ namespace wasm {
         mmap(memoryBase, memoryFdSize, PROT_WRITE, MAP_PRIVATE | MAP_FIXED, memoryFd, 0);
     }
 
-    void WAVMWasmModule::doSnapshot(std::ostream &outStream) {
-        cereal::BinaryOutputArchive archive(outStream);
+    MemorySnapshotWriter WAVMWasmModule::prepareSnapshot() {
+        util::SystemConfig &conf = util::getSystemConfig();
+        const std::shared_ptr<spdlog::logger> &logger = util::getLogger();
 
-        // Serialise memory
         Uptr numPages = Runtime::getMemoryNumPages(defaultMemory);
         U8 *memBase = Runtime::getMemoryBaseAddress(defaultMemory);
-        U8 *memEnd = memBase + (numPages * IR::numBytesPerPage);
+        size_t memSize = numPages * IR::numBytesPerPage;
+
+        wasm::MemorySnapshotHeader header;
+        header.numPages = numPages;
+        if (conf.snapshotCompression == "lz4") {
+            header.flags |= SNAPSHOT_FLAG_LZ4;
+        }
+
+        // Memory mapped from the zygote's fd can be diffed against it. Only the pages written since
+        // the mapping differ from the zygote, and pages past it only if they're not zero.
+        std::vector<std::pair<size_t, size_t>> ranges;
+        bool isDiff = conf.snapshotMode == "diff" && memoryFd > 0 && memoryFdSize <= memSize;
+        if (isDiff) {
+            header.flags |= SNAPSHOT_FLAG_DIFF;
+            header.baseBytes = memoryFdSize;
+            header.baseHash = memoryFdHash;
+
+            ranges = util::getDirtyPrivatePages(memBase, memoryFdSize);
+            for (size_t offset = memoryFdSize; offset < memSize; offset += util::HOST_PAGE_SIZE) {
+                const U8 *page = memBase + offset;
+                bool isZero = page[0] == 0 && std::memcmp(page, page + 1, util::HOST_PAGE_SIZE - 1) == 0;
+                if (isZero) {
+                    continue;
+                }
+
+                if (!ranges.empty() && ranges.back().first + ranges.back().second == offset) {
+                    ranges.back().second += util::HOST_PAGE_SIZE;
+                } else {
+                    ranges.emplace_back(offset, util::HOST_PAGE_SIZE);
+                }
+            }
+        } else {
+            ranges.emplace_back(0, memSize);
+        }
 
-        wasm::MemorySerialised mem;
-        mem.numPages = numPages;
-        mem.data = std::vector<uint8_t>(memBase, memEnd);
+        size_t nBytes = 0;
+        for (auto &r : ranges) {
+            nBytes += r.second;
+        }
+        logger->debug("Snapshotting {} of {} bytes of memory for {}/{}", nBytes, memSize, boundUser, boundFunction);
 
-        // Serialise to file
-        archive(mem);
+        return MemorySnapshotWriter(header, memBase, ranges);
     }
 
     void WAVMWasmModule::doRestore(std::istream &inStream) {
-        cereal::BinaryInputArchive archive(inStream);
+        wasm::MemorySnapshotHeader header = wasm::readMemorySnapshotHeader(inStream);
 
-        // Read in serialised data
-        wasm::MemorySerialised mem;
-        archive(mem);
+        // Diffs have to be applied to the zygote they were taken from, which must be untouched
+        bool isDiff = header.flags & SNAPSHOT_FLAG_DIFF;
+        U8 *memBase = Runtime::getMemoryBaseAddress(defaultMemory);
+        if (isDiff) {
+            if (memoryFd <= 0 || header.baseBytes != memoryFdSize || header.baseHash != memoryFdHash) {
+                util::getLogger()->error("Snapshot diff for {}/{} doesn't match this host's zygote, "
+                                         "use SNAPSHOT_MODE=full where zygotes can differ", boundUser,
+                                         boundFunction);
+                throw std::runtime_error("Restoring snapshot diff on module not cloned from its zygote");
+            }
 
-        // Restore memory
+            util::resetDirtyPrivatePages(memBase, util::getDirtyPrivatePages(memBase, memoryFdSize));
+        }
+
+        // Grow memory if necessary
         Uptr currentNumPages = Runtime::getMemoryNumPages(defaultMemory);
-        size_t pagesRequired = mem.numPages - currentNumPages;
-        if (pagesRequired > 0) {
-            mmapPages(pagesRequired);
+        if (header.numPages > currentNumPages) {
+            mmapPages(header.numPages - currentNumPages);
         }
 
-        U8 *memBase = Runtime::getMemoryBaseAddress(defaultMemory);
-        size_t memSize = mem.numPages * IR::numBytesPerPage;
-        memcpy(memBase, mem.data.data(), memSize);
+        memBase = Runtime::getMemoryBaseAddress(defaultMemory);
+        size_t memSize = header.numPages * IR::numBytesPerPage;
+
+        // Pages past the zygote are zero unless in the snapshot, which new pages already are
+        size_t usedSize = std::min<size_t>(currentNumPages * IR::numBytesPerPage, memSize);
+        if (isDiff && usedSize > memoryFdSize) {
+            std::memset(memBase + memoryFdSize, 0, usedSize - memoryFdSize);
+        }
+
+        wasm::readMemorySnapshotChunks(inStream, header, memBase, memSize);
     }
 
 
@@ -1145,6 +1320,19 @@ namespace wasm {
         return result.i32;
     }
 
+    OMPThreadPool &WAVMWasmModule::getOMPThreadPool() {
+        util::UniqueLock lock(ompThreadPoolMx);
+        if (!ompThreadPool) {
+            ompThreadPool = std::make_unique<OMPThreadPool>(this, compartment);
+        }
+
+        return *ompThreadPool;
+    }
+
+    openmp::OMPCriticalSections &WAVMWasmModule::getOMPCriticalSections() {
+        return ompCriticalSections;
+    }
+
     Runtime::Function *WAVMWasmModule::getMainFunction(Runtime::Instance *module) {
         std::string mainFuncName(ENTRY_FUNC_NAME);
 
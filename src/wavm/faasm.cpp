@@ -5,6 +5,7 @@
 #include <WAVM/Runtime/Intrinsics.h>
 
 #include <redis/Redis.h>
+#include <state/RedisStateKeyValue.h>
 #include <state/StateKeyValue.h>
 #include <util/bytes.h>
 #include <util/files.h>
@@ -171,8 +172,7 @@ namespace wasm {
 
         // Write to state
         const std::string actualKey = util::keyForUser(getExecutingCall()->user(), key);
-        redis::Redis &redis = redis::Redis::getState();
-        redis.set(actualKey, bytes);
+        state::RedisStateKeyValue::setRemote(actualKey, bytes);
 
         return bytes.size();
     }
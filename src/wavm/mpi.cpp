@@ -271,7 +271,100 @@ namespace wasm {
 
         ContextWrapper ctx;
         int requestId = ctx.getFaasmRequestId(requestPtrPtr);
-        ctx.world.awaitAsyncRequest(requestId);
+        if (requestId == FAASMPI_REQUEST_NULL) {
+            return MPI_SUCCESS;
+        }
+
+        MPI_Status *hostStatus = status == 0 ? nullptr : &Runtime::memoryRef<MPI_Status>(ctx.memory, status);
+        ctx.world.awaitAsyncRequest(requestId, hostStatus);
+        ctx.writeFaasmRequestId(requestPtrPtr, FAASMPI_REQUEST_NULL);
+
+        return MPI_SUCCESS;
+    }
+
+    /**
+     * Waits for all the given asynchronous requests to complete
+     */
+    WAVM_DEFINE_INTRINSIC_FUNCTION(env, "MPI_Waitall", I32, MPI_Waitall, I32 count, I32 requestsPtr,
+                                   I32 statusesPtr) {
+        util::getLogger()->debug("S - MPI_Waitall {} {} {}", count, requestsPtr, statusesPtr);
+
+        ContextWrapper ctx;
+        I32 *requests = Runtime::memoryArrayPtr<I32>(ctx.memory, requestsPtr, count);
+        std::vector<int> requestIds(requests, requests + count);
+
+        MPI_Status *hostStatuses = nullptr;
+        if (statusesPtr != 0) {
+            hostStatuses = Runtime::memoryArrayPtr<MPI_Status>(ctx.memory, statusesPtr, count);
+        }
+
+        ctx.world.awaitAllAsyncRequests(requestIds, hostStatuses);
+        std::copy(requestIds.begin(), requestIds.end(), requests);
+
+        return MPI_SUCCESS;
+    }
+
+    /**
+     * Waits for any one of the given asynchronous requests to complete
+     */
+    WAVM_DEFINE_INTRINSIC_FUNCTION(env, "MPI_Waitany", I32, MPI_Waitany, I32 count, I32 requestsPtr,
+                                   I32 indexPtr, I32 status) {
+        util::getLogger()->debug("S - MPI_Waitany {} {} {} {}", count, requestsPtr, indexPtr, status);
+
+        ContextWrapper ctx;
+        I32 *requests = Runtime::memoryArrayPtr<I32>(ctx.memory, requestsPtr, count);
+        std::vector<int> requestIds(requests, requests + count);
+        MPI_Status *hostStatus = status == 0 ? nullptr : &Runtime::memoryRef<MPI_Status>(ctx.memory, status);
+
+        // Completed requests are nulled in the caller's array so they aren't waited on again
+        int idx = ctx.world.awaitAnyAsyncRequest(requestIds, hostStatus);
+        std::copy(requestIds.begin(), requestIds.end(), requests);
+        ctx.writeMpiResult<int>(indexPtr, idx);
+
+        return MPI_SUCCESS;
+    }
+
+    /**
+     * Checks whether the asynchronous request has completed, without blocking
+     */
+    WAVM_DEFINE_INTRINSIC_FUNCTION(env, "MPI_Test", I32, MPI_Test, I32 requestPtrPtr, I32 flagPtr, I32 status) {
+        util::getLogger()->debug("S - MPI_Test {} {} {}", requestPtrPtr, flagPtr, status);
+
+        ContextWrapper ctx;
+        int requestId = ctx.getFaasmRequestId(requestPtrPtr);
+        if (requestId == FAASMPI_REQUEST_NULL) {
+            ctx.writeMpiResult<int>(flagPtr, 1);
+            return MPI_SUCCESS;
+        }
+
+        MPI_Status *hostStatus = status == 0 ? nullptr : &Runtime::memoryRef<MPI_Status>(ctx.memory, status);
+
+        bool isComplete = ctx.world.testAsyncRequest(requestId, hostStatus);
+        if (isComplete) {
+            ctx.writeFaasmRequestId(requestPtrPtr, FAASMPI_REQUEST_NULL);
+        }
+        ctx.writeMpiResult<int>(flagPtr, isComplete ? 1 : 0);
+
+        return MPI_SUCCESS;
+    }
+
+    /**
+     * Checks whether any of the given asynchronous requests have completed, without blocking
+     */
+    WAVM_DEFINE_INTRINSIC_FUNCTION(env, "MPI_Testany", I32, MPI_Testany, I32 count, I32 requestsPtr,
+                                   I32 indexPtr, I32 flagPtr, I32 status) {
+        util::getLogger()->debug("S - MPI_Testany {} {} {} {} {}", count, requestsPtr, indexPtr, flagPtr, status);
+
+        ContextWrapper ctx;
+        I32 *requests = Runtime::memoryArrayPtr<I32>(ctx.memory, requestsPtr, count);
+        std::vector<int> requestIds(requests, requests + count);
+        MPI_Status *hostStatus = status == 0 ? nullptr : &Runtime::memoryRef<MPI_Status>(ctx.memory, status);
+
+        // Having no active requests counts as complete, with an undefined index
+        int idx = ctx.world.testAnyAsyncRequest(requestIds, hostStatus);
+        std::copy(requestIds.begin(), requestIds.end(), requests);
+        ctx.writeMpiResult<int>(indexPtr, idx < 0 ? MPI_UNDEFINED : idx);
+        ctx.writeMpiResult<int>(flagPtr, idx == -1 ? 0 : 1);
 
         return MPI_SUCCESS;
     }
@@ -311,12 +404,7 @@ namespace wasm {
         faasmpi_datatype_t *hostDtype = ctx.getFaasmDataType(datatype);
         auto inputs = Runtime::memoryArrayPtr<uint8_t>(ctx.memory, buffer, count * hostDtype->size);
 
-        // See if this is a send broadcast or receive broadcast
-        if (ctx.rank == root) {
-            ctx.world.broadcast(ctx.rank, inputs, hostDtype, count);
-        } else {
-            ctx.world.recv(root, ctx.rank, inputs, hostDtype, count, nullptr);
-        }
+        ctx.world.bcast(root, ctx.rank, inputs, hostDtype, count);
 
         return MPI_SUCCESS;
     }
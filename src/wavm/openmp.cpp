@@ -1,38 +1,25 @@
 #include "WAVMWasmModule.h"
+#include "OMPThreadPool.h"
 
+#include <wasm/openmp/DistributedReduction.h>
 #include <wasm/openmp/Level.h>
 #include <wasm/openmp/ThreadState.h>
 
 #include <WAVM/Platform/Thread.h>
 #include <WAVM/Runtime/Runtime.h>
 #include <WAVM/Runtime/Intrinsics.h>
+#include <Runtime/RuntimePrivate.h>
+
+#include <atomic>
+#include <type_traits>
 
 #include <faasm/array.h>
+#include <state/State.h>
 #include <state/StateKeyValue.h>
 #include <scheduler/Scheduler.h>
 
-constexpr int OMP_STACK_SIZE = 2 * (ONE_MB_BYTES);
-
 namespace wasm {
     using namespace openmp;
-    const auto REDUCE_KEY = std::string("omp_wowzoid");
-
-    // Types in accordance with Clang's OpenMP implementation
-    namespace kmp {
-        enum sched_type : I32 {
-            sch_lower = 32, /**< lower bound for unordered values */
-            sch_static_chunked = 33,
-            sch_static = 34, /**< static unspecialized */
-        };
-
-        enum _reduction_method {
-            reduction_method_not_defined = 0,
-            critical_reduce_block = (1 << 8),
-            atomic_reduce_block = (2 << 8),
-            tree_reduce_block = (3 << 8),
-            empty_reduce_block = (4 << 8)
-        };
-    }
 
     /**
      * Function used to spawn OMP threads. Will be called from within a thread
@@ -88,6 +75,32 @@ namespace wasm {
         thisLevel->max_active_level = level;
     }
 
+    /**
+     * Sets the schedule used by loops with schedule(runtime). Like the other ICVs this is
+     * inherited by nested levels. Chunk sizes below one mean the default.
+     */
+    WAVM_DEFINE_INTRINSIC_FUNCTION(env, "omp_set_schedule", void, omp_set_schedule, I32 kind, I32 chunk) {
+        util::getLogger()->debug("S - omp_set_schedule {} {}", kind, chunk);
+
+        // Drop the monotonic modifier, which we don't need to distinguish
+        kind &= 0x7fffffff;
+        if (kind < omp_sched_static || kind > omp_sched_auto) {
+            util::getLogger()->warn("Ignoring unknown schedule kind {}", kind);
+            return;
+        }
+
+        thisLevel->runtime_schedule = kind;
+        thisLevel->runtime_chunk = chunk > 0 ? chunk : 0;
+    }
+
+    WAVM_DEFINE_INTRINSIC_FUNCTION(env, "omp_get_schedule", void, omp_get_schedule, I32 kindPtr, I32 chunkPtr) {
+        util::getLogger()->debug("S - omp_get_schedule {} {}", kindPtr, chunkPtr);
+
+        Runtime::Memory *memoryPtr = getExecutingModule()->defaultMemory;
+        Runtime::memoryRef<I32>(memoryPtr, kindPtr) = thisLevel->runtime_schedule;
+        Runtime::memoryRef<I32>(memoryPtr, chunkPtr) = (I32) thisLevel->runtime_chunk;
+    }
+
     /**
      * Synchronization point at which threads in a parallel region will not execute beyond
      * the omp barrier until all other threads in the team complete all explicit tasks in the region.
@@ -109,14 +122,14 @@ namespace wasm {
      * Enter code protected by a `critical` construct. This function blocks until the thread can enter the critical section.
      * @param loc  source location information.
      * @param global_tid  global thread number.
-     * @param crit identity of the critical section. This could be a pointer to a lock
-        associated with the critical section, or some other suitably unique value.
-        The lock is not used because Faasm needs to control the locking mechanism for the team.
+     * @param crit identity of the critical section. This is a pointer to a kmp_critical_name
+        emitted for each name, so we use its address to look up a lock of our own.
+        The lock itself is not used because Faasm needs to control the locking mechanism for the team.
      */
     WAVM_DEFINE_INTRINSIC_FUNCTION(env, "__kmpc_critical", void, __kmpc_critical, I32 loc, I32 globalTid, I32 crit) {
         util::getLogger()->debug("S - __kmpc_critical {} {} {}", loc, globalTid, crit);
         if (thisLevel->num_threads > 1) {
-            thisLevel->criticalSection.lock();
+            getExecutingModule()->getOMPCriticalSections().getMutex(crit).lock();
         }
     }
 
@@ -130,7 +143,7 @@ namespace wasm {
                                    I32 crit) {
         util::getLogger()->debug("S - __kmpc_end_critical {} {} {}", loc, globalTid, crit);
         if (thisLevel->num_threads > 1) {
-            thisLevel->criticalSection.unlock();
+            getExecutingModule()->getOMPCriticalSections().getMutex(crit).unlock();
         }
     }
 
@@ -203,11 +216,27 @@ namespace wasm {
 
     int userNumDevice = 1;
     int userMaxNumDevices = 3; // Number of devices available to each user by default
-    // Map of tid to message ID for chained calls
 
-    // Flag to say whether we've spawned a thread
-    static std::string activeSnapshotKey;
-    static size_t threadSnapshotSize;
+    // Distinguishes forks made by the same call
+    static std::atomic<int> distributedForkCount(0);
+
+    /**
+     * Removes the snapshot and any leftover reduction contributions of a distributed fork
+     */
+    void deleteForkState(const std::string &user, const std::string &forkKey, size_t snapshotSize,
+                         int nReductions) {
+        try {
+            state::getGlobalState().getKV(user, forkKey + "_snapshot", snapshotSize)->deleteGlobal();
+
+            redis::Redis &redis = redis::Redis::getState();
+            for (int i = 0; i < nReductions; i++) {
+                redis.delPipeline(getForkReduceKey(forkKey, i));
+            }
+            redis.flushPipeline(nReductions);
+        } catch (std::exception &e) {
+            util::getLogger()->warn("Failed deleting state for fork {}: {}", forkKey, e.what());
+        }
+    }
 
     /**
      * The "real" version of this function is implemented in the openmp source at
@@ -238,99 +267,106 @@ namespace wasm {
                 Runtime::getTableElement(getExecutingModule()->defaultTable, microtaskPtr));
 
         if (1 != userNumDevice) {
-            int *reducePtr = nullptr;
             int nextNumThreads = thisLevel->get_next_level_num_threads();
-            redis::Redis &redis = redis::Redis::getState();
-            logger->warn("Number of threads spawned: {}", nextNumThreads);
+            thisLevel->pushed_num_threads = -1; // Resets for next push
+            logger->debug("Forking {} distributed threads", nextNumThreads);
 
-            std::vector<int> chainedThreads;
-            chainedThreads.reserve(nextNumThreads);
-
-            redis.setLong(REDUCE_KEY, 0);
-
-            // rec
-            if (activeSnapshotKey.empty()) {
-                int callId = getExecutingCall()->id();
-                activeSnapshotKey = fmt::format("omp_snapshot_{}", callId);
-                threadSnapshotSize = parentModule->snapshotToState(activeSnapshotKey);
-            } else {
-                // TODO - implement
-                throw std::runtime_error("OMP already bound");
+            // Everything shared by the fork is keyed on it, so that forks don't clash
+            std::string forkKey = fmt::format("omp_{}_{}", parentCall->id(), distributedForkCount.fetch_add(1));
+            std::string snapshotKey = forkKey + "_snapshot";
+            size_t snapshotSize = parentModule->snapshotToState(snapshotKey);
+
+            std::vector<U32> sharedArgs;
+            if (argc > 0) {
+                U32 *pointers = Runtime::memoryArrayPtr<U32>(memoryPtr, argsPtr, argc);
+                sharedArgs.assign(pointers, pointers + argc);
             }
 
             scheduler::Scheduler &sch = scheduler::getScheduler();
+            const std::string origStr = util::funcToString(*parentCall, false);
 
-            const message::Message *originalCall = getExecutingCall();
-            const std::string origStr = util::funcToString(*originalCall, false);
-
-            // Create the threads themselves
-            for (int threadNum = 0; threadNum < nextNumThreads; threadNum++) {
-                message::Message call = util::messageFactory(originalCall->user(), originalCall->function());
+            // This thread is the master of the team, so only the others are chained
+            std::vector<int> chainedThreads;
+            chainedThreads.reserve(nextNumThreads - 1);
+            for (int threadNum = 1; threadNum < nextNumThreads; threadNum++) {
+                message::Message call = util::messageFactory(parentCall->user(), parentCall->function());
                 call.set_isasync(true);
 
-                if (argc > 0) {
-                    U32 *pointers = Runtime::memoryArrayPtr<U32>(memoryPtr, argsPtr, argc);
-                    for (int argIdx = 0; argIdx < argc; argIdx++) {
-                        if (argIdx == 0) {
-                            reducePtr = &Runtime::memoryRef<I32>(memoryPtr, pointers[argIdx]);
-                            logger->warn("BEFORE ARG: {}", *reducePtr);
-                        }
-                        call.add_ompfunctionargs(pointers[argIdx]);
-                    }
+                for (U32 arg : sharedArgs) {
+                    call.add_ompfunctionargs(arg);
                 }
 
-
                 // Snapshot details
-                call.set_snapshotkey(activeSnapshotKey);
-                call.set_snapshotsize(threadSnapshotSize);
-                call.set_funcptr(microtaskPtr); // ugh..?>?> TODO-Luckily I don't think it's being used.
+                call.set_snapshotkey(snapshotKey);
+                call.set_snapshotsize(snapshotSize);
+                call.set_funcptr(microtaskPtr);
                 call.set_ompthreadnum(threadNum);
                 call.set_ompnumthreads(nextNumThreads);
+                call.set_ompforkkey(forkKey);
                 thisLevel->snapshot_parent(call);
                 const std::string chainedStr = util::funcToString(call, false);
                 sch.callFunction(call);
 
-                logger->warn("Forked thread {} ({}) -> {} {}(*{}) ({})", origStr, util::getNodeId(), chainedStr,
-                             microtaskPtr, argsPtr, call.schedulednode());
-                chainedThreads[threadNum] = call.id();
+                logger->debug("Forked thread {} ({}) -> {} {}(*{}) ({})", origStr, util::getNodeId(), chainedStr,
+                              microtaskPtr, argsPtr, call.schedulednode());
+                chainedThreads.push_back(call.id());
             }
 
-            I64 numErrors = 0;
+            // Do the master's share of the work, during which it collects any reductions
+            auto masterLevel = std::make_shared<OMPLevel>(thisLevel->depth, thisLevel->effective_depth,
+                                                          thisLevel->max_active_level, nextNumThreads);
+            masterLevel->fork_key = forkKey;
 
-            for (int threadNum = 0; threadNum < nextNumThreads; threadNum++) {
+            std::shared_ptr<OMPLevel> parentLevel = thisLevel;
+            int parentThreadNumber = thisThreadNumber;
+            setThreadLevel(masterLevel);
+            setThreadNumber(0);
+
+            std::vector<IR::UntaggedValue> masterArgs = {0, argc};
+            for (U32 arg : sharedArgs) {
+                masterArgs.emplace_back(arg);
+            }
+
+            IR::UntaggedValue result;
+            Runtime::invokeFunction(Runtime::getContextFromRuntimeData(contextRuntimeData), func,
+                                    Runtime::getFunctionType(func), masterArgs.data(), &result);
+
+            setThreadLevel(parentLevel);
+            setThreadNumber(parentThreadNumber);
+
+            I64 numErrors = 0;
+            for (int callId : chainedThreads) {
                 scheduler::GlobalMessageBus &bus = scheduler::getGlobalMessageBus();
-                scheduler::Scheduler &scheduler = scheduler::getScheduler();
                 int callTimeoutMs = util::getSystemConfig().chainedCallTimeout;
-                logger->info("Waiting for thread #{} with call id {} with a timeout of {}", threadNum,
-                             chainedThreads[threadNum], callTimeoutMs);
+                logger->info("Waiting for thread with call id {} with a timeout of {}", callId, callTimeoutMs);
 
                 // Free this thread
-                message::Message *msg = getExecutingCall();
-                scheduler.notifyAwaiting(*msg);
+                sch.notifyAwaiting(*parentCall);
 
                 int returnCode = 1;
                 try {
-                    const message::Message result = bus.getFunctionResult(chainedThreads[threadNum], callTimeoutMs);
-                    returnCode = result.returnvalue();
+                    const message::Message threadResult = bus.getFunctionResult(callId, callTimeoutMs);
+                    returnCode = threadResult.returnvalue();
                 } catch (redis::RedisNoResponseException &ex) {
-                    util::getLogger()->error("Timed out waiting for chained call: {}", chainedThreads[threadNum]);
+                    util::getLogger()->error("Timed out waiting for chained call: {}", callId);
                 } catch (std::exception &ex) {
                     util::getLogger()->error("Non-timeout exception waiting for chained call: {}", ex.what());
                 }
 
-                scheduler.notifyFinishedAwaiting(*msg);
+                sch.notifyFinishedAwaiting(*parentCall);
 
                 if (returnCode) {
                     numErrors++;
                 }
             }
+
+            // Nothing reads the fork's keys once its threads have returned
+            deleteForkState(parentCall->user(), forkKey, snapshotSize, masterLevel->distributed_reductions);
+
             if (numErrors) {
-                throw std::runtime_error(fmt::format("{}} OMP threads have exited with errors", numErrors));
+                throw std::runtime_error(fmt::format("{} OMP threads have exited with errors", numErrors));
             }
 
-
-            *reducePtr = redis.getLong(REDUCE_KEY);
-            logger->error("END DISTRIBUTED FORK. SETTING REDUCE VALUE TO {}", *reducePtr);
             return;
         }
 
@@ -341,21 +377,11 @@ namespace wasm {
         // Set up new level
         auto nextLevel = std::make_shared<OMPLevel>(thisLevel, nextNumThreads);
 
-        // Note - must ensure thread arguments are outside loop scope otherwise they do
-        // may not exist by the time the thread actually consumes them
-        std::vector<WasmThreadSpec> threadArgs;
-        threadArgs.reserve(nextNumThreads);
-
+        // Note - these arguments are the thread number followed by the number of
+        // shared variables, then the pointers to those shared variables
         std::vector<std::vector<IR::UntaggedValue>> microtaskArgs;
         microtaskArgs.reserve(nextNumThreads);
-
-        std::vector<WAVM::Platform::Thread *> platformThreads;
-        platformThreads.reserve(nextNumThreads);
-
-        // Build up arguments
         for (int threadNum = 0; threadNum < nextNumThreads; threadNum++) {
-            // Note - these arguments are the thread number followed by the number of
-            // shared variables, then the pointers to those shared variables
             microtaskArgs.push_back({threadNum, argc});
             if (argc > 0) {
                 // Get pointer to start of arguments in host memory
@@ -364,34 +390,59 @@ namespace wasm {
                     microtaskArgs[threadNum].emplace_back(pointers[argIdx]);
                 }
             }
-
-            // Arguments for spawning the thread
-            // NOTE - CLion auto-format insists on this layout... and clangd really hates C99 extensions
-            threadArgs.push_back({
-                                         .contextRuntimeData = contextRuntimeData,
-                                         .parentModule = parentModule,
-                                         .parentCall = parentCall,
-                                         .func = func,
-                                         .funcArgs = microtaskArgs[threadNum].data(),
-                                         .stackSize = OMP_STACK_SIZE,
-                                         .tid = threadNum,
-                                         .level = nextLevel
-                                 });
-        }
-
-        // Create the threads themselves
-        for (int threadNum = 0; threadNum < nextNumThreads; threadNum++) {
-            platformThreads.emplace_back(Platform::createThread(
-                    0,
-                    ompThreadEntryFunc,
-                    &threadArgs[threadNum]
-            ));
         }
 
-        // Await all threads
+        // Top-level regions run on the module's persistent team. Nested regions, or forks
+        // while the team is busy, start their own threads
         I64 numErrors = 0;
-        for (auto t: platformThreads) {
-            numErrors += Platform::joinThread(t);
+        bool ranOnPool = false;
+        if (thisLevel->depth == 0) {
+            OMPThreadPool &pool = parentModule->getOMPThreadPool();
+            std::unique_lock<std::mutex> regionLock(pool.getRegionMutex(), std::try_to_lock);
+            if (regionLock.owns_lock()) {
+                numErrors = pool.runRegion(parentCall, func, microtaskArgs, nextLevel);
+                ranOnPool = true;
+            }
+        }
+
+        if (!ranOnPool) {
+            // Note - must ensure thread arguments are outside loop scope otherwise they do
+            // may not exist by the time the thread actually consumes them
+            std::vector<WasmThreadSpec> threadArgs;
+            threadArgs.reserve(nextNumThreads);
+
+            std::vector<WAVM::Platform::Thread *> platformThreads;
+            platformThreads.reserve(nextNumThreads);
+
+            // Build up arguments
+            for (int threadNum = 0; threadNum < nextNumThreads; threadNum++) {
+                // Arguments for spawning the thread
+                // NOTE - CLion auto-format insists on this layout... and clangd really hates C99 extensions
+                threadArgs.push_back({
+                                             .contextRuntimeData = contextRuntimeData,
+                                             .parentModule = parentModule,
+                                             .parentCall = parentCall,
+                                             .func = func,
+                                             .funcArgs = microtaskArgs[threadNum].data(),
+                                             .stackSize = OMP_STACK_SIZE,
+                                             .tid = threadNum,
+                                             .level = nextLevel
+                                     });
+            }
+
+            // Create the threads themselves
+            for (int threadNum = 0; threadNum < nextNumThreads; threadNum++) {
+                platformThreads.emplace_back(Platform::createThread(
+                        0,
+                        ompThreadEntryFunc,
+                        &threadArgs[threadNum]
+                ));
+            }
+
+            // Await all threads
+            for (auto t: platformThreads) {
+                numErrors += Platform::joinThread(t);
+            }
         }
 
         if (numErrors) {
@@ -418,37 +469,26 @@ namespace wasm {
     }
 
     /**
-     * @param    loc       Source code location
-     * @param    gtid      Global thread id of this thread
-     * @param    schedule  Scheduling type for the parallel loop
-     * @param    lastIterPtr Pointer to the "last iteration" flag (boolean)
-     * @param    lowerPtr    Pointer to the lower bound
-     * @param    upperPtr    Pointer to the upper bound of loop chunk
-     * @param    stridePtr   Pointer to the stride for parallel loop
-     * @param    incr      Loop increment
-     * @param    chunk     The chunk size for the parallel loop
-     *
-     * The functions compute the upper and lower bounds and strides to be used for the
-     * set of iterations to be executed by the current thread.
+     * Computes the upper and lower bounds and strides to be used for the set of iterations
+     * to be executed by the current thread, for loops over integers of type T.
      *
      * The guts of the implementation in openmp can be found in __kmp_for_static_init in
      * runtime/src/kmp_sched.cpp
      *
      * See sched_type for supported scheduling.
      */
-    WAVM_DEFINE_INTRINSIC_FUNCTION(env, "__kmpc_for_static_init_4", void, __kmpc_for_static_init_4,
-                                   I32 loc, I32 gtid, I32 schedule, I32 lastIterPtr, I32 lowerPtr,
-                                   I32 upperPtr, I32 stridePtr, I32 incr, I32 chunk) {
+    template<typename T>
+    void forStaticInit(I32 schedule, I32 lastIterPtr, I32 lowerPtr, I32 upperPtr, I32 stridePtr,
+                       std::make_signed_t<T> incr, std::make_signed_t<T> chunk) {
+        using ST = std::make_signed_t<T>;
         const std::shared_ptr<spdlog::logger> &logger = util::getLogger();
-        logger->debug("S - __kmpc_for_static_init_4 {} {} {} {} {} {} {} {} {}",
-                      loc, gtid, schedule, lastIterPtr, lowerPtr, upperPtr, stridePtr, incr, chunk);
 
         // Get host pointers for the things we need to write
         Runtime::Memory *memoryPtr = getExecutingModule()->defaultMemory;
         I32 *lastIter = &Runtime::memoryRef<I32>(memoryPtr, lastIterPtr);
-        I32 *lower = &Runtime::memoryRef<I32>(memoryPtr, lowerPtr);
-        I32 *upper = &Runtime::memoryRef<I32>(memoryPtr, upperPtr);
-        I32 *stride = &Runtime::memoryRef<I32>(memoryPtr, stridePtr);
+        T *lower = &Runtime::memoryRef<T>(memoryPtr, lowerPtr);
+        T *upper = &Runtime::memoryRef<T>(memoryPtr, upperPtr);
+        ST *stride = &Runtime::memoryRef<ST>(memoryPtr, stridePtr);
 
         if (thisLevel->num_threads == 1) {
             *lastIter = true;
@@ -456,55 +496,46 @@ namespace wasm {
             return;
         }
 
-        unsigned int tripCount;
-        if (incr == 1) {
-            tripCount = *upper - *lower + 1;
-        } else if (incr == -1) {
-            tripCount = *lower - *upper + 1;
-        } else if (incr > 0) {
-            // upper-lower can exceed the limit of signed type
-            tripCount = (int) (*upper - *lower) / incr + 1;
-        } else {
-            tripCount = (int) (*lower - *upper) / (-incr) + 1;
-        }
+        // Widening T gives the raw bits getTripCount expects
+        auto tripCount = (U64) getTripCount((U64) *lower, (U64) *upper, incr, std::is_signed<T>::value);
+        auto nThreads = (U64) thisLevel->num_threads;
+        auto threadNum = (U64) thisThreadNumber;
 
-        switch (schedule) {
+        switch (schedule & ~(kmp::sch_modifier_monotonic | kmp::sch_modifier_nonmonotonic)) {
             case kmp::sch_static_chunked: {
-                int span;
                 if (chunk < 1) {
                     chunk = 1;
                 }
-                span = chunk * incr;
-                *stride = span * thisLevel->num_threads;
-                *lower = *lower + (span * thisThreadNumber);
+                ST span = chunk * incr;
+                *stride = span * (ST) nThreads;
+                *lower = *lower + (span * (ST) threadNum);
                 *upper = *lower + span - incr;
-                *lastIter = (thisThreadNumber == ((tripCount - 1) / (unsigned int) chunk) % thisLevel->num_threads);
+                *lastIter = tripCount > 0 && threadNum == ((tripCount - 1) / (U64) chunk) % nThreads;
                 break;
             }
             case kmp::sch_static: { // (chunk not given)
                 // If we have fewer trip_counts than threads
-                if (tripCount < thisLevel->num_threads) {
+                if (tripCount < nThreads) {
                     logger->warn("Small for loop trip count {} {}", tripCount,
-                                 thisLevel->num_threads); // Warns for future use, not tested at scale
-                    if (thisThreadNumber < tripCount) {
-                        *upper = *lower = *lower + thisThreadNumber * incr;
+                                 nThreads); // Warns for future use, not tested at scale
+                    if (threadNum < tripCount) {
+                        *upper = *lower = *lower + (T) threadNum * incr;
                     } else {
                         *lower = *upper + incr;
                     }
-                    *lastIter = (thisThreadNumber == tripCount - 1);
+                    *lastIter = tripCount > 0 && threadNum == tripCount - 1;
                 } else {
                     // TODO: We only implement below kmp_sch_static_balanced, not kmp_sch_static_greedy
                     // Those are set through KMP_SCHEDULE so we would need to look out for real code setting this
                     logger->debug("Ignores KMP_SCHEDULE variable, defaults to static balanced schedule");
-                    U32 small_chunk = tripCount / thisLevel->num_threads;
-                    U32 extras = tripCount % thisLevel->num_threads;
-                    *lower += incr * (thisThreadNumber * small_chunk +
-                                      (thisThreadNumber < extras ? thisThreadNumber : extras));
-                    *upper = *lower + small_chunk * incr - (thisThreadNumber < extras ? 0 : incr);
-                    *lastIter = (thisThreadNumber == thisLevel->num_threads - 1);
+                    U64 small_chunk = tripCount / nThreads;
+                    U64 extras = tripCount % nThreads;
+                    *lower += incr * (T) (threadNum * small_chunk + (threadNum < extras ? threadNum : extras));
+                    *upper = *lower + (T) small_chunk * incr - (threadNum < extras ? 0 : incr);
+                    *lastIter = threadNum == nThreads - 1;
                 }
 
-                *stride = tripCount;
+                *stride = (ST) tripCount;
                 break;
             }
             default: {
@@ -513,55 +544,351 @@ namespace wasm {
         }
     }
 
+    /**
+     * @param    loc       Source code location
+     * @param    gtid      Global thread id of this thread
+     * @param    schedule  Scheduling type for the parallel loop
+     * @param    lastIterPtr Pointer to the "last iteration" flag (boolean)
+     * @param    lowerPtr    Pointer to the lower bound
+     * @param    upperPtr    Pointer to the upper bound of loop chunk
+     * @param    stridePtr   Pointer to the stride for parallel loop
+     * @param    incr      Loop increment
+     * @param    chunk     The chunk size for the parallel loop
+     *
+     * Static scheduling for loops over 32-bit signed integers. The _4u, _8 and _8u variants
+     * below are the same for unsigned and 64-bit loops.
+     */
+    WAVM_DEFINE_INTRINSIC_FUNCTION(env, "__kmpc_for_static_init_4", void, __kmpc_for_static_init_4,
+                                   I32 loc, I32 gtid, I32 schedule, I32 lastIterPtr, I32 lowerPtr,
+                                   I32 upperPtr, I32 stridePtr, I32 incr, I32 chunk) {
+        util::getLogger()->debug("S - __kmpc_for_static_init_4 {} {} {} {} {} {} {} {} {}",
+                                 loc, gtid, schedule, lastIterPtr, lowerPtr, upperPtr, stridePtr, incr, chunk);
+        forStaticInit<I32>(schedule, lastIterPtr, lowerPtr, upperPtr, stridePtr, incr, chunk);
+    }
+
+    WAVM_DEFINE_INTRINSIC_FUNCTION(env, "__kmpc_for_static_init_4u", void, __kmpc_for_static_init_4u,
+                                   I32 loc, I32 gtid, I32 schedule, I32 lastIterPtr, I32 lowerPtr,
+                                   I32 upperPtr, I32 stridePtr, I32 incr, I32 chunk) {
+        util::getLogger()->debug("S - __kmpc_for_static_init_4u {} {} {} {} {} {} {} {} {}",
+                                 loc, gtid, schedule, lastIterPtr, lowerPtr, upperPtr, stridePtr, incr, chunk);
+        forStaticInit<U32>(schedule, lastIterPtr, lowerPtr, upperPtr, stridePtr, incr, chunk);
+    }
+
+    WAVM_DEFINE_INTRINSIC_FUNCTION(env, "__kmpc_for_static_init_8", void, __kmpc_for_static_init_8,
+                                   I32 loc, I32 gtid, I32 schedule, I32 lastIterPtr, I32 lowerPtr,
+                                   I32 upperPtr, I32 stridePtr, I64 incr, I64 chunk) {
+        util::getLogger()->debug("S - __kmpc_for_static_init_8 {} {} {} {} {} {} {} {} {}",
+                                 loc, gtid, schedule, lastIterPtr, lowerPtr, upperPtr, stridePtr, incr, chunk);
+        forStaticInit<I64>(schedule, lastIterPtr, lowerPtr, upperPtr, stridePtr, incr, chunk);
+    }
+
+    WAVM_DEFINE_INTRINSIC_FUNCTION(env, "__kmpc_for_static_init_8u", void, __kmpc_for_static_init_8u,
+                                   I32 loc, I32 gtid, I32 schedule, I32 lastIterPtr, I32 lowerPtr,
+                                   I32 upperPtr, I32 stridePtr, I64 incr, I64 chunk) {
+        util::getLogger()->debug("S - __kmpc_for_static_init_8u {} {} {} {} {} {} {} {} {}",
+                                 loc, gtid, schedule, lastIterPtr, lowerPtr, upperPtr, stridePtr, incr, chunk);
+        forStaticInit<U64>(schedule, lastIterPtr, lowerPtr, upperPtr, stridePtr, incr, chunk);
+    }
+
     WAVM_DEFINE_INTRINSIC_FUNCTION(env, "__kmpc_for_static_fini", void, __kmpc_for_static_fini,
                                    I32 loc, I32 gtid) {
         util::getLogger()->debug("S - __kmpc_for_static_fini {} {}", loc, gtid);
     }
 
     /**
-     * There exists many reduction methods, implementing everything as a reduce block
+     * Dynamic, guided and runtime scheduled loops are set up with __kmpc_dispatch_init_*
+     * by every thread in the team, then each thread calls __kmpc_dispatch_next_* to get
+     * chunks of iterations until it returns zero. See Dispatch.h for how chunks are handed out.
+     *
+     * @param    loc       Source code location
+     * @param    gtid      Global thread id of this thread
+     * @param    schedule  Scheduling type for the parallel loop
+     * @param    lower     First iteration of the loop
+     * @param    upper     Last iteration of the loop (inclusive)
+     * @param    incr      Loop increment
+     * @param    chunk     The chunk size for the parallel loop
      */
-    kmp::_reduction_method determineReductionMethod() {
-        if (thisLevel->num_threads == 1) {
-            return kmp::empty_reduce_block;
+    template<typename T>
+    void loopDispatchInit(I32 schedule, T lower, T upper, std::make_signed_t<T> incr, std::make_signed_t<T> chunk) {
+        dispatchInit(*thisLevel, thisThreadNumber, schedule, (U64) lower, (U64) upper, incr, chunk,
+                     std::is_signed<T>::value);
+    }
+
+    /**
+     * @param    lastIterPtr Pointer to the "last iteration" flag (boolean)
+     * @param    lowerPtr    Pointer to the lower bound of the next chunk
+     * @param    upperPtr    Pointer to the upper bound of the next chunk
+     * @param    stridePtr   Pointer to the stride of the next chunk
+     * @return   one if there is another chunk for this thread, zero once the loop is done
+     */
+    template<typename T>
+    I32 loopDispatchNext(I32 lastIterPtr, I32 lowerPtr, I32 upperPtr, I32 stridePtr) {
+        OMPChunk chunk;
+        if (!dispatchNext(*thisLevel, thisThreadNumber, chunk)) {
+            return 0;
+        }
+
+        Runtime::Memory *memoryPtr = getExecutingModule()->defaultMemory;
+        if (lastIterPtr != 0) {
+            Runtime::memoryRef<I32>(memoryPtr, lastIterPtr) = chunk.isLast;
         }
-        return kmp::critical_reduce_block;
+        Runtime::memoryRef<T>(memoryPtr, lowerPtr) = (T) chunk.lower;
+        Runtime::memoryRef<T>(memoryPtr, upperPtr) = (T) chunk.upper;
+        Runtime::memoryRef<std::make_signed_t<T>>(memoryPtr, stridePtr) = (std::make_signed_t<T>) chunk.stride;
+
+        return 1;
+    }
+
+    WAVM_DEFINE_INTRINSIC_FUNCTION(env, "__kmpc_dispatch_init_4", void, __kmpc_dispatch_init_4,
+                                   I32 loc, I32 gtid, I32 schedule, I32 lower, I32 upper, I32 incr, I32 chunk) {
+        util::getLogger()->debug("S - __kmpc_dispatch_init_4 {} {} {} {} {} {} {}",
+                                 loc, gtid, schedule, lower, upper, incr, chunk);
+        loopDispatchInit<I32>(schedule, lower, upper, incr, chunk);
+    }
+
+    WAVM_DEFINE_INTRINSIC_FUNCTION(env, "__kmpc_dispatch_init_4u", void, __kmpc_dispatch_init_4u,
+                                   I32 loc, I32 gtid, I32 schedule, I32 lower, I32 upper, I32 incr, I32 chunk) {
+        util::getLogger()->debug("S - __kmpc_dispatch_init_4u {} {} {} {} {} {} {}",
+                                 loc, gtid, schedule, lower, upper, incr, chunk);
+        loopDispatchInit<U32>(schedule, lower, upper, incr, chunk);
+    }
+
+    WAVM_DEFINE_INTRINSIC_FUNCTION(env, "__kmpc_dispatch_init_8", void, __kmpc_dispatch_init_8,
+                                   I32 loc, I32 gtid, I32 schedule, I64 lower, I64 upper, I64 incr, I64 chunk) {
+        util::getLogger()->debug("S - __kmpc_dispatch_init_8 {} {} {} {} {} {} {}",
+                                 loc, gtid, schedule, lower, upper, incr, chunk);
+        loopDispatchInit<I64>(schedule, lower, upper, incr, chunk);
+    }
+
+    WAVM_DEFINE_INTRINSIC_FUNCTION(env, "__kmpc_dispatch_init_8u", void, __kmpc_dispatch_init_8u,
+                                   I32 loc, I32 gtid, I32 schedule, I64 lower, I64 upper, I64 incr, I64 chunk) {
+        util::getLogger()->debug("S - __kmpc_dispatch_init_8u {} {} {} {} {} {} {}",
+                                 loc, gtid, schedule, lower, upper, incr, chunk);
+        loopDispatchInit<U64>(schedule, lower, upper, incr, chunk);
+    }
+
+    WAVM_DEFINE_INTRINSIC_FUNCTION(env, "__kmpc_dispatch_next_4", I32, __kmpc_dispatch_next_4,
+                                   I32 loc, I32 gtid, I32 lastIterPtr, I32 lowerPtr, I32 upperPtr, I32 stridePtr) {
+        util::getLogger()->debug("S - __kmpc_dispatch_next_4 {} {} {} {} {} {}",
+                                 loc, gtid, lastIterPtr, lowerPtr, upperPtr, stridePtr);
+        return loopDispatchNext<I32>(lastIterPtr, lowerPtr, upperPtr, stridePtr);
+    }
+
+    WAVM_DEFINE_INTRINSIC_FUNCTION(env, "__kmpc_dispatch_next_4u", I32, __kmpc_dispatch_next_4u,
+                                   I32 loc, I32 gtid, I32 lastIterPtr, I32 lowerPtr, I32 upperPtr, I32 stridePtr) {
+        util::getLogger()->debug("S - __kmpc_dispatch_next_4u {} {} {} {} {} {}",
+                                 loc, gtid, lastIterPtr, lowerPtr, upperPtr, stridePtr);
+        return loopDispatchNext<U32>(lastIterPtr, lowerPtr, upperPtr, stridePtr);
+    }
+
+    WAVM_DEFINE_INTRINSIC_FUNCTION(env, "__kmpc_dispatch_next_8", I32, __kmpc_dispatch_next_8,
+                                   I32 loc, I32 gtid, I32 lastIterPtr, I32 lowerPtr, I32 upperPtr, I32 stridePtr) {
+        util::getLogger()->debug("S - __kmpc_dispatch_next_8 {} {} {} {} {} {}",
+                                 loc, gtid, lastIterPtr, lowerPtr, upperPtr, stridePtr);
+        return loopDispatchNext<I64>(lastIterPtr, lowerPtr, upperPtr, stridePtr);
+    }
+
+    WAVM_DEFINE_INTRINSIC_FUNCTION(env, "__kmpc_dispatch_next_8u", I32, __kmpc_dispatch_next_8u,
+                                   I32 loc, I32 gtid, I32 lastIterPtr, I32 lowerPtr, I32 upperPtr, I32 stridePtr) {
+        util::getLogger()->debug("S - __kmpc_dispatch_next_8u {} {} {} {} {} {}",
+                                 loc, gtid, lastIterPtr, lowerPtr, upperPtr, stridePtr);
+        return loopDispatchNext<U64>(lastIterPtr, lowerPtr, upperPtr, stridePtr);
+    }
+
+    /**
+     * Copies out this thread's private reduction variables, each padded to OMP_REDUCE_VAR_BYTES.
+     */
+    std::vector<uint8_t> readReduceVars(I32 reduceData, int numVars) {
+        Runtime::Memory *memoryPtr = getExecutingModule()->defaultMemory;
+        Uptr memorySize = Runtime::getMemoryNumPages(memoryPtr) * IR::numBytesPerPage;
+        U32 *varPtrs = Runtime::memoryArrayPtr<U32>(memoryPtr, reduceData, numVars);
+
+        std::vector<uint8_t> vars(numVars * OMP_REDUCE_VAR_BYTES, 0);
+        for (int i = 0; i < numVars; i++) {
+            // The padding can run off the end of memory
+            Uptr nBytes = std::min<Uptr>(OMP_REDUCE_VAR_BYTES, memorySize - varPtrs[i]);
+            U8 *varBytes = Runtime::memoryArrayPtr<U8>(memoryPtr, varPtrs[i], nBytes);
+            std::copy(varBytes, varBytes + nBytes, vars.begin() + i * OMP_REDUCE_VAR_BYTES);
+        }
+
+        return vars;
+    }
+
+    /**
+     * Folds other threads' reduction variables into this thread's with the reduce function. As
+     * the function takes a list of pointers to each side's variables, the other side is copied
+     * onto the wasm stack below the current frame for the duration of the call.
+     */
+    void foldReduceVars(Runtime::ContextRuntimeData *contextRuntimeData, I32 reduceFunc, I32 reduceData,
+                        int numVars, const std::vector<uint8_t> &otherVars) {
+        if (otherVars.size() != numVars * OMP_REDUCE_VAR_BYTES) {
+            throw std::runtime_error(fmt::format("Reduction contribution of {} bytes for {} variables",
+                                                 otherVars.size(), numVars));
+        }
+
+        Runtime::Context *context = Runtime::getContextFromRuntimeData(contextRuntimeData);
+        Runtime::Memory *memoryPtr = getExecutingModule()->defaultMemory;
+        Runtime::Function *func = Runtime::asFunction(
+                Runtime::getTableElement(getExecutingModule()->defaultTable, reduceFunc));
+
+        U32 stackPointer = context->runtimeData->mutableGlobals[0].u32;
+        U32 listSize = numVars * sizeof(U32);
+        U32 varsPtr = (stackPointer - otherVars.size() - listSize) & ~15U;
+        U32 listPtr = varsPtr + otherVars.size();
+
+        U8 *vars = Runtime::memoryArrayPtr<U8>(memoryPtr, varsPtr, otherVars.size());
+        std::copy(otherVars.begin(), otherVars.end(), vars);
+        U32 *list = Runtime::memoryArrayPtr<U32>(memoryPtr, listPtr, numVars);
+        for (int i = 0; i < numVars; i++) {
+            list[i] = varsPtr + i * OMP_REDUCE_VAR_BYTES;
+        }
+
+        context->runtimeData->mutableGlobals[0] = varsPtr;
+        IR::UntaggedValue args[2] = {reduceData, listPtr};
+        Runtime::invokeFunction(context, func, Runtime::getFunctionType(func), args);
+        context->runtimeData->mutableGlobals[0] = stackPointer;
+    }
+
+    /**
+     * Reductions across a distributed fork. Threads on other hosts combine their variables with
+     * those of the other threads from the fork on the same host, then one of them sends the
+     * result on. The master folds these into its own variables and goes on to update the shared
+     * variables as in a local reduction. As the reduce function does the folding, any type and
+     * operation that fits in OMP_REDUCE_VAR_BYTES will do.
+     *
+     * @return 1 on the master, which must then finish the reduction, and 0 elsewhere
+     */
+    I32 distributedReduction(Runtime::ContextRuntimeData *contextRuntimeData, I32 numVars, I32 reduceSize,
+                             I32 reduceData, I32 reduceFunc) {
+        const std::shared_ptr<spdlog::logger> &logger = util::getLogger();
+
+        // Array sections and VLAs add extra entries to the list
+        if (reduceSize != numVars * (I32) sizeof(U32) || reduceFunc == 0) {
+            throw std::runtime_error("Unsupported distributed reduction");
+        }
+
+        int reductionIdx = thisLevel->distributed_reductions++;
+        if (thisThreadNumber != 0) {
+            getNodeReductions().contribute(thisLevel->fork_key, reductionIdx,
+                                           [contextRuntimeData, numVars, reduceData, reduceFunc](
+                                                   const OMPReduceContribution *pending) {
+                                               if (pending != nullptr) {
+                                                   foldReduceVars(contextRuntimeData, reduceFunc, reduceData,
+                                                                  numVars, pending->data);
+                                               }
+                                               return readReduceVars(reduceData, numVars);
+                                           });
+            return 0;
+        }
+
+        // The master waits for contributions covering all the other threads
+        redis::Redis &redis = redis::Redis::getState();
+        scheduler::Scheduler &sch = scheduler::getScheduler();
+        message::Message *call = getExecutingCall();
+        const std::string reduceKey = getForkReduceKey(thisLevel->fork_key, reductionIdx);
+        int timeoutMs = util::getSystemConfig().chainedCallTimeout;
+
+        scheduler::AwaitingGuard awaiting(sch, *call);
+        int nReduced = 1;
+        while (nReduced < thisLevel->num_threads) {
+            OMPReduceContribution contribution = OMPReduceContribution::fromBytes(
+                    redis.dequeueBytes(reduceKey, timeoutMs));
+            logger->debug("Reduction {} received {} threads", reduceKey, contribution.nThreads);
+
+            foldReduceVars(contextRuntimeData, reduceFunc, reduceData, numVars, contribution.data);
+            nReduced += contribution.nThreads;
+        }
+
+        return 1;
+    }
+
+    // The method this thread is using for its current reduction, needed again to end it
+    static thread_local kmp::_reduction_method thisReductionMethod = kmp::reduction_method_not_defined;
+
+    /**
+     * Picks between the reduction methods the compiler has generated code for. Tree reductions
+     * need the reduce data and function, atomic ones are flagged on the source location.
+     *
+     * Functions built with -mno-atomics (as our toolchain does) still flag the atomic path, but
+     * it's lowered to plain loads and stores. Only modules with shared memory can have been built
+     * with real atomics, so the atomic path is ignored for anything else.
+     */
+    kmp::_reduction_method pickReductionMethod(I32 loc, I32 reduceData, I32 reduceFunc) {
+        Runtime::Memory *memoryPtr = getExecutingModule()->defaultMemory;
+
+        bool atomicAvailable = false;
+        if (loc != 0 && Runtime::getMemoryType(memoryPtr).isShared) {
+            // Flags are the second field of ident_t
+            I32 flags = Runtime::memoryRef<I32>(memoryPtr, loc + sizeof(I32));
+            atomicAvailable = (flags & kmp::KMP_IDENT_ATOMIC_REDUCE) != 0;
+        }
+
+        bool treeAvailable = reduceData != 0 && reduceFunc != 0;
+        return determineReductionMethod(*thisLevel, atomicAvailable, treeAvailable);
     }
 
     /**
      *  When reaching the end of the reduction loop, the threads need to synchronise to operate the
-     *  reduction function. In the multi-machine case, this
+     *  reduction function. For tree reductions the threads' data is combined here, by calling the
+     *  reduce function from the threads themselves.
+     *
+     *  A blocking reduce holds the other threads until the one folding in the result ends the
+     *  reduction, whereas with nowait they're only held until their data has been used.
      */
-    int startReduction() {
-        int retVal = 0;
+    I32 startReduction(Runtime::ContextRuntimeData *contextRuntimeData, I32 loc, I32 reduceData, I32 reduceFunc,
+                       I32 lck, bool isNowait) {
+        thisReductionMethod = pickReductionMethod(loc, reduceData, reduceFunc);
 
-        switch (determineReductionMethod()) {
+        switch (thisReductionMethod) {
             case kmp::critical_reduce_block:
                 util::getLogger()->debug("Thread {} reduction locking", thisThreadNumber);
-                thisLevel->reduceMutex.lock();
-                retVal = 1;
-                break;
+                getExecutingModule()->getOMPCriticalSections().getMutex(lck).lock();
+                return 1;
             case kmp::empty_reduce_block:
-                retVal = 1;
-                break;
+                return 1;
             case kmp::atomic_reduce_block:
-                retVal = 2;
-                break;
-            case kmp::reduction_method_not_defined:
-            case kmp::tree_reduce_block:
-                std::runtime_error("Unsupported reduce operation");
+                return 2;
+            case kmp::tree_reduce_block: {
+                Runtime::Context *context = Runtime::getContextFromRuntimeData(contextRuntimeData);
+                Runtime::Function *func = Runtime::asFunction(
+                        Runtime::getTableElement(getExecutingModule()->defaultTable, reduceFunc));
+
+                bool isMaster = treeReduce(*thisLevel, thisThreadNumber, reduceData,
+                                           [context, func](uint32_t lhs, uint32_t rhs) {
+                                               IR::UntaggedValue args[2] = {lhs, rhs};
+                                               Runtime::invokeFunction(context, func, Runtime::getFunctionType(func),
+                                                                       args);
+                                           });
+
+                if (isNowait || !isMaster) {
+                    thisLevel->barrier->wait();
+                }
+
+                return isMaster ? 1 : 0;
+            }
+            default:
+                throw std::runtime_error("Unsupported reduce operation");
         }
-        return retVal;
     }
 
     /**
      *  Called immediately after running the reduction section before exiting the `reduce` construct.
      */
-    void endReduction() {
-        // Unlocking not owned mutex is UB
-        if (thisLevel->num_threads > 1) {
-            util::getLogger()->debug("Thread {} unlocking reduction", thisThreadNumber);
-            thisLevel->reduceMutex.unlock();
+    void endReduction(I32 lck, bool isNowait) {
+        switch (thisReductionMethod) {
+            case kmp::critical_reduce_block:
+                util::getLogger()->debug("Thread {} unlocking reduction", thisThreadNumber);
+                getExecutingModule()->getOMPCriticalSections().getMutex(lck).unlock();
+                break;
+            case kmp::atomic_reduce_block:
+            case kmp::tree_reduce_block:
+                break;
+            default:
+                return;
+        }
+
+        if (!isNowait) {
+            thisLevel->barrier->wait();
         }
     }
 
@@ -582,7 +909,11 @@ namespace wasm {
         logger->debug("S - __kmpc_reduce {} {} {} {} {} {} {}", loc, gtid, num_vars, reduce_size,
                       reduce_data, reduce_func, lck);
 
-        return startReduction();
+        if (thisLevel->is_distributed) {
+            return distributedReduction(contextRuntimeData, num_vars, reduce_size, reduce_data, reduce_func);
+        }
+
+        return startReduction(contextRuntimeData, loc, reduce_data, reduce_func, lck, false);
     }
 
     /**
@@ -602,21 +933,11 @@ namespace wasm {
         logger->debug("S - __kmpc_reduce_nowait {} {} {} {} {} {} {}", loc, gtid, num_vars, reduce_size, reduce_data,
                       reduce_func, lck);
 
-        if (1 == userNumDevice) {
-            Runtime::Memory *memoryPtr = getExecutingModule()->defaultMemory;
-            int *localReduceData = &Runtime::memoryRef<I32>(memoryPtr, Runtime::memoryRef<I32>(memoryPtr, reduce_data));
-            logger->debug("Reduce local data ({}): {}", thisThreadNumber, *localReduceData);
-
-            if(util::getSystemConfig().stateMode == "redis") {
-                redis::Redis &redis = redis::Redis::getState();
-                redis.incrByLong(REDUCE_KEY, *localReduceData);
-            } else {
-                throw std::runtime_error("Only supports Redis for state");
-            }
-            return kmp::empty_reduce_block; // Just need a number different from 1 and 2
-        } else {
-            return startReduction();
+        if (thisLevel->is_distributed) {
+            return distributedReduction(contextRuntimeData, num_vars, reduce_size, reduce_data, reduce_func);
         }
+
+        return startReduction(contextRuntimeData, loc, reduce_data, reduce_func, lck, true);
     }
 
     /**
@@ -627,10 +948,9 @@ namespace wasm {
      */
     WAVM_DEFINE_INTRINSIC_FUNCTION(env, "__kmpc_end_reduce", void, __kmpc_end_reduce, I32 loc, I32 gtid, I32 lck) {
         util::getLogger()->debug("S - __kmpc_end_reduce {} {} {}", loc, gtid, lck);
-        if (1 == userNumDevice) {
-            endReduction();
-        } else {
-            throw std::runtime_error("End reduce called in distributed context");
+        // Distributed reductions are finished once the master has its result
+        if (!thisLevel->is_distributed) {
+            endReduction(lck, false);
         }
     }
 
@@ -643,10 +963,9 @@ namespace wasm {
     WAVM_DEFINE_INTRINSIC_FUNCTION(env, "__kmpc_end_reduce_nowait", void, __kmpc_end_reduce_nowait, I32 loc, I32 gtid,
                                    I32 lck) {
         util::getLogger()->debug("S - __kmpc_end_reduce_nowait {} {} {}", loc, gtid, lck);
-        if (1 == userNumDevice) {
-            endReduction();
-        } else {
-            throw std::runtime_error("End reduce called in distributed context");
+        // Distributed reductions are finished once the master has its result
+        if (!thisLevel->is_distributed) {
+            endReduction(lck, true);
         }
     }
 
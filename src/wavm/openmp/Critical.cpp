@@ -0,0 +1,35 @@
+#include "wasm/openmp/Critical.h"
+
+#include <util/locks.h>
+
+namespace wasm {
+    namespace openmp {
+        std::mutex &OMPCriticalSections::getMutex(uint32_t lockPtr) {
+            {
+                util::SharedLock lock(mx);
+                auto it = sections.find(lockPtr);
+                if (it != sections.end()) {
+                    return *it->second;
+                }
+            }
+
+            util::FullLock lock(mx);
+            std::unique_ptr<std::mutex> &section = sections[lockPtr];
+            if (!section) {
+                section = std::make_unique<std::mutex>();
+            }
+
+            return *section;
+        }
+
+        int OMPCriticalSections::getCount() {
+            util::SharedLock lock(mx);
+            return (int) sections.size();
+        }
+
+        void OMPCriticalSections::clear() {
+            util::FullLock lock(mx);
+            sections.clear();
+        }
+    }
+}
@@ -0,0 +1,208 @@
+#include "wasm/openmp/Dispatch.h"
+#include "wasm/openmp/Level.h"
+
+#include <util/locks.h>
+#include <util/logging.h>
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace wasm {
+    namespace openmp {
+        // This thread's view of the loop it's currently dispatching
+        struct OMPThreadDispatch {
+            OMPDispatchBuffer *buffer = nullptr;
+            int32_t schedule = kmp::sch_static;
+            uint64_t lower = 0;
+            int64_t incr = 1;
+            uint64_t tripCount = 0;
+            uint64_t chunk = 1;
+            uint64_t staticNext = 0;
+            bool isDone = true;
+        };
+
+        static thread_local OMPThreadDispatch thisDispatch;
+
+        int32_t normaliseSchedule(const OMPLevel &level, int32_t schedule, int64_t &chunk) {
+            int32_t kind = schedule & ~(kmp::sch_modifier_monotonic | kmp::sch_modifier_nonmonotonic);
+
+            // Runtime schedules come from omp_set_schedule
+            if (kind == kmp::sch_runtime) {
+                chunk = level.runtime_chunk;
+                switch (level.runtime_schedule) {
+                    case omp_sched_dynamic:
+                        kind = kmp::sch_dynamic_chunked;
+                        break;
+                    case omp_sched_guided:
+                        kind = kmp::sch_guided_chunked;
+                        break;
+                    case omp_sched_static:
+                        kind = chunk > 0 ? kmp::sch_static_chunked : kmp::sch_static;
+                        break;
+                    default:
+                        kind = kmp::sch_auto;
+                        break;
+                }
+            }
+
+            switch (kind) {
+                case kmp::sch_static:
+                case kmp::sch_auto:
+                case kmp::sch_static_greedy:
+                case kmp::sch_static_balanced:
+                    return kmp::sch_static;
+                case kmp::sch_static_chunked:
+                case kmp::sch_dynamic_chunked:
+                    chunk = std::max<int64_t>(chunk, 1);
+                    return kind;
+                case kmp::sch_guided_chunked:
+                case kmp::sch_guided_iterative_chunked:
+                case kmp::sch_guided_analytical_chunked:
+                    chunk = std::max<int64_t>(chunk, 1);
+                    return kmp::sch_guided_chunked;
+                default:
+                    throw std::runtime_error(fmt::format("Unimplemented scheduler {}", schedule));
+            }
+        }
+
+        uint64_t getTripCount(uint64_t lower, uint64_t upper, int64_t incr, bool isSigned) {
+            if (incr == 0) {
+                throw std::runtime_error("Zero loop increment");
+            }
+
+            // Differences are taken unsigned, as they can exceed the range of the signed type
+            if (incr > 0) {
+                bool isEmpty = isSigned ? (int64_t) upper < (int64_t) lower : upper < lower;
+                return isEmpty ? 0 : (upper - lower) / (uint64_t) incr + 1;
+            } else {
+                bool isEmpty = isSigned ? (int64_t) lower < (int64_t) upper : lower < upper;
+                return isEmpty ? 0 : (lower - upper) / (0 - (uint64_t) incr) + 1;
+            }
+        }
+
+        void dispatchInit(OMPLevel &level, int threadNum, int32_t schedule, uint64_t lower, uint64_t upper,
+                          int64_t incr, int64_t chunk, bool isSigned) {
+            if (threadNum < 0 || threadNum >= (int) level.dispatch_seqs.size()) {
+                throw std::runtime_error(fmt::format("Thread {} not in team of {}", threadNum, level.num_threads));
+            }
+
+            int32_t kind = normaliseSchedule(level, schedule, chunk);
+            uint64_t tripCount = getTripCount(lower, upper, incr, isSigned);
+            uint64_t seq = level.dispatch_seqs[threadNum]++;
+
+            thisDispatch.buffer = nullptr;
+            thisDispatch.schedule = kind;
+            thisDispatch.lower = lower;
+            thisDispatch.incr = incr;
+            thisDispatch.tripCount = tripCount;
+            thisDispatch.chunk = (uint64_t) std::max<int64_t>(chunk, 1);
+            thisDispatch.staticNext = 0;
+            thisDispatch.isDone = false;
+
+            // Static schedules don't need anything shared
+            if (kind == kmp::sch_static || kind == kmp::sch_static_chunked) {
+                return;
+            }
+
+            // The first thread into the loop sets up its buffer, once the team is done with the
+            // loop that used it last
+            OMPDispatchBuffer &buffer = level.dispatch_buffers[seq % OMP_DISPATCH_BUFFERS];
+            util::UniqueLock lock(buffer.mx);
+            buffer.cv.wait(lock, [&buffer, &level, seq] {
+                return buffer.seq == seq || buffer.seq == UINT64_MAX || buffer.finished == level.num_threads;
+            });
+
+            if (buffer.seq != seq) {
+                buffer.seq = seq;
+                buffer.finished = 0;
+                buffer.schedule = kind;
+                buffer.tripCount = tripCount;
+                buffer.chunk = thisDispatch.chunk;
+                buffer.next.store(0);
+            }
+
+            thisDispatch.buffer = &buffer;
+        }
+
+        static bool finishDispatch(OMPLevel &level) {
+            OMPDispatchBuffer *buffer = thisDispatch.buffer;
+            if (buffer != nullptr) {
+                util::UniqueLock lock(buffer->mx);
+                buffer->finished++;
+                if (buffer->finished == level.num_threads) {
+                    buffer->cv.notify_all();
+                }
+            }
+
+            thisDispatch.buffer = nullptr;
+            thisDispatch.isDone = true;
+            return false;
+        }
+
+        bool dispatchNext(OMPLevel &level, int threadNum, OMPChunk &chunk) {
+            OMPThreadDispatch &d = thisDispatch;
+            if (d.isDone) {
+                return false;
+            }
+
+            auto nThreads = (uint64_t) level.num_threads;
+            uint64_t start;
+            uint64_t end = 0;
+            switch (d.schedule) {
+                case kmp::sch_static: {
+                    // One balanced block per thread
+                    if (d.staticNext > 0) {
+                        return finishDispatch(level);
+                    }
+
+                    uint64_t smallChunk = d.tripCount / nThreads;
+                    uint64_t extras = d.tripCount % nThreads;
+                    auto t = (uint64_t) threadNum;
+                    start = t * smallChunk + std::min(t, extras);
+                    end = start + smallChunk + (t < extras ? 1 : 0);
+                    d.staticNext++;
+                    break;
+                }
+                case kmp::sch_static_chunked: {
+                    // Chunks dealt round-robin
+                    start = ((uint64_t) threadNum + d.staticNext * nThreads) * d.chunk;
+                    end = std::min(start + d.chunk, d.tripCount);
+                    d.staticNext++;
+                    break;
+                }
+                case kmp::sch_dynamic_chunked: {
+                    start = d.buffer->next.fetch_add(d.chunk);
+                    end = std::min(start + d.chunk, d.tripCount);
+                    break;
+                }
+                case kmp::sch_guided_chunked: {
+                    // Chunks shrink with the work left, down to the given chunk size
+                    start = d.buffer->next.load();
+                    do {
+                        if (start >= d.tripCount) {
+                            break;
+                        }
+
+                        uint64_t remaining = d.tripCount - start;
+                        uint64_t size = std::max(d.chunk, (remaining + 2 * nThreads - 1) / (2 * nThreads));
+                        end = start + std::min(size, remaining);
+                    } while (!d.buffer->next.compare_exchange_weak(start, end));
+                    break;
+                }
+                default:
+                    throw std::runtime_error(fmt::format("Unimplemented scheduler {}", d.schedule));
+            }
+
+            if (start >= d.tripCount || start >= end) {
+                return finishDispatch(level);
+            }
+
+            chunk.lower = d.lower + start * (uint64_t) d.incr;
+            chunk.upper = d.lower + (end - 1) * (uint64_t) d.incr;
+            chunk.stride = d.incr;
+            chunk.isLast = end == d.tripCount;
+
+            return true;
+        }
+    }
+}
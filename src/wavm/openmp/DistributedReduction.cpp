@@ -0,0 +1,131 @@
+#include "wasm/openmp/DistributedReduction.h"
+
+#include <redis/Redis.h>
+#include <util/locks.h>
+#include <util/logging.h>
+
+#include <cstring>
+#include <stdexcept>
+
+namespace wasm {
+    namespace openmp {
+        std::vector<uint8_t> OMPReduceContribution::toBytes() const {
+            std::vector<uint8_t> bytes(sizeof(int32_t) + data.size());
+            std::memcpy(bytes.data(), &nThreads, sizeof(int32_t));
+            std::copy(data.begin(), data.end(), bytes.begin() + sizeof(int32_t));
+            return bytes;
+        }
+
+        OMPReduceContribution OMPReduceContribution::fromBytes(const std::vector<uint8_t> &bytes) {
+            if (bytes.size() < sizeof(int32_t)) {
+                throw std::runtime_error("Reduction contribution too short");
+            }
+
+            OMPReduceContribution contribution;
+            std::memcpy(&contribution.nThreads, bytes.data(), sizeof(int32_t));
+            contribution.data.assign(bytes.begin() + sizeof(int32_t), bytes.end());
+            return contribution;
+        }
+
+        std::string getForkReduceKey(const std::string &forkKey, int reductionIdx) {
+            return forkKey + "_reduce_" + std::to_string(reductionIdx);
+        }
+
+        OMPNodeReductions &getNodeReductions() {
+            static OMPNodeReductions reductions;
+            return reductions;
+        }
+
+        void OMPNodeReductions::joinFork(const std::string &forkKey) {
+            util::UniqueLock lock(mx);
+            forks[forkKey].activeThreads++;
+        }
+
+        void OMPNodeReductions::contribute(const std::string &forkKey, int reductionIdx,
+                                           const std::function<std::vector<uint8_t>(
+                                                   const OMPReduceContribution *)> &combine) {
+            OMPReduceContribution mine;
+            mine.nThreads = 1;
+            mine.data = combine(nullptr);
+
+            // Another thread may contribute while we're folding in what was there, in which
+            // case we take that and go again
+            while (true) {
+                OMPReduceContribution pending;
+                {
+                    util::UniqueLock lock(mx);
+                    auto forkIt = forks.find(forkKey);
+                    if (forkIt == forks.end()) {
+                        throw std::runtime_error("Contributing to fork " + forkKey + " without joining");
+                    }
+
+                    auto it = forkIt->second.pending.find(reductionIdx);
+                    if (it == forkIt->second.pending.end()) {
+                        forkIt->second.pending.emplace(reductionIdx, std::move(mine));
+                        return;
+                    }
+
+                    pending = std::move(it->second);
+                    forkIt->second.pending.erase(it);
+                }
+
+                mine.data = combine(&pending);
+                mine.nThreads += pending.nThreads;
+            }
+        }
+
+        void OMPNodeReductions::leaveFork(const std::string &forkKey) {
+            ForkReductions finished;
+            {
+                util::UniqueLock lock(mx);
+                auto it = forks.find(forkKey);
+                if (it == forks.end()) {
+                    return;
+                }
+
+                it->second.activeThreads--;
+                if (it->second.activeThreads > 0) {
+                    return;
+                }
+
+                finished = std::move(it->second);
+                forks.erase(it);
+            }
+
+            flush(forkKey, finished);
+        }
+
+        void OMPNodeReductions::flush(const std::string &forkKey, ForkReductions &fork) {
+            redis::Redis &redis = redis::Redis::getState();
+            for (auto &p : fork.pending) {
+                util::getLogger()->debug("Sending reduction {} of fork {} for {} threads", p.first, forkKey,
+                                         p.second.nThreads);
+                redis.enqueueBytes(getForkReduceKey(forkKey, p.first), p.second.toBytes());
+            }
+        }
+
+        int OMPNodeReductions::getActiveThreadCount(const std::string &forkKey) {
+            util::UniqueLock lock(mx);
+            auto it = forks.find(forkKey);
+            return it == forks.end() ? 0 : it->second.activeThreads;
+        }
+
+        void OMPNodeReductions::clear() {
+            util::UniqueLock lock(mx);
+            forks.clear();
+        }
+
+        OMPForkGuard::OMPForkGuard(const std::string &forkKeyIn) : forkKey(forkKeyIn) {
+            getNodeReductions().joinFork(forkKey);
+        }
+
+        OMPForkGuard::~OMPForkGuard() {
+            // Leaving may send the host's contributions on, which mustn't escape the destructor
+            try {
+                getNodeReductions().leaveFork(forkKey);
+            } catch (std::exception &e) {
+                util::getLogger()->error("Failed leaving fork {}: {}", forkKey, e.what());
+            }
+        }
+    }
+}
@@ -6,7 +6,11 @@ namespace wasm {
                 depth(parent->depth + 1),
                 effective_depth(num_threads > 1 ? parent->effective_depth + 1 : parent->effective_depth),
                 max_active_level(parent->max_active_level),
-                num_threads(num_threads) {
+                num_threads(num_threads),
+                runtime_schedule(parent->runtime_schedule),
+                runtime_chunk(parent->runtime_chunk),
+                dispatch_seqs(num_threads, 0),
+                reduce_slots(num_threads) {
             if (num_threads > 1) {
                 barrier = std::make_unique<util::Barrier>(num_threads);
             }
@@ -16,7 +20,10 @@ namespace wasm {
                 depth(depth + 1),
                 effective_depth(num_threads > 1 ? effective_depth + 1 : effective_depth),
                 max_active_level(max_active_level),
-                num_threads(num_threads) {
+                num_threads(num_threads),
+                is_distributed(true),
+                dispatch_seqs(num_threads, 0),
+                reduce_slots(num_threads) {
             if (num_threads > 1) {
                 barrier = std::make_unique<util::Barrier>(num_threads);
             }
@@ -0,0 +1,78 @@
+#include "wasm/openmp/Reduction.h"
+#include "wasm/openmp/Level.h"
+
+#include <util/queue.h>
+
+#include <climits>
+#include <stdexcept>
+#include <thread>
+
+namespace wasm {
+    namespace openmp {
+        kmp::_reduction_method determineReductionMethod(const OMPLevel &level, bool atomicAvailable,
+                                                        bool treeAvailable) {
+            if (level.num_threads == 1) {
+                return kmp::empty_reduce_block;
+            }
+
+            // Small teams contend little on atomics, larger ones are better off with the tree
+            if (atomicAvailable && (!treeAvailable || level.num_threads <= OMP_ATOMIC_REDUCE_MAX_THREADS)) {
+                return kmp::atomic_reduce_block;
+            }
+
+            if (treeAvailable) {
+                return kmp::tree_reduce_block;
+            }
+
+            return kmp::critical_reduce_block;
+        }
+
+        static void awaitRound(OMPReduceSlot &slot, uint32_t round) {
+            for (int i = 0; i < OMP_REDUCE_SPIN_COUNT && slot.round.load() != round; i++) {
+                std::this_thread::yield();
+            }
+
+            while (slot.round.load() != round) {
+                slot.waiters.fetch_add(1);
+                uint32_t seen = slot.round.load();
+                if (seen != round) {
+                    util::futexWait(slot.round, seen, 0);
+                }
+                slot.waiters.fetch_sub(1);
+            }
+        }
+
+        bool treeReduce(OMPLevel &level, int threadNum, uint32_t reduceData,
+                        const std::function<void(uint32_t, uint32_t)> &reduceFunc) {
+            if (threadNum < 0 || threadNum >= (int) level.reduce_slots.size()) {
+                throw std::runtime_error("Thread not in team for tree reduction");
+            }
+
+            // Every thread takes part in each reduction, so all slots are on the same round
+            OMPReduceSlot &slot = level.reduce_slots[threadNum];
+            uint32_t round = slot.round.load() + 1;
+
+            // Fold in each child's subtree, stopping at the step where this thread becomes a child
+            for (int step = 1; step < level.num_threads; step <<= 1) {
+                if (threadNum & step) {
+                    break;
+                }
+
+                int child = threadNum + step;
+                if (child < level.num_threads) {
+                    OMPReduceSlot &childSlot = level.reduce_slots[child];
+                    awaitRound(childSlot, round);
+                    reduceFunc(reduceData, childSlot.reduceData);
+                }
+            }
+
+            slot.reduceData = reduceData;
+            slot.round.store(round);
+            if (slot.waiters.load() > 0) {
+                util::futexWake(slot.round, INT_MAX);
+            }
+
+            return threadNum == 0;
+        }
+    }
+}
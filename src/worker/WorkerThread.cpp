@@ -7,6 +7,7 @@
 #include <util/config.h>
 #include <util/timing.h>
 #include <module_cache/WasmModuleCache.h>
+#include <module_cache/WasmModulePool.h>
 
 using namespace isolation;
 
@@ -24,6 +25,7 @@ namespace worker {
 
         // Listen to bind queue by default
         currentQueue = scheduler.getBindQueue();
+        inbox = std::make_shared<scheduler::InMemoryMessageQueue>();
 
         // Set up network namespace
         isolationIdx = threadIdx + 1;
@@ -49,9 +51,25 @@ namespace worker {
         if (_isBound) {
             // Notify scheduler if this thread was bound to a function
             scheduler.notifyThreadFinished(boundMessage);
+        } else {
+            scheduler.unparkIdleWorker(inbox);
         }
     }
 
+    void WorkerThread::unbind() {
+        if (!_isBound) {
+            return;
+        }
+
+        // Give up the function but keep the module, which will be reused if this thread
+        // is bound to the same function again
+        scheduler.notifyThreadFinished(boundMessage);
+        lastFuncStr = util::funcToString(boundMessage, false);
+
+        currentQueue = scheduler.getBindQueue();
+        _isBound = false;
+    }
+
     void WorkerThread::finishCall(message::Message &call, bool success, const std::string &errorMsg) {
         const std::shared_ptr<spdlog::logger> &logger = util::getLogger();
         const std::string funcStr = util::funcToString(call, true);
@@ -83,11 +101,17 @@ namespace worker {
         logger->debug("Setting function result for {}", funcStr);
         globalBus.setFunctionResult(call);
 
-        // Restore from zygote
+        // Restore from the function's own zygote, even after calls restored from a snapshot. Their
+        // zygote may have been evicted and its snapshot deleted once the result is out, and the
+        // snapshot's memory mustn't be carried into later calls
         logger->debug("Resetting module {} from zygote", funcStr);
+        message::Message baseCall = call;
+        baseCall.clear_snapshotkey();
+
         module_cache::WasmModuleCache &registry = module_cache::getWasmModuleCache();
-        wasm::WAVMWasmModule &cachedModule = registry.getCachedModule(call);
-        *module = cachedModule;
+        std::shared_ptr<wasm::WAVMWasmModule> cachedModule = registry.getCachedModule(baseCall);
+        module->resetFromZygote(*cachedModule);
+        moduleIsBase = true;
 
         // Increment the execution counter
         executionCount++;
@@ -110,23 +134,33 @@ namespace worker {
         // Get queue from the scheduler
         currentQueue = scheduler.getFunctionQueue(msg);
 
-        // Instantiate the module from its snapshot
-        PROF_START(snapshotCreate)
+        // Modules are restored to the base zygote after every call, so one left from running the
+        // same function can be used as-is. Otherwise take a ready instance from the pool, or
+        // instantiate the module from its snapshot if there isn't one
+        bool isWarm = !force && module != nullptr && moduleIsBase && lastFuncStr == util::funcToString(msg, false);
+        if (!isWarm) {
+            PROF_START(snapshotCreate)
 
-        module_cache::WasmModuleCache &registry = module_cache::getWasmModuleCache();
-        wasm::WAVMWasmModule &snapshot = registry.getCachedModule(msg);
-        module = std::make_unique<wasm::WAVMWasmModule>(snapshot);
+            module = module_cache::getWasmModulePool().claim(msg);
+            if (module == nullptr) {
+                module_cache::WasmModuleCache &registry = module_cache::getWasmModuleCache();
+                std::shared_ptr<wasm::WAVMWasmModule> snapshot = registry.getCachedModule(msg);
+                module = std::make_unique<wasm::WAVMWasmModule>(*snapshot);
+            }
 
-        PROF_END(snapshotCreate)
+            moduleIsBase = true;
+
+            PROF_END(snapshotCreate)
+        }
 
         _isBound = true;
     }
 
-    void WorkerThread::run() {
+    void WorkerThread::run(const std::function<bool()> &isShutdown) {
         const std::shared_ptr<spdlog::logger> &logger = util::getLogger();
 
         // Wait for next message
-        while (true) {
+        while (!isShutdown()) {
             try {
                 logger->debug("Worker {} waiting for next message", this->id);
                 std::string errorMessage = this->processNextMessage();
@@ -137,15 +171,33 @@ namespace worker {
                 }
             }
             catch (util::QueueTimeoutException &e) {
-                // At this point we've received no message, so die off
-                logger->debug("Worker {} got no messages. Finishing", this->id);
-                break;
+                // Thread stays alive with its isolation set up, ready to be bound again
+                if (_isBound) {
+                    logger->debug("Worker {} got no messages. Unbinding", this->id);
+                    this->unbind();
+                }
             }
         }
 
         this->finish();
     }
 
+    message::Message WorkerThread::nextBindMessage(int timeoutMs) {
+        // Register as idle so binds can be sent straight to this thread
+        scheduler.parkIdleWorker(lastFuncStr, inbox);
+
+        try {
+            return inbox->dequeue(timeoutMs);
+        } catch (util::QueueTimeoutException &e) {
+            // If we can't unpark, a bind is already on its way
+            if (scheduler.unparkIdleWorker(inbox)) {
+                throw;
+            }
+
+            return inbox->dequeue(timeoutMs);
+        }
+    }
+
     std::string WorkerThread::processNextMessage() {
         const std::shared_ptr<spdlog::logger> &logger = util::getLogger();
 
@@ -159,7 +211,7 @@ namespace worker {
         }
 
         // Wait for next message (note, timeout in ms)
-        message::Message msg = currentQueue->dequeue(timeoutMs);
+        message::Message msg = _isBound ? currentQueue->dequeue(timeoutMs) : nextBindMessage(timeoutMs);
 
         // Handle the message
         std::string errorMessage;
@@ -192,11 +244,13 @@ namespace worker {
                 PROF_START(snapshotOverride)
 
                 module_cache::WasmModuleCache &registry = module_cache::getWasmModuleCache();
-                wasm::WAVMWasmModule &snapshot = registry.getCachedModule(msg);
-                module = std::make_unique<wasm::WAVMWasmModule>(snapshot);
+                std::shared_ptr<wasm::WAVMWasmModule> snapshot = registry.getCachedModule(msg);
+                module = std::make_unique<wasm::WAVMWasmModule>(*snapshot);
 
                 PROF_END(snapshotOverride)
             }
+            // Module holds the call's memory until it's reset
+            moduleIsBase = false;
             errorMessage = this->executeCall(msg);
         }
 
@@ -7,12 +7,20 @@
 #include <state/StateServer.h>
 #include <worker/worker.h>
 #include <mpi/MpiGlobalBus.h>
+#include <mpi/MpiTransport.h>
+#include <module_cache/WasmModuleCache.h>
+#include <module_cache/WasmModulePool.h>
+
+#include <unistd.h>
+
+#define GLOBAL_QUEUE_REPORT_INTERVAL_MS 10000
 
 namespace worker {
     WorkerThreadPool::WorkerThreadPool(int nThreads) :
             _shutdown(false),
             scheduler(scheduler::getScheduler()),
-            threadTokenPool(nThreads) {
+            threadTokenPool(nThreads),
+            ingressCount(0) {
 
         // Ensure we can ping both redis instances
         redis::Redis::getQueue().ping();
@@ -23,30 +31,67 @@ namespace worker {
         const std::shared_ptr<spdlog::logger> &logger = util::getLogger();
         util::SystemConfig &conf = util::getSystemConfig();
 
-        logger->info("Starting global queue listener on {}", conf.queueName);
+        int nThreads = std::max(conf.globalQueueThreads, 1);
+        int batchSize = std::max(conf.globalQueueBatchSize, 1);
+        logger->info("Starting {} global queue listeners on {} (batch size {})", nThreads, conf.queueName,
+                     batchSize);
 
-        globalQueueThread = std::thread([this, &conf, &logger] {
-            scheduler::GlobalMessageBus &bus = scheduler::getGlobalMessageBus();
-            scheduler::Scheduler &sch = scheduler::getScheduler();
+        ingressCount = 0;
+        ingressStart = util::startTimer();
 
-            while (!this->isShutdown()) {
-                try {
-                    message::Message msg = bus.nextMessage(conf.globalMessageTimeout);
+        for (int i = 0; i < nThreads; i++) {
+            globalQueueThreads.emplace_back(std::thread([this, i, batchSize, &conf, &logger] {
+                // Bus and redis connection are thread-local so each listener has its own
+                scheduler::GlobalMessageBus &bus = scheduler::getGlobalMessageBus();
+                scheduler::Scheduler &sch = scheduler::getScheduler();
+                module_cache::WasmModulePool &modulePool = module_cache::getWasmModulePool();
 
-                    logger->debug("Got invocation for {} on {}", util::funcToString(msg, true), conf.queueName);
-                    sch.callFunction(msg);
-                }
-                catch (scheduler::GlobalMessageBusNoMessageException &ex) {
-                    logger->info("No message from global bus in {}ms, dropping out", conf.globalMessageTimeout);
-                    return;
+                util::TimePoint lastReport = util::startTimer();
+
+                while (!this->isShutdown()) {
+                    std::vector<message::Message> msgs;
+                    try {
+                        msgs = bus.nextMessageBatch(batchSize, conf.globalMessageTimeout);
+                    }
+                    catch (scheduler::GlobalMessageBusNoMessageException &ex) {
+                        logger->info("No message from global bus in {}ms, dropping out", conf.globalMessageTimeout);
+                        return;
+                    }
+
+                    for (auto &msg : msgs) {
+                        logger->debug("Got invocation for {} on {}", util::funcToString(msg, true), conf.queueName);
+                        modulePool.notifyCall(msg);
+                        sch.callFunction(msg);
+                    }
+
+                    ingressCount += (long) msgs.size();
+
+                    // First listener periodically reports throughput for the whole node
+                    if (i == 0 && util::getTimeDiffMillis(lastReport) > GLOBAL_QUEUE_REPORT_INTERVAL_MS) {
+                        logger->info("Global queue ingress: {} messages, {:.2f} msg/s", this->getIngressCount(),
+                                     this->getIngressRate());
+
+                        module_cache::WasmModuleCache &cache = module_cache::getWasmModuleCache();
+                        logger->info("Module cache: {} zygotes, {}MB, {} hits, {} misses, {} evictions",
+                                     cache.getTotalCachedModuleCount(), cache.getTotalCachedBytes() / ONE_MB_BYTES,
+                                     cache.getHitCount(), cache.getMissCount(), cache.getEvictionCount());
+                        lastReport = util::startTimer();
+                    }
                 }
-            }
 
-            // Will die gracefully at this point
-        });
+                // Will die gracefully at this point
+            }));
+        }
 
         // Waits for the queue to time out
-        globalQueueThread.join();
+        for (auto &t : globalQueueThreads) {
+            if (t.joinable()) {
+                t.join();
+            }
+        }
+
+        logger->info("Global queue ingress finished: {} messages, {:.2f} msg/s", getIngressCount(),
+                     getIngressRate());
     }
 
     void WorkerThreadPool::startSharingThread() {
@@ -87,6 +132,13 @@ namespace worker {
                 }
             }
 
+            // Don't drop any shared calls still buffered from the last batch
+            try {
+                sharingBus.requeueReceived();
+            } catch (std::exception &e) {
+                util::getLogger()->error("Failed requeueing shared calls on shutdown: {}", e.what());
+            }
+
             // Will die gracefully at this point
         });
     }
@@ -98,7 +150,15 @@ namespace worker {
         mpiThread = std::thread([this] {
             mpi::MpiGlobalBus &bus = mpi::getMpiGlobalBus();
             const std::string nodeId = util::getNodeId();
-            
+
+            // Serve direct messages from other nodes, and tell them where to send them
+            mpi::MpiServer server;
+            server.start();
+
+            mpi::MpiTransport &transport = mpi::getMpiTransport();
+            transport.registerEndpoint(nodeId, util::getSystemConfig().endpointHost);
+
+            // Nodes without a direct endpoint still send via the bus
             while (!this->isShutdown()) {
                 try {
                     bus.next(nodeId);
@@ -107,6 +167,9 @@ namespace worker {
                 }
             }
 
+            transport.removeEndpoint(nodeId);
+            server.close();
+
             // Will die gracefully at this point
         });
     }
@@ -124,9 +187,12 @@ namespace worker {
         logger->info("Starting state server");
 
         stateThread = std::thread([this] {
+            // Server runs its own threads, this one just waits for the shutdown
             state::StateServer server;
+            server.start();
+
             while (!this->isShutdown()) {
-                server.poll();
+                usleep(1000 * 100);
             }
 
             server.close();
@@ -155,8 +221,8 @@ namespace worker {
                 poolThreads.emplace_back(std::thread([this, threadIdx] {
                     WorkerThread w(threadIdx);
 
-                    // Worker will now run for a long time
-                    w.run();
+                    // Worker will now run until shutdown, rebinding as necessary
+                    w.run([this] { return this->isShutdown(); });
 
                     // Handle thread finishing
                     threadTokenPool.releaseToken(w.threadIdx);
@@ -174,6 +240,9 @@ namespace worker {
             // Will die gracefully at this point
         });
 
+        // Keep instances of hot functions ready for binding
+        module_cache::getWasmModulePool().start();
+
         // Prepare the python runtime (no-op if not necessary)
         preparePythonRuntime();
     }
@@ -212,6 +281,19 @@ namespace worker {
         return threadTokenPool.taken();
     }
 
+    long WorkerThreadPool::getIngressCount() {
+        return ingressCount;
+    }
+
+    double WorkerThreadPool::getIngressRate() {
+        double elapsedMillis = util::getTimeDiffMillis(ingressStart);
+        if (elapsedMillis <= 0) {
+            return 0;
+        }
+
+        return ((double) ingressCount * 1000.0) / elapsedMillis;
+    }
+
     bool WorkerThreadPool::isShutdown() {
         return _shutdown;
     }
@@ -221,9 +303,11 @@ namespace worker {
 
         const std::shared_ptr<spdlog::logger> &logger = util::getLogger();
 
-        if (globalQueueThread.joinable()) {
-            logger->info("Waiting for global queue thread to finish");
-            globalQueueThread.join();
+        for (auto &t : globalQueueThreads) {
+            if (t.joinable()) {
+                logger->info("Waiting for global queue thread to finish");
+                t.join();
+            }
         }
 
         if (stateThread.joinable()) {
@@ -236,11 +320,19 @@ namespace worker {
             sharingQueueThread.join();
         }
 
+        if (mpiThread.joinable()) {
+            logger->info("Waiting for MPI thread to finish");
+            mpiThread.join();
+        }
+
         if (poolThread.joinable()) {
             logger->info("Waiting for pool to finish");
             poolThread.join();
         }
 
+        logger->info("Waiting for module pool manager to finish");
+        module_cache::getWasmModulePool().shutdown();
+
         logger->info("Worker pool successfully shut down");
     }
 }
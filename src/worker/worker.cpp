@@ -3,6 +3,7 @@
 #include <state/State.h>
 #include <scheduler/Scheduler.h>
 #include <module_cache/WasmModuleCache.h>
+#include <module_cache/WasmModulePool.h>
 #include <boost/filesystem.hpp>
 
 namespace worker {
@@ -24,7 +25,8 @@ namespace worker {
         // Clear out global message bus
         scheduler::getGlobalMessageBus().clear();
 
-        // Clear zygotes
+        // Clear pooled instances and zygotes
+        module_cache::getWasmModulePool().clear();
         module_cache::getWasmModuleCache().clear();
     }
 }
\ No newline at end of file
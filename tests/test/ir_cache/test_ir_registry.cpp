@@ -4,9 +4,12 @@
 #include <util/func.h>
 #include <util/files.h>
 
+#include <ir_cache/CodeCache.h>
 #include <ir_cache/IRModuleCache.h>
 #include <storage/FileLoader.h>
 
+#include <boost/filesystem.hpp>
+
 namespace tests {
     void checkObjCode(const Runtime::ModuleRef moduleRef, const std::string &path) {
         const std::vector<uint8_t> fileBytes = util::readFileToBytes(path);
@@ -129,4 +132,70 @@ namespace tests {
         checkObjCode(objRefA1, objPathA);
         checkObjCode(objRefB1, objPathB);
     }
+
+    TEST_CASE("Test code cache keys", "[wasm]") {
+        std::vector<uint8_t> wasmA = {0, 1, 2, 3};
+        std::vector<uint8_t> wasmB = {0, 1, 2, 4};
+
+        std::string keyA = wasm::getCodeCacheKey(wasmA);
+        REQUIRE(keyA.size() == 40);
+        REQUIRE(wasm::getCodeCacheKey(wasmA) == keyA);
+        REQUIRE(wasm::getCodeCacheKey(wasmB) != keyA);
+    }
+
+    TEST_CASE("Test caching object code on disk", "[wasm]") {
+        util::SystemConfig &conf = util::getSystemConfig();
+        std::string originalDir = conf.codeCacheDir;
+        conf.codeCacheDir = "/tmp/faasm-test-code-cache";
+        boost::filesystem::remove_all(conf.codeCacheDir);
+
+        wasm::IRModuleCache &registry = wasm::getIRModuleCache();
+        wasm::CodeCache &codeCache = wasm::getCodeCache();
+
+        std::string user = "demo";
+        std::string func = "echo";
+        message::Message msg = util::messageFactory(user, func);
+
+        std::vector<uint8_t> wasmBytes = storage::getFileLoader().loadFunctionWasm(msg);
+        std::string key = wasm::getCodeCacheKey(wasmBytes);
+
+        // Nothing there to start with
+        REQUIRE(codeCache.load(key).empty());
+
+        IR::Module &module = registry.getModule(user, func, "");
+        Runtime::ModuleRef compiled = registry.getCompiledModule(user, func, "");
+        std::vector<U8> objectCode = Runtime::getObjectCode(compiled);
+
+        // Compiling may have stored the object code in the background already, so it's waited
+        // for and removed to check the stores below on their own
+        codeCache.waitForPending();
+        codeCache.remove(key);
+        REQUIRE(codeCache.load(key).empty());
+
+        SECTION("Synchronous store") {
+            codeCache.store(key, objectCode);
+        }
+
+        SECTION("Background store") {
+            codeCache.storeAsync(key, [compiled] {
+                return Runtime::getObjectCode(compiled);
+            });
+            codeCache.waitForPending();
+        }
+
+        REQUIRE(boost::filesystem::exists(codeCache.getObjectPath(key)));
+
+        // Check what we load back works in place of compiling
+        std::vector<uint8_t> loaded = codeCache.load(key);
+        REQUIRE(loaded == objectCode);
+
+        Runtime::ModuleRef reloaded = Runtime::loadPrecompiledModule(module, loaded);
+        REQUIRE(Runtime::getObjectCode(reloaded) == objectCode);
+
+        codeCache.remove(key);
+        REQUIRE(codeCache.load(key).empty());
+
+        boost::filesystem::remove_all(conf.codeCacheDir);
+        conf.codeCacheDir = originalDir;
+    }
 }
\ No newline at end of file
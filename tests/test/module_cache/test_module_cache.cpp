@@ -1,6 +1,7 @@
 #include <catch/catch.hpp>
 #include "utils.h"
 
+#include <util/config.h>
 #include <util/func.h>
 #include <module_cache/WasmModuleCache.h>
 
@@ -18,16 +19,64 @@ namespace tests {
         msgA.set_inputdata(BYTES(input), 3 * sizeof(int));
 
         module_cache::WasmModuleCache &registry = module_cache::getWasmModuleCache();
-        wasm::WasmModule &moduleA = registry.getCachedModule(msgA);
-        wasm::WasmModule &moduleB = registry.getCachedModule(msgB);
+        std::shared_ptr<wasm::WAVMWasmModule> moduleA = registry.getCachedModule(msgA);
+        std::shared_ptr<wasm::WAVMWasmModule> moduleB = registry.getCachedModule(msgB);
 
         // Check modules are the same
-        REQUIRE(std::addressof(moduleA) == std::addressof(moduleB));
-        REQUIRE(moduleA.isBound());
+        REQUIRE(moduleA == moduleB);
+        REQUIRE(moduleA->isBound());
 
         // Execute the function normally and make sure zygote is not used directly
         worker::WorkerThread workerThread = execFunction(msgA);
         REQUIRE(workerThread.isBound());
-        REQUIRE(std::addressof(moduleA) != std::addressof(*workerThread.module));
+        REQUIRE(moduleA.get() != workerThread.module.get());
     }
-}
\ No newline at end of file
+
+    TEST_CASE("Test evicting zygotes", "[zygote]") {
+        cleanSystem();
+
+        util::SystemConfig &conf = util::getSystemConfig();
+        int originalMax = conf.moduleCacheMaxMb;
+
+        // Smaller than any zygote, so only those in use are kept
+        conf.moduleCacheMaxMb = 1;
+
+        message::Message msgA = util::messageFactory("demo", "echo");
+        message::Message msgB = util::messageFactory("demo", "dummy");
+
+        module_cache::WasmModuleCache &registry = module_cache::getWasmModuleCache();
+        long initialHits = registry.getHitCount();
+        long initialMisses = registry.getMissCount();
+        long initialEvictions = registry.getEvictionCount();
+
+        // Newly created zygotes aren't evicted straight away
+        registry.getCachedModule(msgA);
+        REQUIRE(registry.getTotalCachedModuleCount() == 1);
+        REQUIRE(registry.getTotalCachedBytes() > 0);
+
+        // Evicted once another is needed
+        std::shared_ptr<wasm::WAVMWasmModule> moduleB = registry.getCachedModule(msgB);
+        REQUIRE(registry.getTotalCachedModuleCount() == 1);
+        REQUIRE(registry.getEvictionCount() == initialEvictions + 1);
+        REQUIRE(registry.getMissCount() == initialMisses + 2);
+
+        REQUIRE(registry.getCachedModule(msgB) == moduleB);
+        REQUIRE(registry.getHitCount() == initialHits + 1);
+
+        // Zygotes in use aren't evicted, even over the limit
+        std::shared_ptr<wasm::WAVMWasmModule> moduleA = registry.getCachedModule(msgA);
+        REQUIRE(registry.getTotalCachedModuleCount() == 2);
+        REQUIRE(registry.getEvictionCount() == initialEvictions + 1);
+        REQUIRE(registry.getMissCount() == initialMisses + 3);
+
+        // Evicted zygotes can still be used by those holding them
+        registry.clear();
+        REQUIRE(registry.getTotalCachedModuleCount() == 0);
+        REQUIRE(registry.getTotalCachedBytes() == 0);
+
+        wasm::WAVMWasmModule clone(*moduleB);
+        REQUIRE(clone.execute(msgB));
+
+        conf.moduleCacheMaxMb = originalMax;
+    }
+}
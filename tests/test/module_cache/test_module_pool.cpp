@@ -0,0 +1,73 @@
+#include <catch/catch.hpp>
+#include "utils.h"
+
+#include <util/config.h>
+#include <util/func.h>
+#include <module_cache/WasmModuleCache.h>
+#include <module_cache/WasmModulePool.h>
+
+using namespace module_cache;
+
+namespace tests {
+    TEST_CASE("Test sizing module pools", "[zygote]") {
+        int maxSize = 10;
+
+        // Any function in use gets an instance
+        REQUIRE(getModulePoolTarget(0, 0, maxSize) == 1);
+        REQUIRE(getModulePoolTarget(1, 5, maxSize) == 1);
+
+        // Enough for claims while refilling
+        REQUIRE(getModulePoolTarget(20, 100, maxSize) == 4);
+        REQUIRE(getModulePoolTarget(50, 0, maxSize) == 5);
+
+        // Capped
+        REQUIRE(getModulePoolTarget(1000, 100, maxSize) == maxSize);
+        REQUIRE(getModulePoolTarget(1000, 100, 0) == 0);
+    }
+
+    TEST_CASE("Test claiming and refilling pooled modules", "[zygote]") {
+        cleanSystem();
+
+        util::SystemConfig &conf = util::getSystemConfig();
+        int originalSize = conf.modulePoolSize;
+        conf.modulePoolSize = 4;
+
+        message::Message msg = util::messageFactory("demo", "echo");
+        WasmModulePool &pool = getWasmModulePool();
+        std::shared_ptr<wasm::WAVMWasmModule> zygote = getWasmModuleCache().getCachedModule(msg);
+
+        // Nothing ready before the pool is filled
+        REQUIRE(pool.claim(msg) == nullptr);
+        REQUIRE(pool.getReadyCount(msg) == 0);
+        REQUIRE(pool.getTargetSize(msg) == 1);
+
+        pool.refill();
+        REQUIRE(pool.getReadyCount(msg) == 1);
+
+        // Claimed instances are clones ready to execute
+        std::unique_ptr<wasm::WAVMWasmModule> module = pool.claim(msg);
+        REQUIRE(module != nullptr);
+        REQUIRE(module->isBound());
+        REQUIRE(module.get() != zygote.get());
+        REQUIRE(pool.getReadyCount(msg) == 0);
+        REQUIRE(module->execute(msg));
+
+        pool.refill();
+        REQUIRE(pool.getReadyCount(msg) == 1);
+
+        // Calls restoring special snapshots aren't pooled
+        message::Message snapshotMsg = util::messageFactory("demo", "echo");
+        snapshotMsg.set_snapshotkey("foobar");
+        REQUIRE(pool.claim(snapshotMsg) == nullptr);
+        REQUIRE(pool.getReadyCount(msg) == 1);
+
+        // Nothing pooled when disabled
+        conf.modulePoolSize = 0;
+        REQUIRE(pool.claim(msg) == nullptr);
+
+        pool.clear();
+        REQUIRE(pool.getReadyCount(msg) == 0);
+
+        conf.modulePoolSize = originalSize;
+    }
+}
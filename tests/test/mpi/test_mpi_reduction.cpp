@@ -0,0 +1,88 @@
+#include <catch/catch.hpp>
+
+#include <mpi/MpiReduction.h>
+#include <util/macros.h>
+
+#include <vector>
+
+using namespace mpi;
+
+namespace tests {
+    template<typename T>
+    void checkReduction(MPI_Op op, MPI_Datatype datatype, T (*expectedOp)(T, T)) {
+        // Odd length so that the tail after any vectorised part is covered
+        int count = 37;
+        std::vector<T> in(count);
+        std::vector<T> out(count);
+        std::vector<T> expected(count);
+        for (int i = 0; i < count; i++) {
+            in[i] = (T) ((i * 7) % 11);
+            out[i] = (T) ((i * 5) % 13);
+            expected[i] = expectedOp(out[i], in[i]);
+        }
+
+        applyReduceOp(op, datatype, count, BYTES(in.data()), BYTES(out.data()));
+        REQUIRE(out == expected);
+    }
+
+    TEST_CASE("Test reduction kernels", "[mpi]") {
+        SECTION("Sum") {
+            checkReduction<int>(MPI_SUM, MPI_INT, [](int a, int b) { return a + b; });
+            checkReduction<long>(MPI_SUM, MPI_LONG, [](long a, long b) { return a + b; });
+            checkReduction<float>(MPI_SUM, MPI_FLOAT, [](float a, float b) { return a + b; });
+            checkReduction<double>(MPI_SUM, MPI_DOUBLE, [](double a, double b) { return a + b; });
+        }
+
+        SECTION("Prod") {
+            checkReduction<int>(MPI_PROD, MPI_INT, [](int a, int b) { return a * b; });
+            checkReduction<double>(MPI_PROD, MPI_DOUBLE, [](double a, double b) { return a * b; });
+        }
+
+        SECTION("Max and min") {
+            checkReduction<int>(MPI_MAX, MPI_INT, [](int a, int b) { return std::max(a, b); });
+            checkReduction<int>(MPI_MIN, MPI_INT, [](int a, int b) { return std::min(a, b); });
+            checkReduction<float>(MPI_MAX, MPI_FLOAT, [](float a, float b) { return std::max(a, b); });
+            checkReduction<double>(MPI_MIN, MPI_DOUBLE, [](double a, double b) { return std::min(a, b); });
+        }
+
+        SECTION("Logical and bitwise") {
+            checkReduction<int>(MPI_LAND, MPI_INT, [](int a, int b) { return (int) (a && b); });
+            checkReduction<int>(MPI_LOR, MPI_INT, [](int a, int b) { return (int) (a || b); });
+            checkReduction<int>(MPI_BAND, MPI_INT, [](int a, int b) { return a & b; });
+            checkReduction<long long int>(MPI_BOR, MPI_LONG_LONG_INT,
+                                          [](long long int a, long long int b) { return a | b; });
+        }
+    }
+
+    TEST_CASE("Test maxloc and minloc reductions", "[mpi]") {
+        // Pairs of value and location
+        std::vector<int> in = {5, 1, 3, 1, 7, 1};
+        std::vector<int> out = {4, 0, 3, 0, 9, 0};
+
+        SECTION("Maxloc") {
+            applyReduceOp(MPI_MAXLOC, MPI_INT, in.size(), BYTES(in.data()), BYTES(out.data()));
+            REQUIRE(out == std::vector<int>({5, 1, 3, 0, 9, 0}));
+        }
+
+        SECTION("Minloc") {
+            applyReduceOp(MPI_MINLOC, MPI_INT, in.size(), BYTES(in.data()), BYTES(out.data()));
+            REQUIRE(out == std::vector<int>({4, 0, 3, 0, 7, 1}));
+        }
+    }
+
+    TEST_CASE("Test reducing longs from wasm", "[mpi]") {
+        // Longs in wasm are 4 bytes, so the buffers only hold 4 bytes per element
+        faasmpi_datatype_t wasmLong{.id=FAASMPI_LONG, .size=sizeof(int32_t)};
+        checkReduction<int32_t>(MPI_SUM, &wasmLong, [](int32_t a, int32_t b) { return a + b; });
+        checkReduction<int32_t>(MPI_MAX, &wasmLong, [](int32_t a, int32_t b) { return std::max(a, b); });
+    }
+
+    TEST_CASE("Test unsupported reductions", "[mpi]") {
+        REQUIRE_THROWS(getReduceKernel(MPI_BAND, MPI_DOUBLE));
+        REQUIRE_THROWS(getReduceKernel(MPI_LAND, MPI_FLOAT));
+
+        // Sizes that don't match any kernel
+        faasmpi_datatype_t oddInt{.id=FAASMPI_INT, .size=2};
+        REQUIRE_THROWS(getReduceKernel(MPI_SUM, &oddInt));
+    }
+}
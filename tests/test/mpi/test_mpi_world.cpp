@@ -3,8 +3,13 @@
 #include <util/random.h>
 #include <faasmpi/mpi.h>
 #include <mpi/MpiGlobalBus.h>
+#include <mpi/MpiTransport.h>
 #include "utils.h"
 
+#include <atomic>
+#include <numeric>
+#include <thread>
+
 using namespace mpi;
 
 namespace tests {
@@ -106,11 +111,17 @@ namespace tests {
         REQUIRE(actualMessage->sender == senderRank);
         REQUIRE(actualMessage->type == FAASMPI_INT);
 
-        // Check data written to state
-        const std::string messageStateKey = getMessageStateKey(actualMessage->id);
-        state::State &state = state::getGlobalState();
-        const std::shared_ptr<state::StateKeyValue> &kv = state.getKV(user, messageStateKey, sizeof(MpiWorldState));
-        int *actualDataPtr = reinterpret_cast<int *>(kv->get());
+        // Check data carried with local messages, or written to state for remote ones
+        int *actualDataPtr;
+        if (actualMessage->payload == PAYLOAD_INLINE) {
+            actualDataPtr = reinterpret_cast<int *>(actualMessage->buffer);
+        } else {
+            const std::string messageStateKey = getMessageStateKey(actualMessage->id);
+            state::State &state = state::getGlobalState();
+            const std::shared_ptr<state::StateKeyValue> &kv = state.getKV(user, messageStateKey,
+                                                                          sizeof(MpiWorldState));
+            actualDataPtr = reinterpret_cast<int *>(kv->get());
+        }
         std::vector<int> actualData(actualDataPtr, actualDataPtr + data.size());
 
         REQUIRE(actualData == data);
@@ -144,7 +155,7 @@ namespace tests {
             const std::shared_ptr<InMemoryMpiQueue> &queueA2 = world.getLocalQueue(rankA1, rankA2);
             MpiMessage *actualMessage = queueA2->dequeue();
             checkMessage(actualMessage, rankA1, rankA2, messageData);
-            delete actualMessage;
+            world.releaseMessage(actualMessage);
         }
 
         SECTION("Test recv") {
@@ -162,6 +173,48 @@ namespace tests {
         }
     }
 
+    TEST_CASE("Test local send to a waiting receive", "[mpi]") {
+        cleanSystem();
+
+        const message::Message &msg = util::messageFactory(user, func);
+        mpi::MpiWorld world;
+        world.create(msg, worldId, worldSize);
+
+        int rankA1 = 1;
+        int rankA2 = 2;
+        world.registerRank(rankA1);
+        world.registerRank(rankA2);
+
+        state::State &state = state::getGlobalState();
+        long kvCount = state.getKVCount();
+
+        std::vector<int> messageData(1000);
+        std::iota(messageData.begin(), messageData.end(), 0);
+
+        // Send and receive a few times so that messages come back out of the pool
+        for (int i = 0; i < 3; i++) {
+            std::vector<int> actual(messageData.size(), 0);
+            std::thread recvThread([&world, &actual, rankA1, rankA2] {
+                world.recv(rankA1, rankA2, BYTES(actual.data()), MPI_INT, actual.size(), nullptr);
+            });
+
+            // Give the receive time to be posted
+            usleep(1000 * 100);
+
+            world.send(rankA1, rankA2, BYTES(messageData.data()), MPI_INT, messageData.size());
+            if (recvThread.joinable()) {
+                recvThread.join();
+            }
+
+            REQUIRE(actual == messageData);
+            REQUIRE(world.getLocalQueueSize(rankA1, rankA2) == 0);
+        }
+
+        // Check nothing was put in state and the message was reused
+        REQUIRE(state.getKVCount() == kvCount);
+        REQUIRE(world.getPooledMessageCount() == 1);
+    }
+
     TEST_CASE("Test async send and recv", "[mpi]") {
         cleanSystem();
 
@@ -195,6 +248,167 @@ namespace tests {
 
         REQUIRE(actualA == messageDataA);
         REQUIRE(actualB == messageDataB);
+        REQUIRE(world.getAsyncRequestCount() == 0);
+    }
+
+    TEST_CASE("Test completing many async requests", "[mpi]") {
+        cleanSystem();
+
+        const message::Message &msg = util::messageFactory(user, func);
+        mpi::MpiWorld world;
+        world.create(msg, worldId, worldSize);
+
+        int rankA = 1;
+        int rankB = 2;
+        world.registerRank(rankA);
+        world.registerRank(rankB);
+
+        // Post the receives before anything is sent
+        int nMessages = 50;
+        std::vector<int> actual(nMessages, -1);
+        std::vector<int> recvIds;
+        for (int i = 0; i < nMessages; i++) {
+            recvIds.push_back(world.irecv(rankA, rankB, BYTES(&actual[i]), MPI_INT, 1));
+        }
+
+        // Nothing can complete yet
+        int firstRecvId = recvIds[0];
+        MPI_Status status{};
+        REQUIRE(!world.testAsyncRequest(recvIds[0]));
+        REQUIRE(world.testAnyAsyncRequest(recvIds, &status) == -1);
+
+        std::vector<int> sendIds;
+        for (int i = 0; i < nMessages; i++) {
+            sendIds.push_back(world.isend(rankA, rankB, BYTES(&i), MPI_INT, 1));
+        }
+
+        SECTION("Wait all") {
+            std::vector<MPI_Status> statuses(nMessages);
+            world.awaitAllAsyncRequests(recvIds, statuses.data());
+            world.awaitAllAsyncRequests(sendIds);
+
+            REQUIRE(statuses[nMessages - 1].MPI_SOURCE == rankA);
+            REQUIRE(statuses[nMessages - 1].bytesSize == sizeof(int));
+        }
+
+        SECTION("Test any") {
+            // Receives complete in the order they were posted
+            for (int i = 0; i < nMessages; i++) {
+                std::vector<int> remaining(recvIds.begin() + i, recvIds.end());
+                REQUIRE(world.testAnyAsyncRequest(remaining, &status) == 0);
+            }
+
+            REQUIRE(world.awaitAnyAsyncRequest(sendIds) == 0);
+            sendIds.erase(sendIds.begin());
+            world.awaitAllAsyncRequests(sendIds);
+        }
+
+        std::vector<int> expected(nMessages);
+        std::iota(expected.begin(), expected.end(), 0);
+        REQUIRE(actual == expected);
+        REQUIRE(world.getAsyncRequestCount() == 0);
+
+        // Requests can only be completed once
+        REQUIRE_THROWS(world.awaitAsyncRequest(firstRecvId));
+    }
+
+    TEST_CASE("Test blocking recv after async recv", "[mpi]") {
+        cleanSystem();
+
+        const message::Message &msg = util::messageFactory(user, func);
+        mpi::MpiWorld world;
+        world.create(msg, worldId, worldSize);
+
+        int rankA = 1;
+        int rankB = 2;
+        world.registerRank(rankA);
+        world.registerRank(rankB);
+
+        // The async receive is posted first so must get the first message
+        std::vector<int> actualA(3, 0);
+        std::vector<int> actualB(3, 0);
+        int recvId = world.irecv(rankA, rankB, BYTES(actualA.data()), MPI_INT, 3);
+
+        std::vector<int> messageDataA = {0, 1, 2};
+        std::vector<int> messageDataB = {3, 4, 5};
+        world.send(rankA, rankB, BYTES(messageDataA.data()), MPI_INT, messageDataA.size());
+        world.send(rankA, rankB, BYTES(messageDataB.data()), MPI_INT, messageDataB.size());
+
+        world.recv(rankA, rankB, BYTES(actualB.data()), MPI_INT, 3, nullptr);
+        world.awaitAsyncRequest(recvId);
+
+        REQUIRE(actualA == messageDataA);
+        REQUIRE(actualB == messageDataB);
+    }
+
+    TEST_CASE("Test waiting on any of the same requests repeatedly", "[mpi]") {
+        cleanSystem();
+
+        const message::Message &msg = util::messageFactory(user, func);
+        mpi::MpiWorld world;
+        world.create(msg, worldId, worldSize);
+
+        int rankA = 1;
+        int rankB = 2;
+        world.registerRank(rankA);
+        world.registerRank(rankB);
+
+        int nMessages = 3;
+        std::vector<int> actual(nMessages, -1);
+        std::vector<int> requestIds;
+        for (int i = 0; i < nMessages; i++) {
+            requestIds.push_back(world.irecv(rankA, rankB, BYTES(&actual[i]), MPI_INT, 1));
+            world.send(rankA, rankB, BYTES(&i), MPI_INT, 1);
+        }
+
+        // Each completed request is nulled, so the next wait moves on to the next one
+        for (int i = 0; i < nMessages; i++) {
+            REQUIRE(world.awaitAnyAsyncRequest(requestIds) == i);
+            REQUIRE(requestIds[i] == FAASMPI_REQUEST_NULL);
+        }
+
+        REQUIRE(actual == std::vector<int>({0, 1, 2}));
+        REQUIRE(world.getAsyncRequestCount() == 0);
+
+        // Nothing left to complete
+        REQUIRE(world.awaitAnyAsyncRequest(requestIds) == MPI_UNDEFINED);
+        REQUIRE(world.testAnyAsyncRequest(requestIds) == MPI_UNDEFINED);
+        world.awaitAllAsyncRequests(requestIds);
+    }
+
+    TEST_CASE("Test collective messages while async recv is pending", "[mpi]") {
+        cleanSystem();
+
+        const message::Message &msg = util::messageFactory(user, func);
+        mpi::MpiWorld world;
+        world.create(msg, worldId, worldSize);
+
+        int rankA = 1;
+        int rankB = 2;
+        world.registerRank(rankA);
+        world.registerRank(rankB);
+
+        std::vector<int> actual(3, 0);
+        std::vector<int> messageData = {0, 1, 2};
+        int recvId = world.irecv(rankA, rankB, BYTES(actual.data()), MPI_INT, 3);
+
+        SECTION("Collective message first") {
+            world.send(rankA, rankB, nullptr, MPI_INT, 0, MpiMessageType::BARRIER_DONE);
+            world.send(rankA, rankB, BYTES(messageData.data()), MPI_INT, messageData.size());
+        }
+
+        SECTION("Point-to-point message first") {
+            world.send(rankA, rankB, BYTES(messageData.data()), MPI_INT, messageData.size());
+            world.send(rankA, rankB, nullptr, MPI_INT, 0, MpiMessageType::BARRIER_DONE);
+        }
+
+        // The collective takes its own message and leaves the pending receive alone
+        world.recv(rankA, rankB, nullptr, MPI_INT, 0, nullptr, MpiMessageType::BARRIER_DONE);
+        REQUIRE(world.getLocalQueueSize(rankA, rankB) == 1);
+
+        world.awaitAsyncRequest(recvId);
+        REQUIRE(actual == messageData);
+        REQUIRE(world.getLocalQueueSize(rankA, rankB) == 0);
     }
 
     TEST_CASE("Test send across nodes", "[mpi]") {
@@ -254,6 +468,129 @@ namespace tests {
         }
     }
 
+    TEST_CASE("Test direct send across nodes", "[mpi]") {
+        cleanSystem();
+        util::SystemConfig &conf = util::getSystemConfig();
+        MpiTransport &transport = getMpiTransport();
+        transport.clear();
+
+        std::string nodeIdA = util::randomString(NODE_ID_LEN);
+        std::string nodeIdB = util::randomString(NODE_ID_LEN);
+
+        // Receiving world must be in the registry for the server to find it
+        int directWorldId = 456;
+        const message::Message &msg = util::messageFactory(user, func);
+        mpi::MpiWorld worldA;
+        worldA.overrideNodeId(nodeIdA);
+        worldA.create(msg, directWorldId, worldSize);
+
+        mpi::MpiWorld &worldB = getMpiWorldRegistry().getOrInitialiseWorld(msg, directWorldId);
+        worldB.overrideNodeId(nodeIdB);
+
+        int rankA = 1;
+        int rankB = 2;
+        worldA.registerRank(rankA);
+        worldB.registerRank(rankB);
+
+        // Both "nodes" are served from here
+        int port = 8009;
+        MpiServer server(port);
+        server.start();
+        transport.registerEndpoint(nodeIdA, "127.0.0.1", port);
+        transport.registerEndpoint(nodeIdB, "127.0.0.1", port);
+
+        std::vector<int> messageData(100);
+        std::iota(messageData.begin(), messageData.end(), 0);
+
+        SECTION("Eager") {
+            conf.mpiEagerLimit = 1024 * 1024;
+        }
+
+        SECTION("Rendezvous") {
+            conf.mpiEagerLimit = 16;
+        }
+
+        worldA.send(rankA, rankB, BYTES(messageData.data()), MPI_INT, messageData.size());
+
+        // Nothing should go via the bus or state
+        MpiGlobalBus &bus = mpi::getMpiGlobalBus();
+        REQUIRE(bus.getQueueSize(nodeIdB) == 0);
+
+        MPI_Status status{};
+        std::vector<int> actual(messageData.size(), 0);
+        worldB.recv(rankA, rankB, BYTES(actual.data()), MPI_INT, actual.size(), &status);
+
+        REQUIRE(actual == messageData);
+        REQUIRE(status.MPI_SOURCE == rankA);
+        REQUIRE(status.bytesSize == messageData.size() * sizeof(int));
+        REQUIRE(transport.getPendingCount() == 0);
+
+        transport.removeEndpoint(nodeIdA);
+        transport.removeEndpoint(nodeIdB);
+        transport.clear();
+        server.close();
+        conf.reset();
+    }
+
+    TEST_CASE("Test unpulled MPI data is dropped", "[mpi]") {
+        cleanSystem();
+        util::SystemConfig &conf = util::getSystemConfig();
+        conf.mpiEagerLimit = 16;
+        MpiTransport &transport = getMpiTransport();
+        transport.clear();
+
+        std::string nodeIdA = util::randomString(NODE_ID_LEN);
+        std::string nodeIdB = util::randomString(NODE_ID_LEN);
+
+        int directWorldId = 457;
+        const message::Message &msg = util::messageFactory(user, func);
+        mpi::MpiWorld worldA;
+        worldA.overrideNodeId(nodeIdA);
+        worldA.create(msg, directWorldId, worldSize);
+
+        mpi::MpiWorld &worldB = getMpiWorldRegistry().getOrInitialiseWorld(msg, directWorldId);
+        worldB.overrideNodeId(nodeIdB);
+
+        int rankA = 1;
+        int rankB = 2;
+        worldA.registerRank(rankA);
+        worldB.registerRank(rankB);
+
+        int port = 8009;
+        MpiServer server(port);
+        server.start();
+        transport.registerEndpoint(nodeIdA, "127.0.0.1", port);
+        transport.registerEndpoint(nodeIdB, "127.0.0.1", port);
+
+        util::Clock &clock = util::getGlobalClock();
+        util::TimePoint start = clock.now();
+        clock.setFakeNow(start);
+
+        // Data is held until the receiver pulls it, which it never does
+        std::vector<int> messageData(100, 1);
+        worldA.send(rankA, rankB, BYTES(messageData.data()), MPI_INT, messageData.size());
+        REQUIRE(transport.getPendingCount() == 1);
+
+        SECTION("Expiry") {
+            // Expired data is dropped when more is held
+            clock.setFakeNow(start + std::chrono::milliseconds(conf.mpiPayloadTimeout + 1));
+            worldA.send(rankA, rankB, BYTES(messageData.data()), MPI_INT, messageData.size());
+            REQUIRE(transport.getPendingCount() == 1);
+        }
+
+        SECTION("World destroyed") {
+            worldA.destroy();
+            REQUIRE(transport.getPendingCount() == 0);
+        }
+
+        clock.stopFakeNow();
+        transport.removeEndpoint(nodeIdA);
+        transport.removeEndpoint(nodeIdB);
+        transport.clear();
+        server.close();
+        conf.reset();
+    }
+
     TEST_CASE("Test send/recv message with no data", "[mpi]") {
         cleanSystem();
 
@@ -961,6 +1298,132 @@ namespace tests {
 
     }
 
+    TEST_CASE("Test tree collectives across nodes", "[mpi]") {
+        cleanSystem();
+        util::SystemConfig &conf = util::getSystemConfig();
+        conf.mpiLinearCollectiveSize = 1;
+
+        SECTION("Recursive doubling allreduce") {
+            conf.mpiRingAllReduceBytes = 1024 * 1024;
+        }
+
+        SECTION("Ring allreduce") {
+            conf.mpiRingAllReduceBytes = 1;
+        }
+
+        std::string nodeIdA = util::randomString(NODE_ID_LEN);
+        std::string nodeIdB = util::randomString(NODE_ID_LEN);
+        std::string nodeIdC = util::randomString(NODE_ID_LEN);
+
+        const message::Message &msg = util::messageFactory(user, func);
+        int thisWorldSize = 7;
+        mpi::MpiWorld worldA;
+        worldA.overrideNodeId(nodeIdA);
+        worldA.create(msg, worldId, thisWorldSize);
+
+        mpi::MpiWorld worldB;
+        worldB.overrideNodeId(nodeIdB);
+        worldB.initialiseFromState(msg, worldId);
+
+        mpi::MpiWorld worldC;
+        worldC.overrideNodeId(nodeIdC);
+        worldC.initialiseFromState(msg, worldId);
+
+        // Ranks spread unevenly and out of order across three nodes
+        std::vector<mpi::MpiWorld *> rankWorlds = {&worldA, &worldB, &worldC, &worldA, &worldB, &worldC, &worldA};
+        for (int r = 1; r < thisWorldSize; r++) {
+            rankWorlds[r]->registerRank(r);
+        }
+
+        // Pass messages between the nodes in the background
+        MpiGlobalBus &bus = mpi::getMpiGlobalBus();
+        std::atomic<bool> done(false);
+        std::vector<std::thread> busThreads;
+        std::vector<std::pair<std::string, mpi::MpiWorld *>> nodes = {
+                {nodeIdA, &worldA},
+                {nodeIdB, &worldB},
+                {nodeIdC, &worldC}
+        };
+        for (auto &n : nodes) {
+            busThreads.emplace_back([&bus, &done, n] {
+                while (!done) {
+                    if (bus.getQueueSize(n.first) > 0) {
+                        n.second->enqueueMessage(bus.dequeueForNode(n.first));
+                    } else {
+                        usleep(1000);
+                    }
+                }
+            });
+        }
+
+        int root = 4;
+        int count = 10;
+        std::vector<std::vector<int>> bcastResults(thisWorldSize);
+        std::vector<int> reduceResult(count, 0);
+        std::vector<std::vector<int>> allReduceResults(thisWorldSize);
+        std::vector<std::vector<int>> allGatherResults(thisWorldSize);
+
+        std::vector<std::thread> rankThreads;
+        for (int r = 0; r < thisWorldSize; r++) {
+            rankThreads.emplace_back([&, r] {
+                mpi::MpiWorld &world = *rankWorlds[r];
+
+                std::vector<int> data(count);
+                std::iota(data.begin(), data.end(), r * 100);
+
+                bcastResults[r] = r == root ? data : std::vector<int>(count, 0);
+                world.bcast(root, r, BYTES(bcastResults[r].data()), MPI_INT, count);
+
+                world.reduce(r, root, BYTES(data.data()), r == root ? BYTES(reduceResult.data()) : nullptr,
+                             MPI_INT, count, MPI_SUM);
+
+                allReduceResults[r] = std::vector<int>(count, 0);
+                world.allReduce(r, BYTES(data.data()), BYTES(allReduceResults[r].data()), MPI_INT, count, MPI_SUM);
+
+                int rankValue = r;
+                allGatherResults[r] = std::vector<int>(thisWorldSize, 0);
+                world.allGather(r, BYTES(&rankValue), MPI_INT, 1, BYTES(allGatherResults[r].data()), MPI_INT, 1);
+
+                world.barrier(r);
+            });
+        }
+
+        for (auto &t : rankThreads) {
+            if (t.joinable()) {
+                t.join();
+            }
+        }
+
+        done = true;
+        for (auto &t : busThreads) {
+            if (t.joinable()) {
+                t.join();
+            }
+        }
+
+        std::vector<int> expectedBcast(count);
+        std::iota(expectedBcast.begin(), expectedBcast.end(), root * 100);
+
+        std::vector<int> expectedSum(count, 0);
+        for (int r = 0; r < thisWorldSize; r++) {
+            for (int i = 0; i < count; i++) {
+                expectedSum[i] += r * 100 + i;
+            }
+        }
+
+        std::vector<int> expectedRanks(thisWorldSize);
+        std::iota(expectedRanks.begin(), expectedRanks.end(), 0);
+
+        REQUIRE(reduceResult == expectedSum);
+        for (int r = 0; r < thisWorldSize; r++) {
+            REQUIRE(bcastResults[r] == expectedBcast);
+            REQUIRE(allReduceResults[r] == expectedSum);
+            REQUIRE(allGatherResults[r] == expectedRanks);
+        }
+
+        conf.reset();
+    }
+
     TEST_CASE("Test RMA across nodes", "[mpi]") {
         cleanSystem();
         std::string nodeIdA = util::randomString(NODE_ID_LEN);
@@ -81,6 +81,51 @@ namespace tests {
         conf.serialisation = originalSerialisation;
     }
 
+    TEST_CASE("Global message queue batch dequeue", "[scheduler]") {
+        cleanSystem();
+
+        GlobalMessageBus &bus = getGlobalMessageBus();
+        util::SystemConfig &conf = util::getSystemConfig();
+        std::string originalSerialisation = conf.serialisation;
+
+        SECTION("JSON") {
+            conf.serialisation = "json";
+        }
+
+        SECTION("Protobuf") {
+            conf.serialisation = "proto";
+        }
+
+        std::vector<message::Message> expected;
+        for (int i = 0; i < 5; i++) {
+            message::Message msg = util::messageFactory("demo", "echo");
+            msg.set_inputdata("input " + std::to_string(i));
+            bus.enqueueMessage(msg);
+            expected.push_back(msg);
+        }
+
+        // Batch smaller than the queue should leave the rest behind
+        std::vector<message::Message> actualA = bus.nextMessageBatch(3, 1000);
+        REQUIRE(actualA.size() == 3);
+
+        // Batch larger than the queue should return only what's there
+        std::vector<message::Message> actualB = bus.nextMessageBatch(10, 1000);
+        REQUIRE(actualB.size() == 2);
+
+        for (int i = 0; i < 3; i++) {
+            checkMessageEquality(expected.at(i), actualA.at(i));
+        }
+
+        for (int i = 0; i < 2; i++) {
+            checkMessageEquality(expected.at(i + 3), actualB.at(i));
+        }
+
+        // Empty queue should time out as with a single message
+        REQUIRE_THROWS_AS(bus.nextMessageBatch(10, 100), GlobalMessageBusNoMessageException);
+
+        conf.serialisation = originalSerialisation;
+    }
+
     TEST_CASE("Check multithreaded function results", "[scheduler]") {
         cleanSystem();
 
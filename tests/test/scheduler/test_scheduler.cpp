@@ -6,6 +6,8 @@
 #include <scheduler/Scheduler.h>
 #include <redis/Redis.h>
 
+#include <thread>
+
 using namespace scheduler;
 using namespace redis;
 
@@ -31,6 +33,7 @@ namespace tests {
         // Call the function and check it's added to the function's warm set
         s.callFunction(call);
 
+        s.flushWarmSetUpdates();
         REQUIRE(redis.sismember(GLOBAL_NODE_SET, nodeId));
         REQUIRE(redis.sismember(funcSet, nodeId));
 
@@ -73,12 +76,14 @@ namespace tests {
             }
 
             // Check node is now part of function's set
+            sch.flushWarmSetUpdates();
             REQUIRE(redis.sismember(funcSet, nodeId));
             REQUIRE(sch.getFunctionInFlightCount(call) == requiredCalls);
             REQUIRE(sch.getBindQueue()->size() == 2);
 
             // Notify that a worker has finished, count decremented by one and worker is still member of function set
             sch.notifyThreadFinished(call);
+            sch.flushWarmSetUpdates();
             REQUIRE(redis.sismember(funcSet, nodeId));
             REQUIRE(sch.getFunctionInFlightCount(call) == requiredCalls);
             REQUIRE(sch.getFunctionThreadCount(call) == 1);
@@ -86,6 +91,7 @@ namespace tests {
             // Notify that another worker has finished, check count is decremented and node removed from function set
             // (but still in global set)
             sch.notifyThreadFinished(call);
+            sch.flushWarmSetUpdates();
             REQUIRE(redis.sismember(GLOBAL_NODE_SET, nodeId));
             REQUIRE(!redis.sismember(funcSet, nodeId));
             REQUIRE(sch.getFunctionInFlightCount(call) == requiredCalls);
@@ -306,6 +312,7 @@ namespace tests {
 
                 // Check this node is in the warm set
                 const std::string warmSet = sch.getFunctionWarmSetName(call);
+                sch.flushWarmSetUpdates();
                 REQUIRE(redis.sismember(warmSet, nodeId));
 
                 // Add another node to the warm set
@@ -353,6 +360,9 @@ namespace tests {
         Redis &redis = redis::Redis::getQueue();
         redis.sadd(warmSet, otherNodeA);
 
+        // Make sure the scheduler sees the change
+        sch.clearNodeSetCache();
+
         for (int i = 0; i < 3; i++) {
             message::Message msgC = util::messageFactory("demo", "chain_simple");
             sch.callFunction(msgC);
@@ -388,6 +398,9 @@ namespace tests {
         Redis &redis = redis::Redis::getQueue();
         redis.sadd(warmSet, otherNodeA);
 
+        // Make sure the scheduler sees the change
+        sch.clearNodeSetCache();
+
         // Now create a message that's already got a scheduled node and hops
         message::Message msgWithHops = util::messageFactory("demo", "chain_simple");
         msgWithHops.set_schedulednode("Some other node");
@@ -417,6 +430,7 @@ namespace tests {
         // Add a call and make sure we're in the warm set
         sch.callFunction(msg);
         const std::string warmSetName = sch.getFunctionWarmSetName(msg);
+        sch.flushWarmSetUpdates();
         REQUIRE(redis.sismember(warmSetName, thisNodeId));
 
         // Now saturate up to the point we're about to fail over
@@ -435,6 +449,7 @@ namespace tests {
 
         // Make another call and check we're no longer in the warm set
         sch.callFunction(msg);
+        sch.flushWarmSetUpdates();
         REQUIRE(!redis.sismember(warmSetName, thisNodeId));
     }
 
@@ -578,4 +593,150 @@ namespace tests {
             REQUIRE(actual == expected);
         }
     }
+
+    TEST_CASE("Test concurrent calls to different functions", "[scheduler]") {
+        cleanSystem();
+        Scheduler &sch = scheduler::getScheduler();
+
+        int nFuncs = 8;
+        int nCalls = 50;
+        std::vector<std::thread> threads;
+        for (int f = 0; f < nFuncs; f++) {
+            threads.emplace_back([&sch, f, nCalls] {
+                for (int i = 0; i < nCalls; i++) {
+                    message::Message msg = util::messageFactory("demo", "func_" + std::to_string(f));
+                    sch.callFunction(msg, true);
+                }
+            });
+        }
+
+        for (auto &t : threads) {
+            t.join();
+        }
+
+        sch.flushWarmSetUpdates();
+        Redis &redis = Redis::getQueue();
+        std::string nodeId = util::getNodeId();
+
+        for (int f = 0; f < nFuncs; f++) {
+            message::Message msg = util::messageFactory("demo", "func_" + std::to_string(f));
+            REQUIRE(sch.getFunctionInFlightCount(msg) == nCalls);
+            REQUIRE(sch.getFunctionQueue(msg)->size() == nCalls);
+            REQUIRE(sch.getFunctionThreadCount(msg) > 0);
+            REQUIRE(redis.sismember(sch.getFunctionWarmSetName(msg), nodeId) == (sch.getOpinion(msg) == YES));
+        }
+    }
+
+    TEST_CASE("Test node sets are cached", "[scheduler]") {
+        cleanSystem();
+        Scheduler &sch = scheduler::getScheduler();
+        Redis &redis = Redis::getQueue();
+
+        util::SystemConfig &conf = util::getSystemConfig();
+        conf.noScheduler = 0;
+        conf.schedulerCacheTtl = 60000;
+
+        // Saturate this node so that it looks elsewhere
+        message::Message msg = util::messageFactory("demo", "chain_simple");
+        int requiredCalls = conf.maxInFlightRatio * conf.maxWorkersPerFunction;
+        for (int i = 0; i < requiredCalls; i++) {
+            sch.callFunction(msg);
+        }
+        REQUIRE(sch.getOpinion(msg) == NO);
+
+        const std::string warmSet = sch.getFunctionWarmSetName(msg);
+        redis.sadd(warmSet, "node A");
+        sch.clearNodeSetCache();
+        REQUIRE(sch.getBestNodeForFunction(msg) == "node A");
+
+        // Changes in Redis aren't seen until the cache is refreshed
+        redis.srem(warmSet, "node A");
+        redis.sadd(warmSet, "node B");
+        REQUIRE(sch.getBestNodeForFunction(msg) == "node A");
+
+        sch.clearNodeSetCache();
+        REQUIRE(sch.getBestNodeForFunction(msg) == "node B");
+
+        conf.reset();
+    }
+
+    TEST_CASE("Test less loaded node is chosen", "[scheduler]") {
+        cleanSystem();
+        Scheduler &sch = scheduler::getScheduler();
+        Redis &redis = Redis::getQueue();
+        util::SystemConfig &conf = util::getSystemConfig();
+
+        message::Message msg = util::messageFactory("demo", "chain_simple");
+        int requiredCalls = conf.maxInFlightRatio * conf.maxWorkersPerFunction;
+        for (int i = 0; i < requiredCalls; i++) {
+            sch.callFunction(msg);
+        }
+
+        // Check the load hint for this node
+        REQUIRE(sch.getNodeLoad() == requiredCalls);
+        sch.publishNodeLoad();
+        REQUIRE(redis.getLong(sch.getNodeLoadKey(util::getNodeId())) == requiredCalls);
+
+        // With two warm options, the less loaded should always win
+        const std::string warmSet = sch.getFunctionWarmSetName(msg);
+        redis.sadd(warmSet, "busy node");
+        redis.sadd(warmSet, "idle node");
+        redis.setLong(sch.getNodeLoadKey("busy node"), 20);
+        redis.setLong(sch.getNodeLoadKey("idle node"), 2);
+        sch.clearNodeSetCache();
+
+        for (int i = 0; i < 10; i++) {
+            REQUIRE(sch.getBestNodeForFunction(msg) == "idle node");
+        }
+
+        // Load goes down as calls finish
+        sch.notifyCallFinished(msg);
+        REQUIRE(sch.getNodeLoad() == requiredCalls - 1);
+    }
+
+    TEST_CASE("Test binds prefer idle workers with a warm module", "[scheduler]") {
+        cleanSystem();
+        Scheduler &sch = scheduler::getScheduler();
+
+        message::Message msgA = util::messageFactory("demo", "echo");
+        message::Message msgB = util::messageFactory("demo", "noop");
+        std::string funcStrA = util::funcToString(msgA, false);
+        std::string funcStrB = util::funcToString(msgB, false);
+
+        auto inboxA = std::make_shared<InMemoryMessageQueue>();
+        auto inboxB = std::make_shared<InMemoryMessageQueue>();
+        auto inboxFresh = std::make_shared<InMemoryMessageQueue>();
+
+        sch.parkIdleWorker(funcStrA, inboxA);
+        sch.parkIdleWorker(funcStrB, inboxB);
+        sch.parkIdleWorker("", inboxFresh);
+        REQUIRE(sch.getIdleWorkerCount() == 3);
+
+        // Bind for a function should go to the worker that last ran it
+        sch.callFunction(msgB);
+        REQUIRE(inboxB->size() == 1);
+        REQUIRE(inboxB->dequeue().type() == message::Message_MessageType_BIND);
+        REQUIRE(sch.getBindQueue()->size() == 0);
+
+        // Bind for an unseen function should go to the worker with nothing loaded
+        message::Message msgC = util::messageFactory("demo", "x2");
+        sch.callFunction(msgC);
+        REQUIRE(inboxFresh->size() == 1);
+        REQUIRE(inboxA->size() == 0);
+
+        // Unparking the remaining worker leaves nobody, so binds fall back to the shared queue
+        REQUIRE(sch.unparkIdleWorker(inboxA));
+        REQUIRE(!sch.unparkIdleWorker(inboxB));
+        REQUIRE(sch.getIdleWorkerCount() == 0);
+
+        sch.callFunction(msgA);
+        REQUIRE(inboxA->size() == 0);
+        REQUIRE(sch.getBindQueue()->size() == 1);
+
+        // Parking with a bind already waiting should pick it up straight away
+        sch.parkIdleWorker(funcStrA, inboxA);
+        REQUIRE(sch.getIdleWorkerCount() == 0);
+        REQUIRE(inboxA->size() == 1);
+        REQUIRE(sch.getBindQueue()->size() == 0);
+    }
 }
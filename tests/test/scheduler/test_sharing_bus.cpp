@@ -63,4 +63,79 @@ namespace tests {
         }
     }
 
-}
\ No newline at end of file
+    TEST_CASE("Sharing bus batching", "[scheduler]") {
+        cleanSystem();
+
+        util::SystemConfig &conf = util::getSystemConfig();
+        conf.sharingBatchSize = 3;
+
+        SharingMessageBus &bus = SharingMessageBus::getInstance();
+        Redis &redis = Redis::getQueue();
+        std::string otherNode = "node_batch";
+        std::string queueName = getSharingQueueNameForNode(otherNode);
+
+        message::Message msgA = util::messageFactory("demo", "a");
+        message::Message msgB = util::messageFactory("demo", "b");
+        message::Message msgC = util::messageFactory("demo", "c");
+
+        SECTION("Full batch is pushed at once") {
+            conf.sharingBatchWindow = 60000;
+
+            bus.shareMessageWithNode(otherNode, msgA);
+            bus.shareMessageWithNode(otherNode, msgB);
+            REQUIRE(redis.listLength(queueName) == 0);
+
+            bus.shareMessageWithNode(otherNode, msgC);
+            REQUIRE(redis.listLength(queueName) == 3);
+
+            // All are popped in one go, then returned in order
+            checkMessageEquality(bus.nextMessageForNode(otherNode), msgA);
+            REQUIRE(redis.listLength(queueName) == 0);
+            checkMessageEquality(bus.nextMessageForNode(otherNode), msgB);
+            checkMessageEquality(bus.nextMessageForNode(otherNode), msgC);
+        }
+
+        SECTION("Unreturned messages are requeued in order") {
+            conf.sharingBatchWindow = 60000;
+
+            bus.shareMessageWithNode(otherNode, msgA);
+            bus.shareMessageWithNode(otherNode, msgB);
+            bus.shareMessageWithNode(otherNode, msgC);
+
+            checkMessageEquality(bus.nextMessageForNode(otherNode), msgA);
+            REQUIRE(redis.listLength(queueName) == 0);
+
+            bus.requeueReceived();
+            REQUIRE(redis.listLength(queueName) == 2);
+
+            // Nothing is left buffered, so requeueing again is a no-op
+            bus.requeueReceived();
+            REQUIRE(redis.listLength(queueName) == 2);
+            checkMessageEquality(bus.nextMessageForNode(otherNode), msgB);
+            checkMessageEquality(bus.nextMessageForNode(otherNode), msgC);
+        }
+
+        SECTION("Partial batch is pushed on flush") {
+            conf.sharingBatchWindow = 60000;
+
+            bus.shareMessageWithNode(otherNode, msgA);
+            REQUIRE(redis.listLength(queueName) == 0);
+
+            getSharingMessageBatcher().flush();
+            REQUIRE(redis.listLength(queueName) == 1);
+            checkMessageEquality(bus.nextMessageForNode(otherNode), msgA);
+        }
+
+        SECTION("Partial batch is pushed after window") {
+            conf.sharingBatchWindow = 5;
+
+            bus.shareMessageWithNode(otherNode, msgA);
+            bus.shareMessageWithNode(otherNode, msgB);
+
+            usleep(200 * 1000);
+            REQUIRE(redis.listLength(queueName) == 2);
+        }
+
+        conf.reset();
+    }
+}
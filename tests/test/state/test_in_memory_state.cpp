@@ -0,0 +1,273 @@
+#include <catch/catch.hpp>
+
+#include "utils.h"
+
+#include <state/InMemoryStateKeyValue.h>
+#include <state/StateMessage.h>
+#include <state/StateServer.h>
+#include <tcp/TCPServer.h>
+#include <util/clock.h>
+#include <util/config.h>
+#include <util/macros.h>
+
+#include <atomic>
+#include <thread>
+
+using namespace state;
+
+namespace tests {
+    static const char *OTHER_IP = "192.168.111.111";
+
+    TEST_CASE("Test state request serialisation", "[state]") {
+        std::vector<uint8_t> data = {0, 1, 2, 3, 4};
+
+        StateRequest request;
+        request.user = "alpha";
+        request.key = "beta";
+        request.valueSize = 20;
+        request.offset = 7;
+        request.length = data.size();
+        request.data = data.data();
+
+        tcp::TCPMessage *msg = buildStateRequest(tcp::TCPMessageType::STATE_GET, request);
+        REQUIRE(msg->type == tcp::TCPMessageType::STATE_GET);
+
+        StateRequest actual = parseStateRequest(msg);
+        REQUIRE(actual.user == "alpha");
+        REQUIRE(actual.key == "beta");
+        REQUIRE(actual.valueSize == 20);
+        REQUIRE(actual.offset == 7);
+        REQUIRE(actual.length == data.size());
+
+        std::vector<uint8_t> actualData(actual.data, actual.data + actual.length);
+        REQUIRE(actualData == data);
+
+        tcp::freeTcpMessage(msg);
+    }
+
+    TEST_CASE("Test state segment serialisation", "[state]") {
+        std::vector<uint8_t> segA = {1, 2, 3};
+        std::vector<uint8_t> segB = {4, 5};
+
+        std::vector<uint8_t> segments;
+        appendStateSegment(segments, 2, segA.data(), segA.size());
+        appendStateSegment(segments, 10, segB.data(), segB.size());
+
+        std::vector<size_t> offsets;
+        std::vector<std::vector<uint8_t>> actual;
+        forEachStateSegment(segments.data(), segments.size(),
+                            [&offsets, &actual](size_t offset, const uint8_t *data, size_t length) {
+                                offsets.push_back(offset);
+                                actual.emplace_back(data, data + length);
+                            });
+
+        REQUIRE(offsets == std::vector<size_t>({2, 10}));
+        REQUIRE(actual.at(0) == segA);
+        REQUIRE(actual.at(1) == segB);
+    }
+
+    TEST_CASE("Test parsing malformed state requests", "[state]") {
+        std::vector<uint8_t> data = {0, 1, 2, 3, 4};
+
+        StateRequest request;
+        request.user = "alpha";
+        request.key = "beta";
+        request.valueSize = 20;
+        request.length = data.size();
+        request.data = data.data();
+
+        tcp::TCPMessage *msg = buildStateRequest(tcp::TCPMessageType::STATE_SET, request);
+        size_t fullLen = msg->len;
+
+        SECTION("String longer than the message") {
+            size_t hugeLen = 1000;
+            std::copy(BYTES(&hugeLen), BYTES(&hugeLen) + sizeof(size_t), msg->buffer);
+        }
+
+        SECTION("Header cut short") {
+            msg->len = sizeof(size_t) + 5 + sizeof(size_t) + 4 + sizeof(size_t);
+        }
+
+        SECTION("Data shorter than the length") {
+            msg->len = fullLen - 1;
+        }
+
+        REQUIRE_THROWS(parseStateRequest(msg));
+
+        msg->len = fullLen;
+        tcp::freeTcpMessage(msg);
+    }
+
+    TEST_CASE("Test truncated state segments", "[state]") {
+        std::vector<uint8_t> seg = {1, 2, 3};
+        std::vector<uint8_t> segments;
+        appendStateSegment(segments, 2, seg.data(), seg.size());
+
+        size_t segmentsLen = 0;
+        SECTION("Truncated header") {
+            segmentsLen = sizeof(size_t) + 1;
+        }
+
+        SECTION("Truncated data") {
+            segmentsLen = segments.size() - 1;
+        }
+
+        int nCalls = 0;
+        REQUIRE_THROWS(forEachStateSegment(segments.data(), segmentsLen,
+                                           [&nCalls](size_t offset, const uint8_t *data, size_t length) {
+                                               nCalls++;
+                                           }));
+        REQUIRE(nCalls == 0);
+    }
+
+    TEST_CASE("Test state server flags failed requests", "[state]") {
+        StateServer server;
+
+        // Too short to hold a request
+        std::vector<uint8_t> bytes = {0, 1, 2};
+        tcp::TCPMessage request{};
+        request.type = tcp::TCPMessageType::STATE_SET;
+        request.len = bytes.size();
+        request.buffer = bytes.data();
+
+        tcp::TCPMessage *response = server.handleMessage(&request);
+        REQUIRE(response->type == tcp::TCPMessageType::STATE_SET);
+        REQUIRE(response->status == tcp::TCPMessageStatus::FAILED);
+        REQUIRE(response->len == 0);
+
+        tcp::freeTcpMessage(response);
+        server.close();
+    }
+
+    TEST_CASE("Test in-memory state with remote master", "[state]") {
+        cleanSystem();
+        util::SystemConfig &conf = util::getSystemConfig();
+        conf.stateMode = "inmemory";
+        conf.globalMessageTimeout = 100;
+
+        std::string user = "alpha";
+        std::string key = "inmem_key";
+        std::vector<uint8_t> values = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9};
+
+        // Master value lives in global state on this host
+        State &s = getGlobalState();
+        auto masterKv = std::static_pointer_cast<InMemoryStateKeyValue>(s.getKV(user, key, values.size()));
+        REQUIRE(masterKv->isMaster());
+        masterKv->set(values.data());
+
+        // Run the state server in the background
+        std::atomic<bool> done(false);
+        std::thread serverThread([&done] {
+            StateServer server;
+            while (!done) {
+                try {
+                    server.poll();
+                } catch (tcp::TCPTimeoutException &ex) {
+                    continue;
+                }
+            }
+            server.close();
+        });
+
+        // Let the server start
+        usleep(1000 * 100);
+
+        // Create a value that thinks it's on another host
+        InMemoryStateKeyValue remoteKv(user, key, values.size(), OTHER_IP);
+        REQUIRE(!remoteKv.isMaster());
+
+        REQUIRE(InMemoryStateKeyValue::getStateSizeFromRemote(user, key, OTHER_IP) == values.size());
+        REQUIRE(InMemoryStateKeyValue::getStateSizeFromRemote(user, "blah", OTHER_IP) == 0);
+
+        SECTION("Full pull") {
+            std::vector<uint8_t> actual(values.size());
+            remoteKv.get(actual.data());
+            REQUIRE(actual == values);
+        }
+
+        SECTION("Range pull") {
+            std::vector<uint8_t> actual(3);
+            remoteKv.getSegment(4, actual.data(), 3);
+            REQUIRE(actual == std::vector<uint8_t>({4, 5, 6}));
+        }
+
+        SECTION("Full push") {
+            std::vector<uint8_t> update = {9, 9, 9, 9, 9, 8, 8, 8, 8, 8};
+            remoteKv.set(update.data());
+            remoteKv.pushFull();
+
+            std::vector<uint8_t> actual(values.size());
+            masterKv->get(actual.data());
+            REQUIRE(actual == update);
+        }
+
+        SECTION("Partial push") {
+            std::vector<uint8_t> actual(values.size());
+            remoteKv.get(actual.data());
+
+            std::vector<uint8_t> update = {7, 7};
+            remoteKv.setSegment(1, update.data(), 2);
+            remoteKv.setSegment(8, update.data(), 2);
+            remoteKv.pushPartial();
+
+            std::vector<uint8_t> expected = {0, 7, 7, 3, 4, 5, 6, 7, 7, 7};
+            masterKv->get(actual.data());
+            REQUIRE(actual == expected);
+        }
+
+        SECTION("Global lock") {
+            remoteKv.lockGlobal();
+            REQUIRE(masterKv->tryLockGlobalLocal() == 0);
+
+            remoteKv.unlockGlobal();
+            long lockId = masterKv->tryLockGlobalLocal();
+            REQUIRE(lockId > 0);
+
+            // Locked elsewhere, so remote lock times out and unlocking with an old id does nothing
+            REQUIRE_THROWS(remoteKv.lockGlobal());
+            remoteKv.unlockGlobal();
+            REQUIRE(masterKv->tryLockGlobalLocal() == 0);
+
+            masterKv->unlockGlobalLocal(lockId);
+        }
+
+        done = true;
+        if (serverThread.joinable()) {
+            serverThread.join();
+        }
+
+        conf.reset();
+    }
+
+    TEST_CASE("Test in-memory global locks expire", "[state]") {
+        cleanSystem();
+        util::SystemConfig &conf = util::getSystemConfig();
+        conf.stateMode = "inmemory";
+
+        InMemoryStateKeyValue kv("alpha", "lock_expiry_key", 10);
+        REQUIRE(kv.isMaster());
+
+        util::Clock &clock = util::getGlobalClock();
+        util::TimePoint start = clock.now();
+        clock.setFakeNow(start);
+
+        long lockId = kv.tryLockGlobalLocal();
+        REQUIRE(lockId > 0);
+        REQUIRE(kv.tryLockGlobalLocal() == 0);
+
+        // Once the lease is up someone else can take it, and the old holder can't release it
+        clock.setFakeNow(start + std::chrono::seconds(REMOTE_LOCK_TIMEOUT_SECS + 1));
+        long otherLockId = kv.tryLockGlobalLocal();
+        REQUIRE(otherLockId > 0);
+        REQUIRE(otherLockId != lockId);
+
+        kv.unlockGlobalLocal(lockId);
+        REQUIRE(kv.tryLockGlobalLocal() == 0);
+
+        kv.unlockGlobalLocal(otherLockId);
+        REQUIRE(kv.tryLockGlobalLocal() > 0);
+
+        clock.stopFakeNow();
+        conf.reset();
+    }
+}
@@ -6,6 +6,7 @@
 #include <util/memory.h>
 #include <util/config.h>
 #include <state/State.h>
+#include <state/RedisStateKeyValue.h>
 #include <sys/mman.h>
 #include <emulator/emulator.h>
 #include <faasm/state.h>
@@ -340,6 +341,188 @@ namespace tests {
         std::vector<uint8_t> expectedBytes(expectedBytePtr, expectedBytePtr + stateSize);
     }
 
+    TEST_CASE("Test push partial with mask keeps other dirty segments", "[state]") {
+        cleanSystem();
+
+        redis::Redis &redisState = redis::Redis::getState();
+
+        size_t stateSize = 8;
+        std::shared_ptr<StateKeyValue> kvData = setupKV(stateSize);
+        std::shared_ptr<StateKeyValue> kvMask = setupKV(stateSize);
+
+        std::vector<uint8_t> values = {0, 0, 0, 0, 0, 0, 0, 0};
+        kvData->set(values.data());
+        kvData->pushFull();
+
+        // Write to both ends, but only mask the end
+        std::vector<uint8_t> update = {5, 5};
+        kvData->setSegment(0, update.data(), 2);
+        kvData->setSegment(6, update.data(), 2);
+
+        uint8_t *maskBytePtr = kvMask->get();
+        maskBytePtr[6] = 1;
+        maskBytePtr[7] = 1;
+
+        kvData->pushPartialMask(kvMask);
+        REQUIRE(redisState.get(kvData->key) == std::vector<uint8_t>({0, 0, 0, 0, 0, 0, 5, 5}));
+
+        // The push may have pulled over our copy, but the start must still be flagged dirty
+        uint8_t *dataBytePtr = kvData->get();
+        dataBytePtr[0] = 5;
+        dataBytePtr[1] = 5;
+
+        kvData->pushPartial();
+        REQUIRE(redisState.get(kvData->key) == std::vector<uint8_t>({5, 5, 0, 0, 0, 0, 5, 5}));
+    }
+
+    void checkRefreshAfterPartialPush(bool versioned) {
+        cleanSystem();
+        redis::Redis &redisState = redis::Redis::getState();
+
+        util::SystemConfig &conf = util::getSystemConfig();
+        conf.stateRefreshMode = versioned ? "versioned" : "full";
+
+        // Two writers on the same value, spanning several version chunks
+        size_t chunkSize = STATE_VERSION_CHUNK_SIZE;
+        size_t stateSize = 3 * chunkSize;
+        std::string key = "refresh_test_" + std::to_string(versioned);
+        RedisStateKeyValue kv(key, stateSize);
+        RedisStateKeyValue otherKv(key, stateSize);
+
+        std::vector<uint8_t> values(stateSize, 0);
+        kv.set(values.data());
+        kv.pushFull();
+
+        // First partial push after a full push syncs the whole value
+        uint8_t *ptr = kv.get();
+        ptr[0] = 1;
+        kv.flagSegmentDirty(0, 1);
+        kv.pushPartial();
+
+        // Other writer updates the last chunk
+        std::vector<uint8_t> otherUpdate = {5, 5};
+        otherKv.setSegment(2 * chunkSize, otherUpdate.data(), 2);
+        otherKv.pushPartial();
+
+        // Change the first chunk locally without flagging it, then push a change to the middle chunk
+        ptr[10] = 9;
+        ptr[chunkSize] = 3;
+        kv.flagSegmentDirty(chunkSize, 1);
+        kv.pushPartial();
+
+        // Check the other writer's update has been pulled
+        REQUIRE(ptr[0] == 1);
+        REQUIRE(ptr[chunkSize] == 3);
+        REQUIRE(ptr[2 * chunkSize] == 5);
+        REQUIRE(ptr[2 * chunkSize + 1] == 5);
+
+        // Unflagged local change only survives if its chunk wasn't pulled again
+        if (versioned) {
+            REQUIRE(ptr[10] == 9);
+        } else {
+            REQUIRE(ptr[10] == 0);
+        }
+
+        std::vector<uint8_t> remote = redisState.get(key);
+        REQUIRE(remote[0] == 1);
+        REQUIRE(remote[10] == 0);
+        REQUIRE(remote[chunkSize] == 3);
+        REQUIRE(remote[2 * chunkSize] == 5);
+
+        conf.reset();
+    }
+
+    TEST_CASE("Test versioned refresh after partial push", "[state]") {
+        checkRefreshAfterPartialPush(true);
+    }
+
+    TEST_CASE("Test full refresh after partial push", "[state]") {
+        checkRefreshAfterPartialPush(false);
+    }
+
+    TEST_CASE("Test versioned refresh picks up values set directly", "[state]") {
+        cleanSystem();
+
+        util::SystemConfig &conf = util::getSystemConfig();
+        conf.stateRefreshMode = "versioned";
+
+        std::string key = "direct_set_test";
+        RedisStateKeyValue kv(key, 4);
+
+        std::vector<uint8_t> values = {0, 0, 0, 0};
+        kv.set(values.data());
+        kv.pushFull();
+
+        // Sync the versions with a partial push
+        uint8_t *ptr = kv.get();
+        ptr[0] = 1;
+        kv.flagSegmentDirty(0, 1);
+        kv.pushPartial();
+
+        // Set the whole value without going through a key-value, as uploads do
+        RedisStateKeyValue::setRemote(key, {1, 2, 3, 4});
+
+        // Next partial push must pull the whole value again
+        ptr[0] = 1;
+        kv.flagSegmentDirty(0, 1);
+        kv.pushPartial();
+
+        std::vector<uint8_t> actual(ptr, ptr + 4);
+        REQUIRE(actual == std::vector<uint8_t>({1, 2, 3, 4}));
+
+        conf.reset();
+    }
+
+    TEST_CASE("Test chunked pulling", "[state]") {
+        cleanSystem();
+        redis::Redis &redisState = redis::Redis::getState();
+
+        // Chunk size that doesn't divide the value
+        util::SystemConfig &conf = util::getSystemConfig();
+        conf.statePullChunkSize = 6;
+
+        std::string key = "chunked_pull_test";
+        size_t stateSize = 20;
+        std::vector<uint8_t> values(stateSize);
+        for (size_t i = 0; i < stateSize; i++) {
+            values[i] = (uint8_t) i;
+        }
+        redisState.set(key, values);
+
+        RedisStateKeyValue kv(key, stateSize);
+
+        SECTION("Full pull") {
+            std::vector<uint8_t> actual(stateSize);
+            kv.get(actual.data());
+            REQUIRE(actual == values);
+        }
+
+        SECTION("Segment pull") {
+            std::vector<uint8_t> actual(10);
+            kv.getSegment(4, actual.data(), 10);
+            REQUIRE(actual == std::vector<uint8_t>(values.begin() + 4, values.begin() + 14));
+        }
+
+        conf.reset();
+    }
+
+    TEST_CASE("Test failed chunk pulls are only reported for that pull", "[state]") {
+        StatePullTracker tracker(4);
+
+        tracker.setPending(0, 2);
+        tracker.chunkDone(0, false);
+        tracker.chunkDone(1, true);
+
+        REQUIRE_THROWS_AS(tracker.await(0, 2), StateKeyValueException);
+        tracker.await(1, 1);
+
+        // Pulling the chunk again clears the failure
+        tracker.setPending(0, 1);
+        tracker.chunkDone(0, true);
+        tracker.await(0, 4);
+        tracker.awaitIdle();
+    }
+
     void checkPulling(bool async) {
         auto kv = setupKV(4);
         std::vector<uint8_t> values = {0, 1, 2, 3};
@@ -587,4 +770,73 @@ namespace tests {
         kv->deleteGlobal();
         redisState.get(kv->key);
     }
-}
\ No newline at end of file
+
+    TEST_CASE("Test deletion moves on the epoch", "[state]") {
+        cleanSystem();
+        redis::Redis &redisState = redis::Redis::getState();
+
+        util::SystemConfig &conf = util::getSystemConfig();
+        std::string originalMode = conf.stateRefreshMode;
+        conf.stateRefreshMode = "versioned";
+
+        std::string key = "delete_versions_test";
+        RedisStateKeyValue kv(key, 5);
+
+        std::vector<uint8_t> values = {0, 1, 2, 3, 4};
+        kv.set(values.data());
+        kv.pushFull();
+
+        kv.flagSegmentDirty(1, 2);
+        kv.pushPartial();
+
+        REQUIRE(redisState.getCounter(key + "_epoch") == 1);
+        REQUIRE(redisState.getCounter(key + "_version") == 2);
+        REQUIRE(!redisState.get(key + "_chunks").empty());
+
+        kv.deleteGlobal();
+
+        REQUIRE(redisState.get(key).empty());
+        REQUIRE(redisState.getCounter(key + "_epoch") == 2);
+        REQUIRE(redisState.getCounter(key + "_version") == 3);
+        REQUIRE(redisState.get(key + "_chunks").empty());
+
+        conf.stateRefreshMode = originalMode;
+    }
+
+    TEST_CASE("Test clients synced before a deletion pull the new value", "[state]") {
+        cleanSystem();
+
+        util::SystemConfig &conf = util::getSystemConfig();
+        conf.stateRefreshMode = "versioned";
+
+        std::string key = "delete_stale_test";
+        RedisStateKeyValue staleKv(key, 4);
+        RedisStateKeyValue otherKv(key, 4);
+
+        // Sync the versions on one client
+        std::vector<uint8_t> values = {0, 0, 0, 0};
+        staleKv.set(values.data());
+        staleKv.pushFull();
+
+        uint8_t *ptr = staleKv.get();
+        ptr[0] = 1;
+        staleKv.flagSegmentDirty(0, 1);
+        staleKv.pushPartial();
+
+        // Another client deletes the value and pushes a new one
+        otherKv.deleteGlobal();
+        std::vector<uint8_t> newValues = {1, 6, 7, 8};
+        otherKv.set(newValues.data());
+        otherKv.pushFull();
+
+        // Next partial push on the first client must pull the new value
+        ptr[0] = 1;
+        staleKv.flagSegmentDirty(0, 1);
+        staleKv.pushPartial();
+
+        std::vector<uint8_t> actual(ptr, ptr + 4);
+        REQUIRE(actual == newValues);
+
+        conf.reset();
+    }
+}
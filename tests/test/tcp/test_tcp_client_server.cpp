@@ -42,4 +42,90 @@ namespace tests {
             serverThread.join();
         }
     }
-}
\ No newline at end of file
+
+    TEST_CASE("Test large messages and concurrent clients on threaded echo server", "[tcp]") {
+        int port = 8007;
+        std::string host = "127.0.0.1";
+
+        EchoServer server(port, 4);
+        server.start();
+
+        int nClients = 6;
+        int nMessages = 5;
+        std::vector<std::thread> clientThreads;
+        std::vector<int> success(nClients, 0);
+        for (int c = 0; c < nClients; c++) {
+            clientThreads.emplace_back([c, nMessages, &host, port, &success] {
+                TCPClient client(host, port);
+
+                // Several megabytes per message
+                size_t dataSize = (c + 1) * 1024 * 1024;
+                std::vector<uint8_t> requestBytes(dataSize, (uint8_t) c);
+                std::vector<uint8_t> actual(dataSize, 0);
+
+                bool allMatched = true;
+                for (int m = 0; m < nMessages; m++) {
+                    requestBytes[m] = (uint8_t) m;
+
+                    TCPMessage msg{};
+                    msg.type = TCPMessageType::STANDARD;
+                    msg.len = requestBytes.size();
+                    msg.buffer = requestBytes.data();
+                    client.sendMessage(&msg);
+
+                    // Receive straight into the destination
+                    TCPMessage r = client.recvMessageInto(actual.data(), actual.size());
+                    allMatched &= r.len == dataSize && actual == requestBytes;
+                }
+
+                client.exit();
+                success[c] = allMatched ? 1 : 0;
+            });
+        }
+
+        for (auto &t : clientThreads) {
+            if (t.joinable()) {
+                t.join();
+            }
+        }
+
+        server.close();
+
+        for (int c = 0; c < nClients; c++) {
+            REQUIRE(success[c] == 1);
+        }
+    }
+
+    TEST_CASE("Test receiving into a buffer that's too small", "[tcp]") {
+        int port = 8008;
+        std::string host = "127.0.0.1";
+
+        EchoServer server(port);
+        server.start();
+
+        TCPClient client(host, port);
+
+        std::vector<uint8_t> requestBytes = {0, 1, 2, 3, 4, 5, 6, 7};
+        TCPMessage msg{};
+        msg.type = TCPMessageType::STANDARD;
+        msg.len = requestBytes.size();
+        msg.buffer = requestBytes.data();
+
+        // Too small a buffer leaves it untouched
+        std::vector<uint8_t> small(4, 9);
+        client.sendMessage(&msg);
+        TCPMessage r = client.recvMessageInto(small.data(), small.size());
+        REQUIRE(r.len == requestBytes.size());
+        REQUIRE(r.buffer == nullptr);
+        REQUIRE(small == std::vector<uint8_t>(4, 9));
+
+        // Connection is still usable
+        std::vector<uint8_t> actual(requestBytes.size());
+        client.sendMessage(&msg);
+        r = client.recvMessageInto(actual.data(), actual.size());
+        REQUIRE(actual == requestBytes);
+
+        client.exit();
+        server.close();
+    }
+}
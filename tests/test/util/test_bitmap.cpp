@@ -0,0 +1,117 @@
+#include <catch/catch.hpp>
+
+#include <util/bitmap.h>
+
+#include <thread>
+
+using namespace util;
+
+namespace tests {
+    static std::vector<std::pair<size_t, size_t>> getRuns(const Bitmap &b) {
+        std::vector<std::pair<size_t, size_t>> runs;
+        b.forEachRun([&runs](size_t start, size_t len) {
+            runs.emplace_back(start, len);
+        });
+        return runs;
+    }
+
+    TEST_CASE("Test setting and clearing bitmap ranges", "[util]") {
+        Bitmap b(200);
+        REQUIRE(b.size() == 200);
+        REQUIRE(!b.anySet());
+
+        // Within a word
+        b.set(3, 4);
+        REQUIRE(!b.isSet(2));
+        REQUIRE(b.isSet(3));
+        REQUIRE(b.isSet(6));
+        REQUIRE(!b.isSet(7));
+
+        // Across several words
+        b.set(60, 100);
+        REQUIRE(b.allSet(60, 100));
+        REQUIRE(!b.allSet(59, 100));
+        REQUIRE(!b.allSet(60, 101));
+
+        b.clear(100, 10);
+        REQUIRE(!b.allSet(60, 100));
+        REQUIRE(b.allSet(60, 40));
+        REQUIRE(b.allSet(110, 50));
+
+        std::vector<std::pair<size_t, size_t>> expected = {{3,   4},
+                                                           {60,  40},
+                                                           {110, 50}};
+        REQUIRE(getRuns(b) == expected);
+
+        b.clearAll();
+        REQUIRE(!b.anySet());
+        REQUIRE(getRuns(b).empty());
+    }
+
+    TEST_CASE("Test bitmap runs at the end", "[util]") {
+        Bitmap b(130);
+
+        // Out of bounds is ignored
+        b.set(120, 20);
+        REQUIRE(b.allSet(120, 10));
+
+        std::vector<std::pair<size_t, size_t>> expected = {{120, 10}};
+        REQUIRE(getRuns(b) == expected);
+        REQUIRE(b.nextClear(120) == 130);
+        REQUIRE(b.nextSet(0) == 120);
+    }
+
+    TEST_CASE("Test bitmap from byte mask", "[util]") {
+        std::vector<uint8_t> mask(100, 0);
+        mask[0] = 1;
+        std::fill(mask.begin() + 30, mask.begin() + 75, 0xFF);
+        mask[99] = 3;
+
+        Bitmap b(mask.size());
+        b.setFromByteMask(mask.data(), mask.size());
+
+        std::vector<std::pair<size_t, size_t>> expected = {{0,  1},
+                                                           {30, 45},
+                                                           {99, 1}};
+        REQUIRE(getRuns(b) == expected);
+    }
+
+    TEST_CASE("Test taking all bitmap bits", "[util]") {
+        Bitmap b(200);
+        b.set(10, 5);
+        b.set(150, 20);
+
+        Bitmap taken = b.takeAll();
+        REQUIRE(!b.anySet());
+
+        std::vector<std::pair<size_t, size_t>> expected = {{10,  5},
+                                                           {150, 20}};
+        REQUIRE(getRuns(taken) == expected);
+    }
+
+    TEST_CASE("Test setting bits in the same word from several threads", "[util]") {
+        int nThreads = 8;
+        size_t bitsPerThread = 8;
+        Bitmap b(nThreads * bitsPerThread);
+
+        // Each thread sets and clears its own bits repeatedly, leaving every other bit set
+        std::vector<std::thread> threads;
+        for (int t = 0; t < nThreads; t++) {
+            threads.emplace_back([&b, t, bitsPerThread] {
+                for (int i = 0; i < 10000; i++) {
+                    b.set(t * bitsPerThread, bitsPerThread);
+                    b.clear(t * bitsPerThread, 1);
+                }
+            });
+        }
+
+        for (auto &t : threads) {
+            t.join();
+        }
+
+        for (int t = 0; t < nThreads; t++) {
+            REQUIRE(!b.isSet(t * bitsPerThread));
+            REQUIRE(b.allSet(t * bitsPerThread + 1, bitsPerThread - 1));
+        }
+    }
+}
@@ -33,22 +33,50 @@ namespace tests {
         REQUIRE(conf.pythonPreload == "off");
         REQUIRE(conf.captureStdout == "off");
         REQUIRE(conf.stateMode == "redis");
+        REQUIRE(conf.stateRefreshMode == "versioned");
+        REQUIRE(conf.statePullThreads == 4);
+        REQUIRE(conf.statePullChunkSize == 4194304);
+        REQUIRE(conf.stateServerThreads == 4);
         REQUIRE(conf.wasmVm == "wavm");
 
         REQUIRE(conf.redisPort == "6379");
 
+        REQUIRE(conf.moduleResetMode == "clone");
+        REQUIRE(conf.modulePoolSize == 4);
+        REQUIRE(conf.moduleCacheMaxMb == 4096);
+        REQUIRE(conf.codeCacheMode == "on");
+        REQUIRE(conf.snapshotMode == "full");
+        REQUIRE(conf.snapshotCompression == "lz4");
+
         REQUIRE(conf.maxNodes == 4);
         REQUIRE(conf.noScheduler == 0);
         REQUIRE(conf.maxInFlightRatio == 3);
         REQUIRE(conf.maxWorkersPerFunction == 10);
+        REQUIRE(conf.schedulerCacheTtl == 1000);
+        REQUIRE(conf.sharingBatchSize == 1);
+        REQUIRE(conf.sharingBatchWindow == 2);
         REQUIRE(conf.threadMode == "local");
 
         REQUIRE(conf.globalMessageTimeout == 60000);
+
+        REQUIRE(conf.globalQueueThreads == 1);
+
+        REQUIRE(conf.globalQueueBatchSize == 10);
         REQUIRE(conf.boundTimeout == 30000);
         REQUIRE(conf.unboundTimeout == 300000);
         REQUIRE(conf.chainedCallTimeout == 300000);
 
         REQUIRE(conf.defaultMpiWorldSize == 5);
+
+        REQUIRE(conf.mpiEagerLimit == 65536);
+
+        REQUIRE(conf.mpiServerThreads == 4);
+
+        REQUIRE(conf.mpiPayloadTimeout == 300000);
+
+        REQUIRE(conf.mpiLinearCollectiveSize == 8);
+
+        REQUIRE(conf.mpiRingAllReduceBytes == 65536);
     }
 
     TEST_CASE("Test overriding system config initialisation", "[util]") {
@@ -68,6 +96,10 @@ namespace tests {
         std::string pythonPre = setEnvVar("PYTHON_PRELOAD", "on");
         std::string captureStdout = setEnvVar("CAPTURE_STDOUT", "on");
         std::string stateMode = setEnvVar("STATE_MODE", "foobar");
+        std::string stateRefreshMode = setEnvVar("STATE_REFRESH_MODE", "full");
+        std::string statePullThreads = setEnvVar("STATE_PULL_THREADS", "7");
+        std::string statePullChunkSize = setEnvVar("STATE_PULL_CHUNK_SIZE", "1024");
+        std::string stateServerThreads = setEnvVar("STATE_SERVER_THREADS", "8");
         std::string wasmVm = setEnvVar("WASM_VM", "blah");
 
         std::string redisState = setEnvVar("REDIS_STATE_HOST", "not-localhost");
@@ -75,20 +107,32 @@ namespace tests {
         std::string redisPort = setEnvVar("REDIS_PORT", "1234");
 
         std::string irCacheMode = setEnvVar("IR_CACHE_MODE", "foo-ir-cache");
+        std::string moduleResetMode = setEnvVar("MODULE_RESET_MODE", "foo-reset");
+        std::string modulePoolSize = setEnvVar("MODULE_POOL_SIZE", "9");
+        std::string moduleCacheMaxMb = setEnvVar("MODULE_CACHE_MAX_MB", "123");
+        std::string codeCacheMode = setEnvVar("CODE_CACHE_MODE", "off");
+        std::string snapshotMode = setEnvVar("SNAPSHOT_MODE", "foo-snap");
+        std::string snapshotCompression = setEnvVar("SNAPSHOT_COMPRESSION", "foo-compress");
 
         std::string maxNodes = setEnvVar("MAX_NODES", "15");
         std::string noScheduler = setEnvVar("NO_SCHEDULER", "1");
         std::string inFlightRatio = setEnvVar("MAX_IN_FLIGHT_RATIO", "8888");
         std::string workers = setEnvVar("MAX_WORKERS_PER_FUNCTION", "7777");
+        std::string schedulerCacheTtl = setEnvVar("SCHEDULER_CACHE_TTL", "50");
+        std::string sharingBatchSize = setEnvVar("SHARING_BATCH_SIZE", "20");
+        std::string sharingBatchWindow = setEnvVar("SHARING_BATCH_WINDOW", "15");
         std::string threadMode = setEnvVar("THREAD_MODE", "threadfoo");
 
         std::string globalTimeout = setEnvVar("GLOBAL_MESSAGE_TIMEOUT", "9876");
+        std::string globalQueueThreads = setEnvVar("GLOBAL_QUEUE_THREADS", "4");
+        std::string globalQueueBatchSize = setEnvVar("GLOBAL_QUEUE_BATCH_SIZE", "32");
         std::string boundTimeout = setEnvVar("BOUND_TIMEOUT", "6666");
         std::string unboundTimeout = setEnvVar("UNBOUND_TIMEOUT", "5555");
         std::string chainedTimeout = setEnvVar("CHAINED_CALL_TIMEOUT", "9999");
 
         std::string funcDir = setEnvVar("FUNC_DIR", "/tmp/foo");
         std::string objDir = setEnvVar("OBJ_DIR", "/tmp/bar");
+        std::string codeCacheDir = setEnvVar("CODE_CACHE_DIR", "/tmp/ccc");
         std::string runtimeDir = setEnvVar("RUNTIME_FILES_DIR", "/tmp/rara");
         std::string sharedDir = setEnvVar("SHARED_FILES_DIR", "/tmp/sss");
         std::string sharedStorageDir = setEnvVar("SHARED_FILES_STORAGE_DIR", "/tmp/sss_store");
@@ -96,6 +140,11 @@ namespace tests {
         std::string ibmApi = setEnvVar("IBM_API_KEY", "ibm-123");
 
         std::string mpiSize = setEnvVar("DEFAULT_MPI_WORLD_SIZE", "2468");
+        std::string mpiEagerLimit = setEnvVar("MPI_EAGER_LIMIT", "1024");
+        std::string mpiServerThreads = setEnvVar("MPI_SERVER_THREADS", "8");
+        std::string mpiPayloadTimeout = setEnvVar("MPI_PAYLOAD_TIMEOUT", "1234");
+        std::string mpiLinearCollectiveSize = setEnvVar("MPI_LINEAR_COLLECTIVE_SIZE", "16");
+        std::string mpiRingAllReduceBytes = setEnvVar("MPI_RING_ALLREDUCE_BYTES", "2048");
 
         // Create new conf for test
         SystemConfig conf;
@@ -113,6 +162,10 @@ namespace tests {
         REQUIRE(conf.pythonPreload == "on");
         REQUIRE(conf.captureStdout == "on");
         REQUIRE(conf.stateMode == "foobar");
+        REQUIRE(conf.stateRefreshMode == "full");
+        REQUIRE(conf.statePullThreads == 7);
+        REQUIRE(conf.statePullChunkSize == 1024);
+        REQUIRE(conf.stateServerThreads == 8);
         REQUIRE(conf.wasmVm == "blah");
 
         REQUIRE(conf.redisStateHost == "not-localhost");
@@ -120,20 +173,34 @@ namespace tests {
         REQUIRE(conf.redisPort == "1234");
 
         REQUIRE(conf.irCacheMode == "foo-ir-cache");
+        REQUIRE(conf.moduleResetMode == "foo-reset");
+        REQUIRE(conf.modulePoolSize == 9);
+        REQUIRE(conf.moduleCacheMaxMb == 123);
+        REQUIRE(conf.codeCacheMode == "off");
+        REQUIRE(conf.snapshotMode == "foo-snap");
+        REQUIRE(conf.snapshotCompression == "foo-compress");
 
         REQUIRE(conf.maxNodes == 15);
         REQUIRE(conf.noScheduler == 1);
         REQUIRE(conf.maxInFlightRatio == 8888);
         REQUIRE(conf.maxWorkersPerFunction == 7777);
+        REQUIRE(conf.schedulerCacheTtl == 50);
+        REQUIRE(conf.sharingBatchSize == 20);
+        REQUIRE(conf.sharingBatchWindow == 15);
         REQUIRE(conf.threadMode == "threadfoo");
 
         REQUIRE(conf.globalMessageTimeout == 9876);
+
+        REQUIRE(conf.globalQueueThreads == 4);
+
+        REQUIRE(conf.globalQueueBatchSize == 32);
         REQUIRE(conf.boundTimeout == 6666);
         REQUIRE(conf.unboundTimeout == 5555);
         REQUIRE(conf.chainedCallTimeout == 9999);
 
         REQUIRE(conf.functionDir == "/tmp/foo");
         REQUIRE(conf.objectFileDir == "/tmp/bar");
+        REQUIRE(conf.codeCacheDir == "/tmp/ccc");
         REQUIRE(conf.runtimeFilesDir == "/tmp/rara");
         REQUIRE(conf.sharedFilesDir == "/tmp/sss");
         REQUIRE(conf.sharedFilesStorageDir == "/tmp/sss_store");
@@ -142,6 +209,16 @@ namespace tests {
 
         REQUIRE(conf.defaultMpiWorldSize == 2468);
 
+        REQUIRE(conf.mpiEagerLimit == 1024);
+
+        REQUIRE(conf.mpiServerThreads == 8);
+
+        REQUIRE(conf.mpiPayloadTimeout == 1234);
+
+        REQUIRE(conf.mpiLinearCollectiveSize == 16);
+
+        REQUIRE(conf.mpiRingAllReduceBytes == 2048);
+
         // Be careful with host type
         setEnvVar("HOST_TYPE", originalHostType);
 
@@ -158,6 +235,10 @@ namespace tests {
         setEnvVar("PYTHON_PRELOAD", pythonPre);
         setEnvVar("CAPTURE_STDOUT", captureStdout);
         setEnvVar("STATE_MODE", stateMode);
+        setEnvVar("STATE_REFRESH_MODE", stateRefreshMode);
+        setEnvVar("STATE_PULL_THREADS", statePullThreads);
+        setEnvVar("STATE_PULL_CHUNK_SIZE", statePullChunkSize);
+        setEnvVar("STATE_SERVER_THREADS", stateServerThreads);
         setEnvVar("WASM_VM", wasmVm);
 
         setEnvVar("REDIS_STATE_HOST", redisState);
@@ -165,20 +246,34 @@ namespace tests {
         setEnvVar("REDIS_PORT", redisPort);
 
         setEnvVar("IR_CACHE_MODE", irCacheMode);
+        setEnvVar("MODULE_RESET_MODE", moduleResetMode);
+        setEnvVar("MODULE_POOL_SIZE", modulePoolSize);
+        setEnvVar("MODULE_CACHE_MAX_MB", moduleCacheMaxMb);
+        setEnvVar("CODE_CACHE_MODE", codeCacheMode);
+        setEnvVar("SNAPSHOT_MODE", snapshotMode);
+        setEnvVar("SNAPSHOT_COMPRESSION", snapshotCompression);
 
         setEnvVar("MAX_NODES", maxNodes);
         setEnvVar("NO_SCHEDULER", noScheduler);
         setEnvVar("MAX_IN_FLIGHT_RATIO", inFlightRatio);
         setEnvVar("MAX_WORKERS_PER_FUNCTION", workers);
+        setEnvVar("SCHEDULER_CACHE_TTL", schedulerCacheTtl);
+        setEnvVar("SHARING_BATCH_SIZE", sharingBatchSize);
+        setEnvVar("SHARING_BATCH_WINDOW", sharingBatchWindow);
         setEnvVar("THREAD_MODE", threadMode);
 
         setEnvVar("GLOBAL_MESSAGE_TIMEOUT", globalTimeout);
+
+        setEnvVar("GLOBAL_QUEUE_THREADS", globalQueueThreads);
+
+        setEnvVar("GLOBAL_QUEUE_BATCH_SIZE", globalQueueBatchSize);
         setEnvVar("BOUND_TIMEOUT", boundTimeout);
         setEnvVar("UNBOUND_TIMEOUT", unboundTimeout);
         setEnvVar("CHAINED_CALL_TIMEOUT", chainedTimeout);
 
         setEnvVar("FUNC_DIR", funcDir);
         setEnvVar("OBJ_DIR", objDir);
+        setEnvVar("CODE_CACHE_DIR", codeCacheDir);
         setEnvVar("RUNTIME_FILES_DIR", runtimeDir);
         setEnvVar("SHARED_FILES_DIR", sharedDir);
         setEnvVar("SHARED_FILES_STORAGE_DIR", sharedStorageDir);
@@ -186,6 +281,16 @@ namespace tests {
         setEnvVar("IBM_API_KEY", ibmApi);
 
         setEnvVar("DEFAULT_MPI_WORLD_SIZE", mpiSize);
+
+        setEnvVar("MPI_EAGER_LIMIT", mpiEagerLimit);
+
+        setEnvVar("MPI_SERVER_THREADS", mpiServerThreads);
+
+        setEnvVar("MPI_PAYLOAD_TIMEOUT", mpiPayloadTimeout);
+
+        setEnvVar("MPI_LINEAR_COLLECTIVE_SIZE", mpiLinearCollectiveSize);
+
+        setEnvVar("MPI_RING_ALLREDUCE_BYTES", mpiRingAllReduceBytes);
     }
 
 }
\ No newline at end of file
@@ -19,4 +19,18 @@ namespace tests {
         REQUIRE(hashA1 != hashB1);
         REQUIRE(hashB1 == hashB2);
     }
+
+    TEST_CASE("Test hashing bytes", "[util]") {
+        std::string str = "one string";
+        std::vector<uint8_t> bytes(str.begin(), str.end());
+
+        REQUIRE(bytesToSHA1(bytes) == stringToSHA1(str));
+    }
+
+    TEST_CASE("Test hash to hex", "[util]") {
+        std::string hash = stringToSHA1("abc");
+
+        REQUIRE(hash.size() == 20);
+        REQUIRE(hashToHex(hash) == "a9993e364706816aba3e25717850c26c9cd0d89d");
+    }
 }
\ No newline at end of file
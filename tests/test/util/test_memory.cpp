@@ -4,6 +4,9 @@
 #include <unistd.h>
 #include <util/macros.h>
 
+#include <algorithm>
+#include <vector>
+
 using namespace util;
 
 namespace tests {
@@ -149,4 +152,52 @@ namespace tests {
         REQUIRE(regionBInt[0] == 55);
         REQUIRE(regionBInt[1] == 66);
     }
-}
\ No newline at end of file
+
+    TEST_CASE("Test finding and resetting dirty pages of a private mapping", "[memory]") {
+        size_t pageSize = util::HOST_PAGE_SIZE;
+        size_t nPages = 10;
+        size_t memSize = nPages * pageSize;
+
+        // Create a file with each page filled with its index
+        std::vector<uint8_t> original(memSize);
+        for (size_t p = 0; p < nPages; p++) {
+            std::fill(original.begin() + p * pageSize, original.begin() + (p + 1) * pageSize, (uint8_t) p);
+        }
+
+        int fd = memfd_create("dirtypages", 0);
+        REQUIRE(ftruncate(fd, memSize) == 0);
+        REQUIRE(write(fd, original.data(), memSize) == (ssize_t) memSize);
+
+        auto memory = BYTES(mmap(nullptr, memSize, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0));
+        REQUIRE(memory != MAP_FAILED);
+
+        // Reading doesn't dirty pages
+        for (size_t p = 0; p < nPages; p++) {
+            REQUIRE(memory[p * pageSize] == p);
+        }
+        REQUIRE(util::getDirtyPrivatePages(memory, memSize).empty());
+
+        // Write to an isolated page, a run of pages, and the last page
+        memory[1 * pageSize + 5] = 100;
+        memory[4 * pageSize] = 100;
+        memory[5 * pageSize + 10] = 100;
+        memory[6 * pageSize + pageSize - 1] = 100;
+        memory[9 * pageSize] = 100;
+
+        std::vector<std::pair<size_t, size_t>> expected = {
+                {1 * pageSize, pageSize},
+                {4 * pageSize, 3 * pageSize},
+                {9 * pageSize, pageSize},
+        };
+        std::vector<std::pair<size_t, size_t>> actual = util::getDirtyPrivatePages(memory, memSize);
+        REQUIRE(actual == expected);
+
+        // Resetting brings back the file's contents
+        util::resetDirtyPrivatePages(memory, actual);
+        REQUIRE(std::equal(original.begin(), original.end(), memory));
+        REQUIRE(util::getDirtyPrivatePages(memory, memSize).empty());
+
+        munmap(memory, memSize);
+        close(fd);
+    }
+}
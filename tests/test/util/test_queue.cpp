@@ -2,6 +2,10 @@
 #include <util/bytes.h>
 #include <util/queue.h>
 
+#include <atomic>
+#include <thread>
+#include <unistd.h>
+
 using namespace util;
 
 typedef util::Queue<int> IntQueue;
@@ -27,4 +31,132 @@ namespace tests {
 
         REQUIRE_THROWS(q.dequeue(1));
     }
-}
\ No newline at end of file
+
+    TEST_CASE("Test lock-free queue operations", "[util]") {
+        LockFreeQueue<int> q(4);
+
+        q.enqueue(1);
+        q.enqueue(2);
+        q.enqueue(3);
+        REQUIRE(q.size() == 3);
+
+        REQUIRE(q.dequeue() == 1);
+        REQUIRE(q.dequeue() == 2);
+
+        // Wrap around the ring
+        q.enqueue(4);
+        q.enqueue(5);
+        q.enqueue(6);
+        REQUIRE(q.size() == 4);
+
+        int extra = 7;
+        REQUIRE(!q.tryEnqueue(extra));
+
+        REQUIRE(q.dequeue() == 3);
+        REQUIRE(q.dequeue() == 4);
+        REQUIRE(q.dequeue() == 5);
+        REQUIRE(q.dequeue() == 6);
+        REQUIRE(q.size() == 0);
+
+        REQUIRE_THROWS_AS(q.dequeue(1), QueueTimeoutException);
+
+        q.enqueue(8);
+        q.reset();
+        REQUIRE(q.size() == 0);
+    }
+
+    TEST_CASE("Test lock-free queue blocking", "[util]") {
+        LockFreeQueue<int> q(2);
+
+        // Consumer blocks until something is enqueued
+        int actual = 0;
+        std::thread consumer([&q, &actual] {
+            actual = q.dequeue(5000);
+        });
+
+        usleep(10 * 1000);
+        q.enqueue(1);
+        consumer.join();
+        REQUIRE(actual == 1);
+
+        // Producer blocks until there's space
+        q.enqueue(2);
+        q.enqueue(3);
+        std::thread producer([&q] {
+            q.enqueue(4);
+        });
+
+        usleep(10 * 1000);
+        REQUIRE(q.dequeue() == 2);
+        producer.join();
+
+        REQUIRE(q.dequeue() == 3);
+        REQUIRE(q.dequeue() == 4);
+    }
+
+    TEST_CASE("Test lock-free queue overflow", "[util]") {
+        LockFreeQueue<int> q(2, true);
+
+        // Doesn't block when full
+        for (int i = 1; i <= 5; i++) {
+            q.enqueue(i);
+        }
+        REQUIRE(q.size() == 5);
+
+        int extra = 6;
+        REQUIRE(!q.tryEnqueue(extra));
+
+        // Values come back in order, even once there's space in the ring again
+        REQUIRE(q.dequeue() == 1);
+        q.enqueue(6);
+        for (int i = 2; i <= 6; i++) {
+            REQUIRE(q.dequeue() == i);
+        }
+        REQUIRE(q.size() == 0);
+
+        // Consumers are woken by overflowed values
+        q.enqueue(7);
+        q.enqueue(8);
+        int actual = 0;
+        std::thread consumer([&q, &actual] {
+            q.dequeue();
+            q.dequeue();
+            actual = q.dequeue(5000);
+        });
+
+        usleep(10 * 1000);
+        q.enqueue(9);
+        consumer.join();
+        REQUIRE(actual == 9);
+    }
+
+    TEST_CASE("Test lock-free queue with multiple producers and consumers", "[util]") {
+        LockFreeQueue<long> q(64);
+        int nThreads = 4;
+        long nPerThread = 10000;
+
+        std::atomic<long> total(0);
+        std::vector<std::thread> threads;
+        for (int t = 0; t < nThreads; t++) {
+            threads.emplace_back([&q, nPerThread] {
+                for (long i = 1; i <= nPerThread; i++) {
+                    q.enqueue(i);
+                }
+            });
+
+            threads.emplace_back([&q, &total, nPerThread] {
+                for (long i = 0; i < nPerThread; i++) {
+                    total += q.dequeue(5000);
+                }
+            });
+        }
+
+        for (auto &t : threads) {
+            t.join();
+        }
+
+        long expected = nThreads * (nPerThread * (nPerThread + 1)) / 2;
+        REQUIRE(total == expected);
+        REQUIRE(q.size() == 0);
+    }
+}
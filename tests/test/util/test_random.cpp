@@ -36,4 +36,26 @@ namespace tests {
 
         REQUIRE(actual.size() == 4);
     }
+
+    TEST_CASE("Test random values from set", "[random]") {
+        std::unordered_set<std::string> s;
+        REQUIRE(util::randomStringsFromSet(s, 2).empty());
+
+        s.insert("foo");
+        REQUIRE(util::randomStringsFromSet(s, 2) == std::vector<std::string>({"foo"}));
+
+        s.insert("bar");
+        s.insert("baz");
+
+        std::unordered_set<std::string> seen;
+        for (int i = 0; i < 1000; i++) {
+            std::vector<std::string> actual = util::randomStringsFromSet(s, 2);
+            REQUIRE(actual.size() == 2);
+            REQUIRE(actual.at(0) != actual.at(1));
+
+            seen.insert(actual.begin(), actual.end());
+        }
+
+        REQUIRE(seen.size() == 3);
+    }
 }
@@ -15,6 +15,12 @@ namespace tests {
         execFunction(msg);
     }
 
+    TEST_CASE("Test dynamic, guided and runtime for scheduling", "[wasm]") {
+        cleanSystem();
+        message::Message msg = util::messageFactory("omp", "for_dynamic_schedule");
+        execFunction(msg);
+    }
+
     TEST_CASE("Test OMP header API functions", "[wasm]") {
         cleanSystem();
         message::Message msg = util::messageFactory("omp", "header_api_support");
@@ -39,6 +45,12 @@ namespace tests {
         execFunction(msg);
     }
 
+    TEST_CASE("Test repeated parallel regions", "[wasm]") {
+        cleanSystem();
+        message::Message msg = util::messageFactory("omp", "repeated_regions");
+        execFunction(msg);
+    }
+
     TEST_CASE("Test non-nested master pragma", "[wasm]") {
         cleanSystem();
         message::Message msg = util::messageFactory("omp", "simple_master");
@@ -53,8 +65,14 @@ namespace tests {
 
     TEST_CASE("Test simple reduction function", "[wasm]") {
         cleanSystem();
-        // message::Message msg = util::messageFactory("omp", "simple_reduce");
-        // execFunction(msg);
+        message::Message msg = util::messageFactory("omp", "simple_reduce");
+        execFunction(msg);
+    }
+
+    TEST_CASE("Test tree and atomic reductions", "[wasm]") {
+        cleanSystem();
+        message::Message msg = util::messageFactory("omp", "reduction_methods");
+        execFunction(msg);
     }
 
     TEST_CASE("Test averaging with different methods (atomic RR and reduction)", "[wasm]") {
@@ -71,14 +89,14 @@ namespace tests {
 
     TEST_CASE("Test critical section", "[wasm]") {
         cleanSystem();
-        // message::Message msg = util::messageFactory("omp", "simple_critical");
-        // execFunction(msg);
+        message::Message msg = util::messageFactory("omp", "simple_critical");
+        execFunction(msg);
     }
 
     TEST_CASE("Test custom reduction function", "[wasm]") {
         cleanSystem();
-        // message::Message msg = util::messageFactory("omp", "custom_reduce");
-        // execFunction(msg);
+        message::Message msg = util::messageFactory("omp", "custom_reduce");
+        execFunction(msg);
     }
 
     TEST_CASE("Test similar nested API than Clang 9.0.1", "[wasm]") {
@@ -0,0 +1,123 @@
+#include <catch/catch.hpp>
+
+#include <wasm/openmp/Level.h>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+using namespace wasm::openmp;
+
+namespace tests {
+    /**
+     * Runs a team of threads through a few loops scheduled via dispatch, with no barriers
+     * between them, and checks each iteration is run exactly once.
+     */
+    static void checkDispatchedLoops(int32_t schedule, int64_t chunk, int nThreads, int64_t lower, int64_t upper,
+                                     int64_t incr) {
+        auto parent = std::make_shared<OMPLevel>();
+        parent->runtime_schedule = omp_sched_guided;
+        parent->runtime_chunk = 3;
+        OMPLevel level(parent, nThreads);
+
+        int nLoops = 3 * OMP_DISPATCH_BUFFERS;
+        uint64_t tripCount = getTripCount(lower, upper, incr, true);
+        std::vector<std::vector<std::atomic<int>>> counts(nLoops);
+        for (auto &c : counts) {
+            c = std::vector<std::atomic<int>>(tripCount);
+        }
+
+        std::atomic<int> lastCount = 0;
+        std::vector<std::thread> threads;
+        for (int t = 0; t < nThreads; t++) {
+            threads.emplace_back([&, t] {
+                for (int loop = 0; loop < nLoops; loop++) {
+                    dispatchInit(level, t, schedule, lower, upper, incr, chunk, true);
+
+                    OMPChunk c;
+                    while (dispatchNext(level, t, c)) {
+                        REQUIRE(c.stride == incr);
+                        for (auto i = (int64_t) c.lower; incr > 0 ? i <= (int64_t) c.upper : i >= (int64_t) c.upper;
+                             i += incr) {
+                            counts[loop][(i - lower) / incr]++;
+                        }
+
+                        if (c.isLast) {
+                            lastCount++;
+                        }
+                    }
+                }
+            });
+        }
+
+        for (auto &t : threads) {
+            t.join();
+        }
+
+        for (auto &loopCounts : counts) {
+            for (auto &c : loopCounts) {
+                REQUIRE(c == 1);
+            }
+        }
+
+        REQUIRE(lastCount == (tripCount > 0 ? nLoops : 0));
+    }
+
+    TEST_CASE("Test OpenMP loop dispatch", "[wasm]") {
+        int32_t schedule = 0;
+        int64_t chunk = 0;
+
+        SECTION("Dynamic") {
+            schedule = kmp::sch_dynamic_chunked;
+            chunk = 4;
+        }
+
+        SECTION("Dynamic nonmonotonic") {
+            schedule = kmp::sch_dynamic_chunked | kmp::sch_modifier_nonmonotonic;
+            chunk = 1;
+        }
+
+        SECTION("Guided") {
+            schedule = kmp::sch_guided_chunked;
+            chunk = 2;
+        }
+
+        SECTION("Static") {
+            schedule = kmp::sch_static;
+        }
+
+        SECTION("Static chunked") {
+            schedule = kmp::sch_static_chunked;
+            chunk = 5;
+        }
+
+        SECTION("Runtime") {
+            schedule = kmp::sch_runtime;
+        }
+
+        checkDispatchedLoops(schedule, chunk, 4, 0, 99, 1);
+        checkDispatchedLoops(schedule, chunk, 3, 50, -13, -3);
+        checkDispatchedLoops(schedule, chunk, 4, 0, 2, 1);
+        checkDispatchedLoops(schedule, chunk, 2, 10, 0, 1);
+    }
+
+    TEST_CASE("Test OpenMP loop trip counts", "[wasm]") {
+        REQUIRE(getTripCount(0, 9, 1, true) == 10);
+        REQUIRE(getTripCount(0, 9, 4, true) == 3);
+        REQUIRE(getTripCount(9, 0, -2, true) == 5);
+        REQUIRE(getTripCount(5, 4, 1, true) == 0);
+
+        // Signed and unsigned bounds either side of zero
+        REQUIRE(getTripCount((uint64_t) -5, 5, 1, true) == 11);
+        REQUIRE(getTripCount((uint64_t) -5, 5, 1, false) == 0);
+        REQUIRE(getTripCount(0, UINT64_MAX - 1, 1, false) == UINT64_MAX);
+    }
+
+    TEST_CASE("Test unsupported OpenMP schedules", "[wasm]") {
+        OMPLevel level;
+        int64_t chunk = 1;
+
+        // Ordered loops
+        REQUIRE_THROWS(normaliseSchedule(level, 66, chunk));
+    }
+}
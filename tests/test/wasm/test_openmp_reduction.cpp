@@ -0,0 +1,238 @@
+#include <catch/catch.hpp>
+
+#include "utils.h"
+
+#include <redis/Redis.h>
+#include <wasm/openmp/Critical.h>
+#include <wasm/openmp/DistributedReduction.h>
+#include <wasm/openmp/Level.h>
+
+#include <cstring>
+#include <thread>
+#include <vector>
+
+using namespace wasm::openmp;
+
+namespace tests {
+    TEST_CASE("Test choosing OpenMP reduction method", "[wasm]") {
+        auto parent = std::make_shared<OMPLevel>();
+        OMPLevel single(parent, 1);
+        OMPLevel small(parent, OMP_ATOMIC_REDUCE_MAX_THREADS);
+        OMPLevel large(parent, OMP_ATOMIC_REDUCE_MAX_THREADS + 1);
+
+        REQUIRE(determineReductionMethod(single, true, true) == kmp::empty_reduce_block);
+
+        REQUIRE(determineReductionMethod(small, true, true) == kmp::atomic_reduce_block);
+        REQUIRE(determineReductionMethod(small, false, true) == kmp::tree_reduce_block);
+        REQUIRE(determineReductionMethod(small, false, false) == kmp::critical_reduce_block);
+
+        REQUIRE(determineReductionMethod(large, true, true) == kmp::tree_reduce_block);
+        REQUIRE(determineReductionMethod(large, true, false) == kmp::atomic_reduce_block);
+        REQUIRE(determineReductionMethod(large, false, false) == kmp::critical_reduce_block);
+    }
+
+    TEST_CASE("Test OpenMP tree reduction", "[wasm]") {
+        int nThreads = 0;
+        SECTION("Two threads") {
+            nThreads = 2;
+        }
+
+        SECTION("Power of two") {
+            nThreads = 8;
+        }
+
+        SECTION("Uneven") {
+            nThreads = 7;
+        }
+
+        auto parent = std::make_shared<OMPLevel>();
+        OMPLevel level(parent, nThreads);
+
+        // Stands in for wasm memory, with each thread's data at its index
+        int nRounds = 50;
+        std::vector<long> values(nThreads);
+        std::vector<int> masterCounts(nThreads, 0);
+        std::vector<long> results;
+
+        std::vector<std::thread> threads;
+        for (int t = 0; t < nThreads; t++) {
+            threads.emplace_back([&, t] {
+                for (int round = 0; round < nRounds; round++) {
+                    values[t] = t + round;
+
+                    bool isMaster = treeReduce(level, t, t, [&values](uint32_t lhs, uint32_t rhs) {
+                        values[lhs] += values[rhs];
+                    });
+
+                    if (isMaster) {
+                        masterCounts[t]++;
+                        results.push_back(values[t]);
+                    }
+
+                    // As at the end of a reduction
+                    level.barrier->wait();
+                }
+            });
+        }
+
+        for (auto &t : threads) {
+            t.join();
+        }
+
+        REQUIRE(masterCounts[0] == nRounds);
+        for (int t = 1; t < nThreads; t++) {
+            REQUIRE(masterCounts[t] == 0);
+        }
+
+        REQUIRE((int) results.size() == nRounds);
+        for (int round = 0; round < nRounds; round++) {
+            long expected = (long) nThreads * (nThreads - 1) / 2 + (long) nThreads * round;
+            REQUIRE(results[round] == expected);
+        }
+    }
+
+    TEST_CASE("Test OpenMP critical section locks", "[wasm]") {
+        OMPCriticalSections sections;
+
+        std::mutex &a = sections.getMutex(100);
+        std::mutex &b = sections.getMutex(200);
+        REQUIRE(&a != &b);
+        REQUIRE(&sections.getMutex(100) == &a);
+        REQUIRE(sections.getCount() == 2);
+
+        // Holding one section doesn't block another
+        a.lock();
+        REQUIRE(b.try_lock());
+        REQUIRE(!sections.getMutex(100).try_lock());
+        b.unlock();
+        a.unlock();
+
+        // Threads looking up sections concurrently get the same locks
+        int nThreads = 8;
+        int nIncrements = 1000;
+        int counterA = 0;
+        int counterB = 0;
+        std::vector<std::thread> threads;
+        for (int t = 0; t < nThreads; t++) {
+            threads.emplace_back([&, t] {
+                for (int i = 0; i < nIncrements; i++) {
+                    uint32_t lockPtr = (i + t) % 2 == 0 ? 300 : 400;
+                    int &counter = lockPtr == 300 ? counterA : counterB;
+
+                    std::mutex &mx = sections.getMutex(lockPtr);
+                    mx.lock();
+                    counter++;
+                    mx.unlock();
+                }
+            });
+        }
+
+        for (auto &t : threads) {
+            t.join();
+        }
+
+        REQUIRE(counterA + counterB == nThreads * nIncrements);
+        REQUIRE(sections.getCount() == 4);
+
+        sections.clear();
+        REQUIRE(sections.getCount() == 0);
+    }
+
+    TEST_CASE("Test OpenMP reduction contribution serialisation", "[wasm]") {
+        OMPReduceContribution contribution;
+        contribution.nThreads = 3;
+        contribution.data = {1, 2, 3, 4, 5};
+
+        OMPReduceContribution actual = OMPReduceContribution::fromBytes(contribution.toBytes());
+        REQUIRE(actual.nThreads == 3);
+        REQUIRE(actual.data == contribution.data);
+
+        REQUIRE_THROWS(OMPReduceContribution::fromBytes({1, 2}));
+    }
+
+    TEST_CASE("Test combining distributed OpenMP reductions on one host", "[wasm]") {
+        cleanSystem();
+        redis::Redis &redis = redis::Redis::getState();
+
+        OMPNodeReductions reductions;
+        std::string forkKey = "omp_test_fork";
+        int nThreads = 6;
+
+        // Threads contributing without having joined is a bug
+        REQUIRE_THROWS(reductions.contribute(forkKey, 0, [](const OMPReduceContribution *) {
+            return std::vector<uint8_t>();
+        }));
+
+        for (int t = 0; t < nThreads; t++) {
+            reductions.joinFork(forkKey);
+        }
+        REQUIRE(reductions.getActiveThreadCount(forkKey) == nThreads);
+
+        // Each thread sums its number into a single int, with two reductions in the fork
+        std::vector<std::thread> threads;
+        for (int t = 0; t < nThreads; t++) {
+            threads.emplace_back([&reductions, &forkKey, t] {
+                for (int reductionIdx = 0; reductionIdx < 2; reductionIdx++) {
+                    int value = t * (reductionIdx + 1);
+                    reductions.contribute(forkKey, reductionIdx,
+                                          [value](const OMPReduceContribution *other) {
+                                              int sum = value;
+                                              if (other != nullptr) {
+                                                  int otherValue;
+                                                  std::memcpy(&otherValue, other->data.data(), sizeof(int));
+                                                  sum += otherValue;
+                                              }
+
+                                              std::vector<uint8_t> data(sizeof(int));
+                                              std::memcpy(data.data(), &sum, sizeof(int));
+                                              return data;
+                                          });
+                }
+            });
+        }
+
+        for (auto &t : threads) {
+            t.join();
+        }
+
+        // Nothing is sent until the last thread leaves
+        for (int t = 0; t < nThreads - 1; t++) {
+            reductions.leaveFork(forkKey);
+        }
+        REQUIRE(reductions.getActiveThreadCount(forkKey) == 1);
+        REQUIRE(redis.listLength(getForkReduceKey(forkKey, 0)) == 0);
+
+        reductions.leaveFork(forkKey);
+        REQUIRE(reductions.getActiveThreadCount(forkKey) == 0);
+
+        int expectedSum = nThreads * (nThreads - 1) / 2;
+        for (int reductionIdx = 0; reductionIdx < 2; reductionIdx++) {
+            std::string key = getForkReduceKey(forkKey, reductionIdx);
+            REQUIRE(redis.listLength(key) == 1);
+
+            OMPReduceContribution actual = OMPReduceContribution::fromBytes(redis.dequeueBytes(key));
+            REQUIRE(actual.nThreads == nThreads);
+
+            int actualSum;
+            std::memcpy(&actualSum, actual.data.data(), sizeof(int));
+            REQUIRE(actualSum == expectedSum * (reductionIdx + 1));
+        }
+    }
+
+    TEST_CASE("Test threads leave distributed OpenMP forks when they fail", "[wasm]") {
+        cleanSystem();
+        OMPNodeReductions &reductions = getNodeReductions();
+        reductions.clear();
+
+        std::string forkKey = "omp_test_fork_guard";
+        try {
+            OMPForkGuard guard(forkKey);
+            REQUIRE(reductions.getActiveThreadCount(forkKey) == 1);
+
+            throw std::runtime_error("Thread failed");
+        } catch (std::runtime_error &) {
+        }
+
+        REQUIRE(reductions.getActiveThreadCount(forkKey) == 0);
+    }
+}
@@ -1,9 +1,17 @@
 #include <catch/catch.hpp>
 #include <wasm/WasmModule.h>
+#include <wasm/serialisation.h>
+#include <wavm/WAVMWasmModule.h>
 #include <boost/filesystem.hpp>
+#include <module_cache/WasmModuleCache.h>
+#include <util/bytes.h>
+#include <util/config.h>
 #include <util/func.h>
+#include <util/memory.h>
 #include <utils.h>
 
+#include <cstring>
+
 using namespace wasm;
 
 namespace tests {
@@ -73,4 +81,115 @@ namespace tests {
         bool successB = moduleB.execute(m);
         REQUIRE(successB);
     }
+
+    TEST_CASE("Test writing and reading memory snapshot chunks", "[wasm]") {
+        size_t memSize = 3 * SNAPSHOT_CHUNK_BYTES;
+        std::vector<uint8_t> memory(memSize, 0);
+
+        // Mix of compressible and incompressible data
+        for (size_t i = 0; i < memSize; i++) {
+            memory[i] = i < SNAPSHOT_CHUNK_BYTES ? (uint8_t) (i % 7) : (uint8_t) ((i * 2654435761U) >> 24);
+        }
+
+        wasm::MemorySnapshotHeader header;
+        header.numPages = 12;
+
+        SECTION("Uncompressed") {
+        }
+
+        SECTION("Compressed") {
+            header.flags |= SNAPSHOT_FLAG_LZ4;
+        }
+
+        // Ranges crossing chunk boundaries
+        std::vector<std::pair<size_t, size_t>> ranges = {
+                {100, 200},
+                {SNAPSHOT_CHUNK_BYTES - 10, SNAPSHOT_CHUNK_BYTES + 20},
+                {memSize - 50, 50},
+        };
+
+        std::vector<std::pair<size_t, size_t>> expectedChunks = {
+                {100, 200},
+                {SNAPSHOT_CHUNK_BYTES - 10, SNAPSHOT_CHUNK_BYTES},
+                {2 * SNAPSHOT_CHUNK_BYTES - 10, 20},
+                {memSize - 50, 50},
+        };
+        REQUIRE(wasm::getSnapshotChunks(ranges) == expectedChunks);
+
+        std::vector<uint8_t> snapData;
+        util::BytesOutputStreamBuf outBuf(snapData);
+        std::ostream outStream(&outBuf);
+        wasm::writeMemorySnapshot(outStream, header, memory.data(), ranges);
+
+        if (header.flags & SNAPSHOT_FLAG_LZ4) {
+            REQUIRE(snapData.size() < SNAPSHOT_CHUNK_BYTES + 300);
+        }
+
+        // Writing straight to a buffer gives the same bytes
+        wasm::MemorySnapshotWriter writer(header, memory.data(), ranges);
+        REQUIRE(writer.size() == snapData.size());
+        std::vector<uint8_t> bufferData(writer.size());
+        writer.write(bufferData.data());
+        REQUIRE(bufferData == snapData);
+
+        util::BytesInputStreamBuf inBuf(snapData.data(), snapData.size());
+        std::istream inStream(&inBuf);
+        wasm::MemorySnapshotHeader actualHeader = wasm::readMemorySnapshotHeader(inStream);
+        REQUIRE(actualHeader.flags == header.flags);
+        REQUIRE(actualHeader.numPages == 12);
+        REQUIRE(actualHeader.nChunks == expectedChunks.size());
+
+        // Only the ranges are restored
+        std::vector<uint8_t> restored(memSize, 255);
+        wasm::readMemorySnapshotChunks(inStream, actualHeader, restored.data(), memSize);
+        for (auto &r : ranges) {
+            REQUIRE(std::memcmp(restored.data() + r.first, memory.data() + r.first, r.second) == 0);
+        }
+        REQUIRE(restored[0] == 255);
+        REQUIRE(restored[2 * SNAPSHOT_CHUNK_BYTES + 100] == 255);
+
+        // Chunks past the end of memory are rejected
+        util::BytesInputStreamBuf shortBuf(snapData.data(), snapData.size());
+        std::istream shortStream(&shortBuf);
+        wasm::MemorySnapshotHeader shortHeader = wasm::readMemorySnapshotHeader(shortStream);
+        REQUIRE_THROWS(wasm::readMemorySnapshotChunks(shortStream, shortHeader, restored.data(), memSize - 1));
+    }
+
+    TEST_CASE("Test snapshots diffed against the zygote", "[wasm]") {
+        cleanSystem();
+
+        util::SystemConfig &conf = util::getSystemConfig();
+        std::string originalMode = conf.snapshotMode;
+        conf.snapshotMode = "diff";
+
+        message::Message m = util::messageFactory("demo", "echo");
+        m.set_inputdata("snapshot diff");
+
+        module_cache::WasmModuleCache &registry = module_cache::getWasmModuleCache();
+        std::shared_ptr<wasm::WAVMWasmModule> zygote = registry.getCachedModule(m);
+
+        // Dirty some memory by executing
+        wasm::WAVMWasmModule moduleA(*zygote);
+        REQUIRE(moduleA.execute(m));
+        std::vector<uint8_t> snapData = moduleA.snapshotToMemory();
+
+        U8 *memA = Runtime::getMemoryBaseAddress(moduleA.defaultMemory);
+        size_t memSizeA = Runtime::getMemoryNumPages(moduleA.defaultMemory) * IR::numBytesPerPage;
+        REQUIRE(snapData.size() < memSizeA / 2);
+
+        // Restoring on another clone gives the same memory
+        wasm::WAVMWasmModule moduleB(*zygote);
+        moduleB.restoreFromMemory(snapData);
+
+        U8 *memB = Runtime::getMemoryBaseAddress(moduleB.defaultMemory);
+        REQUIRE(Runtime::getMemoryNumPages(moduleB.defaultMemory) == Runtime::getMemoryNumPages(moduleA.defaultMemory));
+        REQUIRE(std::memcmp(memA, memB, memSizeA) == 0);
+
+        // Can't be restored without the zygote
+        wasm::WAVMWasmModule moduleC;
+        moduleC.bindToFunctionNoZygote(m);
+        REQUIRE_THROWS(moduleC.restoreFromMemory(snapData));
+
+        conf.snapshotMode = originalMode;
+    }
 }
@@ -78,21 +78,21 @@ namespace tests {
         call.set_function("x2");
 
         module_cache::WasmModuleCache &registry = module_cache::getWasmModuleCache();
-        wasm::WAVMWasmModule &cachedModule = registry.getCachedModule(call);
+        std::shared_ptr<wasm::WAVMWasmModule> cachedModule = registry.getCachedModule(call);
         
-        wasm::WAVMWasmModule module(cachedModule);
+        wasm::WAVMWasmModule module(*cachedModule);
 
         // Perform first execution
         executeX2(module);
 
         // Reset
-        module = cachedModule;
+        module = *cachedModule;
 
         // Perform repeat executions on same module
         executeX2(module);
 
         // Reset
-        module = cachedModule;
+        module = *cachedModule;
 
         executeX2(module);
     }
@@ -130,16 +130,16 @@ namespace tests {
         message::Message call = util::messageFactory("demo", "heap");
 
         module_cache::WasmModuleCache &registry = module_cache::getWasmModuleCache();
-        wasm::WAVMWasmModule &cachedModule = registry.getCachedModule(call);
+        std::shared_ptr<wasm::WAVMWasmModule> cachedModule = registry.getCachedModule(call);
         
-        wasm::WAVMWasmModule module(cachedModule);
+        wasm::WAVMWasmModule module(*cachedModule);
 
         Uptr initialPages = Runtime::getMemoryNumPages(module.defaultMemory);
 
         // Run it (knowing memory will grow during execution)
         module.execute(call);
         
-        module = cachedModule;
+        module = *cachedModule;
 
         Uptr pagesAfter = Runtime::getMemoryNumPages(module.defaultMemory);
         REQUIRE(pagesAfter == initialPages);
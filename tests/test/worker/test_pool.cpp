@@ -418,6 +418,7 @@ namespace tests {
         REQUIRE(sch.getFunctionInFlightCount(call) == 1);
         REQUIRE(sch.getFunctionThreadCount(call) == 1);
         REQUIRE(bindQueue->size() == 1);
+        sch.flushWarmSetUpdates();
         REQUIRE(redis.sismember(warmSetName, nodeId));
 
         // Bind the thread and check it's now registered but in-flight decreased
@@ -440,9 +441,60 @@ namespace tests {
         REQUIRE(sch.getFunctionThreadCount(call) == 0);
         REQUIRE(sch.getFunctionInFlightRatio(call) == 0);
         REQUIRE(bindQueue->size() == 0);
+        sch.flushWarmSetUpdates();
         REQUIRE(!redis.sismember(warmSetName, nodeId));
     }
 
+    TEST_CASE("Test worker reuses module when rebound to the same function", "[worker]") {
+        setUp();
+
+        WorkerThreadPool pool(1);
+        WorkerThread w(1);
+
+        scheduler::Scheduler &sch = scheduler::getScheduler();
+        message::Message call = util::messageFactory("demo", "noop");
+        setEmulatedMessage(call);
+
+        // Bind and execute
+        sch.callFunction(call);
+        w.processNextMessage();
+        w.processNextMessage();
+        REQUIRE(w.isBound());
+        REQUIRE(sch.getFunctionThreadCount(call) == 1);
+
+        wasm::WAVMWasmModule *originalModule = w.module.get();
+
+        // Unbinding releases the function but keeps the module
+        w.unbind();
+        REQUIRE(!w.isBound());
+        REQUIRE(sch.getFunctionThreadCount(call) == 0);
+        REQUIRE(w.module.get() == originalModule);
+
+        // Next call for the same function should bind to the same module
+        message::Message callB = util::messageFactory("demo", "noop");
+        setEmulatedMessage(callB);
+        sch.callFunction(callB);
+        w.processNextMessage();
+        REQUIRE(w.isBound());
+        REQUIRE(w.module.get() == originalModule);
+
+        w.processNextMessage();
+        scheduler::GlobalMessageBus &globalBus = scheduler::getGlobalMessageBus();
+        REQUIRE(globalBus.getFunctionResult(callB.id(), 1).returnvalue() == 0);
+
+        // Unbinding and binding to a different function needs a new module
+        w.unbind();
+        message::Message callC = util::messageFactory("demo", "echo");
+        setEmulatedMessage(callC);
+        sch.callFunction(callC);
+        w.processNextMessage();
+        REQUIRE(w.isBound());
+        REQUIRE(w.module.get() != originalModule);
+
+        w.finish();
+        tearDown();
+    }
+
     TEST_CASE("Test writing file to state", "[worker]") {
         cleanSystem();
         message::Message msg = util::messageFactory("demo", "state_file");
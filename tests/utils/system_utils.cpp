@@ -11,6 +11,7 @@ extern "C" {
 #include <scheduler/Scheduler.h>
 #include <emulator/emulator.h>
 #include <module_cache/WasmModuleCache.h>
+#include <module_cache/WasmModulePool.h>
 #include <boost/filesystem.hpp>
 #include <worker/worker.h>
 
@@ -37,7 +38,8 @@ namespace tests {
         // Clear out global message bus
         scheduler::getGlobalMessageBus().clear();
 
-        // Clear zygotes
+        // Clear pooled instances and zygotes
+        module_cache::getWasmModulePool().clear();
         module_cache::getWasmModuleCache().clear();
 
         // Reset system config